@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Builds cache keys: FNV-1a over the generator name, its version and every
+// value that affects the result. Bump the version whenever the generator
+// changes its output, old entries then simply stop being found.
+class BakeKey
+{
+public:
+	BakeKey(const char* _generator, uint32_t _version);
+
+	template <typename T>
+	BakeKey& add(const T& _value)
+	{
+		mix(&_value, sizeof(T));
+		return *this;
+	}
+
+	uint64_t get() const { return hash; }
+
+private:
+	void mix(const void* _data, size_t _size);
+
+	uint64_t hash;
+};
+
+// Persistent, content addressed store for baked data. Every blob is a file
+// named after its key in the cache directory, compressed (optionally after a
+// byte shuffle for arrays of numbers) and checked with a CRC on load. Hits
+// are read through a memory map. An index file keeps the size and last use
+// of every blob so the least recently used ones can be deleted once the
+// directory grows past its size cap, also across sessions.
+//
+// One cache object may be used from several threads. Several processes
+// sharing a directory work, but each keeps its own view of the LRU order.
+class BakeCache
+{
+public:
+	BakeCache();
+	~BakeCache();
+
+	// Creates the directory if needed and reads its index.
+	bool open(const std::string& _directory, uint64_t _maxBytes);
+	bool isOpen() const { return !directory.empty(); }
+
+	bool load(uint64_t _key, std::vector<uint8_t>& _data);
+	// _elementSize > 1 shuffles the bytes of _elementSize sized values before compressing.
+	bool store(uint64_t _key, const void* _data, size_t _size, int _elementSize = 1);
+
+	// Deletes every blob.
+	void clear();
+
+	uint64_t getSize() const { return total_bytes; }
+	uint64_t getMaxSize() const { return max_bytes; }
+	int getEntryCount() const { return (int)entries.size(); }
+	int getHits() const { return hits; }
+	int getMisses() const { return misses; }
+
+private:
+	struct Entry
+	{
+		uint64_t size;      // of the file
+		uint64_t last_used; // tick, larger is more recent
+	};
+
+	std::string blobPath(uint64_t _key) const;
+	void remove(uint64_t _key);
+	void evict();
+	void readIndex();
+	void writeIndex();
+
+	std::string directory;
+	uint64_t max_bytes;
+	uint64_t total_bytes;
+	uint64_t tick;
+	std::map<uint64_t, Entry> entries;
+	int hits, misses;
+
+	std::mutex mutex;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "Parameters.h"
+#include "WorkQueue.h"
+
+struct GLFWwindow;
+
+struct BatchSettings
+{
+	std::vector<std::string> presets;
+
+	// Seed sweep on top of base_preset (or the defaults), inclusive range
+	bool sweep_seeds = false;
+	int seed_first = 0;
+	int seed_last = 0;
+	std::string base_preset;
+
+	std::string output_directory = ".";
+	int width = 256;
+	int height = 256;
+	int workers = 2;
+	int encoders = 1;
+};
+
+struct BatchJob
+{
+	int index;
+	std::string name;
+	PlanetParameters params;
+};
+
+struct BatchImage
+{
+	int index;
+	std::string name;
+	std::vector<unsigned char> pixels; // RGB, bottom-up rows
+};
+
+// Renders many planets to PNG files without a visible window.
+//
+// Three stages run concurrently and are connected by bounded queues:
+// parsing presets on one thread, rendering on one thread per offscreen GL
+// context and encoding on a set of encoder threads. Each render worker reads
+// back through two pixel buffers so the readback of one planet overlaps the
+// rendering of the next.
+class BatchRenderer
+{
+public:
+	BatchRenderer(const BatchSettings& _settings);
+	~BatchRenderer();
+
+	// Returns the process exit code.
+	int run();
+
+	static bool parseArguments(int _argc, char* _argv[], BatchSettings& _settings);
+	static void printUsage();
+
+private:
+	void parseStage();
+	void queueJob(BatchJob _job);
+	void renderStage(GLFWwindow* _context);
+	void renderWorker();
+	void encodeStage();
+
+	BatchSettings settings;
+
+	WorkQueue<BatchJob> render_queue;
+	WorkQueue<BatchImage> encode_queue;
+
+	std::atomic<int> jobs_queued;
+	std::atomic<int> planets_rendered;
+	std::atomic<int> planets_written;
+	std::atomic<int> failures;
+	std::atomic<int> renderers_running;
+};
@@ -5,6 +5,8 @@
 
 #include "GLFW\glfw3.h"
 
+class PlanetQuery;
+
 class Camera
 {
 public:
@@ -32,6 +34,11 @@ public:
 
 	void fpsCamera(GLFWwindow* _window, double _dT);
 
+	// Stops a move from _previous where it enters the terrain of the planet
+	// drawn with _model and keeps the camera _clearance above the terrain and
+	// the sea. Returns the height above them, before the clearance is applied.
+	float collideWithGround(const PlanetQuery& _query, const glm::mat4& _model, const glm::vec3& _previous, float _clearance);
+
 	float pitch;
 	float yaw;
 
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 as used by PNG and zlib. Pass the previous result as _crc to
+// continue over several buffers, start with 0.
+uint32_t crc32(const void* _data, size_t _size, uint32_t _crc = 0);
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "CubeHeightmap.h"
+#include "JobSystem.h"
+#include "Parameters.h"
+
+// Climate of one spot of the surface. Temperature and moisture run 0..1,
+// slope is the gradient of the terrain fBm in noise units per radian:
+// multiply by terrain_elevation and divide by the planet radius for the
+// tangent of the terrain slope.
+struct Climate
+{
+	float temperature = 0.5f;
+	float moisture = 0.5f;
+	float slope = 0.0f;
+};
+
+// Weights of the beach, grass, rock and snow colours for a temperature and
+// moisture, from a small Whittaker style table: ice, tundra, taiga, steppe,
+// grassland, forest, desert, savanna and rain forest. Weights may sum to less
+// than one, forests are darker versions of the grass colour.
+glm::vec4 biome_weights(float _temperature, float _moisture);
+// biome_weights() at the texel centers of a _size x _size RGBA8 image,
+// temperature along x and moisture along y. terrain_frag.glsl samples it.
+void build_biome_lut(int _size, std::vector<uint8_t>& _rgba);
+// Climate without a ClimateMap, from latitude and height only. What
+// terrain_frag.glsl uses for planets that have no map.
+Climate estimate_climate(const glm::vec3& _direction, float _elevation);
+
+// Temperature, moisture and slope per texel of a CubeHeightmap, faces in
+// PlanetSurface::cubeDirection() order:
+// - temperature falls with latitude and with height above the sea
+// - moisture falls with the distance to the sea (elevation below 0) across
+//   face edges, varied by noise at terrain_frag_frequency
+// - slope comes from central differences of the heightmap
+// Rows and faces are computed in tasks.
+class ClimateMap
+{
+public:
+	// Part of cache keys, bump when the computed values change.
+	static const uint32_t GENERATOR_VERSION = 1;
+	// Climate varies slowly, only the slope would gain from more
+	static const int DEFAULT_RESOLUTION = 256;
+
+	ClimateMap();
+
+	// Derives the maps from _heightmap at its resolution, in tasks on _jobs
+	// (JobSystem::global() if nullptr). Returns false and leaves the map
+	// empty if cancelled.
+	bool bake(const CubeHeightmap& _heightmap, const PlanetParameters& _params,
+		JobSystem* _jobs = nullptr, const CancelToken& _cancel = CancelToken());
+
+	// Everything besides the heightmap that goes into the map.
+	static uint64_t cacheKey(const PlanetParameters& _params, int _resolution);
+
+	int getResolution() const { return resolution; }
+	bool empty() const { return texels.empty(); }
+
+	// Temperature, moisture and slope of every texel of a face, 3 floats each.
+	const float* getFace(int _face) const { return &texels[(size_t)_face * resolution * resolution * 3]; }
+
+	// Bilinear within the face the direction points at.
+	Climate sample(const glm::vec3& _direction) const;
+
+private:
+	void findOceanDistance(JobSystem& _jobs, const CancelToken& _cancel, std::vector<float>& _distance) const;
+
+	int resolution;
+	std::vector<float> texels;
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Byte oriented LZ77 in the LZ4 block layout: tokens of literal and match
+// lengths, 16 bit offsets. Fast enough to decompress bakes on load, blocks
+// are limited to 4 GB.
+void compress_block(const uint8_t* _data, size_t _size, std::vector<uint8_t>& _out);
+// False if the block is damaged or does not decompress to exactly _outSize bytes.
+bool decompress_block(const uint8_t* _data, size_t _size, uint8_t* _out, size_t _outSize);
+
+// Filter for arrays of fixed size values (floats, uint16, ...) before
+// compression: byte n of every value is stored together and delta coded,
+// which turns smooth data into long runs of small numbers.
+void shuffle_bytes(const uint8_t* _data, size_t _size, int _elementSize, uint8_t* _out);
+void unshuffle_bytes(const uint8_t* _data, size_t _size, int _elementSize, uint8_t* _out);
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Parameters.h"
+
+class BakeCache;
+
+// The terrain fBm (PlanetSurface::elevation, before terrain_elevation is
+// applied) sampled at texel centers on the six faces of a cube, faces in
+// PlanetSurface::cubeDirection() order. Only the noise method, seed,
+// frequency, octaves and the feature layer go into it, so it survives changes
+// of elevation, radius and colours.
+class CubeHeightmap
+{
+public:
+	// Part of the cache key, bump when the baked values change.
+	static const uint32_t GENERATOR_VERSION = 1;
+
+	CubeHeightmap();
+
+	// Loads the heightmap from _cache or bakes it with tasks on _jobs
+	// (JobSystem::global() if nullptr) and stores it there. _cache may be
+	// nullptr. Returns true on a cache hit. Bakes sum the octave layers of
+	// OctaveCache::global(), evaluating only the ones it does not have. A bake cancelled through _cancel
+	// leaves the heightmap empty and stores nothing.
+	bool bake(const PlanetParameters& _params, int _resolution, BakeCache* _cache,
+		JobSystem* _jobs = nullptr, const CancelToken& _cancel = CancelToken());
+
+	static uint64_t cacheKey(const PlanetParameters& _params, int _resolution);
+
+	int getResolution() const { return resolution; }
+	bool empty() const { return heights.empty(); }
+
+	float at(int _face, int _x, int _y) const { return heights[((size_t)_face * resolution + _y) * resolution + _x]; }
+	float* getFace(int _face) { return &heights[(size_t)_face * resolution * resolution]; }
+	const float* getFace(int _face) const { return &heights[(size_t)_face * resolution * resolution]; }
+
+	// Bilinear within the face the direction points at.
+	float sample(const glm::vec3& _direction) const;
+
+private:
+	int resolution;
+	std::vector<float> heights;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <GL/glew.h>
+
+#include "Framebuffer.h"
+#include "Shader.h"
+
+// Renders the scene into an offscreen target at a fraction of the window
+// resolution and upscales it with a sharpening filter. The fraction follows
+// the GPU time of the scene so the frame stays within budget_ms.
+//
+// The target is allocated at full window size once; lower scales only shrink
+// the viewport, so changing the scale never reallocates anything.
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+	~DynamicResolution();
+
+	void init();
+
+	// Binds the target (or the window when disabled) and starts the GPU timer.
+	void begin(int _windowWidth, int _windowHeight);
+	// Stops the timer, upscales into the window and picks the next scale.
+	void end();
+
+	float getScale() const { return enabled ? scale : 1.0f; }
+	float getGpuTime() const { return gpu_ms; }
+	int getRenderWidth() const { return render_width; }
+	int getRenderHeight() const { return render_height; }
+
+	bool enabled;
+	float budget_ms;
+	float min_scale;
+	float max_scale;
+	float sharpness;
+
+private:
+	void readTimer();
+	void updateScale();
+
+	Framebuffer target;
+	Shader upscale_shader;
+	GLuint vao;
+
+	GLint loc_source;
+	GLint loc_uv_scale;
+	GLint loc_texel_size;
+	GLint loc_sharpness;
+
+	GLuint timer_queries[2];
+	bool timer_pending[2];
+	int frame;
+
+	float scale;
+	float gpu_ms;
+	int window_width, window_height;
+	int render_width, render_height;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Parameters.h"
+
+// Stamps of the feature layer.
+enum FeatureKind
+{
+	FEATURE_CRATER = 0, // bowl with a raised rim
+	FEATURE_VOLCANO,    // cone with a caldera
+	FEATURE_RIFT,       // trench along a short segment
+	FEATURE_KIND_COUNT
+};
+
+// One stamp as terrain_vert.glsl reads it, std430 with vec4 members only.
+// Distances are chords between unit directions.
+struct FeatureStamp
+{
+	glm::vec4 center; // unit direction, w radius of the footprint
+	glm::vec4 axis;   // rifts run from center - axis to center + axis, zero for the others
+	glm::vec4 shape;  // kind, height (noise units), variation 0..1, unused
+};
+
+// Impact craters, volcanoes and rifts stamped onto the terrain, added to the
+// fBm of PlanetSurface::elevation() and terrain_vert.glsl. There are far too
+// many stamps to test each sample against all of them, so they are sorted
+// into a grid over the cube faces: every cell lists the stamps whose
+// footprint touches it, and a sample only visits the stamps of its cell.
+//
+// Layers are built on the CPU and shared through get(), the renderer uploads
+// the stamps and the cells as shader storage buffers.
+class FeatureLayer
+{
+public:
+	// Part of the cache keys of everything baked from the terrain, bump when the stamps change.
+	static const uint32_t GENERATOR_VERSION = 1;
+
+	FeatureLayer();
+
+	// Places the stamps of _params and sorts them into the grid.
+	void build(const PlanetParameters& _params);
+	bool empty() const { return stamps.empty(); }
+
+	// Sum of the stamps at _direction (unit length), noise units.
+	float height(const glm::vec3& _direction) const;
+
+	// Cells per cube face edge, cells are in face, row, column order.
+	int getGridSize() const { return grid_size; }
+	const std::vector<FeatureStamp>& getStamps() const { return stamps; }
+	// Index of the first entry of every cell and one past the last cell,
+	// followed by the entries: stamp indices. Indices count from the start of
+	// this array so the shader can read it as is.
+	const std::vector<uint32_t>& getCells() const { return cells; }
+
+	// Everything the stamps of _params depend on, 0 without features.
+	static uint64_t cacheKey(const PlanetParameters& _params);
+	// Layer of _params, built on first use. The layers of the last few
+	// parameter sets are kept. nullptr without features. Thread safe.
+	static std::shared_ptr<const FeatureLayer> get(const PlanetParameters& _params);
+
+private:
+	void buildGrid();
+
+	int grid_size;
+	std::vector<FeatureStamp> stamps;
+	std::vector<uint32_t> cells;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <GL/glew.h>
+
+// Offscreen render target: one color texture and a depth renderbuffer.
+class Framebuffer
+{
+public:
+	Framebuffer();
+	~Framebuffer();
+
+	// Returns false if the framebuffer is incomplete.
+	bool create(int _width, int _height, GLenum _colorFormat = GL_RGBA8);
+	void clean();
+
+	void bind();
+	void unbind();
+
+	GLuint fbo;
+	GLuint colorTexture;
+	GLuint depthBuffer;
+
+	int width;
+	int height;
+	GLenum colorFormat;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Streaming PNG encoder. Rows are written one at a time and go straight to
+// disk in stored (uncompressed) deflate blocks, so memory use does not depend
+// on the image size. 8 and 16 bits per channel, 1-4 channels.
+class PngWriter
+{
+public:
+	PngWriter();
+	~PngWriter();
+
+	bool open(const std::string& _filePath, int _width, int _height, int _channels, int _bitDepth = 8);
+	// 16 bit rows are given in native byte order.
+	bool writeRow(const void* _row);
+	bool close();
+
+	bool isOpen() const { return file != nullptr; }
+
+private:
+	void writeChunk(const char _type[4], const uint8_t* _data, size_t _length);
+	void flushBlock(bool _final);
+
+	FILE* file;
+	int width;
+	int height;
+	int channels;
+	int bitDepth;
+	int rowsWritten;
+
+	std::vector<uint8_t> row;     // filter byte + samples in PNG byte order
+	std::vector<uint8_t> block;   // pending deflate payload (< 64 KB)
+	std::vector<uint8_t> scratch; // chunk assembly
+	uint32_t adlerA, adlerB;
+};
+
+// Writes a whole 8 bit image. Rows are stored bottom-up when _flipRows is set,
+// which is what glReadPixels returns.
+bool write_png(const std::string& _filePath, int _width, int _height, int _channels,
+	const uint8_t* _pixels, bool _flipRows);
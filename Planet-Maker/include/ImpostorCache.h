@@ -0,0 +1,80 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Framebuffer.h"
+#include "Shader.h"
+
+// Atlas of pre-rendered planet images for planets that are only a few pixels
+// wide. Each slot remembers the parameters hash and the view it was baked
+// with and only needs a new bake when either changed noticeably. The images
+// are drawn as camera facing quads, all of them in one instanced draw.
+class ImpostorCache
+{
+public:
+	ImpostorCache();
+	~ImpostorCache();
+
+	void init(int _atlasSize = 2048, int _slotSize = 128);
+
+	// Forgets last frame's billboards and resets the bake budget.
+	void beginFrame();
+
+	// True if _planet has a slot baked with these parameters from about this
+	// direction. _slot is its slot, possibly stale, or -1 if it has none.
+	// Directions are in the planet's model space.
+	bool lookup(int _planet, uint64_t _hash, const glm::vec3& _direction, const glm::vec3& _up, int& _slot);
+
+	// Slot to bake _planet into, reusing its stale slot or evicting the least
+	// recently drawn one. -1 once this frame's bake budget is used up.
+	int acquire(int _planet);
+
+	// Renders into the slot: binds the atlas, sets viewport and scissor, clears.
+	void beginBake(int _slot);
+	void endBake(int _slot, uint64_t _hash, const glm::vec3& _direction, const glm::vec3& _up);
+
+	// Queues a billboard of radius _radius at _center (world space).
+	void addBillboard(int _slot, const glm::vec3& _center, float _radius);
+	void render(const glm::mat4& _projection, const glm::mat4& _view);
+
+	int getBillboardCount() const { return (int)billboards.size() / 2; }
+	int getBakeCount() const { return bakes_this_frame; }
+
+	int max_bakes_per_frame;
+	float refresh_angle; // radians the view may turn before a planet is baked again
+
+private:
+	struct Slot
+	{
+		int planet = -1;
+		uint64_t hash = 0;
+		glm::vec3 direction;
+		glm::vec3 up;
+		int last_used = -1;
+	};
+
+	glm::vec4 slotRect(int _slot) const;
+
+	Framebuffer atlas;
+	int slot_size;
+	int slots_per_row;
+	std::vector<Slot> slots;
+	std::unordered_map<int, int> slot_of_planet;
+
+	int frame;
+	int bakes_this_frame;
+
+	// Saved by beginBake()
+	GLint previous_framebuffer;
+	GLint previous_viewport[4];
+
+	Shader billboard_shader;
+	GLuint billboard_vao;
+	GLuint billboard_buffer;
+	std::vector<glm::vec4> billboards; // center + radius, atlas rect, per billboard
+	GLint loc_P, loc_V, loc_atlas;
+};
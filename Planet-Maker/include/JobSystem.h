@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tells queued work that its result is no longer wanted, e.g. a mesh for a
+// slider value that moved on. Copies share the flag. Tasks whose token is
+// cancelled before they start are skipped; long running work can poll it.
+class CancelToken
+{
+public:
+	CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void cancel() { *flag = true; }
+	bool isCancelled() const { return *flag; }
+
+private:
+	std::shared_ptr<std::atomic<bool>> flag;
+};
+
+struct Task;
+typedef std::shared_ptr<Task> TaskRef;
+
+// Work-stealing task scheduler. Every worker owns a deque: it pushes and
+// pops its own tasks at the back, idle workers steal from the front of the
+// others. Tasks started from threads outside the pool go through a shared
+// queue. A task may depend on others and only becomes runnable once all of
+// them finished, skipped ones included, which makes continuations.
+//
+// Tasks created with runOnMainThread() are only run by pumpMainThread(), the
+// render loop calls it once per frame for GL work. The main thread is the one
+// that created the system.
+class JobSystem
+{
+public:
+	// -1 starts one worker per core but one, the caller helps in wait().
+	// 0 starts none, everything then runs on the thread that waits.
+	explicit JobSystem(int _workers = -1);
+	~JobSystem();
+
+	// Shared by the application, created on first use.
+	static JobSystem& global();
+
+	TaskRef run(std::function<void()> _work, const CancelToken& _cancel = CancelToken());
+	// Runs _work once every task of _dependencies is done.
+	TaskRef runAfter(const std::vector<TaskRef>& _dependencies, std::function<void()> _work,
+		const CancelToken& _cancel = CancelToken());
+	// Runs _work in pumpMainThread() once _dependencies are done.
+	TaskRef runOnMainThread(const std::vector<TaskRef>& _dependencies, std::function<void()> _work,
+		const CancelToken& _cancel = CancelToken());
+
+	// Calls _body(begin, end) for pieces of [0, _count) no larger than _grain,
+	// split in halves so idle workers steal large ranges. Returns when all
+	// pieces ran; pieces not started before _cancel is cancelled are skipped.
+	void parallelFor(int _count, int _grain, const std::function<void(int, int)>& _body,
+		const CancelToken& _cancel = CancelToken());
+
+	// Runs other tasks until _task is done.
+	void wait(const TaskRef& _task);
+	static bool isDone(const TaskRef& _task);
+
+	// Main thread: runs up to _maxTasks queued main thread tasks, -1 for all.
+	int pumpMainThread(int _maxTasks = -1);
+	// Called from any thread whenever a main thread task becomes ready, e.g. to
+	// wake a render loop that waits for input.
+	void setMainThreadWakeup(std::function<void()> _wakeup);
+	bool isMainThread() const { return std::this_thread::get_id() == main_thread; }
+
+	// Workers plus the waiting thread.
+	int getThreadCount() const { return worker_count + 1; }
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<TaskRef> tasks;
+	};
+
+	TaskRef create(std::function<void()> _work, const CancelToken& _cancel, bool _mainThread);
+	void submit(const TaskRef& _task, const std::vector<TaskRef>& _dependencies);
+	void schedule(const TaskRef& _task);
+	void execute(const TaskRef& _task);
+	bool findTask(TaskRef& _task);
+	void helpWhile(const std::function<bool()>& _busy);
+	void workerLoop(int _index);
+
+	int worker_count; // fixed before the workers start, they read it
+	std::vector<std::thread> workers;
+	// One per worker, then the shared queue for everyone else
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<int> queued; // tasks in all deques
+	bool stopping;
+
+	std::mutex main_mutex;
+	std::deque<TaskRef> main_tasks;
+	std::function<void()> main_wakeup; // under main_mutex
+	std::thread::id main_thread;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Parameters.h"
+#include "PlanetSurface.h"
+
+enum MapProjection
+{
+	MAP_EQUIRECTANGULAR, // width x width/2, row 0 at the +z pole
+	MAP_CUBE,            // six width x width faces in GL cube map order
+};
+
+enum MapFormat
+{
+	MAP_PNG, // 16 bit grey height, 8 bit RGB colour
+	MAP_RAW, // little endian uint16 height and RGB8 colour, no header
+};
+
+struct MapExportSettings
+{
+	std::string preset;
+	std::string output_prefix = "planet";
+
+	MapProjection projection = MAP_EQUIRECTANGULAR;
+	MapFormat format = MAP_PNG;
+	int width = 16384;
+
+	bool export_height = true;
+	bool export_color = true;
+
+	int workers = 0;           // threads including the writer, 0 = one per hardware thread
+	size_t memory_budget = 64; // MB for all strips in flight
+};
+
+struct MapExportStatistics
+{
+	int64_t pixels = 0;
+	double seconds = 0.0;
+	size_t peak_bytes = 0; // strip buffers, the only allocation that grows with the image
+
+	double megapixelsPerSecond() const { return seconds > 0.0 ? pixels / seconds / 1.0e6 : 0.0; }
+};
+
+// Exports elevation and colour maps of a planet at resolutions far beyond what
+// fits in memory (16k-64k). The image is cut into strips of whole rows, tasks
+// on the exporter's JobSystem evaluate PlanetSurface for the strips and the
+// calling thread writes them to disk in order as soon as they are complete,
+// computing strips itself while it waits. Only a fixed number of
+// strips exist at a time and their height is chosen from memory_budget, so
+// memory use does not grow with the output size beyond one row per strip.
+//
+// Every image gets a .txt sidecar with its size, layout and how to turn the
+// 16 bit heights back into planet units.
+class MapExporter
+{
+public:
+	MapExporter(const MapExportSettings& _settings);
+
+	// Returns the process exit code.
+	int run();
+	bool exportMaps(const PlanetParameters& _params);
+
+	const MapExportStatistics& getStatistics() const { return statistics; }
+
+	static bool parseArguments(int _argc, char* _argv[], MapExportSettings& _settings);
+	static void printUsage();
+
+private:
+	struct Strip
+	{
+		int first_row = 0;
+		int rows = 0;
+		std::vector<uint16_t> height;
+		std::vector<uint8_t> color;
+	};
+
+	// One output image: the equirectangular map or one cube face
+	struct Image
+	{
+		std::string name;
+		int width, height;
+		int face; // -1 for equirectangular
+	};
+
+	bool exportImage(const Image& _image, const PlanetSurface& _surface);
+	void fillStrip(const Image& _image, const PlanetSurface& _surface, Strip& _strip);
+	bool writeSidecar(const Image& _image, const std::string& _heightPath, const std::string& _colorPath, const PlanetSurface& _surface);
+
+	MapExportSettings settings;
+	MapExportStatistics statistics;
+
+	// The writing thread computes strips too while it waits
+	JobSystem jobs;
+};
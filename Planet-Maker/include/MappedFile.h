@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Memory map of a whole file. open() maps an existing file read-only,
+// create() makes a new file of a fixed size and maps it writable so several
+// threads can fill their parts of it directly. The contents stay valid until
+// close() or destruction; nothing is copied into the process.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& _filePath);
+	// Replaces any existing file.
+	bool create(const std::string& _filePath, size_t _size);
+	void close();
+
+	bool isOpen() const { return bytes != nullptr; }
+	const uint8_t* data() const { return bytes; }
+	// Only for files made with create().
+	uint8_t* writableData() { return writable ? bytes : nullptr; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	uint8_t* bytes;
+	size_t length;
+	bool writable;
+
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#else
+	int file_descriptor;
+#endif
+};
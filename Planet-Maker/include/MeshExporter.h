@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Parameters.h"
+#include "PlanetSurface.h"
+
+struct MeshExportSettings
+{
+	std::string preset;
+	std::string output_prefix = "planet";
+
+	int resolution = 512; // quads along each cube face edge at LOD 0
+	int chunk_size = 128; // quads along each chunk edge at LOD 0
+	int lods = 1;         // every further LOD halves the quads per chunk
+
+	bool write_gltf = true;
+	bool write_ply = true;
+	bool vertex_colors = false;
+	float scale = 1.0f; // planet radius 1 becomes _scale units
+
+	int workers = 0; // threads including the caller, 0 = one per hardware thread
+};
+
+struct MeshExportStatistics
+{
+	int chunks = 0;
+	int64_t vertices = 0;
+	int64_t triangles = 0;
+	double seconds = 0.0;
+
+	double megatrianglesPerSecond() const { return seconds > 0.0 ? triangles / seconds / 1.0e6 : 0.0; }
+};
+
+// Exports the displaced terrain as a triangle mesh. The planet is a cube
+// sphere: every cube face is cut into chunk_size x chunk_size quad chunks,
+// each chunk becomes its own mesh, and every LOD keeps the same chunks with
+// half the quads. Normals come from the displaced surface, chunk borders
+// included, so chunks line up without seams in shading.
+//
+// Vertex and index counts only depend on the settings, so the layout of the
+// output files is known up front. The files are created at their final size
+// and memory mapped, and JobSystem tasks generate chunks straight into them.
+//
+// <prefix>.glb holds every chunk and LOD as separate nodes. <prefix>_lodN.ply
+// holds all chunks of one LOD.
+class MeshExporter
+{
+public:
+	MeshExporter(const MeshExportSettings& _settings);
+
+	// Returns the process exit code.
+	int run();
+	bool exportMesh(const PlanetParameters& _params);
+
+	const MeshExportStatistics& getStatistics() const { return statistics; }
+
+	static bool parseArguments(int _argc, char* _argv[], MeshExportSettings& _settings);
+	static void printUsage();
+
+private:
+	struct Chunk
+	{
+		int face, x, y, lod;
+		int quads;    // along each edge
+		int chunks;   // chunks along each face edge
+		int64_t first_vertex; // in the PLY file of its LOD
+		int64_t first_triangle;
+		size_t gltf_offset; // of the vertices in the glTF binary chunk
+		glm::vec3 min, max;
+
+		int vertexCount() const { return (quads + 1) * (quads + 1); }
+		int triangleCount() const { return 2 * quads * quads; }
+	};
+
+	void planChunks();
+	size_t vertexStride() const { return settings.vertex_colors ? 28 : 24; }
+
+	void buildChunk(const PlanetSurface& _surface, Chunk& _chunk, std::vector<glm::vec3>& _scratch,
+		uint8_t* _gltf, uint8_t* _plyVertices, uint8_t* _plyFaces);
+
+	std::string gltfJson() const;
+	std::string plyHeader(int64_t _vertices, int64_t _triangles) const;
+
+	MeshExportSettings settings;
+	MeshExportStatistics statistics;
+	std::vector<Chunk> chunks;
+	size_t gltf_binary_size;
+
+	JobSystem jobs;
+};
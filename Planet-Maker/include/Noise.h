@@ -0,0 +1,13 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// CPU versions of the noise functions in the shaders (Stefan Gustavson's
+// webgl-noise), written to give the same values so CPU side bakes and
+// exports match what is drawn on screen.
+
+// Classic Perlin noise, cnoise() in the shaders.
+float perlin_noise(const glm::vec3& _p);
+// Simplex noise, snoise() in the shaders.
+float simplex_noise(const glm::vec3& _p);
+// Cellular noise, F1 and F2 distances, cellular() in the shaders.
+glm::vec2 cellular_noise(const glm::vec3& _p);
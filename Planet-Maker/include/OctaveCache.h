@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Parameters.h"
+
+// One value per texel center of a cube heightmap, faces in
+// PlanetSurface::cubeDirection() order.
+typedef std::shared_ptr<const std::vector<float>> CubeLayer;
+
+// In memory cache of the terms of the terrain fBm, each one sampled on the
+// grid of a CubeHeightmap. An octave only depends on the noise method, seed,
+// frequency and its own index, so a different octave count adds or drops
+// one layer and a different elevation or radius reuses all of them; the
+// heightmap is their sum. Least recently used layers go first once the
+// cache grows past its size cap.
+//
+// Layers are read only once made, any number of threads may use the cache.
+class OctaveCache
+{
+public:
+	explicit OctaveCache(size_t _maxBytes);
+
+	// Shared by every heightmap bake of the process.
+	static OctaveCache& global();
+
+	// Term _octave of PlanetSurface::elevation() for _params, weight included,
+	// at _resolution texels per face edge. Evaluated with tasks on _jobs
+	// unless cached, nullptr if cancelled.
+	CubeLayer octave(const PlanetParameters& _params, int _octave, int _resolution,
+		JobSystem& _jobs, const CancelToken& _cancel = CancelToken());
+	// Heights of the feature layer of _params on the same grid, nullptr without features.
+	CubeLayer features(const PlanetParameters& _params, int _resolution,
+		JobSystem& _jobs, const CancelToken& _cancel = CancelToken());
+
+	void clear();
+
+	size_t getSize() const;
+	size_t getMaxSize() const { return max_bytes; }
+	int getLayerCount() const;
+	int getHits() const { return hits; }
+	int getMisses() const { return misses; }
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		CubeLayer layer;
+		uint64_t last_used; // tick, larger is more recent
+	};
+
+	CubeLayer layer(uint64_t _key, int _resolution, const std::function<float(const glm::vec3&)>& _sample,
+		JobSystem& _jobs, const CancelToken& _cancel);
+	void evict();
+
+	mutable std::mutex mutex;
+	std::vector<Entry> entries;
+	size_t bytes;
+	size_t max_bytes;
+	uint64_t tick;
+	int hits;
+	int misses;
+};
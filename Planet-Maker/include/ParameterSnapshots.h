@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "Parameters.h"
+
+// One published state of the planet. Never changes once published, any
+// thread may read it for as long as it holds a SnapshotRef.
+struct PlanetSnapshot
+{
+	PlanetParameters params;
+	uint64_t version = 0; // counts publishes, 0 is the default planet
+	uint64_t hash = 0;    // hash_parameters(params)
+	int changes = PARAMETERS_UNCHANGED; // ParameterChange flags against the previous version
+};
+
+// Keeps a snapshot from being reused while it is read. Copies are cheap and
+// may be captured by tasks; the ParameterSnapshots it came from must outlive it.
+class SnapshotRef
+{
+public:
+	SnapshotRef() : snapshot(nullptr), refs(nullptr) {}
+	SnapshotRef(const SnapshotRef& _other);
+	SnapshotRef(SnapshotRef&& _other);
+	SnapshotRef& operator=(SnapshotRef _other);
+	~SnapshotRef();
+
+	const PlanetSnapshot* operator->() const { return snapshot; }
+	const PlanetSnapshot& operator*() const { return *snapshot; }
+	explicit operator bool() const { return snapshot != nullptr; }
+
+	uint64_t getVersion() const { return snapshot != nullptr ? snapshot->version : 0; }
+
+private:
+	friend class ParameterSnapshots;
+	// Takes over a reference already counted in _refs
+	SnapshotRef(const PlanetSnapshot* _snapshot, std::atomic<int>* _refs) : snapshot(_snapshot), refs(_refs) {}
+
+	const PlanetSnapshot* snapshot;
+	std::atomic<int>* refs;
+};
+
+// Hands the parameters edited by the UI to the renderer and to tasks without
+// locks. The UI thread edits its own PlanetParameters and publishes them once
+// per frame; a changed set goes into a free slot, which then becomes current
+// with one atomic store. Readers pin the current slot with a reference count
+// and check it is still current, so a slot is only ever rewritten while
+// nobody holds it and every reader sees one consistent version.
+//
+// The version grows with every publish, caches compare it (or the changes of
+// the versions in between) instead of the parameters.
+class ParameterSnapshots
+{
+public:
+	// Snapshots held at once, including the current one. More than the frame
+	// needs plus every running task, publish() fails if none is free.
+	static const int SLOT_COUNT = 16;
+
+	ParameterSnapshots();
+
+	// Single publishing thread. Makes _params the current snapshot if they
+	// differ from it. Returns false if every other slot is still held; the
+	// caller keeps its parameters and publishes again next frame.
+	bool publish(const PlanetParameters& _params);
+
+	// Any thread, lock free.
+	SnapshotRef acquire() const;
+	uint64_t getVersion() const { return version; }
+
+private:
+	struct Slot
+	{
+		PlanetSnapshot snapshot;
+		std::atomic<int> refs;
+	};
+
+	mutable Slot slots[SLOT_COUNT];
+	std::atomic<int> current;
+	std::atomic<uint64_t> version;
+};
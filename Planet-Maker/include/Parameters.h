@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Every value that describes one planet. This is what the preset files store
+// and what the renderer needs to draw the terrain, ocean and sky layers.
+struct PlanetParameters
+{
+	int noise_method = 0;
+
+	// ________ SKY _________
+	bool sky_enabled = true;
+	float sky_frequency = 4.0f;
+	int sky_seed = 0;
+	int sky_octaves = 6;
+	float sky_color[3] = { 1.0f,1.0f,1.0f };
+	float sky_opacity = 1.0f;
+
+	// ________ TERRAIN _________
+	int terrain_segments = 100;
+	float terrain_elevation = 0.1f;
+	float terrain_radius = 0.01f;
+	float terrain_vert_frequency = 4.0f;
+	float terrain_frag_frequency = 4.0f;
+	int terrain_octaves = 6;
+	int terrain_seed = 0;
+
+	float terrain_color_deep[3] = { 0.3f,0.3f,0.3f };
+	float terrain_color_beach[3] = { 1.0f,0.96f,0.57f };
+	float terrain_color_grass[3] = { 0.0535179f,0.454902f,0.0912952f };
+	float terrain_color_rock[3] = { 0.286275f,0.286275f,0.286275f };
+	float terrain_color_snow[3] = { 0.980392f,0.980392f,0.980392f };
+
+	// ________ OCEAN _________
+	bool ocean_enabled = true;
+	float ocean_frequency = 4.0f;
+	int ocean_seed = 0;
+	int ocean_octaves = 6;
+	float ocean_color_1[3] = { 0.0f,0.352941f,1.0f };
+	float ocean_color_2[3] = { 0.0f,0.231142f,0.654902f };
+
+	// ________ FEATURES _________
+	// Craters, volcanoes and rifts on top of the terrain noise, see FeatureLayer
+	bool features_enabled = false;
+	int feature_seed = 0;
+	int feature_craters = 200000;
+	int feature_volcanoes = 100;
+	int feature_rifts = 40;
+	float feature_size = 0.05f;     // footprint of the largest stamps, radians
+	float feature_strength = 0.15f; // height of the largest stamps, noise units
+};
+
+// Reads/writes the line based preset format (one value per line, fixed order).
+// Fields added later are appended and optional when reading.
+// The path is used as is, the caller appends the file ending.
+bool load_parameters(const std::string& _filePath, PlanetParameters& _params);
+bool save_parameters(const std::string& _filePath, const PlanetParameters& _params);
+
+// FNV-1a over every field. Equal parameters give equal hashes, so caches can
+// tell whether a planet changed without keeping a copy of it.
+uint64_t hash_parameters(const PlanetParameters& _params);
+
+// What has to be redone when a planet moves from one parameter set to another.
+// Uniforms are read every frame, rebakes invalidate anything rendered from the
+// noise fields (cloud history, impostors), tessellation rebuilds the terrain mesh.
+enum ParameterChange
+{
+	PARAMETERS_UNCHANGED = 0,
+	PARAMETERS_UNIFORMS = 1 << 0,
+	PARAMETERS_REBAKE = 1 << 1,
+	PARAMETERS_TESSELLATE = 1 << 2,
+};
+
+// Combination of ParameterChange flags for every field that differs.
+int compare_parameters(const PlanetParameters& _from, const PlanetParameters& _to);
@@ -0,0 +1,74 @@
+#pragma once
+#include <GL/glew.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+// Queues run in this order. Opaque passes are sorted front-to-back,
+// transparent passes back-to-front.
+enum PassQueue
+{
+	PASS_DEPTH_PREPASS = 0, // depth only, no color writes
+	PASS_OPAQUE,            // depth tested with GL_LEQUAL against the pre-pass
+	PASS_BACKGROUND,        // drawn at the far plane, only where nothing opaque is
+	PASS_TRANSPARENT,       // blended
+	PASS_QUEUE_COUNT
+};
+
+struct RenderPass
+{
+	std::string name;
+	PassQueue queue;
+	float sort_depth; // distance from the camera to the nearest point of the layer
+	std::function<void()> draw;
+};
+
+struct PassStatistics
+{
+	std::string name;
+	GLuint64 samples; // fragments that passed the depth test
+};
+
+// Collects the passes of a frame, orders them and sets the depth/blend state
+// of each queue. Optionally counts the shaded fragments of every pass with
+// occlusion queries and shows per pixel overdraw as a heat map.
+class PassScheduler
+{
+public:
+	PassScheduler();
+	~PassScheduler();
+
+	void init();
+
+	void add(const RenderPass& _pass);
+	void execute();
+
+	// Replaces the color buffer with the overdraw heat map of the last execute().
+	// Needs a stencil buffer and show_overdraw set before execute().
+	void drawOverdraw();
+
+	// Results are one frame old so reading them never stalls the pipeline.
+	const std::vector<PassStatistics>& getStatistics() const { return statistics; }
+	GLuint64 getTotalSamples() const;
+
+	bool measure;
+	bool show_overdraw;
+
+private:
+	void applyQueueState(PassQueue _queue);
+	void collectQueries();
+
+	std::vector<RenderPass> passes;
+	std::vector<PassStatistics> statistics;
+
+	// Double buffered so last frame's queries are read while this frame records
+	std::vector<GLuint> queries[2];
+	std::vector<std::string> query_names[2];
+	int frame;
+
+	Shader overdraw_shader;
+	GLuint overdraw_vao;
+	GLint loc_overdraw_color;
+};
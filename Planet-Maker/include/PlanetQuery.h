@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BakeCache.h"
+#include "CubeHeightmap.h"
+#include "JobSystem.h"
+#include "Parameters.h"
+#include "PlanetSurface.h"
+
+// A ray in planet space, direction normalized.
+struct PlanetRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float max_distance = 1.0e30f;
+};
+
+struct PlanetRayHit
+{
+	bool hit = false;
+	float distance = 0.0f;
+	glm::vec3 position;
+	glm::vec3 normal;
+	float elevation = 0.0f; // noise units, like PlanetSurface::elevation()
+};
+
+// Height, normal and ray queries against the terrain of one planet, in
+// planet space (the planet centered at the origin, +z the pole, before the
+// model rotation). Built once from a CubeHeightmap and read only after
+// that, so any number of threads may query one instance.
+//
+// Heights are bilinear in the heightmap. Rays descend a min/max pyramid
+// over it: a ray that stays above the highest terrain of a cell while it
+// crosses the cell skips the cell, so most rays only touch the
+// heightmap near where they hit. _exact queries evaluate the noise instead,
+// like PlanetSurface, and large batches of them are split over
+// JobSystem::global().
+class PlanetQuery
+{
+public:
+	PlanetQuery();
+
+	// Takes the heightmap, baked with the noise of _params at any resolution.
+	void build(const PlanetParameters& _params, CubeHeightmap&& _heightmap);
+	bool empty() const { return heightmap.empty(); }
+
+	// Elevation at each direction, noise units. Directions do not have to be normalized.
+	void elevations(const glm::vec3* _directions, float* _elevations, size_t _count, bool _exact = false) const;
+	// Distance of the terrain surface from the center at each direction.
+	void surfaceRadii(const glm::vec3* _directions, float* _radii, size_t _count, bool _exact = false) const;
+	// Terrain normals at each direction, from differences about one texel apart.
+	void normals(const glm::vec3* _directions, glm::vec3* _normals, size_t _count, bool _exact = false) const;
+	// First intersection of each ray with the terrain, the ocean is not solid.
+	// Large batches are split over JobSystem::global() too.
+	void raycast(const PlanetRay* _rays, PlanetRayHit* _hits, size_t _count) const;
+
+	float elevation(const glm::vec3& _direction, bool _exact = false) const;
+	float surfaceRadius(const glm::vec3& _direction, bool _exact = false) const;
+	glm::vec3 normal(const glm::vec3& _direction, bool _exact = false) const;
+	PlanetRayHit raycast(const PlanetRay& _ray) const;
+
+	const PlanetSurface& getSurface() const { return surface; }
+	// Distance of the highest and the lowest terrain from the center
+	float getOuterRadius() const { return outer_radius; }
+	float getInnerRadius() const { return inner_radius; }
+
+private:
+	// Highest and lowest terrain of the cells of one level, all faces
+	struct Level
+	{
+		int size; // cells per face edge
+		int shift; // texels per cell edge, log2
+		std::vector<float> max_height;
+		std::vector<float> min_height;
+	};
+
+	float sampleHeightmap(const glm::vec3& _direction) const;
+	float sampleHeight(const glm::vec3& _direction, bool _exact) const;
+	glm::vec3 sampleNormal(const glm::vec3& _direction, bool _exact) const;
+	PlanetRayHit castRay(const PlanetRay& _ray) const;
+
+	PlanetSurface surface;
+	CubeHeightmap heightmap;
+	std::vector<Level> levels; // finest first, the last has one cell per face
+	float normal_step; // angle between the samples of normals()
+	float outer_radius; // highest and lowest terrain
+	float inner_radius;
+};
+
+// Keeps a PlanetQuery of the current planet, rebuilt in a task whenever the
+// terrain changes. The previous query stays available until the new one is
+// done, queries handed out stay valid while they are in use.
+class BackgroundQuery
+{
+public:
+	BackgroundQuery();
+	~BackgroundQuery();
+
+	// Bakes the heightmap of _params (through _cache if not nullptr) and
+	// builds a query from it, unless the terrain is the one already built
+	// or being built.
+	void start(const PlanetParameters& _params, int _resolution, BakeCache* _cache);
+	void stop();
+
+	// Main thread, once per frame. True if a new query arrived.
+	bool update();
+
+	// nullptr until the first build finished
+	std::shared_ptr<const PlanetQuery> get() const { return current; }
+
+	// Everything the queries of _params depend on.
+	static uint64_t cacheKey(const PlanetParameters& _params, int _resolution);
+
+private:
+	std::shared_ptr<const PlanetQuery> current;
+	std::shared_ptr<PlanetQuery> building;
+	uint64_t building_key;
+	CancelToken cancel;
+	TaskRef task;
+};
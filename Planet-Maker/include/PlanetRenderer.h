@@ -0,0 +1,292 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ClimateMap.h"
+#include "FeatureLayer.h"
+#include "JobSystem.h"
+#include "Shader.h"
+#include "Sphere.h"
+#include "StreamBuffer.h"
+#include "Plane.h"
+#include "Parameters.h"
+#include "ParameterSnapshots.h"
+#include "PassScheduler.h"
+#include "TemporalClouds.h"
+#include "Scene.h"
+#include "SceneIndex.h"
+#include "ImpostorCache.h"
+#include "PropScatter.h"
+
+// Per frame values that are not part of the planet itself.
+struct RenderState
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::mat4 model; // rotation of the planet
+
+	float light_position[3] = { 1.0f, 1.0f, 1.0f };
+	float light_intensity = 1.0f;
+	float shininess = 1.0f;
+
+	float time = 0.0f;
+	float sky_speed = 1.0f;
+
+	// Cloud pixels evaluated per frame: 1 = all of them, 4 or 16 = one in
+	// that many, the rest reprojected from the previous frame
+	int cloud_update_rate = 1;
+
+	// Drop the fBm octaves finer than a pixel or the terrain's vertex spacing,
+	// the last one that is kept fades out with distance instead of popping
+	bool octave_lod = true;
+
+	// Scenes only: skip planets outside the view, and draw planets smaller
+	// than impostor_pixels (radius on screen) from the impostor atlas. 0 disables impostors.
+	bool frustum_culling = true;
+	float impostor_pixels = 24.0f;
+
+	// Cube map of eroded minus noise height added by the terrain shaders, see
+	// BackgroundErosion. Single planets only, 0 or a strength of 0 disables it.
+	GLuint erosion_map = 0;
+	int erosion_resolution = 0;
+	float erosion_strength = 0.0f;
+
+	// Rocks and vegetation of getProps(), single planets only. Chunks
+	// farther than prop_distance (planet radii) from the camera are skipped.
+	bool draw_props = false;
+	float prop_distance = 0.3f;
+
+	bool draw_stars = true;
+	bool draw_wireframe = false;
+
+	bool depth_prepass = true;  // lay down terrain depth before shading anything
+	bool measure_passes = false; // per pass fragment counters, see getScheduler()
+	bool show_overdraw = false;  // replace the image with an overdraw heat map
+};
+
+// What renderScene() did with the planets of the last frame.
+struct SceneStatistics
+{
+	int planets = 0;
+	int visible = 0;   // survived frustum culling
+	int impostors = 0; // of those, drawn as billboards
+	int bakes = 0;     // impostors rendered into the atlas this frame
+};
+
+// Owns the shaders and meshes of one planet and draws it into the current
+// GL context. Create one per context, GL objects are not shared.
+class PlanetRenderer
+{
+public:
+	PlanetRenderer();
+	~PlanetRenderer();
+
+	void init(int _terrainSegments);
+	void reloadShaders();
+
+	// Rebuilds the terrain mesh if the segment count changed.
+	void setTerrainSegments(int _segments);
+	// Same without stalling the frame: the mesh is built in a JobSystem::global()
+	// task and swapped in by its main thread queue once done, the old mesh is
+	// drawn until then. A newer request cancels an older one still in flight.
+	// With ARB_buffer_storage the task writes the mesh into a persistently
+	// mapped StreamBuffer that it is drawn from, nothing is uploaded.
+	void requestTerrainSegments(int _segments);
+	int getTerrainSegments() const { return terrain_segments; }
+	// Replaces the terrain mesh with an uploaded one, e.g. from PresetLoader. Takes ownership.
+	void adoptTerrainMesh(Sphere* _sphere, int _segments);
+	// Drops everything rendered from the noise fields, see PARAMETERS_REBAKE.
+	void invalidateBakes();
+	// Brings bakes, the climate map and the terrain mesh up to date with
+	// _snapshot, using the changes since the version applied last. Free if
+	// the version is the same.
+	void applySnapshot(const SnapshotRef& _snapshot);
+	// Builds the feature layer of _params and uploads it before returning,
+	// for renderers without a main thread queue such as BatchRenderer's
+	// workers. applySnapshot() does the same in the background.
+	void buildFeatures(const PlanetParameters& _params);
+	// Recreates all three planet meshes.
+	void rebuildSpheres(int _terrainSegments);
+
+	// Clears the current framebuffer and sets the render state of the planet passes.
+	void beginFrame();
+
+	// Schedules the layers as passes: terrain depth pre-pass, terrain and props,
+	// stars at the far plane, then ocean and sky back-to-front.
+	void render(const PlanetParameters& _params, const RenderState& _state);
+
+	// Draws every planet of the scene with one instanced draw per layer, the
+	// per planet values live in a shader storage buffer indexed by instance.
+	// Without SSBO support it falls back to one render() per planet.
+	void renderScene(const Scene& _scene, const RenderState& _state);
+	bool supportsInstancing() const { return instancing_supported; }
+	const SceneStatistics& getSceneStatistics() const { return scene_statistics; }
+
+	PassScheduler& getScheduler() { return scheduler; }
+	// Started and stopped by the caller, see PropScatter::start()
+	PropScatter& getProps() { return props; }
+
+	void renderTerrainDepth(const PlanetParameters& _params, const RenderState& _state);
+	void renderStars(const RenderState& _state);
+	void renderTerrain(const PlanetParameters& _params, const RenderState& _state);
+	void renderOcean(const PlanetParameters& _params, const RenderState& _state);
+	void renderSky(const PlanetParameters& _params, const RenderState& _state);
+
+	// Camera used for thumbnails and batch renders, planet centered at the origin.
+	static void defaultView(float _aspect, glm::mat4& _projection, glm::mat4& _view);
+
+private:
+	void loadShaders();
+	void lookupUniforms();
+	void deleteMeshes();
+	void startMeshTask();
+	bool startStreamedMeshTask(int _segments);
+	void cancelMeshTask();
+	void startClimateTask(const PlanetParameters& _params);
+	void bindClimate(const PlanetParameters& _params);
+	void startFeatureTask(const PlanetParameters& _params);
+	void uploadFeatures(const FeatureLayer& _layer, uint64_t _key);
+	void bindFeatures(const PlanetParameters& _params, GLint _grid);
+
+	void uploadScene(const Scene& _scene);
+	void selectPlanets(const Scene& _scene, const RenderState& _state, std::vector<int>& _full);
+	void bakeImpostor(const Planet& _planet, int _slot, uint64_t _hash, const RenderState& _state,
+		const glm::vec3& _center, float _radius, const glm::vec3& _localDirection, const glm::vec3& _localUp);
+	void sortInstances(const Scene& _scene, const std::vector<int>& _planets, const RenderState& _state);
+	void renderSceneTerrain(const RenderState& _state, bool _depthOnly);
+	void renderSceneOcean(const RenderState& _state);
+	void renderSceneSky(const RenderState& _state);
+	void bindErosion(const RenderState& _state, GLint _map, GLint _strength, GLint _step);
+	void bindOctaveLod(const RenderState& _state, GLint _pixelAngle, GLint _pixelSize, GLint _vertexAngle);
+
+	Shader terrain_shader;
+	Shader terrain_depth_shader;
+	Shader sky_shader;
+	Shader ocean_shader;
+	Shader stars_shader;
+
+	// Same shaders compiled with INSTANCED, see renderScene()
+	Shader terrain_instanced_shader;
+	Shader terrain_depth_instanced_shader;
+	Shader ocean_instanced_shader;
+	Shader sky_instanced_shader;
+
+	Sphere* terrain_sphere;
+	Sphere* sky_sphere;
+	Sphere* ocean_sphere;
+	std::vector<Plane*> skybox;
+
+	int terrain_segments;
+
+	// __________ TERRAIN MESH TASKS ______________
+	TaskRef mesh_task;       // upload of pending_segments, runs after its tessellation
+	CancelToken mesh_cancel;
+	int pending_segments;    // being built, 0 if none
+	int requested_segments;
+
+	// Tessellated in place by tasks and drawn from there, see startStreamedMeshTask()
+	struct AbandonedWrite
+	{
+		TaskRef writer;
+		StreamAllocation allocation;
+	};
+	StreamBuffer mesh_stream;
+	TaskRef streamed_build; // writing streamed_allocation for mesh_task
+	StreamAllocation streamed_allocation;
+	std::vector<AbandonedWrite> abandoned_writes; // released once the writer finished
+
+	SnapshotRef applied_snapshot; // what the bakes and the mesh were made for
+
+	// __________ CLIMATE ______________
+	// Biome lookup of terrain_frag.glsl, the same for every planet
+	GLuint biome_lut;
+	// Climate cube map of the planet of the last snapshot, baked by a task.
+	// Used for the parameters it was made for only, see bindClimate().
+	GLuint climate_texture;
+	uint64_t climate_key;         // of climate_texture, 0 if none
+	uint64_t pending_climate_key; // being baked, 0 if none
+	CancelToken climate_cancel;
+	TaskRef climate_task;
+
+	// __________ FEATURES ______________
+	// Stamps and grid of the feature layer of the last snapshot, in storage
+	// buffers for terrain_vert.glsl. Single planets only, scenes draw the noise.
+	GLuint feature_stamp_buffer;
+	GLuint feature_cell_buffer;
+	int feature_grid;             // cells per face edge of the uploaded layer
+	uint64_t feature_key;         // of the buffers, 0 if none
+	uint64_t pending_feature_key; // being built, 0 if none
+	CancelToken feature_cancel;
+	TaskRef feature_task;
+
+	PassScheduler scheduler;
+	TemporalClouds temporal_clouds;
+	PropScatter props;
+
+	// __________ SCENE ______________
+	enum SceneLayer { LAYER_TERRAIN, LAYER_OCEAN, LAYER_SKY, LAYER_COUNT };
+
+	bool instancing_supported;
+	GLuint planet_buffer;   // one PlanetInstanceData per planet
+	GLuint instance_buffer; // planet indices of every layer in draw order
+	const Scene* uploaded_scene;
+	unsigned int uploaded_version;
+	std::vector<GLuint> instances;
+	int layer_offset[LAYER_COUNT];
+	int layer_count[LAYER_COUNT];
+
+	SceneIndex scene_index;
+	ImpostorCache impostors;
+	std::vector<uint64_t> planet_hashes;
+	const Scene* hashed_scene;
+	unsigned int hashed_version;
+	SceneStatistics scene_statistics;
+
+	// __________ TERRAIN ______________
+	GLint loc_P_terrain, loc_V_terrain, loc_M_terrain;
+	GLint loc_color_deep, loc_color_beach, loc_color_grass, loc_color_rock, loc_color_snow;
+	GLint loc_terrain_method;
+	GLint loc_radius, loc_elevation, loc_seed, loc_octaves, loc_vert_frequency, loc_frag_frequency;
+	GLint loc_erosion_map, loc_erosion_strength, loc_erosion_step;
+	GLint loc_climate_map, loc_climate_enabled, loc_slope_scale, loc_biome_lut;
+	GLint loc_feature_grid;
+	GLint loc_lod_pixel_angle, loc_lod_pixel_size, loc_lod_vertex_angle;
+
+	// __________ TERRAIN DEPTH PRE-PASS ______________
+	GLint loc_P_depth, loc_V_depth, loc_M_depth;
+	GLint loc_depth_method, loc_depth_radius, loc_depth_elevation, loc_depth_seed, loc_depth_octaves, loc_depth_frequency;
+	GLint loc_depth_erosion_map, loc_depth_erosion_strength, loc_depth_erosion_step;
+	GLint loc_depth_feature_grid;
+	GLint loc_depth_lod_pixel_angle, loc_depth_lod_pixel_size, loc_depth_lod_vertex_angle;
+
+	// __________ SKY ______________
+	GLint loc_P_sky, loc_V_sky, loc_M_sky;
+	GLint loc_sky_radius, loc_sky_elevation, loc_sky_method;
+	GLint loc_sky_time, loc_sky_speed, loc_sky_frequency, loc_sky_octaves, loc_sky_seed;
+	GLint loc_sky_color, loc_sky_opacity;
+	GLint loc_sky_octave_lod;
+
+	// __________ OCEAN ______________
+	GLint loc_P_ocean, loc_V_ocean, loc_M_ocean;
+	GLint loc_light_position, loc_light_intensity, loc_shininess;
+	GLint loc_ocean_method;
+	GLint loc_ocean_radius, loc_ocean_elevation, loc_ocean_frequency, loc_ocean_octaves, loc_ocean_seed;
+	GLint loc_ocean_color_1, loc_ocean_color_2;
+	GLint loc_ocean_octave_lod;
+
+	// __________ STAR BACKGROUND ______________
+	GLint loc_P_stars, loc_V_stars, loc_M_stars;
+
+	// __________ INSTANCED ______________
+	struct InstancedUniforms
+	{
+		GLint P, V, scene_model, instance_offset;
+		GLint lod_pixel_angle, lod_pixel_size, lod_vertex_angle, octave_lod;
+	};
+	InstancedUniforms loc_terrain_instanced, loc_depth_instanced, loc_ocean_instanced, loc_sky_instanced;
+	GLint loc_instanced_biome_lut;
+	GLint loc_instanced_light_position, loc_instanced_light_intensity, loc_instanced_shininess;
+	GLint loc_instanced_sky_time, loc_instanced_sky_speed;
+};
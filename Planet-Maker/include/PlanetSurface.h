@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "FeatureLayer.h"
+#include "Parameters.h"
+
+class ClimateMap;
+
+// CPU evaluation of the terrain and ocean layers, following terrain_vert.glsl,
+// terrain_frag.glsl and ocean_frag.glsl. Directions are unit vectors in planet
+// space (+z is the pole, like Sphere). Safe to use from several threads.
+class PlanetSurface
+{
+public:
+	explicit PlanetSurface(const PlanetParameters& _params);
+
+	// fBm of terrain_vert.glsl plus the stamps of the feature layer, roughly
+	// -2..2. Multiply by terrain_elevation for the displacement.
+	float elevation(const glm::vec3& _direction) const;
+	// Term _octave of the fBm of elevation(), weight included. elevation()
+	// adds octaves 0..terrain_octaves - 1 in order, then the features.
+	float octave(const glm::vec3& _direction, int _octave) const;
+
+	// Distance of the terrain surface from the planet center.
+	float terrainRadius(float _elevation) const;
+	float oceanRadius() const;
+	bool isUnderwater(float _elevation) const;
+	// Elevation of the ocean surface, 0 without an ocean.
+	float seaLevel() const;
+
+	// Biome colours come from _climate if set (not owned, must outlive the
+	// surface), from estimate_climate() otherwise.
+	void setClimateMap(const ClimateMap* _climate) { climate_map = _climate; }
+
+	// Unlit colours as the shaders produce them, before lighting.
+	glm::vec3 terrainColor(const glm::vec3& _direction, float _elevation) const;
+	glm::vec3 oceanColor(const glm::vec3& _direction) const;
+	// Ocean blended over the terrain where it is underwater.
+	glm::vec3 color(const glm::vec3& _direction, float _elevation) const;
+
+	const PlanetParameters& getParameters() const { return params; }
+
+	// Unit direction through (_s, _t) in -1..1 of a cube face, faces in GL
+	// cube map order (+x, -x, +y, -y, +z, -z). Values outside -1..1 continue
+	// smoothly onto the neighbouring face.
+	static glm::vec3 cubeDirection(int _face, float _s, float _t);
+	// Inverse of cubeDirection(), _direction does not have to be normalized.
+	static void cubeCoordinates(const glm::vec3& _direction, int& _face, float& _s, float& _t);
+
+private:
+	float terrainNoise(const glm::vec3& _p) const;
+	float detailNoise(const glm::vec3& _p) const;
+
+	PlanetParameters params;
+	std::shared_ptr<const FeatureLayer> features; // nullptr without features
+	const ClimateMap* climate_map;
+};
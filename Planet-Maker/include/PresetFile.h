@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Parameters.h"
+
+// Binary preset format (.planet). Self-describing: a header, a table naming
+// every stored field with its type and offset, the values, and a CRC-32 of
+// everything after the header. Readers look fields up by name, so fields can
+// be added or reordered without breaking older files; fields a file does not
+// have keep their defaults and fields the reader does not know are skipped.
+//
+//   header  "PLNT", version, field count, table/data offsets, data size, crc
+//   table   field_count x { char name[24], type, count, offset }
+//   data    4 byte little endian values (bools as int32)
+//
+// Files are read through a memory map straight into PlanetParameters.
+
+static const char* const PRESET_FILE_ENDING = ".planet";
+static const uint16_t PRESET_FORMAT_VERSION = 1;
+
+// Reads either format, binary files are recognized by their magic bytes and
+// anything else goes to the text reader (load_parameters).
+bool load_preset(const std::string& _filePath, PlanetParameters& _params);
+
+// Decodes a binary preset that is already in memory. False if it is
+// truncated, has a newer major version or fails the checksum.
+bool read_binary_preset(const uint8_t* _data, size_t _size, PlanetParameters& _params);
+
+bool save_binary_preset(const std::string& _filePath, const PlanetParameters& _params);
+
+// Reads a preset of any format and writes it as a binary preset.
+bool convert_preset(const std::string& _sourcePath, const std::string& _targetPath);
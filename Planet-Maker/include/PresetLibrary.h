@@ -0,0 +1,122 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Parameters.h"
+#include "WorkQueue.h"
+
+class BakeCache;
+
+// One preset file of the library and what the browser shows of it.
+struct PresetEntry
+{
+	std::string file_name; // with ending, relative to the library directory
+	std::string name;      // without ending
+	uint64_t modified = 0; // file time, together with the size tells whether the file changed
+	uint64_t size = 0;
+
+	bool parsed = false;   // the values below are known
+	bool valid = false;    // false if the file is not a preset
+	int noise_method = 0;
+	int terrain_seed = 0;
+	int terrain_octaves = 0;
+	float terrain_radius = 0.0f;
+	float terrain_elevation = 0.0f;
+	bool ocean_enabled = false;
+	bool sky_enabled = false;
+
+	uint64_t thumbnail_key = 0; // bake cache key of the thumbnail, 0 until parsed
+	GLuint texture = 0;         // 0 until the thumbnail arrived
+	bool requested = false;     // thumbnail queued or being rendered
+};
+
+// Index of every preset in a directory for the browser. Opening reads the
+// index file left by the last session, so only presets that are new or whose
+// file time or size changed are parsed again. The directory is watched for
+// changes instead of being rescanned on demand.
+//
+// Thumbnails are rendered on the CPU by background workers and stored in the
+// bake cache under the parameters hash, renamed or copied presets reuse them.
+// Entries on screen are moved to the front of the queue.
+class PresetLibrary
+{
+public:
+	static const int THUMBNAIL_SIZE = 96;
+
+	PresetLibrary();
+	~PresetLibrary();
+
+	// _cache may be null, thumbnails are then rendered every session.
+	bool open(const std::string& _directory, BakeCache* _cache, int _workers = 2);
+	void close();
+
+	// Main thread, once per frame: picks up directory changes and finished
+	// thumbnails, uploads those as textures and writes the index once idle.
+	// Returns true if anything the browser shows changed.
+	bool update();
+	void rescan();
+
+	// For entries on screen, their thumbnail is rendered before the rest.
+	void requestThumbnail(int _index);
+
+	bool isBusy() const { return !pending.empty() || in_flight > 0; }
+	int getPendingCount() const { return (int)pending.size() + in_flight; }
+
+	const std::vector<PresetEntry>& getEntries() const { return entries; }
+	std::string getPath(int _index) const;
+	const std::string& getDirectory() const { return directory; }
+
+private:
+	struct Job
+	{
+		std::string file_name;
+		uint64_t modified;
+		uint64_t thumbnail_key; // known from the index, 0 if the file has to be parsed
+	};
+
+	struct Result
+	{
+		Job job;
+		PresetEntry info; // key values, if the file was parsed
+		std::vector<uint8_t> pixels; // RGBA, empty if the preset could not be read
+	};
+
+	void workerLoop();
+	void process(const Job& _job, Result& _result);
+	void submitJobs();
+	void applyResult(Result& _result);
+
+	void startWatching();
+	void stopWatching();
+	bool directoryChanged();
+
+	void readIndex();
+	void writeIndex();
+	int find(const std::string& _fileName) const;
+
+	std::string directory;
+	BakeCache* cache;
+
+	std::vector<PresetEntry> entries; // sorted by file name
+	std::map<std::string, int> lookup;
+	bool index_dirty;
+
+	std::deque<std::string> pending; // file names waiting for a worker
+	int in_flight;
+	int worker_count;
+
+	WorkQueue<Job>* jobs;
+	WorkQueue<Result>* results;
+	std::vector<std::thread> workers;
+
+#ifdef _WIN32
+	void* change_handle;
+#else
+	int notify_descriptor;
+#endif
+};
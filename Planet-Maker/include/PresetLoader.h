@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+#include <memory>
+#include <string>
+
+#include "JobSystem.h"
+#include "Parameters.h"
+#include "Sphere.h"
+#include "UploadRing.h"
+
+// Loads a preset without stalling the frame, in three stages:
+//  1. a task reads the preset file,
+//  2. a continuation tessellates the terrain mesh if the segment count differs,
+//  3. the main thread copies the mesh into GL buffers through an UploadRing,
+//     a limited number of bytes per frame.
+// Only then update() hands out the parameters and the mesh together, so the
+// caller swaps both at the start of one frame and the old planet stays on
+// screen until then. A new request cancels a load still in flight, the main
+// thread never waits for its tasks.
+class PresetLoader
+{
+public:
+	PresetLoader();
+	~PresetLoader();
+
+	void init(size_t _stagingBytes = 8 * 1024 * 1024);
+
+	// _currentSegments is the segment count of the mesh on screen, an equal
+	// count in the preset skips tessellation.
+	void request(const std::string& _filePath, int _currentSegments);
+
+	// Main thread, once per frame before rendering. Returns true once a
+	// preset is complete; _params then holds it and _terrain the uploaded
+	// mesh, or nullptr if the mesh on screen already fits. The caller owns the mesh.
+	// Returns false with _failed set if the preset could not be read.
+	bool update(PlanetParameters& _params, Sphere*& _terrain, bool& _failed);
+
+	bool isLoading() const { return current != nullptr; }
+	// 0..1 of the current load, the upload makes up most of it
+	float getProgress() const;
+
+	size_t upload_budget; // bytes copied into GL buffers per frame
+
+private:
+	// Shared with its tasks, a cancelled load is freed by whoever finishes last
+	struct Job
+	{
+		std::string file_path;
+		int current_segments;
+
+		CancelToken cancel;
+		TaskRef parse;
+		TaskRef tessellate; // runs after parse
+
+		bool ok;
+		PlanetParameters params;
+		std::unique_ptr<Sphere> terrain; // nullptr if not needed
+
+		bool allocated;
+		size_t vertex_offset; // bytes uploaded so far
+		size_t index_offset;
+	};
+
+	bool uploadTerrain(Job& _job);
+
+	std::shared_ptr<Job> current;
+	UploadRing ring;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BakeCache.h"
+#include "ClimateMap.h"
+#include "JobSystem.h"
+#include "Parameters.h"
+#include "PlanetQuery.h"
+#include "Shader.h"
+
+struct RenderState;
+
+// Props scattered over the land, one mesh each.
+enum PropKind
+{
+	PROP_ROCK = 0, // bare and steep ground, scree below snow
+	PROP_SHRUB,    // grass and beach
+	PROP_TREE,     // grass where it is moist, forests
+	PROP_KIND_COUNT
+};
+
+// Placement of the props, distances in planet radii.
+struct ScatterSettings
+{
+	float spacing = 0.001f;   // closest two props of the densest layer may get
+	int layers = 4;           // the density doubles with every layer
+	int chunks_per_edge = 32; // chunks along a cube face edge
+};
+
+// One prop as prop_vert.glsl reads it, 16 bytes.
+struct PropInstance
+{
+	glm::vec3 position; // planet space, on the terrain
+	uint32_t packed;    // yaw, scale and tint, 8 bits each from the lowest
+};
+
+// Props of one tile of a cube face. The instances of every kind are stored
+// by layer: layer 0 is a Poisson disk set at the widest spacing and every
+// further layer fills it in at 1 / sqrt(2) of the spacing before, so the
+// first layer_end[kind][n - 1] instances of a kind are blue noise at every
+// density n.
+struct PropChunk
+{
+	static const int MAX_LAYERS = 8;
+
+	glm::vec3 center; // bounding sphere of the props, planet space
+	float radius = 0.0f;
+	uint32_t first[PROP_KIND_COUNT];
+	uint32_t layer_end[PROP_KIND_COUNT][MAX_LAYERS];
+};
+
+// What the last render() drew.
+struct ScatterStatistics
+{
+	size_t instances = 0; // placed on the planet
+	int chunks = 0;       // with at least one prop
+	int visible_chunks = 0;
+	size_t drawn = 0;     // instances
+	int draws = 0;
+};
+
+// Rocks, shrubs and trees on the terrain of the current planet. A task
+// bakes the heightmap and climate, then places the props of every chunk in
+// parallel: Poisson disk points in the tile, kept or dropped by height,
+// slope and biome like the colours of terrain_frag.glsl. The instances of
+// all chunks live in one vertex buffer, render() culls chunks against the
+// frustum and the horizon and draws fewer layers the farther away a chunk
+// is, one glDrawElementsInstanced per kind and chunk.
+class PropScatter
+{
+public:
+	PropScatter();
+	~PropScatter();
+
+	void init();
+	void loadShaders();
+
+	// Places the props of _params in a task, through _cache if not nullptr.
+	// Keeps the props or the build in flight if they are for the same terrain.
+	void start(const PlanetParameters& _params, const ScatterSettings& _settings, BakeCache* _cache);
+	// Cancels the build and frees the instances.
+	void stop();
+	bool isBuilding() const { return !JobSystem::isDone(task); }
+
+	// Draws the props if they were placed for the terrain of _params.
+	// Chunks farther than _distance from the camera are skipped.
+	void render(const PlanetParameters& _params, const RenderState& _state, float _distance);
+	const ScatterStatistics& getStatistics() const { return statistics; }
+
+	// Everything the props of _params depend on.
+	static uint64_t cacheKey(const PlanetParameters& _params, const ScatterSettings& _settings);
+
+	// CPU part of a build, no GL calls. Places the props of every chunk with
+	// tasks on _jobs. Returns false if cancelled.
+	static bool place(const PlanetParameters& _params, const ScatterSettings& _settings,
+		const PlanetQuery& _query, const ClimateMap& _climate, JobSystem& _jobs, const CancelToken& _cancel,
+		std::vector<PropChunk>& _chunks, std::vector<PropInstance>& _instances);
+
+private:
+	struct Build;
+
+	void createMeshes();
+	void upload(Build& _build);
+	void clear();
+
+	Shader prop_shader;
+	GLuint vao[PROP_KIND_COUNT];
+	GLuint mesh_buffer[PROP_KIND_COUNT];
+	GLuint index_buffer[PROP_KIND_COUNT];
+	GLsizei index_count[PROP_KIND_COUNT];
+	GLuint instance_buffer;
+
+	// What is in instance_buffer
+	std::vector<PropChunk> chunks;
+	uint64_t built_key;
+	uint64_t built_terrain; // positions are valid for planets with the same terrain
+	int built_layers;
+	float core_radius;      // lowest terrain, hides the chunks behind it
+
+	uint64_t building_key; // of task, 0 if none
+	CancelToken cancel;
+	TaskRef task;
+
+	ScatterStatistics statistics;
+	std::vector<int> visible;
+	std::vector<int> visible_layers;
+
+	GLint loc_P, loc_V, loc_M;
+	GLint loc_prop_size, loc_prop_color, loc_light_position, loc_light_intensity;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "GLFW/glfw3.h"
+
+// Decides whether the next frame has to be drawn at all. In on-demand mode
+// the render loop sleeps in glfwWaitEventsTimeout and only draws after input,
+// a window change or while something animates. Skipped frames are not
+// swapped, so the window keeps showing the last image at no cost.
+class RedrawTracker
+{
+public:
+	RedrawTracker();
+
+	// Chains onto the window callbacks, install after ImGui so its handlers still run.
+	void attach(GLFWwindow* _window);
+
+	// Polls events, or sleeps until one arrives when nothing needs drawing.
+	// Returns true if a frame should be drawn.
+	bool waitForFrame(bool _animating);
+
+	// Asks for a frame even without input, e.g. after loading a preset.
+	void requestRedraw();
+
+	bool on_demand;
+	double idle_timeout;     // seconds between wake ups while idle
+	int settle_frames;       // frames drawn after the last event, lets ImGui and reprojection settle
+
+	int getFramesDrawn() const { return frames_drawn; }
+	int getFramesSkipped() const { return frames_skipped; }
+
+private:
+	static void onEvent();
+
+	static void mouseButtonCallback(GLFWwindow* _window, int _button, int _action, int _mods);
+	static void scrollCallback(GLFWwindow* _window, double _x, double _y);
+	static void keyCallback(GLFWwindow* _window, int _key, int _scancode, int _action, int _mods);
+	static void charCallback(GLFWwindow* _window, unsigned int _c);
+	static void cursorPosCallback(GLFWwindow* _window, double _x, double _y);
+	static void framebufferSizeCallback(GLFWwindow* _window, int _w, int _h);
+	static void refreshCallback(GLFWwindow* _window);
+	static void focusCallback(GLFWwindow* _window, int _focused);
+
+	int pending_frames;
+	int frames_drawn;
+	int frames_skipped;
+};
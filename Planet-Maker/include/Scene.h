@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Parameters.h"
+
+// One planet placed in a scene.
+struct Planet
+{
+	std::string name;
+	PlanetParameters params;
+
+	glm::vec3 position = glm::vec3(0.0f);
+	float scale = 1.0f;
+	float spin = 0.0f; // rotation around the planet's own y axis, radians
+
+	glm::mat4 modelMatrix() const;
+	// Sphere around all layers, in scene units.
+	float boundingRadius() const;
+};
+
+// A set of planets drawn together, e.g. a solar system or a catalogue wall.
+// The renderer uploads the planets again whenever getVersion() changes, so
+// call touch() after editing planets in place.
+class Scene
+{
+public:
+	Scene();
+
+	int add(const Planet& _planet);
+	void remove(int _index);
+	void clear();
+
+	int size() const { return (int)planets.size(); }
+	bool empty() const { return planets.empty(); }
+	Planet& get(int _index) { return planets[_index]; }
+	const Planet& get(int _index) const { return planets[_index]; }
+	const std::vector<Planet>& getPlanets() const { return planets; }
+
+	void touch() { ++version; }
+	unsigned int getVersion() const { return version; }
+
+	// Catalogue wall: _count variations of _base with consecutive seeds,
+	// on a square grid in the xy plane centered at the origin.
+	void layoutGrid(const PlanetParameters& _base, int _count, float _spacing);
+	// Solar system: a large planet at the origin and _count - 1 smaller ones
+	// on rings around it in the xz plane.
+	void layoutOrbits(const PlanetParameters& _base, int _count);
+
+private:
+	std::vector<Planet> planets;
+	unsigned int version;
+};
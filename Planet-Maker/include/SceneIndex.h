@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+
+// The six clip planes of a view-projection matrix, normals pointing inwards.
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	static Frustum fromMatrix(const glm::mat4& _viewProjection);
+
+	bool intersectsSphere(const glm::vec3& _center, float _radius) const;
+	bool intersectsBox(const glm::vec3& _min, const glm::vec3& _max) const;
+};
+
+// Loose uniform grid over the planets of a scene. Every planet sits in the
+// cell of its center and each cell box is grown by the largest planet radius,
+// so a frustum query only tests the spheres of cells that are (partly) in view.
+class SceneIndex
+{
+public:
+	SceneIndex();
+
+	// Rebuilds the grid if the scene changed since the last call.
+	void update(const Scene& _scene);
+
+	// Planet indices whose bounding sphere touches the frustum, in scene space.
+	void query(const Frustum& _frustum, std::vector<int>& _visible) const;
+
+	const glm::vec3& getCenter(int _planet) const { return centers[_planet]; }
+	float getRadius(int _planet) const { return radii[_planet]; }
+
+private:
+	struct Cell
+	{
+		glm::vec3 min, max;
+		std::vector<int> planets;
+	};
+
+	const Scene* indexed_scene;
+	unsigned int indexed_version;
+
+	std::vector<glm::vec3> centers;
+	std::vector<float> radii;
+	std::vector<Cell> cells; // only cells with planets
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Framebuffer.h"
+#include "Parameters.h"
+
+class PlanetRenderer;
+struct RenderState;
+
+// Grid of candidate planets around the current one, rendered into an atlas
+// so a seed can be picked by looking instead of stepping a slider. The
+// candidates are the base parameters with consecutive seed offsets and, for
+// a jitter above zero, a random spread of the frequencies, the elevation and
+// the cloud opacity.
+//
+// Cells are rendered progressively: every candidate at the coarsest level
+// first, then each finer level over the last one, as many cells per frame as
+// the GPU timings of earlier frames say fit into budget_ms. A level covers
+// the lower left corner of its cell, the finest one all of it.
+class SeedExplorer
+{
+public:
+	static const int LEVEL_COUNT = 4; // 1/8, 1/4, 1/2 and all of the cell size
+
+	SeedExplorer();
+	~SeedExplorer();
+
+	void init(int _atlasSize = 2048, int _cellSize = 128);
+
+	// Replaces the candidates with _count variations of _base, seed offsets
+	// from _firstSeed on. _jitter 0..1 scales the spread of the other values,
+	// a candidate's spread only depends on its seed offset.
+	void generate(const PlanetParameters& _base, int _count, int _firstSeed, float _jitter);
+
+	// Renders the next cells with _renderer, lit like _state. Leaves the
+	// framebuffer and viewport as they were. Must not run inside another
+	// GL_TIME_ELAPSED query, e.g. call it after DynamicResolution::end().
+	void update(PlanetRenderer& _renderer, const RenderState& _state);
+
+	bool isDone() const { return next_level >= LEVEL_COUNT; }
+	int getCount() const { return (int)cells.size(); }
+	int getCapacity() const { return cells_per_row * cells_per_row; }
+	const PlanetParameters& getCandidate(int _index) const { return cells[_index].params; }
+	// Copies what the explorer varied for candidate _index into _params: the
+	// seeds, and the jittered values if the grid has jitter. The rest of
+	// _params stays, it may have been edited since generate().
+	void adopt(int _index, PlanetParameters& _params) const;
+	int getSeedOffset(int _index) const { return first_seed + _index; }
+
+	// Finest level rendered so far, -1 for none.
+	int getLevel(int _index) const { return cells[_index].level; }
+	int getLevelSize(int _level) const { return cell_size >> (LEVEL_COUNT - 1 - _level); }
+	GLuint getTexture() const { return atlas.colorTexture; }
+	// Atlas coordinates of the finest level of a cell, lower left and upper right corner.
+	void getRect(int _index, glm::vec2& _min, glm::vec2& _max) const;
+
+	// Planets per second of GPU time at _level, 0 until measured.
+	float getThroughput(int _level) const;
+	// Wall clock seconds since generate(), stops once every level is done.
+	double getElapsed() const;
+
+	float budget_ms;
+
+private:
+	struct Cell
+	{
+		PlanetParameters params;
+		int level = -1;
+	};
+
+	void renderCell(PlanetRenderer& _renderer, const RenderState& _state, int _index, int _level);
+	void readTimers();
+
+	Framebuffer atlas;
+	int cell_size;
+	int cells_per_row;
+
+	std::vector<Cell> cells;
+	int first_seed;
+	float jitter;
+	int next_cell;
+	int next_level;
+
+	std::chrono::steady_clock::time_point started;
+	std::chrono::steady_clock::time_point finished;
+
+	// One query per frame, each frame renders cells of a single level
+	GLuint timer_queries[2];
+	bool timer_pending[2];
+	int timer_level[2];
+	int timer_renders[2];
+	int frame;
+
+	double level_ms[LEVEL_COUNT];
+	int level_renders[LEVEL_COUNT];
+};
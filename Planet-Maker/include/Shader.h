@@ -14,6 +14,10 @@ class Shader {
 public:
 	GLuint programID;
 
+	// Inserted right after the #version line of every stage, e.g. "#define INSTANCED\n".
+	// Set before calling createShader().
+	std::string defines;
+
 	Shader();
 	Shader(const char *vertexFilePath, const char *fragmentFilePath);
 	~Shader();
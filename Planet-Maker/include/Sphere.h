@@ -2,6 +2,8 @@
 #include "Gl/glew.h"
 #include "glm/glm.hpp"
 
+#include "StreamBuffer.h"
+
 class Sphere {
 public:
 
@@ -15,21 +17,50 @@ public:
 		m_indexbuffer = 0;
 		p_vertexarray = nullptr;
 		p_indexarray = nullptr;
+		p_stream = nullptr;
+		m_index_offset = 0;
 		m_nverts = 0;
 		m_ntris = 0;
 	};
 	void setRadius(float r) { m_radius = r; }
 	void createSphere(float m_radius, int m_segments);
+
+	// createSphere() in two steps: buildArrays() makes no GL calls and may
+	// run on a worker thread, upload() creates the buffers in the current context.
+	void buildArrays(float m_radius, int m_segments);
+	void upload();
+	// upload() without the copy: allocate() creates empty buffers of the right
+	// size for the caller to fill, e.g. through an UploadRing, and
+	// releaseArrays() frees the arrays once that is done.
+	void allocate();
+	void releaseArrays();
+
+	// Vertex and index counts of a sphere with the given segments.
+	static void countElements(int segments, int& nverts, int& ntris);
+	// buildArrays() into memory of the caller, e.g. a StreamAllocation. No GL calls.
+	static void writeArrays(float radius, int segments, GLfloat* vertices, GLuint* indices);
+	// Draws from a StreamBuffer allocation that writeArrays() filled: vertices at
+	// its start, indices indexOffset bytes in. The allocation is released in clean().
+	void useStream(StreamBuffer* stream, const StreamAllocation& allocation, size_t indexOffset, float radius, int segments);
 	void clean();
 	void render();
+	void renderInstanced(int _count);
 
 	float getRadius() const { return m_radius; }
+	GLuint getVertexBuffer() const { return m_vertexbuffer; }
+	GLuint getIndexBuffer() const { return m_indexbuffer; }
+	const GLfloat* getVertexArray() const { return p_vertexarray; }
+	const GLuint* getIndexArray() const { return p_indexarray; }
+	size_t getVertexBytes() const { return 8 * m_nverts * sizeof(GLfloat); }
+	size_t getIndexBytes() const { return 3 * m_ntris * sizeof(GLuint); }
 	glm::vec3* getPosition() { return &m_position; }
 	void setPosition(glm::vec3 pos) { m_position = pos; }
 
 	glm::vec3 m_position;
 
 private:
+	void createBuffers(const GLfloat* vertices, const GLuint* indices);
+
 	GLuint m_vao;          // Vertex array object, the main handle for geometry
 	int m_nverts; // Number of vertices in the vertex array
 	int m_ntris;  // Number of triangles in the index array (may be zero)
@@ -38,5 +69,9 @@ private:
 	GLfloat* p_vertexarray; // Vertex array on interleaved format: x y z nx ny nz s t
 	GLuint* p_indexarray;   // Element index array
 
+	StreamBuffer* p_stream; // Owner of the vertices and indices if drawn from a stream, else nullptr
+	StreamAllocation m_stream_allocation;
+	size_t m_index_offset;  // Byte offset of the indices in the element array buffer
+
 	float m_radius;
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// A piece of a StreamBuffer. pointer is persistently mapped, any thread may
+// write it until the main thread issues the first draw that reads it.
+struct StreamAllocation
+{
+	size_t offset = 0; // in the buffer
+	size_t size = 0;
+	uint8_t* pointer = nullptr;
+};
+
+// One large GL buffer, allocated with glBufferStorage and mapped once,
+// persistent and coherent, from which dynamic vertex and index data is
+// suballocated like a ring. Workers write their data straight into the
+// mapping and the draws read it where it is: no glBufferData, no orphaning
+// and no copy by the driver.
+//
+// Allocations may be released in any order, their space comes back in ring
+// order once the GPU passed the fence of the frame that released them.
+// Nothing ever waits: allocate() fails while the ring is full, and the caller
+// falls back to its own buffers. Needs ARB_buffer_storage, init() fails without it.
+// Main thread only, except for writing through StreamAllocation::pointer.
+class StreamBuffer
+{
+public:
+	StreamBuffer();
+	~StreamBuffer();
+
+	bool init(size_t _capacity = 32 * 1024 * 1024);
+	void clean();
+
+	// Reserves _size bytes at a multiple of _alignment. False if there is no room.
+	bool allocate(size_t _size, size_t _alignment, StreamAllocation& _allocation);
+	// The GPU may still read it in the current frame, it is reused after that frame's fence.
+	void release(const StreamAllocation& _allocation);
+
+	// Fences the releases since the last call and reclaims the space of every
+	// fence the GPU passed, once per frame.
+	void endFrame();
+
+	bool isAvailable() const { return mapped != nullptr; }
+	GLuint getBuffer() const { return buffer; }
+	size_t getCapacity() const { return capacity; }
+	size_t getUsed() const { return used; }
+
+private:
+	// Allocations in ring order
+	struct Block
+	{
+		size_t begin;
+		size_t end;
+		size_t bytes;      // taken from the ring, with the gap up to the next block
+		uint64_t released; // frame of the release, NOT_RELEASED while in use
+	};
+
+	struct Frame
+	{
+		GLsync fence;
+		uint64_t frame;
+	};
+
+	static const uint64_t NOT_RELEASED = ~0ull;
+
+	void reclaim();
+
+	GLuint buffer;
+	uint8_t* mapped;
+	size_t capacity;
+
+	size_t head; // end of the newest block
+	size_t used; // bytes of every block, including alignment and skipped ends
+
+	std::deque<Block> blocks;
+	std::deque<Frame> frames; // fenced frames with releases, oldest first
+	uint64_t frame;           // frame that releases count toward
+	uint64_t completed;       // last fenced frame the GPU passed
+	bool frame_released;      // anything released since the last fence
+};
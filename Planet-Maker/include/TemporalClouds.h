@@ -0,0 +1,63 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Framebuffer.h"
+#include "Parameters.h"
+
+struct RenderState;
+
+// Cloud layer that only evaluates the noise for one pixel in 4 (2x2) or
+// 16 (4x4) per frame, following a Bayer pattern. The other pixels are
+// reprojected from the previous frame using last frame's camera and planet
+// rotation. The result is kept in a history target and blended over the
+// scene afterwards.
+class TemporalClouds
+{
+public:
+	TemporalClouds();
+	~TemporalClouds();
+
+	void init();
+	void loadShaders();
+
+	// Draws the clouds into the currently bound framebuffer and viewport.
+	// _model is the model matrix of the cloud shell.
+	void render(const PlanetParameters& _params, const RenderState& _state, const glm::mat4& _model);
+
+	// Forces every pixel to be evaluated on the next frame.
+	void invalidate() { history_valid = false; }
+
+private:
+	bool parametersChanged(const PlanetParameters& _params, const RenderState& _state);
+	void lookupUniforms();
+
+	Shader cloud_shader;
+	Shader composite_shader;
+	GLuint vao;
+
+	// Written and read alternately, [frame & 1] is written this frame
+	Framebuffer history[2];
+	bool history_valid;
+	int frame;
+
+	glm::mat4 previous_view_projection;
+	glm::mat4 previous_model;
+	glm::vec3 previous_camera;
+
+	// Last values that affect the clouds other than time and view
+	float cloud_key[11];
+
+	// __________ CLOUDS ______________
+	GLint loc_method, loc_time, loc_speed, loc_seed, loc_octaves, loc_frequency, loc_opacity, loc_color;
+	GLint loc_inverse_view_projection, loc_inverse_model, loc_camera_position;
+	GLint loc_shell_radius, loc_core_radius, loc_lod_pixel_angle;
+	GLint loc_history, loc_history_valid;
+	GLint loc_previous_view_projection, loc_previous_model, loc_previous_camera;
+	GLint loc_pattern_size, loc_phase;
+
+	// __________ COMPOSITE ______________
+	GLint loc_composite_clouds;
+};
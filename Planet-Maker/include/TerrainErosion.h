@@ -0,0 +1,129 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "CubeHeightmap.h"
+#include "JobSystem.h"
+#include "Parameters.h"
+
+class BakeCache;
+
+struct ErosionSettings
+{
+	// Relief the slopes are simulated at, like terrain_elevation but fixed so
+	// the elevation slider does not restart the simulation
+	float relief = 0.1f;
+
+	// __________ HYDRAULIC (droplets) ______________
+	float droplets_per_texel = 1.0f / 32.0f; // per iteration
+	int droplet_lifetime = 24; // steps of at most one texel, below TILE_HALO
+	float inertia = 0.05f;
+	float capacity = 4.0f;
+	float min_capacity = 0.01f;
+	float erode_speed = 0.3f;
+	float deposit_speed = 0.3f;
+	float evaporate_speed = 0.02f;
+	float gravity = 4.0f;
+
+	// __________ THERMAL ______________
+	int thermal_passes = 2; // per iteration
+	float talus = 0.8f;     // steepest stable slope, height per texel
+	float thermal_rate = 0.2f;
+};
+
+// Hydraulic and thermal erosion of a CubeHeightmap, on all six faces.
+//
+// An iteration splits every face into tiles that tasks erode independently:
+// each copies its tile plus a halo from the front grid into a local buffer
+// (halos past a face edge are sampled from the neighbouring face), runs
+// droplets that start in the tile and thermal passes over it, and writes only
+// the tile back, into the back grid. The grids then swap. Droplets never
+// leave the halo, and the tile grid is shifted by half a tile every other
+// iteration so seams do not line up. Grids are plain float arrays and the
+// thermal passes run branch free over whole rows.
+//
+// The simulation runs in noise units scaled by relief and resolution, so a
+// texel's slope is the slope on a planet of that relief.
+class TerrainErosion
+{
+public:
+	static const int TILE_SIZE = 128;
+	static const int TILE_HALO = 32;
+
+	TerrainErosion();
+
+	// _heightmap is resampled if its resolution differs.
+	void init(const CubeHeightmap& _heightmap, int _resolution, const ErosionSettings& _settings);
+	// One iteration over every tile. Returns false if cancelled, the grid is then unchanged.
+	bool iterate(JobSystem& _jobs, const CancelToken& _cancel = CancelToken());
+	// Eroded minus baked height of every texel of a face, in noise units.
+	void getDelta(int _face, float* _delta) const;
+
+	int getResolution() const { return resolution; }
+	int getIterations() const { return iterations; }
+
+private:
+	void erodeTile(int _face, int _originX, int _originY, uint32_t _seed, std::vector<float>& _tile, std::vector<float>& _scratch);
+	void fillTile(int _face, int _originX, int _originY, int _size, float* _tile) const;
+	float sampleFront(const glm::vec3& _direction) const;
+
+	int resolution;
+	int iterations;
+	float height_scale; // noise units to simulation units
+	ErosionSettings settings;
+
+	std::vector<float> baked; // the heightmap, noise units
+	std::vector<float> front; // current state, simulation units
+	std::vector<float> back;
+};
+
+// Runs a TerrainErosion in tasks of JobSystem::global() while the frame goes
+// on, and keeps a cube map texture of its delta for the terrain shader. A
+// restart cancels the running simulation, which finishes its iteration on
+// its own copy and is freed by its last task.
+class BackgroundErosion
+{
+public:
+	BackgroundErosion();
+	~BackgroundErosion();
+
+	// Bakes the heightmap of _params (through _cache if not nullptr) and
+	// erodes it until _iterations are done. Keeps the running simulation if
+	// neither its heightmap nor the settings differ.
+	void start(const PlanetParameters& _params, int _resolution, int _iterations,
+		const ErosionSettings& _settings, BakeCache* _cache);
+	void stop();
+
+	// Main thread, once per frame. Uploads the simulation to the texture at
+	// most every upload_interval seconds and keeps it iterating.
+	// True if the texture changed.
+	bool update(double _time);
+
+	bool isRunning() const;
+	// 0 until the first upload
+	GLuint getTexture() const { return texture; }
+	int getIterations() const { return uploaded_iterations; }
+	int getTargetIterations() const;
+	double getIterationsPerSecond() const { return iterations_per_second; }
+
+	double upload_interval;
+
+private:
+	struct Job;
+
+	void startIteration();
+	void upload();
+
+	std::shared_ptr<Job> job;
+	uint64_t job_key;
+
+	double iterations_per_second;
+	double last_upload;
+	int uploaded_iterations;
+
+	GLuint texture;
+	int texture_resolution;
+	std::vector<float> delta;
+};
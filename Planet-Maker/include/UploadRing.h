@@ -0,0 +1,55 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Staging memory for filling static GL buffers a piece at a time. Data is
+// written into a mapped ring and copied into the target buffer on the GPU,
+// so the driver neither copies client memory nor waits for the target.
+//
+// Each frame's part of the ring is fenced in endFrame() and only reused once
+// the GPU passed the fence. upload() never waits: when the ring is full it
+// takes fewer bytes and the caller continues next frame. The ring stays
+// mapped persistently with ARB_buffer_storage, older contexts map the range
+// being written unsynchronized, which the fences make safe.
+class UploadRing
+{
+public:
+	UploadRing();
+	~UploadRing();
+
+	void init(size_t _capacity = 8 * 1024 * 1024);
+	void clean();
+
+	// Copies the first bytes of _data, at most _size, to _offset of _target.
+	// Returns how many were taken, 0 while the GPU still reads the whole ring.
+	size_t upload(GLuint _target, size_t _offset, const void* _data, size_t _size);
+
+	// Fences the bytes written since the last call, once per frame.
+	void endFrame();
+
+	bool isPersistent() const { return mapped != nullptr; }
+	size_t getCapacity() const { return capacity; }
+	size_t getUsed() const { return used; }
+
+private:
+	struct Region
+	{
+		GLsync fence;
+		size_t end;   // head when the region was fenced
+		size_t bytes; // written in that frame
+	};
+
+	void retire();
+
+	GLuint buffer;
+	uint8_t* mapped; // persistent mapping, nullptr without ARB_buffer_storage
+	size_t capacity;
+
+	size_t head;  // next byte to write
+	size_t tail;  // first byte the GPU may still read
+	size_t used;  // bytes between tail and head, including this frame's
+	size_t frame_bytes;
+	std::deque<Region> regions;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Bounded blocking queue connecting two pipeline stages. Producers block when
+// the queue is full, consumers block until an item arrives or the queue is
+// closed and drained.
+template <typename T>
+class WorkQueue
+{
+public:
+	explicit WorkQueue(size_t _capacity = 16) : capacity(_capacity), closed(false) {}
+
+	// Returns false if the queue was closed before the item could be added.
+	bool push(T _item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+		if (closed)
+			return false;
+
+		items.push_back(std::move(_item));
+		not_empty.notify_one();
+		return true;
+	}
+
+	// Returns false once the queue is closed and empty.
+	bool pop(T& _item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this] { return closed || !items.empty(); });
+		if (items.empty())
+			return false;
+
+		_item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	// Non blocking variant of pop.
+	bool tryPop(T& _item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+			return false;
+
+		_item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return items.size();
+	}
+
+private:
+	std::deque<T> items;
+	size_t capacity;
+	bool closed;
+
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+};
@@ -22,10 +22,15 @@ public:
 	~glfwContext();
 
 	void init(int _w, int _h, const char* _wName);
+	// Creates _count invisible windows, one GL context each, for offscreen work.
+	// No context is left current on the calling thread.
+	bool initHeadless(int _count, int _w, int _h);
 
 	void printGLInfo();
 
 	void getCurrentWindow(GLFWwindow* &_window);
+	GLFWwindow* getWindow(int _index);
+	int getWindowCount() const { return (int)window.size(); }
 
 	GLFWwindow* currentWindow;
 
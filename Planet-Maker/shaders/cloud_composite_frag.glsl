@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform sampler2D clouds;
+
+out vec4 color;
+
+void main() {
+  // Premultiplied, blended with GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+  color = texture(clouds, uv);
+}
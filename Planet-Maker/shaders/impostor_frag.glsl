@@ -0,0 +1,15 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform sampler2D atlas;
+
+out vec4 color;
+
+void main() {
+  color = texture(atlas, uv);
+
+  // Keep the empty corners out of the depth buffer
+  if (color.a < 0.01)
+    discard;
+}
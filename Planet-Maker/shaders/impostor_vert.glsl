@@ -0,0 +1,22 @@
+#version 330 core
+
+// Camera facing quad per planet, see ImpostorCache.
+
+layout(location = 0) in vec4 center_radius; // world space, per instance
+layout(location = 1) in vec4 atlas_rect;    // u, v, width, height, per instance
+
+uniform mat4 V;
+uniform mat4 P;
+
+out vec2 uv;
+
+void main(){
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+  // The bake camera looks along the view axis with the same up vector, so
+  // a quad in view space lines up with the baked image
+  vec4 center = V * vec4(center_radius.xyz, 1.0);
+  gl_Position = P * (center + vec4((corner * 2.0 - 1.0) * center_radius.w, 0.0, 0.0));
+
+  uv = atlas_rect.xy + corner * atlas_rect.zw;
+}
@@ -466,6 +466,15 @@ uniform float shininess;
 
 // procedural
 uniform float speed;
+#ifdef INSTANCED
+flat in int instance;
+#define seed planets[instance].ocean_noise.y
+#define octaves planets[instance].ocean_noise.z
+#define frequency planets[instance].ocean.x
+#define noise_method planets[instance].noise.x
+#define color_1 planets[instance].ocean_color_1.rgb
+#define color_2 planets[instance].ocean_color_2.rgb
+#else
 uniform int seed;
 uniform int octaves;
 uniform float frequency;
@@ -474,6 +483,10 @@ uniform int noise_method;
 
 uniform vec3 color_1;
 uniform vec3 color_2;
+#endif
+
+// Fade out the octaves finer than a pixel
+uniform bool octave_lod = false;
 
 out vec4 color;
 
@@ -488,16 +501,28 @@ float generate_noise(vec3 v)
     return cellular(v).x;   
 }
 
+// Octaves of the fBm, at frequency * (o + 1), that a footprint still
+// resolves with two samples per wavelength. Fractional, the weight of
+// octave o is clamp(lod - o), so the last one fades out.
+float octave_limit(float footprint)
+{
+  return 0.5 / (max(footprint, 1e-7) * frequency);
+}
+
 void main() {
 
   vec3 diffuse_color;
   float opacity = 0.6;
   float noise = generate_noise(frequency * vec3(pos + seed));
 
+  float lod = 1e6;
+  if(octave_lod)
+    lod = octave_limit(max(length(dFdx(pos)), length(dFdy(pos))));
+
   // 1th to (n-1):th octave
-  for(float o = 1.0; o < octaves; o++)
+  for(float o = 1.0; o < octaves && o < lod; o++)
   {
-    noise += 1.0 / (pow(2, o)) * generate_noise((o + 1.0) * frequency * vec3(pos + seed));
+    noise += clamp(lod - o, 0.0, 1.0) / (pow(2, o)) * generate_noise((o + 1.0) * frequency * vec3(pos + seed));
   }
 
   diffuse_color = mix(color_1, color_2, noise);
@@ -3,12 +3,20 @@
 layout(location = 0) in vec3 Position;
 layout(location = 1) in vec3 Normal;
 
-uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
 
+#ifdef INSTANCED
+flat out int instance;
+#define M (scene_model * planets[instance].model)
+#define radius planets[instance].terrain.x
+#define elevationModifier planets[instance].terrain.y
+#else
+uniform mat4 M;
+
 uniform float radius;
 uniform float elevationModifier;
+#endif
 
 out vec3 interpolatedNormal;
 
@@ -16,6 +24,10 @@ out vec3 pos;
 out vec3 cam_pos;
 
 void main(){
+#ifdef INSTANCED
+  instance = int(instance_list[instance_offset + gl_InstanceID]);
+#endif
+
   float height = 0.01;
 
   pos = Position + radius * Normal;
@@ -0,0 +1,11 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform vec3 overdraw_color;
+
+out vec4 color;
+
+void main() {
+  color = vec4(overdraw_color, 1.0);
+}
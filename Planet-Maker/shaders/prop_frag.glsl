@@ -0,0 +1,26 @@
+#version 330 core
+
+in vec3 world_position;
+in vec3 world_normal;
+in float tint;
+
+uniform vec3 prop_color;
+
+// Light
+uniform vec3 light_pos;
+uniform float light_intensity;
+
+out vec4 color;
+
+void main() {
+
+  vec3 normal = normalize(world_normal);
+  vec3 s = normalize(light_pos - world_position);
+
+  float ambient = 0.35;
+  float diffuse = 0.65 * max(dot(s, normal), 0.0) * light_intensity;
+
+  // Neighbouring props differ a little in brightness
+  vec3 diffuse_color = prop_color * (0.8 + 0.4 * tint);
+  color = vec4(diffuse_color * (ambient + diffuse), 1.0);
+}
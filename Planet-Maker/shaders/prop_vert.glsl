@@ -0,0 +1,40 @@
+#version 330 core
+
+// Props of PropScatter, one instance per prop. The mesh stands on +y with
+// a height of about one, the instance puts it on the terrain.
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec3 instance_position; // planet space, on the terrain
+layout(location = 3) in uint instance_packed;   // yaw, scale and tint, 8 bits each
+
+uniform mat4 M;
+uniform mat4 V;
+uniform mat4 P;
+
+uniform float prop_size; // planet radii
+
+out vec3 world_position;
+out vec3 world_normal;
+out float tint;
+
+void main(){
+
+  float yaw = float(instance_packed & 255u) * (6.2831853 / 256.0);
+  float scale = prop_size * (0.6 + 0.8 / 255.0 * float((instance_packed >> 8) & 255u));
+  tint = float((instance_packed >> 16) & 255u) / 255.0;
+
+  // Up along the planet normal, turned by the yaw around it
+  vec3 up = normalize(instance_position);
+  vec3 axis = abs(up.z) < 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+  vec3 tangent = normalize(cross(axis, up));
+  vec3 bitangent = cross(up, tangent);
+  vec3 side = cos(yaw) * tangent + sin(yaw) * bitangent;
+  mat3 frame = mat3(side, up, cross(side, up));
+
+  vec4 world = M * vec4(instance_position + scale * (frame * Position), 1.0);
+  world_position = world.xyz;
+  world_normal = mat3(M) * (frame * Normal);
+
+  gl_Position = P * V * world;
+}
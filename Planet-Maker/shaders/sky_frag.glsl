@@ -458,16 +458,30 @@ vec2 cellular(vec3 P) {
 in vec3 interpolatedNormal;
 in vec3 pos;
 
-uniform int noise_method;
-
 uniform float time;
 uniform float speed;
+
+#ifdef INSTANCED
+flat in int instance;
+#define noise_method planets[instance].noise.x
+#define seed planets[instance].sky_noise.y
+#define octaves planets[instance].sky_noise.z
+#define frequency planets[instance].sky.x
+#define opacity planets[instance].sky.y
+#define sky_color planets[instance].sky_color.rgb
+#else
+uniform int noise_method;
+
 uniform int seed;
 uniform int octaves;
 uniform float frequency;
 uniform float opacity;
 
 uniform vec3 sky_color;
+#endif
+
+// Fade out the octaves finer than a pixel
+uniform bool octave_lod = false;
 
 out vec4 color;
 
@@ -482,6 +496,14 @@ float generate_noise(vec3 v)
     return cellular(v).x;   
 }
 
+// Octaves of the fBm, at frequency * (o + 1), that a footprint still
+// resolves with two samples per wavelength. Fractional, the weight of
+// octave o is clamp(lod - o), so the last one fades out.
+float octave_limit(float footprint)
+{
+  return 0.5 / (max(footprint, 1e-7) * frequency);
+}
+
 void main() {
 
   vec3 diffuse_color = sky_color;
@@ -490,10 +512,14 @@ void main() {
 
   float noise = generate_noise(frequency*vec3(pos + seed + 0.01 * speed * time));
 
+  float lod = 1e6;
+  if(octave_lod)
+    lod = octave_limit(max(length(dFdx(pos)), length(dFdy(pos))));
+
   // 1th to (n-1):th octave
-  for(float o = 1.0; o < octaves; o++)
+  for(float o = 1.0; o < octaves && o < lod; o++)
   {
-    noise += 1.0 / (pow(2, o)) * generate_noise((o + 1.0) * frequency * vec3(pos + seed + 0.01 * speed * time));
+    noise += clamp(lod - o, 0.0, 1.0) / (pow(2, o)) * generate_noise((o + 1.0) * frequency * vec3(pos + seed + 0.01 * speed * time));
   }
 
   opac = noise;
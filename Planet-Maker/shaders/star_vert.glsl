@@ -12,5 +12,6 @@ void main(){
 
   pos = Position;
 
-  gl_Position = (P * V * M) * vec4(pos, 1.0);
+  // z = w puts the stars on the far plane, drawn with GL_LEQUAL after the planet
+  gl_Position = ((P * V * M) * vec4(pos, 1.0)).xyww;
 }
\ No newline at end of file
@@ -463,11 +463,25 @@ in float height;
 
 in vec3 camPos;
 in vec3 pos;
+in vec3 surface_direction;
 
 uniform float light_intensity;
 uniform vec3 light_pos;
 uniform float shininess;
 
+#ifdef INSTANCED
+flat in int instance;
+#define color_deep planets[instance].color_deep.rgb
+#define color_beach planets[instance].color_beach.rgb
+#define color_grass planets[instance].color_grass.rgb
+#define color_rock planets[instance].color_rock.rgb
+#define color_snow planets[instance].color_snow.rgb
+#define seed planets[instance].noise.y
+#define frag_frequency planets[instance].terrain.w
+#define octaves planets[instance].noise.z
+#define noise_method planets[instance].noise.x
+#define slope_scale (planets[instance].terrain.y / (1.0 + planets[instance].terrain.x))
+#else
 uniform vec3 color_deep; // water color of the planet
 uniform vec3 color_beach; // beach color of the planet
 uniform vec3 color_grass; // grass color of the planet
@@ -481,45 +495,47 @@ uniform int octaves;
 
 uniform int noise_method;
 
+// Temperature, moisture and slope, see ClimateMap. Scenes have none.
+uniform samplerCube climate_map;
+uniform bool climate_enabled = false;
+uniform float slope_scale; // terrain_elevation / planet radius
+#endif
+
+// Beach, grass, rock and snow weights by temperature (x) and moisture (y), see build_biome_lut()
+uniform sampler2D biome_lut;
+
 out vec4 color;
 
-float generate_noise(vec3 v)
+// Same as estimate_climate() in ClimateMap.cpp, latitude and height only
+vec3 estimate_climate(vec3 direction, float elevation)
 {
-	// perlin
-	if(noise_method == 0)
-		return cnoise(v);
-	else if(noise_method == 1)
-		return snoise(v);
-	else if(noise_method == 2)
-		return cellular(v).x;		
+  float temperature = clamp(sqrt(max(1.0 - direction.z * direction.z, 0.0)) - max(elevation, 0.0), 0.0, 1.0);
+  float moisture = clamp(0.7 - 0.6 * elevation, 0.0, 1.0);
+  return vec3(temperature, moisture, 0.0);
 }
 
 void main() {
 
-  vec3 watermix;
-  vec3 groundmix;
-  vec3 mountainmix;
-
-  vec3 diffusecolor;
-
-  // height: goes from 0 to 1
-  float int_dir = 0.02;
+  vec3 climate;
+#ifdef INSTANCED
+  climate = estimate_climate(surface_direction, height);
+#else
+  if(climate_enabled)
+    climate = texture(climate_map, surface_direction).rgb;
+  else
+    climate = estimate_climate(surface_direction, height);
+#endif
 
-  vec3 c_d = color_deep - 0.05 * generate_noise(1300.0 * pos + seed);
-  vec3 c_b = color_beach - 0.05 * generate_noise(100.0 * pos + seed);
-  vec3 c_g = color_grass - 0.1 * generate_noise(1060.0 * pos + seed);
-  vec3 c_r = color_rock - 0.3 * generate_noise(400.0 * pos + seed);
-  vec3 c_s = color_snow - 0.1 * generate_noise(40.0 * pos + seed);
+  // Same as PlanetSurface::terrainColor()
+  vec4 biome = texture(biome_lut, climate.xy);
+  vec3 land = biome.x * color_beach + biome.y * color_grass + biome.z * color_rock + biome.w * color_snow;
 
-  float beach = smoothstep(0.0,0.1,height);
-  float grass = smoothstep(0.0,0.3,height);
-  float rock = smoothstep(0.2,0.5,height);
-  float snow = smoothstep(0.7, 0.85, height);
+  float steep = smoothstep(0.6, 1.2, climate.z * slope_scale);
+  land = mix(land, color_rock, steep * (1.0 - biome.w));
 
-  diffusecolor = mix(c_d, c_b, beach);
-  diffusecolor = mix(diffusecolor, c_g, grass);
-  diffusecolor = mix(diffusecolor, c_r, rock);
-  diffusecolor = mix(diffusecolor, c_s, snow);
+  float sand = 1.0 - smoothstep(0.05, 0.2, height);
+  land = mix(land, color_beach, sand * (1.0 - biome.w));
 
-  color = vec4(diffusecolor,1.0);
-}
\ No newline at end of file
+  float coast = smoothstep(0.0, 0.1, height);
+  color = vec4(mix(color_deep, land, coast), 1.0);
+}
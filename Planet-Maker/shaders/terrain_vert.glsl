@@ -462,10 +462,22 @@ vec2 cellular(vec3 P) {
 layout(location = 0) in vec3 Position;
 layout(location = 1) in vec3 Normal;
 
-uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
 
+#ifdef INSTANCED
+// Per planet values come from the planet buffer, see PlanetRenderer::renderScene()
+flat out int instance;
+#define M (scene_model * planets[instance].model)
+#define noise_method planets[instance].noise.x
+#define seed planets[instance].noise.y
+#define octaves planets[instance].noise.z
+#define radius planets[instance].terrain.x
+#define elevationModifier planets[instance].terrain.y
+#define vert_frequency planets[instance].terrain.z
+#else
+uniform mat4 M;
+
 uniform int noise_method;
 
 uniform int seed;
@@ -474,11 +486,48 @@ uniform float elevationModifier;
 uniform int octaves;
 uniform float vert_frequency;
 
+// Eroded minus noise height, see BackgroundErosion. Off at strength 0.
+uniform samplerCube erosion_map;
+uniform float erosion_strength = 0.0;
+uniform float erosion_step; // about one texel of erosion_map on the unit sphere
+#endif
+
+// Octave LOD, see PlanetRenderer::bindOctaveLod(). All 0 keeps every octave.
+uniform float lod_pixel_angle = 0.0; // view angle of one pixel, perspective projections
+uniform float lod_pixel_size = 0.0; // view space size of one pixel, orthographic projections
+uniform float lod_vertex_angle = 0.0; // angle between neighbouring vertices of the mesh
+
+#ifdef FEATURES
+// Craters, volcanoes and rifts of FeatureLayer, see PlanetRenderer::bindFeatures().
+// Every cell of the cube face grid lists the stamps that reach into it. Off at feature_grid 0.
+struct FeatureStamp
+{
+  vec4 center; // direction, w radius of the footprint
+  vec4 axis;   // rifts run from center - axis to center + axis
+  vec4 shape;  // kind, height, variation
+};
+layout(std430, binding = 2) readonly buffer FeatureStamps { FeatureStamp feature_stamps[]; };
+// First entry of every cell, one past the last cell, then the stamp indices
+layout(std430, binding = 3) readonly buffer FeatureCells { uint feature_cells[]; };
+uniform int feature_grid = 0; // cells per cube face edge
+
+// Same values as FeatureLayer.cpp
+const float CRATER_RIM = 0.65;
+const float CALDERA_DEPTH = 0.3;
+
+vec4 feature = vec4(0.0); // height and gradient of the stamps at this vertex
+#endif
+
 out vec3 interpolatedNormal;
 out float height;
 
+// The depth pre-pass runs this shader with depth_frag.glsl, both programs
+// must produce bit identical depths for the GL_LEQUAL color pass
+invariant gl_Position;
+
 out vec3 camPos;
 out vec3 pos;
+out vec3 surface_direction; // planet space, for the climate map
 
 float generate_noise(vec3 v)
 {
@@ -496,15 +545,157 @@ uniform float h = 0.0001;
 uniform float h_half = 0.00005;
 uniform float h_inv = 10000;
 
+// Octaves of the fBm, at frequency * (o + 1), that a footprint on the unit
+// sphere still resolves with two samples per wavelength. Fractional, the
+// weight of octave o is clamp(lod - o), so the last one fades out.
+float octave_limit(float footprint, float frequency)
+{
+  return 0.5 / (max(footprint, 1e-7) * frequency);
+}
+
 vec3 central_diff_gradient(vec3 pos)
 {
-  float grad_x = two_h_inv * generate_noise(pos + h_half * vec3(1.0,0.0,0.0) - generate_noise(pos + h_half * vec3(1.0,0.0,0.0)));
-  float grad_y = two_h_inv * generate_noise(pos + h_half * vec3(0.0,1.0,0.0) - generate_noise(pos + h_half * vec3(0.0,1.0,0.0)));
-  float grad_z = two_h_inv * generate_noise(pos + h_half * vec3(0.0,0.0,1.0) - generate_noise(pos + h_half * vec3(0.0,0.0,1.0)));
+  float grad_x = h_inv * (generate_noise(pos + h_half * vec3(1.0,0.0,0.0)) - generate_noise(pos - h_half * vec3(1.0,0.0,0.0)));
+  float grad_y = h_inv * (generate_noise(pos + h_half * vec3(0.0,1.0,0.0)) - generate_noise(pos - h_half * vec3(0.0,1.0,0.0)));
+  float grad_z = h_inv * (generate_noise(pos + h_half * vec3(0.0,0.0,1.0)) - generate_noise(pos - h_half * vec3(0.0,0.0,1.0)));
 
   return vec3(grad_x,grad_y,grad_z);
 }
 
+#ifdef FEATURES
+// stamp_profile() of FeatureLayer.cpp in x, its derivative by x in y
+vec2 stamp_profile(int kind, float x, float variation)
+{
+  if(kind == 0)
+  {
+    // crater
+    float rim = 0.1 + 0.2 * variation;
+    if(x < CRATER_RIM)
+    {
+      float u = x / CRATER_RIM;
+      return vec2(u * u - 1.0 + rim, 2.0 * u / CRATER_RIM);
+    }
+    float v = 1.0 - (x - CRATER_RIM) / (1.0 - CRATER_RIM);
+    return vec2(rim * v * v, -2.0 * rim * v / (1.0 - CRATER_RIM));
+  }
+  if(kind == 1)
+  {
+    // volcano
+    float caldera = 0.08 + 0.12 * variation;
+    if(x < caldera)
+    {
+      float u = x / caldera;
+      return vec2((1.0 - caldera) * (1.0 - caldera) - CALDERA_DEPTH * (1.0 - u * u), 2.0 * CALDERA_DEPTH * u / caldera);
+    }
+    return vec2((1.0 - x) * (1.0 - x), -2.0 * (1.0 - x));
+  }
+  // rift
+  float w = 1.0 - x * x;
+  return vec2(-w * w, 4.0 * x * w);
+}
+
+// Grid cell of a direction, cubeCoordinates() of PlanetSurface.cpp
+int feature_cell(vec3 d)
+{
+  vec3 a = abs(d);
+  int face;
+  float s, t;
+  if(a.x >= a.y && a.x >= a.z)
+  {
+    face = d.x > 0.0 ? 0 : 1;
+    s = (d.x > 0.0 ? -d.z : d.z) / a.x;
+    t = -d.y / a.x;
+  }
+  else if(a.y >= a.z)
+  {
+    face = d.y > 0.0 ? 2 : 3;
+    s = d.x / a.y;
+    t = (d.y > 0.0 ? d.z : -d.z) / a.y;
+  }
+  else
+  {
+    face = d.z > 0.0 ? 4 : 5;
+    s = (d.z > 0.0 ? d.x : -d.x) / a.z;
+    t = -d.y / a.z;
+  }
+
+  int x = clamp(int((s + 1.0) * 0.5 * float(feature_grid)), 0, feature_grid - 1);
+  int y = clamp(int((t + 1.0) * 0.5 * float(feature_grid)), 0, feature_grid - 1);
+  return (face * feature_grid + y) * feature_grid + x;
+}
+
+// Sum of the stamps at a unit direction in x, its gradient in yzw.
+// FeatureLayer::height() without the gradient.
+vec4 feature_height(vec3 direction)
+{
+  vec4 result = vec4(0.0);
+  if(feature_grid == 0)
+    return result;
+
+  int cell = feature_cell(direction);
+  uint end = feature_cells[cell + 1];
+  for(uint e = feature_cells[cell]; e < end; e++)
+  {
+    FeatureStamp stamp = feature_stamps[feature_cells[e]];
+    vec3 center = stamp.center.xyz;
+    float stamp_radius = stamp.center.w;
+    int kind = int(stamp.shape.x);
+
+    float stamp_distance;
+    vec3 distance_gradient;
+    float taper = 1.0;
+    vec3 taper_gradient = vec3(0.0);
+    if(kind == 2)
+    {
+      // Distance from the great circle through the rift, fading out towards its ends
+      float inverse_length = 1.0 / dot(stamp.axis.xyz, stamp.axis.xyz);
+      float along = dot(direction, stamp.axis.xyz) * inverse_length;
+      if(abs(along) >= 1.0 || dot(direction, center) <= 0.0)
+        continue;
+      vec3 across = normalize(cross(center, stamp.axis.xyz));
+      float side = dot(direction, across);
+      stamp_distance = abs(side);
+      distance_gradient = sign(side) * across;
+      taper = 1.0 - along * along;
+      taper_gradient = -2.0 * along * inverse_length * stamp.axis.xyz;
+    }
+    else
+    {
+      vec3 offset = direction - center;
+      stamp_distance = length(offset);
+      distance_gradient = offset / max(stamp_distance, 1e-6);
+    }
+
+    if(stamp_distance >= stamp_radius)
+      continue;
+
+    vec2 profile = stamp_profile(kind, stamp_distance / stamp_radius, stamp.shape.z);
+    result.x += stamp.shape.y * taper * profile.x;
+    result.yzw += stamp.shape.y * (taper * profile.y / stamp_radius * distance_gradient + profile.x * taper_gradient);
+  }
+  return result;
+}
+#endif
+
+#ifndef INSTANCED
+float erosion_delta(vec3 direction)
+{
+  return erosion_strength * textureLod(erosion_map, direction, 0.0).r;
+}
+
+vec3 erosion_gradient(vec3 direction)
+{
+  vec3 dx = vec3(erosion_step, 0.0, 0.0);
+  vec3 dy = vec3(0.0, erosion_step, 0.0);
+  vec3 dz = vec3(0.0, 0.0, erosion_step);
+  float scale = 0.5 / erosion_step;
+
+  return scale * vec3(erosion_delta(direction + dx) - erosion_delta(direction - dx),
+                      erosion_delta(direction + dy) - erosion_delta(direction - dy),
+                      erosion_delta(direction + dz) - erosion_delta(direction - dz));
+}
+#endif
+
 vec3 displace_normal(vec3 pos, vec3 normal)
 {
   /**
@@ -513,6 +704,14 @@ vec3 displace_normal(vec3 pos, vec3 normal)
   */
 
   vec3 grad = central_diff_gradient(pos);
+#ifndef INSTANCED
+  if(erosion_strength > 0.0)
+    grad += erosion_gradient(normalize(Position));
+#endif
+#ifdef FEATURES
+  // The stamps are steep and small, their slope on the displaced sphere bends the normal
+  grad += elevationModifier / (1.0 + radius) * feature.yzw;
+#endif
   vec3 grad_para = dot(grad,normal) * normal;
   vec3 grad_ortho = grad - grad_para;
 
@@ -522,20 +721,47 @@ vec3 displace_normal(vec3 pos, vec3 normal)
 
 void main()
 {
+#ifdef INSTANCED
+  instance = int(instance_list[instance_offset + gl_InstanceID]);
+#endif
+
+  // Octaves finer than a pixel or the vertex spacing would only alias. The
+  // footprint is in units of the unit sphere the noise is sampled on.
+  float lod = 1e6;
+  if(lod_pixel_angle > 0.0 || lod_pixel_size > 0.0)
+  {
+    mat4 MV = V * M;
+    float distance_to_camera = length((MV * vec4(Position * (1.0 + radius), 1.0)).xyz);
+    float scale = length(MV[0].xyz) * (1.0 + radius);
+    float pixel = lod_pixel_size + distance_to_camera * lod_pixel_angle;
+    float footprint = max(pixel / scale, lod_vertex_angle);
+    lod = octave_limit(footprint, vert_frequency);
+  }
+
   // 0th octave
   float elevation = generate_noise(vert_frequency * (Position + seed));
 
   // 1th to (n-1):th octave
-  for(float o = 1.0; o < octaves; o++)
+  for(float o = 1.0; o < octaves && o < lod; o++)
   {
-    elevation += 1.0 / (pow(2,o)) * generate_noise((o + 1.0) * vert_frequency * (Position + seed));
+    elevation += clamp(lod - o, 0.0, 1.0) / (pow(2,o)) * generate_noise((o + 1.0) * vert_frequency * (Position + seed));
   }
+
+#ifndef INSTANCED
+  if(erosion_strength > 0.0)
+    elevation += erosion_delta(normalize(Position));
+#endif
+#ifdef FEATURES
+  feature = feature_height(normalize(Position));
+  elevation += feature.x;
+#endif
   
   pos = Position + radius * Normal;
   pos += elevation * Normal * elevationModifier;
 
   gl_Position = (P * V * M) * vec4(pos, 1.0);
   camPos = mat3(V * M) * Position;
+  surface_direction = normalize(Position);
 
   vec3 new_normal = displace_normal(pos, Normal);
   interpolatedNormal = mat3(V * M) * new_normal;
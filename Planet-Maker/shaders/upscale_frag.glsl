@@ -0,0 +1,32 @@
+#version 330 core
+
+// Bilinear upscale of the low resolution target followed by a light
+// sharpening pass that gives back some of the detail the filter smears.
+
+in vec2 uv;
+
+uniform sampler2D source;
+uniform vec2 uv_scale;   // part of the target that was rendered to
+uniform vec2 texel_size; // one texel of the target
+uniform float sharpness;
+
+out vec4 color;
+
+void main() {
+  vec2 st = uv * uv_scale;
+  // Stay inside the rendered region, the rest of the target holds stale pixels
+  vec2 limit = uv_scale - 0.5 * texel_size;
+
+  vec3 c = texture(source, min(st, limit)).rgb;
+  vec3 n = texture(source, min(st + vec2(0.0, texel_size.y), limit)).rgb;
+  vec3 s = texture(source, min(st - vec2(0.0, texel_size.y), limit)).rgb;
+  vec3 e = texture(source, min(st + vec2(texel_size.x, 0.0), limit)).rgb;
+  vec3 w = texture(source, min(st - vec2(texel_size.x, 0.0), limit)).rgb;
+
+  // Unsharp mask, clamped to the neighbourhood so edges do not ring
+  vec3 sharpened = c + sharpness * (4.0 * c - n - s - e - w);
+  vec3 lo = min(c, min(min(n, s), min(e, w)));
+  vec3 hi = max(c, max(max(n, s), max(e, w)));
+
+  color = vec4(clamp(sharpened, lo, hi), 1.0);
+}
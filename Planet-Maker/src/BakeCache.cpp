@@ -0,0 +1,273 @@
+#include "BakeCache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "Checksum.h"
+#include "Compression.h"
+#include "MappedFile.h"
+
+static const char BLOB_MAGIC[4] = { 'P', 'B', 'A', 'K' };
+static const uint32_t BLOB_FORMAT_VERSION = 1;
+static const char* const INDEX_FILE = "index.txt";
+
+struct BlobHeader
+{
+	char magic[4];
+	uint32_t format_version;
+	uint64_t key;
+	uint64_t raw_size;
+	uint64_t compressed_size;
+	uint32_t element_size;
+	uint32_t crc; // of the raw data
+};
+
+BakeKey::BakeKey(const char* _generator, uint32_t _version)
+{
+	hash = 14695981039346656037ULL;
+	mix(_generator, strlen(_generator));
+	mix(&_version, sizeof(_version));
+}
+
+void BakeKey::mix(const void* _data, size_t _size)
+{
+	const uint8_t* bytes = (const uint8_t*)_data;
+	for (size_t i = 0; i < _size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+BakeCache::BakeCache()
+{
+	max_bytes = 0;
+	total_bytes = 0;
+	tick = 0;
+	hits = misses = 0;
+}
+
+
+BakeCache::~BakeCache()
+{
+}
+
+bool BakeCache::open(const std::string& _directory, uint64_t _maxBytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+#ifdef _WIN32
+	_mkdir(_directory.c_str());
+#else
+	mkdir(_directory.c_str(), 0755);
+#endif
+
+	directory = _directory;
+	max_bytes = _maxBytes;
+	readIndex();
+
+	// The cap may be smaller than last session's
+	evict();
+	writeIndex();
+	return true;
+}
+
+std::string BakeCache::blobPath(uint64_t _key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bake", (unsigned long long)_key);
+	return directory + "/" + name;
+}
+
+bool BakeCache::load(uint64_t _key, std::vector<uint8_t>& _data)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!isOpen() || entries.find(_key) == entries.end()) {
+			++misses;
+			return false;
+		}
+	}
+
+	MappedFile file;
+	bool ok = file.open(blobPath(_key)) && file.size() >= sizeof(BlobHeader);
+
+	BlobHeader header;
+	if (ok) {
+		memcpy(&header, file.data(), sizeof(header));
+		ok = memcmp(header.magic, BLOB_MAGIC, 4) == 0 && header.format_version == BLOB_FORMAT_VERSION &&
+			header.key == _key && header.compressed_size == file.size() - sizeof(BlobHeader) && header.element_size > 0;
+	}
+
+	if (ok) {
+		const uint8_t* compressed = file.data() + sizeof(BlobHeader);
+		_data.resize((size_t)header.raw_size);
+
+		if (header.element_size > 1) {
+			std::vector<uint8_t> shuffled((size_t)header.raw_size);
+			ok = decompress_block(compressed, (size_t)header.compressed_size, shuffled.data(), shuffled.size());
+			if (ok)
+				unshuffle_bytes(shuffled.data(), shuffled.size(), header.element_size, _data.data());
+		}
+		else {
+			ok = decompress_block(compressed, (size_t)header.compressed_size, _data.data(), _data.size());
+		}
+
+		ok = ok && crc32(_data.data(), _data.size()) == header.crc;
+	}
+	file.close();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!ok) {
+		// Damaged or deleted behind our back
+		std::cout << "Dropping damaged cache entry " << blobPath(_key) << std::endl;
+		remove(_key);
+		writeIndex();
+		++misses;
+		_data.clear();
+		return false;
+	}
+
+	std::map<uint64_t, Entry>::iterator it = entries.find(_key);
+	if (it != entries.end())
+		it->second.last_used = ++tick;
+	writeIndex();
+	++hits;
+	return true;
+}
+
+bool BakeCache::store(uint64_t _key, const void* _data, size_t _size, int _elementSize)
+{
+	if (!isOpen())
+		return false;
+
+	// Compress outside the lock, this is the slow part
+	std::vector<uint8_t> compressed;
+	if (_elementSize > 1) {
+		std::vector<uint8_t> shuffled(_size);
+		shuffle_bytes((const uint8_t*)_data, _size, _elementSize, shuffled.data());
+		compress_block(shuffled.data(), shuffled.size(), compressed);
+	}
+	else {
+		compress_block((const uint8_t*)_data, _size, compressed);
+	}
+
+	BlobHeader header;
+	memcpy(header.magic, BLOB_MAGIC, 4);
+	header.format_version = BLOB_FORMAT_VERSION;
+	header.key = _key;
+	header.raw_size = _size;
+	header.compressed_size = compressed.size();
+	header.element_size = _elementSize > 1 ? _elementSize : 1;
+	header.crc = crc32(_data, _size);
+
+	// Written under another name and renamed, readers never see half a blob
+	std::string path = blobPath(_key);
+	std::string temporary = path + ".tmp";
+
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(compressed.empty() || fwrite(compressed.data(), compressed.size(), 1, file) == 1);
+	ok = fclose(file) == 0 && ok;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	::remove(path.c_str());
+	if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+		::remove(temporary.c_str());
+		return false;
+	}
+
+	std::map<uint64_t, Entry>::iterator it = entries.find(_key);
+	if (it != entries.end())
+		total_bytes -= it->second.size;
+
+	Entry entry;
+	entry.size = sizeof(header) + compressed.size();
+	entry.last_used = ++tick;
+	entries[_key] = entry;
+	total_bytes += entry.size;
+
+	evict();
+	writeIndex();
+	return true;
+}
+
+void BakeCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	while (!entries.empty())
+		remove(entries.begin()->first);
+	writeIndex();
+}
+
+//! Deletes the blob and forgets it, the caller holds the lock.
+void BakeCache::remove(uint64_t _key)
+{
+	std::map<uint64_t, Entry>::iterator it = entries.find(_key);
+	if (it == entries.end())
+		return;
+
+	::remove(blobPath(_key).c_str());
+	total_bytes -= it->second.size;
+	entries.erase(it);
+}
+
+//! Deletes least recently used blobs until the cache fits its cap.
+void BakeCache::evict()
+{
+	while (total_bytes > max_bytes && !entries.empty()) {
+		std::map<uint64_t, Entry>::iterator oldest = entries.begin();
+		for (std::map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+			if (it->second.last_used < oldest->second.last_used)
+				oldest = it;
+		}
+		remove(oldest->first);
+	}
+}
+
+//! One line per blob: key in hex, file size, last use.
+void BakeCache::readIndex()
+{
+	entries.clear();
+	total_bytes = 0;
+	tick = 0;
+
+	std::ifstream file(directory + "/" + INDEX_FILE);
+	std::string key_text;
+	Entry entry;
+
+	while (file >> key_text >> entry.size >> entry.last_used) {
+		uint64_t key = strtoull(key_text.c_str(), nullptr, 16);
+
+		// Blobs deleted by hand are dropped from the index
+		FILE* blob = fopen(blobPath(key).c_str(), "rb");
+		if (!blob)
+			continue;
+		fclose(blob);
+
+		entries[key] = entry;
+		total_bytes += entry.size;
+		if (entry.last_used > tick)
+			tick = entry.last_used;
+	}
+}
+
+void BakeCache::writeIndex()
+{
+	std::ofstream file(directory + "/" + INDEX_FILE);
+	for (std::map<uint64_t, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+		char key[32];
+		snprintf(key, sizeof(key), "%016llx", (unsigned long long)it->first);
+		file << key << " " << it->second.size << " " << it->second.last_used << std::endl;
+	}
+}
@@ -0,0 +1,302 @@
+#include <GL/glew.h>
+#include "BatchRenderer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "glfwContext.h"
+#include "Framebuffer.h"
+#include "ImageWriter.h"
+#include "PlanetRenderer.h"
+#include "PresetFile.h"
+
+static std::string file_stem(const std::string& _path)
+{
+	size_t slash = _path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? _path : _path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+
+BatchRenderer::BatchRenderer(const BatchSettings& _settings)
+	: settings(_settings), render_queue(4 * _settings.workers), encode_queue(4 * _settings.workers)
+{
+	jobs_queued = 0;
+	planets_rendered = 0;
+	planets_written = 0;
+	failures = 0;
+	renderers_running = 0;
+}
+
+
+BatchRenderer::~BatchRenderer()
+{
+}
+
+int BatchRenderer::run()
+{
+	glfwContext glfw;
+	if (!glfw.initHeadless(settings.workers, settings.width, settings.height))
+		return 1;
+
+	// Function pointers are resolved once, all contexts come from the same driver
+	glfwMakeContextCurrent(glfw.getWindow(0));
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK) {
+		std::cout << "glewInit() error." << std::endl;
+		return 1;
+	}
+	glfw.printGLInfo();
+	glfwMakeContextCurrent(NULL);
+
+	const int workers = glfw.getWindowCount();
+	std::cout << "Batch: " << workers << " render contexts, " << settings.encoders
+		<< " encoders, " << settings.width << "x" << settings.height << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread parser(&BatchRenderer::parseStage, this);
+
+	renderers_running = workers;
+	std::vector<std::thread> renderers;
+	for (int i = 0; i < workers; ++i)
+		renderers.push_back(std::thread(&BatchRenderer::renderStage, this, glfw.getWindow(i)));
+
+	std::vector<std::thread> encoders;
+	for (int i = 0; i < settings.encoders; ++i)
+		encoders.push_back(std::thread(&BatchRenderer::encodeStage, this));
+
+	parser.join();
+	render_queue.close();
+	for (size_t i = 0; i < renderers.size(); ++i)
+		renderers[i].join();
+	encode_queue.close();
+	for (size_t i = 0; i < encoders.size(); ++i)
+		encoders[i].join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Rendered " << planets_rendered << " and wrote " << planets_written << " of "
+		<< jobs_queued << " planets in " << seconds << " s ("
+		<< (seconds > 0.0 ? planets_written / seconds : 0.0) << " planets/s)";
+	if (failures > 0)
+		std::cout << ", " << failures << " failed";
+	std::cout << std::endl;
+
+	return failures > 0 ? 1 : 0;
+}
+
+void BatchRenderer::parseStage()
+{
+	int index = 0;
+
+	for (size_t i = 0; i < settings.presets.size(); ++i) {
+		BatchJob job;
+		job.index = index++;
+		job.name = file_stem(settings.presets[i]);
+
+		if (!load_preset(settings.presets[i], job.params)) {
+			std::cout << "Error reading preset " << settings.presets[i] << std::endl;
+			++failures;
+			continue;
+		}
+
+		queueJob(std::move(job));
+	}
+
+	if (settings.sweep_seeds) {
+		PlanetParameters base;
+		if (!settings.base_preset.empty() && !load_preset(settings.base_preset, base)) {
+			std::cout << "Error reading base preset " << settings.base_preset << std::endl;
+			++failures;
+			return;
+		}
+
+		std::string prefix = settings.base_preset.empty() ? "seed" : file_stem(settings.base_preset) + "_seed";
+
+		for (int seed = settings.seed_first; seed <= settings.seed_last; ++seed) {
+			BatchJob job;
+			job.index = index++;
+			job.name = prefix + "_" + std::to_string(seed);
+			job.params = base;
+			job.params.terrain_seed = seed;
+			job.params.ocean_seed = seed;
+			job.params.sky_seed = seed;
+
+			queueJob(std::move(job));
+		}
+	}
+}
+
+void BatchRenderer::queueJob(BatchJob _job)
+{
+	++jobs_queued;
+	if (!render_queue.push(std::move(_job)))
+		++failures; // every render worker has given up
+}
+
+void BatchRenderer::renderStage(GLFWwindow* _context)
+{
+	glfwMakeContextCurrent(_context);
+	renderWorker();
+	glfwMakeContextCurrent(NULL);
+
+	// The last worker out closes the queue so the parser never blocks on a full queue
+	if (--renderers_running == 0)
+		render_queue.close();
+}
+
+//! Renders jobs until the queue runs dry. Expects its own context to be current.
+void BatchRenderer::renderWorker()
+{
+	const int w = settings.width;
+	const int h = settings.height;
+	const size_t image_size = (size_t)w * h * 3;
+
+	PlanetRenderer renderer;
+	renderer.init(PlanetParameters().terrain_segments);
+
+	Framebuffer target;
+	if (!target.create(w, h)) {
+		++failures;
+		return;
+	}
+
+	RenderState state;
+	PlanetRenderer::defaultView((float)w / (float)h, state.projection, state.view);
+
+	// Two pack buffers: read back planet n while planet n+1 renders
+	GLuint pbo[2];
+	glGenBuffers(2, pbo);
+	for (int i = 0; i < 2; ++i) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, image_size, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	BatchJob in_flight[2];
+	bool busy[2] = { false, false };
+	int slot = 0;
+
+	auto collect = [&](int _slot) {
+		BatchImage image;
+		image.index = in_flight[_slot].index;
+		image.name = in_flight[_slot].name;
+		image.pixels.resize(image_size);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[_slot]);
+		void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (data) {
+			memcpy(image.pixels.data(), data, image_size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			++planets_rendered;
+			encode_queue.push(std::move(image));
+		}
+		else {
+			std::cout << "Readback failed for " << image.name << std::endl;
+			++failures;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		busy[_slot] = false;
+	};
+
+	BatchJob job;
+	while (render_queue.pop(job)) {
+		renderer.setTerrainSegments(job.params.terrain_segments);
+		// No main thread queue runs here, the layer is uploaded before the render
+		renderer.buildFeatures(job.params);
+
+		target.bind();
+		renderer.beginFrame();
+		renderer.render(job.params, state);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+		glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		in_flight[slot] = std::move(job);
+		busy[slot] = true;
+
+		slot ^= 1;
+		if (busy[slot])
+			collect(slot);
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		slot ^= 1;
+		if (busy[slot])
+			collect(slot);
+	}
+
+	target.unbind();
+	glDeleteBuffers(2, pbo);
+}
+
+void BatchRenderer::encodeStage()
+{
+	BatchImage image;
+	while (encode_queue.pop(image)) {
+		std::string path = settings.output_directory + "/" + image.name + ".png";
+
+		if (write_png(path, settings.width, settings.height, 3, image.pixels.data(), true))
+			++planets_written;
+		else {
+			std::cout << "Error writing " << path << std::endl;
+			++failures;
+		}
+	}
+}
+
+void BatchRenderer::printUsage()
+{
+	std::cout <<
+		"Usage: Planet-Maker --batch [options] [preset ...]\n"
+		"  --seeds A-B     render seeds A to B (terrain, ocean and sky seed)\n"
+		"  --base FILE     base preset for --seeds, defaults to the built-in planet\n"
+		"  --out DIR       output directory (default .)\n"
+		"  --size WxH      image size (default 256x256)\n"
+		"  --workers N     concurrent render contexts (default 2)\n"
+		"  --encoders N    PNG encoder threads (default 1)\n";
+}
+
+bool BatchRenderer::parseArguments(int _argc, char* _argv[], BatchSettings& _settings)
+{
+	for (int i = 1; i < _argc; ++i) {
+		std::string arg = _argv[i];
+		bool has_value = i + 1 < _argc;
+
+		if (arg == "--batch")
+			continue;
+		else if (arg == "--seeds" && has_value) {
+			if (sscanf(_argv[++i], "%d-%d", &_settings.seed_first, &_settings.seed_last) != 2)
+				return false;
+			_settings.sweep_seeds = true;
+		}
+		else if (arg == "--base" && has_value)
+			_settings.base_preset = _argv[++i];
+		else if (arg == "--out" && has_value)
+			_settings.output_directory = _argv[++i];
+		else if (arg == "--size" && has_value) {
+			if (sscanf(_argv[++i], "%dx%d", &_settings.width, &_settings.height) != 2)
+				return false;
+		}
+		else if (arg == "--workers" && has_value)
+			_settings.workers = atoi(_argv[++i]);
+		else if (arg == "--encoders" && has_value)
+			_settings.encoders = atoi(_argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0)
+			return false;
+		else
+			_settings.presets.push_back(arg);
+	}
+
+	if (_settings.width <= 0 || _settings.height <= 0 || _settings.workers < 1 || _settings.encoders < 1)
+		return false;
+
+	return !_settings.presets.empty() || _settings.sweep_seeds;
+}
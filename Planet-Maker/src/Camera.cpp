@@ -4,6 +4,9 @@
 #include <glm/mat4x4.hpp> // glm::mat4
 #include <glm/gtc/matrix_transform.hpp> // glm::translate, glm::rotate, glm::scale, glm::perspective
 #include <glm/gtc/type_ptr.hpp> //glm::make:mat4
+#include <algorithm>
+
+#include "PlanetQuery.h"
 
 
 Camera::Camera()
@@ -148,4 +151,44 @@ void Camera::fpsCamera(GLFWwindow* _window, double _dT)
 
 	glfwSetCursorPos(_window, 960, 540);
 
-}
\ No newline at end of file
+}
+
+float Camera::collideWithGround(const PlanetQuery& _query, const glm::mat4& _model, const glm::vec3& _previous, float _clearance)
+{
+	// The queries work in planet space, before the model rotation
+	glm::mat4 to_planet = glm::inverse(_model);
+	glm::vec3 from = glm::vec3(to_planet * glm::vec4(_previous, 1.0f));
+	glm::vec3 to = glm::vec3(to_planet * glm::vec4(position, 1.0f));
+	bool moved = false;
+
+	float distance = glm::length(to - from);
+	if (distance > 0.0f) {
+		PlanetRay ray;
+		ray.origin = from;
+		ray.direction = (to - from) / distance;
+		ray.max_distance = distance;
+		PlanetRayHit hit = _query.raycast(ray);
+		if (hit.hit) {
+			to = hit.position;
+			moved = true;
+		}
+	}
+
+	const PlanetSurface& surface = _query.getSurface();
+	float radius = glm::length(to);
+	float elevation = _query.elevation(to);
+	// Without an ocean the sea level is 0 and the terrain may be lower
+	if (surface.seaLevel() > 0.0f)
+		elevation = std::max(elevation, surface.seaLevel());
+	float ground = surface.terrainRadius(elevation);
+	if (radius < ground + _clearance) {
+		to *= (ground + _clearance) / std::max(radius, 1.0e-6f);
+		moved = true;
+	}
+
+	if (moved) {
+		position = glm::vec3(_model * glm::vec4(to, 1.0f));
+		this->update();
+	}
+	return radius - ground;
+}
@@ -0,0 +1,28 @@
+#include "Checksum.h"
+
+struct CrcTable
+{
+	uint32_t entries[256];
+
+	CrcTable()
+	{
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			entries[n] = c;
+		}
+	}
+};
+
+uint32_t crc32(const void* _data, size_t _size, uint32_t _crc)
+{
+	// Function local statics are initialized once, even with several threads
+	static const CrcTable table;
+
+	const uint8_t* bytes = (const uint8_t*)_data;
+	uint32_t crc = _crc ^ 0xffffffffu;
+	for (size_t n = 0; n < _size; n++)
+		crc = table.entries[(crc ^ bytes[n]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffffu;
+}
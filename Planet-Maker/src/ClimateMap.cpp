@@ -0,0 +1,282 @@
+#include "ClimateMap.h"
+#include <algorithm>
+#include <cmath>
+
+#include "BakeCache.h"
+#include "Noise.h"
+#include "PlanetSurface.h"
+
+static const float HALF_PI = 1.5707963f;
+static const float FAR = 1.0e9f;
+
+// Temperature lost per unit of height above the sea, peaks near 0.85 freeze at the equator
+static const float LAPSE_RATE = 1.0f;
+// Distance from the sea in radians at which moisture has fallen to 1/e
+static const float MOISTURE_RANGE = 0.12f;
+static const float MOISTURE_NOISE = 0.25f;
+static const float TEMPERATURE_NOISE = 0.05f;
+
+//! Cosine of the latitude, +z is the pole.
+static float latitude_temperature(const glm::vec3& _direction)
+{
+	return std::sqrt(std::max(1.0f - _direction.z * _direction.z, 0.0f));
+}
+
+// __________ BIOMES ______________
+
+// Beach, grass, rock and snow weights at TEMPERATURE_STEPS x MOISTURE_STEPS
+// anchors, cold to hot and dry to wet. biome_weights() blends between them.
+static const int TEMPERATURE_STEPS = 5;
+static const int MOISTURE_STEPS = 3;
+static const float BIOME_TABLE[TEMPERATURE_STEPS][MOISTURE_STEPS][4] = {
+	{ { 0.0f, 0.0f, 0.1f, 0.9f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },   // ice
+	{ { 0.1f, 0.1f, 0.6f, 0.2f }, { 0.0f, 0.3f, 0.5f, 0.2f }, { 0.0f, 0.4f, 0.3f, 0.3f } },   // tundra
+	{ { 0.4f, 0.4f, 0.2f, 0.0f }, { 0.0f, 0.6f, 0.2f, 0.0f }, { 0.0f, 0.5f, 0.1f, 0.0f } },   // steppe, taiga
+	{ { 0.8f, 0.1f, 0.1f, 0.0f }, { 0.1f, 0.9f, 0.0f, 0.0f }, { 0.0f, 0.7f, 0.0f, 0.0f } },   // cold desert, grassland, forest
+	{ { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, 0.0f, 0.0f }, { 0.0f, 0.6f, 0.0f, 0.0f } } }; // desert, savanna, rain forest
+
+glm::vec4 biome_weights(float _temperature, float _moisture)
+{
+	float t = glm::clamp(_temperature, 0.0f, 1.0f) * (TEMPERATURE_STEPS - 1);
+	float m = glm::clamp(_moisture, 0.0f, 1.0f) * (MOISTURE_STEPS - 1);
+	int t0 = std::min((int)t, TEMPERATURE_STEPS - 2);
+	int m0 = std::min((int)m, MOISTURE_STEPS - 2);
+
+	// Smoothstep between the anchors keeps the borders soft but the biomes wide
+	float ft = glm::smoothstep(0.0f, 1.0f, t - t0);
+	float fm = glm::smoothstep(0.0f, 1.0f, m - m0);
+
+	glm::vec4 weights[4];
+	for (int i = 0; i < 4; ++i) {
+		const float* w = BIOME_TABLE[t0 + (i & 1)][m0 + (i >> 1)];
+		weights[i] = glm::vec4(w[0], w[1], w[2], w[3]);
+	}
+	return glm::mix(glm::mix(weights[0], weights[1], ft), glm::mix(weights[2], weights[3], ft), fm);
+}
+
+void build_biome_lut(int _size, std::vector<uint8_t>& _rgba)
+{
+	_rgba.resize((size_t)_size * _size * 4);
+	for (int y = 0; y < _size; ++y) {
+		for (int x = 0; x < _size; ++x) {
+			glm::vec4 w = biome_weights((x + 0.5f) / _size, (y + 0.5f) / _size);
+			uint8_t* texel = &_rgba[((size_t)y * _size + x) * 4];
+			for (int c = 0; c < 4; ++c)
+				texel[c] = (uint8_t)(glm::clamp(w[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+Climate estimate_climate(const glm::vec3& _direction, float _elevation)
+{
+	// Same as estimate_climate() in terrain_frag.glsl
+	Climate climate;
+	climate.temperature = glm::clamp(latitude_temperature(_direction) - LAPSE_RATE * std::max(_elevation, 0.0f), 0.0f, 1.0f);
+	climate.moisture = glm::clamp(0.7f - 0.6f * _elevation, 0.0f, 1.0f);
+	climate.slope = 0.0f;
+	return climate;
+}
+
+// __________ CLIMATE MAP ______________
+
+ClimateMap::ClimateMap()
+{
+	resolution = 0;
+}
+
+uint64_t ClimateMap::cacheKey(const PlanetParameters& _params, int _resolution)
+{
+	return BakeKey("climate_map", GENERATOR_VERSION)
+		.add(CubeHeightmap::cacheKey(_params, _resolution))
+		.add(_params.terrain_frag_frequency)
+		.add(_params.terrain_elevation)
+		.add(_params.ocean_enabled)
+		.get();
+}
+
+//! Texel across the edge of a face, for texels just outside it.
+static int neighbour_texel(int _face, int _x, int _y, int _resolution)
+{
+	float s = 2.0f * (_x + 0.5f) / _resolution - 1.0f;
+	float t = 2.0f * (_y + 0.5f) / _resolution - 1.0f;
+
+	int face;
+	PlanetSurface::cubeCoordinates(PlanetSurface::cubeDirection(_face, s, t), face, s, t);
+	int x = glm::clamp((int)((s * 0.5f + 0.5f) * _resolution), 0, _resolution - 1);
+	int y = glm::clamp((int)((t * 0.5f + 0.5f) * _resolution), 0, _resolution - 1);
+	return (face * _resolution + y) * _resolution + x;
+}
+
+//! Chamfer distance in texels from every texel to the nearest sea texel.
+//! Each round sweeps every face forward and backward in its own task, then
+//! carries the distances over the face edges; rounds stop once no edge changes.
+void ClimateMap::findOceanDistance(JobSystem& _jobs, const CancelToken& _cancel, std::vector<float>& _distance) const
+{
+	const int res = resolution;
+	const float diagonal = 1.41421356f;
+
+	// Border texels of every face and the texel across the edge from them
+	std::vector<int> border, across;
+	for (int face = 0; face < 6; ++face) {
+		for (int i = 0; i < res; ++i) {
+			int edge[4][4] = { { i, 0, i, -1 }, { i, res - 1, i, res }, { 0, i, -1, i }, { res - 1, i, res, i } };
+			for (int e = 0; e < 4; ++e) {
+				border.push_back((face * res + edge[e][1]) * res + edge[e][0]);
+				across.push_back(neighbour_texel(face, edge[e][2], edge[e][3], res));
+			}
+		}
+	}
+
+	bool changed = true;
+	for (int round = 0; round < 8 && changed && !_cancel.isCancelled(); ++round) {
+		_jobs.parallelFor(6, 1, [&](int _begin, int _end) {
+			for (int face = _begin; face < _end; ++face) {
+				float* d = &_distance[(size_t)face * res * res];
+
+				for (int y = 0; y < res; ++y) {
+					for (int x = 0; x < res; ++x) {
+						float& c = d[y * res + x];
+						if (x > 0)
+							c = std::min(c, d[y * res + x - 1] + 1.0f);
+						if (y > 0) {
+							c = std::min(c, d[(y - 1) * res + x] + 1.0f);
+							if (x > 0)
+								c = std::min(c, d[(y - 1) * res + x - 1] + diagonal);
+							if (x < res - 1)
+								c = std::min(c, d[(y - 1) * res + x + 1] + diagonal);
+						}
+					}
+				}
+				for (int y = res - 1; y >= 0; --y) {
+					for (int x = res - 1; x >= 0; --x) {
+						float& c = d[y * res + x];
+						if (x < res - 1)
+							c = std::min(c, d[y * res + x + 1] + 1.0f);
+						if (y < res - 1) {
+							c = std::min(c, d[(y + 1) * res + x] + 1.0f);
+							if (x < res - 1)
+								c = std::min(c, d[(y + 1) * res + x + 1] + diagonal);
+							if (x > 0)
+								c = std::min(c, d[(y + 1) * res + x - 1] + diagonal);
+						}
+					}
+				}
+			}
+		}, _cancel);
+
+		changed = false;
+		for (size_t i = 0; i < border.size(); ++i) {
+			float carried = _distance[across[i]] + 1.0f;
+			if (carried < _distance[border[i]]) {
+				_distance[border[i]] = carried;
+				changed = true;
+			}
+		}
+	}
+}
+
+bool ClimateMap::bake(const CubeHeightmap& _heightmap, const PlanetParameters& _params, JobSystem* _jobs, const CancelToken& _cancel)
+{
+	resolution = _heightmap.getResolution();
+	texels.clear();
+	if (_heightmap.empty())
+		return false;
+
+	if (_jobs == nullptr)
+		_jobs = &JobSystem::global();
+
+	const int res = resolution;
+	PlanetSurface surface(_params);
+	float sea_level = surface.seaLevel();
+
+	std::vector<float> distance(6 * (size_t)res * res);
+	for (int face = 0; face < 6; ++face) {
+		const float* heights = _heightmap.getFace(face);
+		float* d = &distance[(size_t)face * res * res];
+		for (int i = 0; i < res * res; ++i)
+			d[i] = heights[i] < sea_level ? 0.0f : FAR;
+	}
+	findOceanDistance(*_jobs, _cancel, distance);
+
+	float texel_angle = HALF_PI / res;
+	float frequency = _params.terrain_frag_frequency;
+	float seed = (float)_params.terrain_seed;
+
+	texels.resize(6 * (size_t)res * res * 3);
+	_jobs->parallelFor(6 * res, 4, [&](int _begin, int _end) {
+		for (int row = _begin; row < _end; ++row) {
+			int face = row / res;
+			int y = row % res;
+			const float* heights = _heightmap.getFace(face);
+			float* out = &texels[(size_t)row * res * 3];
+
+			for (int x = 0; x < res; ++x) {
+				float s = 2.0f * (x + 0.5f) / res - 1.0f;
+				float t = 2.0f * (y + 0.5f) / res - 1.0f;
+				glm::vec3 direction = PlanetSurface::cubeDirection(face, s, t);
+				float height = heights[y * res + x];
+
+				float temperature = latitude_temperature(direction) - LAPSE_RATE * std::max(height - sea_level, 0.0f)
+					+ TEMPERATURE_NOISE * perlin_noise(2.0f * frequency * direction + seed);
+
+				// Without any sea the distance stays FAR and only the noise is left
+				float sea_distance = distance[(size_t)row * res + x] * texel_angle;
+				float moisture = std::exp(-sea_distance / MOISTURE_RANGE)
+					+ MOISTURE_NOISE * perlin_noise(frequency * direction + seed + 17.0f);
+
+				// Central differences inside the face, one sided at its edges
+				int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, res - 1);
+				int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, res - 1);
+				float angle_x = glm::length(PlanetSurface::cubeDirection(face, 2.0f * (x1 + 0.5f) / res - 1.0f, t) -
+					PlanetSurface::cubeDirection(face, 2.0f * (x0 + 0.5f) / res - 1.0f, t));
+				float angle_y = glm::length(PlanetSurface::cubeDirection(face, s, 2.0f * (y1 + 0.5f) / res - 1.0f) -
+					PlanetSurface::cubeDirection(face, s, 2.0f * (y0 + 0.5f) / res - 1.0f));
+				float gx = (heights[y * res + x1] - heights[y * res + x0]) / angle_x;
+				float gy = (heights[y1 * res + x] - heights[y0 * res + x]) / angle_y;
+
+				out[3 * x + 0] = glm::clamp(temperature, 0.0f, 1.0f);
+				out[3 * x + 1] = glm::clamp(moisture, 0.0f, 1.0f);
+				out[3 * x + 2] = std::sqrt(gx * gx + gy * gy);
+			}
+		}
+	}, _cancel);
+
+	if (_cancel.isCancelled()) {
+		texels.clear();
+		return false;
+	}
+	return true;
+}
+
+Climate ClimateMap::sample(const glm::vec3& _direction) const
+{
+	Climate climate;
+	if (texels.empty())
+		return climate;
+
+	int face;
+	float s, t;
+	PlanetSurface::cubeCoordinates(_direction, face, s, t);
+
+	// Texel centers sit at (i + 0.5) / resolution, like CubeHeightmap::sample()
+	float x = glm::clamp((s * 0.5f + 0.5f) * resolution - 0.5f, 0.0f, resolution - 1.0f);
+	float y = glm::clamp((t * 0.5f + 0.5f) * resolution - 0.5f, 0.0f, resolution - 1.0f);
+	int x0 = std::min((int)x, resolution - 2);
+	int y0 = std::min((int)y, resolution - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const float* texel = getFace(face) + ((size_t)y0 * resolution + x0) * 3;
+	const float* below = texel + (size_t)resolution * 3;
+	float values[3];
+	for (int c = 0; c < 3; ++c) {
+		float top = glm::mix(texel[c], texel[3 + c], fx);
+		float bottom = glm::mix(below[c], below[3 + c], fx);
+		values[c] = glm::mix(top, bottom, fy);
+	}
+
+	climate.temperature = values[0];
+	climate.moisture = values[1];
+	climate.slope = values[2];
+	return climate;
+}
@@ -0,0 +1,172 @@
+#include "Compression.h"
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 16;
+
+static inline uint32_t read_u32(const uint8_t* _p)
+{
+	uint32_t value;
+	memcpy(&value, _p, 4);
+	return value;
+}
+
+//! Lengths of 15 and more continue in bytes of 255 plus a remainder.
+static void write_length(std::vector<uint8_t>& _out, size_t _length)
+{
+	while (_length >= 255) {
+		_out.push_back(255);
+		_length -= 255;
+	}
+	_out.push_back((uint8_t)_length);
+}
+
+static void write_sequence(std::vector<uint8_t>& _out, const uint8_t* _literals, size_t _literalLength,
+	size_t _offset, size_t _matchLength)
+{
+	size_t match_code = _matchLength >= MIN_MATCH ? _matchLength - MIN_MATCH : 0;
+	uint8_t token = (uint8_t)(((_literalLength < 15 ? _literalLength : 15) << 4) | (match_code < 15 ? match_code : 15));
+	_out.push_back(token);
+
+	if (_literalLength >= 15)
+		write_length(_out, _literalLength - 15);
+	_out.insert(_out.end(), _literals, _literals + _literalLength);
+
+	// The last sequence has literals only
+	if (_matchLength == 0)
+		return;
+
+	_out.push_back((uint8_t)(_offset & 0xff));
+	_out.push_back((uint8_t)(_offset >> 8));
+	if (match_code >= 15)
+		write_length(_out, match_code - 15);
+}
+
+void compress_block(const uint8_t* _data, size_t _size, std::vector<uint8_t>& _out)
+{
+	_out.clear();
+	_out.reserve(_size + _size / 255 + 16);
+
+	// Last position of every hashed 4 byte sequence, greedy matching
+	std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0xffffffffu);
+
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (i + MIN_MATCH <= _size) {
+		uint32_t sequence = read_u32(_data + i);
+		uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+		uint32_t candidate = table[hash];
+		table[hash] = (uint32_t)i;
+
+		if (candidate == 0xffffffffu || i - candidate > MAX_OFFSET || read_u32(_data + candidate) != sequence) {
+			++i;
+			continue;
+		}
+
+		size_t length = MIN_MATCH;
+		while (i + length < _size && _data[candidate + length] == _data[i + length])
+			++length;
+
+		write_sequence(_out, _data + anchor, i - anchor, i - candidate, length);
+		i += length;
+		anchor = i;
+	}
+
+	write_sequence(_out, _data + anchor, _size - anchor, 0, 0);
+}
+
+//! Reads a length continued in bytes of 255, false if the input ends first.
+static bool read_length(const uint8_t*& _in, const uint8_t* _end, size_t& _length)
+{
+	for (;;) {
+		if (_in >= _end)
+			return false;
+		uint8_t byte = *_in++;
+		_length += byte;
+		if (byte != 255)
+			return true;
+	}
+}
+
+bool decompress_block(const uint8_t* _data, size_t _size, uint8_t* _out, size_t _outSize)
+{
+	const uint8_t* in = _data;
+	const uint8_t* in_end = _data + _size;
+	size_t out = 0;
+
+	while (in < in_end) {
+		uint8_t token = *in++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !read_length(in, in_end, literals))
+			return false;
+		if ((size_t)(in_end - in) < literals || _outSize - out < literals)
+			return false;
+
+		memcpy(_out + out, in, literals);
+		in += literals;
+		out += literals;
+
+		if (in == in_end)
+			break;
+
+		if (in_end - in < 2)
+			return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+
+		size_t length = token & 15;
+		if (length == 15 && !read_length(in, in_end, length))
+			return false;
+		length += MIN_MATCH;
+
+		if (offset == 0 || offset > out || _outSize - out < length)
+			return false;
+
+		// Byte by byte, matches may overlap what they produce
+		const uint8_t* match = _out + out - offset;
+		for (size_t k = 0; k < length; ++k)
+			_out[out + k] = match[k];
+		out += length;
+	}
+
+	return out == _outSize;
+}
+
+void shuffle_bytes(const uint8_t* _data, size_t _size, int _elementSize, uint8_t* _out)
+{
+	size_t count = _size / _elementSize;
+
+	for (int b = 0; b < _elementSize; ++b) {
+		uint8_t* plane = _out + b * count;
+		uint8_t previous = 0;
+		for (size_t i = 0; i < count; ++i) {
+			uint8_t value = _data[i * _elementSize + b];
+			plane[i] = (uint8_t)(value - previous);
+			previous = value;
+		}
+	}
+
+	// Bytes that do not make up a whole element are copied as they are
+	size_t tail = count * _elementSize;
+	memcpy(_out + tail, _data + tail, _size - tail);
+}
+
+void unshuffle_bytes(const uint8_t* _data, size_t _size, int _elementSize, uint8_t* _out)
+{
+	size_t count = _size / _elementSize;
+
+	for (int b = 0; b < _elementSize; ++b) {
+		const uint8_t* plane = _data + b * count;
+		uint8_t value = 0;
+		for (size_t i = 0; i < count; ++i) {
+			value = (uint8_t)(value + plane[i]);
+			_out[i * _elementSize + b] = value;
+		}
+	}
+
+	size_t tail = count * _elementSize;
+	memcpy(_out + tail, _data + tail, _size - tail);
+}
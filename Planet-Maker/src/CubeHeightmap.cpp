@@ -0,0 +1,101 @@
+#include "CubeHeightmap.h"
+#include <algorithm>
+#include <cstring>
+
+#include "BakeCache.h"
+#include "FeatureLayer.h"
+#include "OctaveCache.h"
+#include "PlanetSurface.h"
+
+CubeHeightmap::CubeHeightmap()
+{
+	resolution = 0;
+}
+
+uint64_t CubeHeightmap::cacheKey(const PlanetParameters& _params, int _resolution)
+{
+	return BakeKey("cube_heightmap", GENERATOR_VERSION)
+		.add(_resolution)
+		.add(_params.noise_method)
+		.add(_params.terrain_seed)
+		.add(_params.terrain_vert_frequency)
+		.add(_params.terrain_octaves)
+		.add(FeatureLayer::cacheKey(_params))
+		.get();
+}
+
+bool CubeHeightmap::bake(const PlanetParameters& _params, int _resolution, BakeCache* _cache, JobSystem* _jobs, const CancelToken& _cancel)
+{
+	// sample() interpolates between two texels
+	resolution = std::max(2, _resolution);
+	size_t count = 6 * (size_t)resolution * resolution;
+	uint64_t key = cacheKey(_params, resolution);
+
+	if (_cache) {
+		std::vector<uint8_t> blob;
+		if (_cache->load(key, blob) && blob.size() == count * sizeof(float)) {
+			heights.resize(count);
+			memcpy(heights.data(), blob.data(), blob.size());
+			return true;
+		}
+	}
+
+	if (_jobs == nullptr)
+		_jobs = &JobSystem::global();
+
+	// Sum of the octaves in the order of PlanetSurface::elevation(), only
+	// the ones this process has not evaluated yet cost noise samples
+	OctaveCache& octaves = OctaveCache::global();
+	std::vector<CubeLayer> layers;
+	for (int o = 0; o < std::max(_params.terrain_octaves, 1) && !_cancel.isCancelled(); ++o)
+		layers.push_back(octaves.octave(_params, o, resolution, *_jobs, _cancel));
+	if (FeatureLayer::cacheKey(_params) != 0 && !_cancel.isCancelled())
+		layers.push_back(octaves.features(_params, resolution, *_jobs, _cancel));
+
+	heights.resize(count);
+	if (!_cancel.isCancelled()) {
+		_jobs->parallelFor(6 * resolution, 16, [&](int _begin, int _end) {
+			size_t begin = (size_t)_begin * resolution;
+			size_t end = (size_t)_end * resolution;
+			const float* first = layers[0]->data();
+			for (size_t i = begin; i < end; ++i)
+				heights[i] = first[i];
+			for (size_t l = 1; l < layers.size(); ++l) {
+				const float* values = layers[l]->data();
+				for (size_t i = begin; i < end; ++i)
+					heights[i] += values[i];
+			}
+		}, _cancel);
+	}
+
+	if (_cancel.isCancelled()) {
+		heights.clear();
+		return false;
+	}
+
+	if (_cache)
+		_cache->store(key, heights.data(), heights.size() * sizeof(float), sizeof(float));
+	return false;
+}
+
+float CubeHeightmap::sample(const glm::vec3& _direction) const
+{
+	int face;
+	float s, t;
+	PlanetSurface::cubeCoordinates(_direction, face, s, t);
+
+	// Texel centers sit at (i + 0.5) / resolution
+	float x = (s * 0.5f + 0.5f) * resolution - 0.5f;
+	float y = (t * 0.5f + 0.5f) * resolution - 0.5f;
+	x = glm::clamp(x, 0.0f, resolution - 1.0f);
+	y = glm::clamp(y, 0.0f, resolution - 1.0f);
+
+	int x0 = std::min((int)x, resolution - 2);
+	int y0 = std::min((int)y, resolution - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	float top = glm::mix(at(face, x0, y0), at(face, x0 + 1, y0), fx);
+	float bottom = glm::mix(at(face, x0, y0 + 1), at(face, x0 + 1, y0 + 1), fx);
+	return glm::mix(top, bottom, fy);
+}
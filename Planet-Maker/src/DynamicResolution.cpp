@@ -0,0 +1,146 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+// Scale steps are quantized so tiny timing jitter does not move the viewport every frame
+static const float SCALE_STEP = 1.0f / 64.0f;
+
+DynamicResolution::DynamicResolution()
+{
+	enabled = false;
+	budget_ms = 16.0f;
+	min_scale = 0.35f;
+	max_scale = 1.0f;
+	sharpness = 0.4f;
+
+	vao = 0;
+	timer_queries[0] = timer_queries[1] = 0;
+	timer_pending[0] = timer_pending[1] = false;
+	frame = 0;
+
+	scale = 1.0f;
+	gpu_ms = 0.0f;
+	window_width = window_height = 0;
+	render_width = render_height = 0;
+}
+
+
+DynamicResolution::~DynamicResolution()
+{
+	if (timer_queries[0] != 0)
+		glDeleteQueries(2, timer_queries);
+	if (vao != 0)
+		glDeleteVertexArrays(1, &vao);
+}
+
+void DynamicResolution::init()
+{
+	upscale_shader.createShader("shaders/fullscreen_vert.glsl", "shaders/upscale_frag.glsl");
+
+	loc_source = glGetUniformLocation(upscale_shader.programID, "source");
+	loc_uv_scale = glGetUniformLocation(upscale_shader.programID, "uv_scale");
+	loc_texel_size = glGetUniformLocation(upscale_shader.programID, "texel_size");
+	loc_sharpness = glGetUniformLocation(upscale_shader.programID, "sharpness");
+
+	glGenQueries(2, timer_queries);
+	glGenVertexArrays(1, &vao);
+}
+
+void DynamicResolution::begin(int _windowWidth, int _windowHeight)
+{
+	window_width = _windowWidth;
+	window_height = _windowHeight;
+
+	readTimer();
+
+	if (enabled) {
+		if (target.width != window_width || target.height != window_height)
+			target.create(window_width, window_height);
+
+		render_width = std::max(1, (int)(window_width * scale));
+		render_height = std::max(1, (int)(window_height * scale));
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		glViewport(0, 0, render_width, render_height);
+	}
+	else {
+		render_width = window_width;
+		render_height = window_height;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, window_width, window_height);
+	}
+
+	int slot = frame & 1;
+	glBeginQuery(GL_TIME_ELAPSED, timer_queries[slot]);
+	timer_pending[slot] = true;
+}
+
+void DynamicResolution::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	++frame;
+
+	if (!enabled)
+		return;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, window_width, window_height);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	glUseProgram(upscale_shader.programID);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, target.colorTexture);
+	glUniform1i(loc_source, 0);
+	glUniform2f(loc_uv_scale, (float)render_width / target.width, (float)render_height / target.height);
+	glUniform2f(loc_texel_size, 1.0f / target.width, 1.0f / target.height);
+	// No sharpening at native resolution, the filter would only add ringing
+	glUniform1f(loc_sharpness, render_width < window_width ? sharpness : 0.0f);
+
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+}
+
+//! Picks up the timer of the previous frame if the GPU is done with it.
+void DynamicResolution::readTimer()
+{
+	int slot = frame & 1;
+	if (!timer_pending[slot])
+		return;
+
+	GLint available = 0;
+	glGetQueryObjectiv(timer_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(timer_queries[slot], GL_QUERY_RESULT, &nanoseconds);
+	timer_pending[slot] = false;
+
+	gpu_ms = (float)(nanoseconds / 1.0e6);
+	updateScale();
+}
+
+void DynamicResolution::updateScale()
+{
+	if (!enabled || gpu_ms <= 0.0f)
+		return;
+
+	// Shading cost follows the pixel count, i.e. scale squared
+	float ideal = scale * std::sqrt(budget_ms / gpu_ms);
+
+	// Drop quickly when over budget, recover slowly to avoid oscillating
+	float rate = ideal < scale ? 0.5f : 0.1f;
+	float next = scale + (ideal - scale) * rate;
+
+	next = std::min(std::max(next, min_scale), max_scale);
+	scale = std::round(next / SCALE_STEP) * SCALE_STEP;
+}
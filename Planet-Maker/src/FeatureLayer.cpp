@@ -0,0 +1,351 @@
+#include "FeatureLayer.h"
+#include "BakeCache.h"
+#include "PlanetSurface.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+static const float PI = 3.141592653f;
+// Craters come in sizes from feature_size / CRATER_SIZE_RANGE to feature_size,
+// N(> r) ~ r^-CRATER_SIZE_EXPONENT like the counts on real surfaces
+static const float CRATER_SIZE_RANGE = 32.0f;
+static const float CRATER_SIZE_EXPONENT = 2.0f;
+// Same values as terrain_vert.glsl
+static const float CRATER_RIM = 0.65f;    // rim of a crater, fraction of its footprint
+static const float CALDERA_DEPTH = 0.3f;  // below the rim of a volcano
+// Stamps per grid cell on average, the cells their footprints overlap list more
+static const float STAMPS_PER_CELL = 2.0f;
+static const int MAX_GRID_SIZE = 256;
+// Angle between the normal and the corners of a cube face
+static const float FACE_CORNER_ANGLE = 0.9553166f;
+// Layers kept by get(), a few planets may be open at once
+static const size_t SHARED_LAYERS = 4;
+
+// Normal, s and t axis of every face, see PlanetSurface::cubeDirection()
+static const glm::vec3 FACE_AXES[6][3] = {
+	{ glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0) },
+	{ glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, -1, 0) },
+	{ glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) },
+	{ glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1) },
+	{ glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0) },
+	{ glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0) },
+};
+
+// PCG hash of a running state, uniform floats in 0..1
+struct FeatureRandom
+{
+	uint32_t state;
+
+	explicit FeatureRandom(uint32_t _seed) : state(_seed) {}
+
+	uint32_t next()
+	{
+		state = state * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+	float range(float _min, float _max) { return _min + (_max - _min) * uniform(); }
+};
+
+// Cells of one face a stamp touches
+struct CellRange
+{
+	uint32_t stamp;
+	int face;
+	int x0, x1, y0, y1;
+};
+
+FeatureLayer::FeatureLayer()
+{
+	grid_size = 0;
+}
+
+
+//! Uniformly distributed unit direction.
+static glm::vec3 random_direction(FeatureRandom& _random)
+{
+	float z = 2.0f * _random.uniform() - 1.0f;
+	float phi = 2.0f * PI * _random.uniform();
+	float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+	return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+//! Height of a stamp _x footprints away from its center or, for rifts, its
+//! line, in units of the stamp height. 0 at and beyond the footprint. Same as
+//! stamp_profile() of terrain_vert.glsl.
+static float stamp_profile(int _kind, float _x, float _variation)
+{
+	if (_x >= 1.0f)
+		return 0.0f;
+
+	if (_kind == FEATURE_CRATER) {
+		// Bowl inside the rim, the ejecta fall off outside of it
+		float rim = 0.1f + 0.2f * _variation;
+		if (_x < CRATER_RIM) {
+			float u = _x / CRATER_RIM;
+			return u * u - 1.0f + rim;
+		}
+		float v = 1.0f - (_x - CRATER_RIM) / (1.0f - CRATER_RIM);
+		return rim * v * v;
+	}
+
+	if (_kind == FEATURE_VOLCANO) {
+		float caldera = 0.08f + 0.12f * _variation;
+		if (_x < caldera) {
+			float u = _x / caldera;
+			return (1.0f - caldera) * (1.0f - caldera) - CALDERA_DEPTH * (1.0f - u * u);
+		}
+		return (1.0f - _x) * (1.0f - _x);
+	}
+
+	float w = 1.0f - _x * _x;
+	return -w * w;
+}
+
+//! Height of _stamp at _direction, noise units.
+static float stamp_height(const FeatureStamp& _stamp, const glm::vec3& _direction)
+{
+	glm::vec3 center = glm::vec3(_stamp.center);
+	float radius = _stamp.center.w;
+	int kind = (int)_stamp.shape.x;
+
+	float distance;
+	float taper = 1.0f;
+	if (kind == FEATURE_RIFT) {
+		// Distance from the great circle through the rift, fading out towards its ends
+		glm::vec3 axis = glm::vec3(_stamp.axis);
+		float along = glm::dot(_direction, axis) / glm::dot(axis, axis);
+		if (std::abs(along) >= 1.0f || glm::dot(_direction, center) <= 0.0f)
+			return 0.0f;
+		distance = std::abs(glm::dot(_direction, glm::normalize(glm::cross(center, axis))));
+		taper = 1.0f - along * along;
+	}
+	else {
+		distance = glm::length(_direction - center);
+	}
+
+	if (distance >= radius)
+		return 0.0f;
+	return _stamp.shape.y * taper * stamp_profile(kind, distance / radius, _stamp.shape.z);
+}
+
+void FeatureLayer::build(const PlanetParameters& _params)
+{
+	stamps.clear();
+	cells.clear();
+	grid_size = 0;
+	if (!_params.features_enabled)
+		return;
+
+	FeatureRandom random((uint32_t)BakeKey("feature stamps", GENERATOR_VERSION).add(_params.feature_seed).get());
+	float largest = std::max(_params.feature_size, 1.0e-4f);
+	float strength = _params.feature_strength;
+
+	int craters = std::max(_params.feature_craters, 0);
+	int volcanoes = std::max(_params.feature_volcanoes, 0);
+	int rifts = std::max(_params.feature_rifts, 0);
+	stamps.reserve((size_t)craters + volcanoes + rifts);
+
+	// Inverse of the cumulative distribution of a power law cut off at both ends
+	float smallest = largest / CRATER_SIZE_RANGE;
+	float tail = 1.0f - std::pow(CRATER_SIZE_RANGE, -CRATER_SIZE_EXPONENT);
+	for (int i = 0; i < craters; ++i) {
+		FeatureStamp stamp;
+		float radius = smallest * std::pow(1.0f - random.uniform() * tail, -1.0f / CRATER_SIZE_EXPONENT);
+		stamp.center = glm::vec4(random_direction(random), radius);
+		stamp.axis = glm::vec4(0.0f);
+		// Deeper the wider, like simple craters
+		stamp.shape = glm::vec4((float)FEATURE_CRATER, strength * radius / largest, random.uniform(), 0.0f);
+		stamps.push_back(stamp);
+	}
+
+	for (int i = 0; i < volcanoes; ++i) {
+		FeatureStamp stamp;
+		float radius = random.range(0.3f, 1.0f) * largest;
+		stamp.center = glm::vec4(random_direction(random), radius);
+		stamp.axis = glm::vec4(0.0f);
+		stamp.shape = glm::vec4((float)FEATURE_VOLCANO, strength * radius / largest, random.uniform(), 0.0f);
+		stamps.push_back(stamp);
+	}
+
+	for (int i = 0; i < rifts; ++i) {
+		FeatureStamp stamp;
+		glm::vec3 center = random_direction(random);
+		float width = random.range(0.1f, 0.25f) * largest;
+		float length = random.range(0.5f, 2.0f) * largest;
+
+		// Any direction along the surface
+		glm::vec3 along = random_direction(random);
+		along -= glm::dot(along, center) * center;
+		if (glm::dot(along, along) < 1.0e-6f)
+			along = std::abs(center.z) < 0.9f ? glm::cross(center, glm::vec3(0, 0, 1)) : glm::cross(center, glm::vec3(1, 0, 0));
+
+		stamp.center = glm::vec4(center, width);
+		stamp.axis = glm::vec4(length * glm::normalize(along), 0.0f);
+		stamp.shape = glm::vec4((float)FEATURE_RIFT, strength * random.range(0.5f, 1.0f), random.uniform(), 0.0f);
+		stamps.push_back(stamp);
+	}
+
+	buildGrid();
+}
+
+//! Angles around _across, measured from _normal towards _along, that the cap
+//! around _center with the angular radius _radius covers, cut to the 90
+//! degrees of one face. False if the cap misses them.
+static bool cap_angles(const glm::vec3& _center, float _radius, const glm::vec3& _normal,
+	const glm::vec3& _along, const glm::vec3& _across, float& _min, float& _max)
+{
+	float angle = std::atan2(glm::dot(_center, _along), glm::dot(_center, _normal));
+	float latitude = std::asin(glm::clamp(glm::dot(_center, _across), -1.0f, 1.0f));
+
+	// A cap that contains the pole _across covers every angle
+	float spread = PI;
+	if (_radius < 0.5f * PI - std::abs(latitude))
+		spread = std::asin(std::min(1.0f, std::sin(_radius) / std::cos(latitude)));
+
+	_min = std::max(angle - spread, -0.25f * PI);
+	_max = std::min(angle + spread, 0.25f * PI);
+	return _min <= _max;
+}
+
+//! Cell of a face coordinate in -1..1, _size cells per edge.
+static int grid_cell(float _coordinate, int _size)
+{
+	return glm::clamp((int)((_coordinate + 1.0f) * 0.5f * _size), 0, _size - 1);
+}
+
+void FeatureLayer::buildGrid()
+{
+	const int size = glm::clamp((int)std::sqrt(stamps.size() / (6.0f * STAMPS_PER_CELL)), 1, MAX_GRID_SIZE);
+	grid_size = size;
+
+	// The face rectangles around the footprint of every stamp
+	std::vector<CellRange> ranges;
+	ranges.reserve(stamps.size() + stamps.size() / 4);
+	for (size_t i = 0; i < stamps.size(); ++i) {
+		const FeatureStamp& stamp = stamps[i];
+		glm::vec3 center = glm::vec3(stamp.center);
+		float reach = std::asin(std::min(1.0f, stamp.center.w)) + std::asin(std::min(1.0f, glm::length(glm::vec3(stamp.axis))));
+		reach += 1.0e-4f; // cells computed from tan() and from cubeCoordinates() may round apart
+
+		float face_reach = std::cos(std::min(FACE_CORNER_ANGLE + reach, PI));
+		for (int face = 0; face < 6; ++face) {
+			const glm::vec3* axes = FACE_AXES[face];
+			if (glm::dot(center, axes[0]) < face_reach)
+				continue;
+
+			float s0, s1, t0, t1;
+			if (!cap_angles(center, reach, axes[0], axes[1], axes[2], s0, s1) ||
+				!cap_angles(center, reach, axes[0], axes[2], axes[1], t0, t1))
+				continue;
+
+			CellRange range;
+			range.stamp = (uint32_t)i;
+			range.face = face;
+			range.x0 = grid_cell(std::tan(s0), size);
+			range.x1 = grid_cell(std::tan(s1), size);
+			range.y0 = grid_cell(std::tan(t0), size);
+			range.y1 = grid_cell(std::tan(t1), size);
+			ranges.push_back(range);
+		}
+	}
+
+	// Counting sort into the cells, stamps stay in index order within a cell
+	const size_t cell_count = 6 * (size_t)size * size;
+	std::vector<uint32_t> counts(cell_count, 0);
+	for (const CellRange& range : ranges) {
+		for (int y = range.y0; y <= range.y1; ++y)
+			for (int x = range.x0; x <= range.x1; ++x)
+				++counts[((size_t)range.face * size + y) * size + x];
+	}
+
+	size_t entries = 0;
+	for (size_t c = 0; c < cell_count; ++c)
+		entries += counts[c];
+
+	cells.resize(cell_count + 1 + entries);
+	uint32_t offset = (uint32_t)(cell_count + 1);
+	for (size_t c = 0; c < cell_count; ++c) {
+		cells[c] = offset;
+		offset += counts[c];
+	}
+	cells[cell_count] = offset;
+
+	std::vector<uint32_t> next(cells.begin(), cells.begin() + cell_count);
+	for (const CellRange& range : ranges) {
+		for (int y = range.y0; y <= range.y1; ++y)
+			for (int x = range.x0; x <= range.x1; ++x)
+				cells[next[((size_t)range.face * size + y) * size + x]++] = range.stamp;
+	}
+}
+
+float FeatureLayer::height(const glm::vec3& _direction) const
+{
+	if (stamps.empty())
+		return 0.0f;
+
+	int face;
+	float s, t;
+	PlanetSurface::cubeCoordinates(_direction, face, s, t);
+	size_t cell = ((size_t)face * grid_size + grid_cell(t, grid_size)) * grid_size + grid_cell(s, grid_size);
+
+	float result = 0.0f;
+	for (uint32_t e = cells[cell]; e < cells[cell + 1]; ++e)
+		result += stamp_height(stamps[cells[e]], _direction);
+	return result;
+}
+
+uint64_t FeatureLayer::cacheKey(const PlanetParameters& _params)
+{
+	if (!_params.features_enabled)
+		return 0;
+
+	return BakeKey("feature_layer", GENERATOR_VERSION)
+		.add(_params.feature_seed)
+		.add(_params.feature_craters)
+		.add(_params.feature_volcanoes)
+		.add(_params.feature_rifts)
+		.add(_params.feature_size)
+		.add(_params.feature_strength)
+		.get();
+}
+
+std::shared_ptr<const FeatureLayer> FeatureLayer::get(const PlanetParameters& _params)
+{
+	uint64_t key = cacheKey(_params);
+	if (key == 0)
+		return nullptr;
+
+	// Most recently used last
+	static std::mutex mutex;
+	static std::vector<std::pair<uint64_t, std::shared_ptr<const FeatureLayer>>> shared;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < shared.size(); ++i) {
+			if (shared[i].first != key)
+				continue;
+			std::pair<uint64_t, std::shared_ptr<const FeatureLayer>> entry = shared[i];
+			shared.erase(shared.begin() + i);
+			shared.push_back(entry);
+			return entry.second;
+		}
+	}
+
+	// Built outside the lock, other threads may build the same layer meanwhile
+	std::shared_ptr<FeatureLayer> layer = std::make_shared<FeatureLayer>();
+	layer->build(_params);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < shared.size(); ++i) {
+		if (shared[i].first == key)
+			return shared[i].second;
+	}
+	shared.push_back(std::make_pair(key, std::shared_ptr<const FeatureLayer>(layer)));
+	if (shared.size() > SHARED_LAYERS)
+		shared.erase(shared.begin());
+	return layer;
+}
@@ -0,0 +1,77 @@
+#include "Framebuffer.h"
+#include <iostream>
+
+Framebuffer::Framebuffer()
+{
+	fbo = 0;
+	colorTexture = 0;
+	depthBuffer = 0;
+	width = height = 0;
+	colorFormat = GL_RGBA8;
+}
+
+
+Framebuffer::~Framebuffer()
+{
+	clean();
+}
+
+bool Framebuffer::create(int _width, int _height, GLenum _colorFormat)
+{
+	clean();
+
+	width = _width;
+	height = _height;
+	colorFormat = _colorFormat;
+
+	glGenTextures(1, &colorTexture);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, colorFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void Framebuffer::clean()
+{
+	if (fbo != 0)
+		glDeleteFramebuffers(1, &fbo);
+	if (colorTexture != 0)
+		glDeleteTextures(1, &colorTexture);
+	if (depthBuffer != 0)
+		glDeleteRenderbuffers(1, &depthBuffer);
+
+	fbo = colorTexture = depthBuffer = 0;
+}
+
+void Framebuffer::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+}
+
+void Framebuffer::unbind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,178 @@
+#include "ImageWriter.h"
+#include "Checksum.h"
+#include <cstring>
+#include <utility>
+
+static const size_t MAX_STORED_BLOCK = 65535;
+
+static void put_u32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+
+PngWriter::PngWriter()
+{
+	file = nullptr;
+	width = height = channels = bitDepth = rowsWritten = 0;
+	adlerA = 1;
+	adlerB = 0;
+}
+
+
+PngWriter::~PngWriter()
+{
+	if (file)
+		close();
+}
+
+bool PngWriter::open(const std::string& _filePath, int _width, int _height, int _channels, int _bitDepth)
+{
+	if (_channels < 1 || _channels > 4 || (_bitDepth != 8 && _bitDepth != 16))
+		return false;
+
+	file = fopen(_filePath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	width = _width;
+	height = _height;
+	channels = _channels;
+	bitDepth = _bitDepth;
+	rowsWritten = 0;
+	adlerA = 1;
+	adlerB = 0;
+	block.clear();
+	block.reserve(MAX_STORED_BLOCK);
+
+	static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	fwrite(signature, 1, 8, file);
+
+	static const uint8_t color_types[5] = { 0, 0, 4, 2, 6 }; // gray, gray+alpha, rgb, rgba
+	uint8_t ihdr[13];
+	put_u32(ihdr, (uint32_t)width);
+	put_u32(ihdr + 4, (uint32_t)height);
+	ihdr[8] = (uint8_t)bitDepth;
+	ihdr[9] = color_types[channels];
+	ihdr[10] = 0; // deflate
+	ihdr[11] = 0; // adaptive filtering
+	ihdr[12] = 0; // no interlace
+	writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+	// zlib header: deflate, 32K window, no preset dictionary
+	static const uint8_t zlib_header[2] = { 0x78, 0x01 };
+	writeChunk("IDAT", zlib_header, 2);
+
+	return true;
+}
+
+bool PngWriter::writeRow(const void* _row)
+{
+	if (!file || rowsWritten >= height)
+		return false;
+
+	// Filter type 0 then the samples, big endian for 16 bit
+	const size_t row_bytes = (size_t)width * channels * (bitDepth / 8);
+	row.resize(1 + row_bytes);
+	row[0] = 0;
+	memcpy(&row[1], _row, row_bytes);
+	if (bitDepth == 16) {
+		for (size_t i = 1; i + 1 < row.size(); i += 2)
+			std::swap(row[i], row[i + 1]);
+	}
+
+	for (size_t i = 0; i < row.size(); ++i) {
+		adlerA = (adlerA + row[i]) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	}
+
+	size_t done = 0;
+	while (done < row.size()) {
+		size_t n = row.size() - done;
+		if (n > MAX_STORED_BLOCK - block.size())
+			n = MAX_STORED_BLOCK - block.size();
+
+		block.insert(block.end(), row.begin() + done, row.begin() + done + n);
+		done += n;
+
+		if (block.size() == MAX_STORED_BLOCK)
+			flushBlock(false);
+	}
+
+	++rowsWritten;
+	return !ferror(file);
+}
+
+bool PngWriter::close()
+{
+	if (!file)
+		return false;
+
+	bool complete = rowsWritten == height;
+
+	flushBlock(true);
+
+	uint8_t adler[4];
+	put_u32(adler, (adlerB << 16) | adlerA);
+	writeChunk("IDAT", adler, 4);
+	writeChunk("IEND", nullptr, 0);
+
+	bool ok = !ferror(file) && complete;
+	fclose(file);
+	file = nullptr;
+	return ok;
+}
+
+void PngWriter::flushBlock(bool _final)
+{
+	// Stored block: BFINAL/BTYPE byte, LEN, NLEN, payload
+	uint16_t len = (uint16_t)block.size();
+	uint16_t nlen = (uint16_t)~len;
+
+	scratch.resize(5 + block.size());
+	scratch[0] = _final ? 1 : 0;
+	scratch[1] = (uint8_t)(len & 0xff);
+	scratch[2] = (uint8_t)(len >> 8);
+	scratch[3] = (uint8_t)(nlen & 0xff);
+	scratch[4] = (uint8_t)(nlen >> 8);
+	if (!block.empty())
+		memcpy(&scratch[5], block.data(), block.size());
+
+	writeChunk("IDAT", scratch.data(), scratch.size());
+	block.clear();
+}
+
+void PngWriter::writeChunk(const char _type[4], const uint8_t* _data, size_t _length)
+{
+	uint8_t header[8];
+	put_u32(header, (uint32_t)_length);
+	memcpy(header + 4, _type, 4);
+	fwrite(header, 1, 8, file);
+	if (_length > 0)
+		fwrite(_data, 1, _length, file);
+
+	uint32_t crc = crc32(_type, 4);
+	crc = crc32(_data, _length, crc);
+	uint8_t tail[4];
+	put_u32(tail, crc);
+	fwrite(tail, 1, 4, file);
+}
+
+
+bool write_png(const std::string& _filePath, int _width, int _height, int _channels,
+	const uint8_t* _pixels, bool _flipRows)
+{
+	PngWriter writer;
+	if (!writer.open(_filePath, _width, _height, _channels))
+		return false;
+
+	const size_t row_bytes = (size_t)_width * _channels;
+	for (int y = 0; y < _height; ++y) {
+		int row = _flipRows ? _height - 1 - y : y;
+		writer.writeRow(_pixels + row * row_bytes);
+	}
+	return writer.close();
+}
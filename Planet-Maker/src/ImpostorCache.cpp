@@ -0,0 +1,191 @@
+#include "ImpostorCache.h"
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+ImpostorCache::ImpostorCache()
+{
+	max_bakes_per_frame = 8;
+	refresh_angle = 0.25f;
+
+	slot_size = 0;
+	slots_per_row = 0;
+	frame = 0;
+	bakes_this_frame = 0;
+
+	previous_framebuffer = 0;
+	for (int i = 0; i < 4; ++i)
+		previous_viewport[i] = 0;
+
+	billboard_vao = 0;
+	billboard_buffer = 0;
+}
+
+
+ImpostorCache::~ImpostorCache()
+{
+	if (billboard_buffer != 0)
+		glDeleteBuffers(1, &billboard_buffer);
+	if (billboard_vao != 0)
+		glDeleteVertexArrays(1, &billboard_vao);
+}
+
+void ImpostorCache::init(int _atlasSize, int _slotSize)
+{
+	atlas.create(_atlasSize, _atlasSize);
+	slot_size = _slotSize;
+	slots_per_row = _atlasSize / _slotSize;
+	slots.assign(slots_per_row * slots_per_row, Slot());
+
+	billboard_shader.createShader("shaders/impostor_vert.glsl", "shaders/impostor_frag.glsl");
+	loc_P = glGetUniformLocation(billboard_shader.programID, "P");
+	loc_V = glGetUniformLocation(billboard_shader.programID, "V");
+	loc_atlas = glGetUniformLocation(billboard_shader.programID, "atlas");
+
+	// Two vec4 per instance, the quad corners come from gl_VertexID
+	glGenVertexArrays(1, &billboard_vao);
+	glGenBuffers(1, &billboard_buffer);
+
+	glBindVertexArray(billboard_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, billboard_buffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+	glVertexAttribDivisor(0, 1);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+	glVertexAttribDivisor(1, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ImpostorCache::beginFrame()
+{
+	billboards.clear();
+	bakes_this_frame = 0;
+	++frame;
+}
+
+bool ImpostorCache::lookup(int _planet, uint64_t _hash, const glm::vec3& _direction, const glm::vec3& _up, int& _slot)
+{
+	std::unordered_map<int, int>::iterator it = slot_of_planet.find(_planet);
+	if (it == slot_of_planet.end()) {
+		_slot = -1;
+		return false;
+	}
+
+	_slot = it->second;
+	Slot& slot = slots[_slot];
+	slot.last_used = frame;
+
+	float cos_limit = std::cos(refresh_angle);
+	return slot.hash == _hash &&
+		glm::dot(slot.direction, _direction) > cos_limit &&
+		glm::dot(slot.up, _up) > cos_limit;
+}
+
+int ImpostorCache::acquire(int _planet)
+{
+	if (bakes_this_frame >= max_bakes_per_frame || slots.empty())
+		return -1;
+
+	std::unordered_map<int, int>::iterator it = slot_of_planet.find(_planet);
+	if (it != slot_of_planet.end())
+		return it->second;
+
+	// Least recently drawn slot, never one that is on screen this frame
+	int best = -1;
+	for (int i = 0; i < (int)slots.size(); ++i) {
+		if (slots[i].last_used == frame)
+			continue;
+		if (best < 0 || slots[i].last_used < slots[best].last_used)
+			best = i;
+	}
+	if (best < 0)
+		return -1;
+
+	if (slots[best].planet >= 0)
+		slot_of_planet.erase(slots[best].planet);
+
+	slots[best] = Slot();
+	slots[best].planet = _planet;
+	slots[best].last_used = frame;
+	slot_of_planet[_planet] = best;
+	return best;
+}
+
+void ImpostorCache::beginBake(int _slot)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+	glGetIntegerv(GL_VIEWPORT, previous_viewport);
+
+	int x = (_slot % slots_per_row) * slot_size;
+	int y = (_slot / slots_per_row) * slot_size;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, atlas.fbo);
+	glViewport(x, y, slot_size, slot_size);
+	glScissor(x, y, slot_size, slot_size);
+	glEnable(GL_SCISSOR_TEST);
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClearStencil(0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void ImpostorCache::endBake(int _slot, uint64_t _hash, const glm::vec3& _direction, const glm::vec3& _up)
+{
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+	glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+
+	Slot& slot = slots[_slot];
+	slot.hash = _hash;
+	slot.direction = _direction;
+	slot.up = _up;
+	++bakes_this_frame;
+}
+
+//! Atlas coordinates of a slot as (u, v, width, height), half a texel inside
+//! so linear filtering does not pick up the neighbours.
+glm::vec4 ImpostorCache::slotRect(int _slot) const
+{
+	float texel = 1.0f / atlas.width;
+	float size = (float)slot_size / atlas.width;
+
+	return glm::vec4((_slot % slots_per_row) * size + 0.5f * texel,
+		(_slot / slots_per_row) * size + 0.5f * texel,
+		size - texel, size - texel);
+}
+
+void ImpostorCache::addBillboard(int _slot, const glm::vec3& _center, float _radius)
+{
+	slots[_slot].last_used = frame;
+	billboards.push_back(glm::vec4(_center, _radius));
+	billboards.push_back(slotRect(_slot));
+}
+
+void ImpostorCache::render(const glm::mat4& _projection, const glm::mat4& _view)
+{
+	if (billboards.empty())
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, billboard_buffer);
+	glBufferData(GL_ARRAY_BUFFER, billboards.size() * sizeof(glm::vec4), billboards.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(billboard_shader.programID);
+	glUniformMatrix4fv(loc_P, 1, GL_FALSE, glm::value_ptr(_projection));
+	glUniformMatrix4fv(loc_V, 1, GL_FALSE, glm::value_ptr(_view));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, atlas.colorTexture);
+	glUniform1i(loc_atlas, 0);
+
+	// The bakes blend over a transparent black slot, so the atlas is premultiplied
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindVertexArray(billboard_vao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, getBillboardCount());
+	glBindVertexArray(0);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
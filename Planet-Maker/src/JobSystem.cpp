@@ -0,0 +1,279 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+struct Task
+{
+	std::function<void()> work;
+	CancelToken cancel;
+	bool main_thread;
+
+	// Unfinished dependencies, plus one while the task is being set up
+	std::atomic<int> waiting;
+	std::atomic<bool> done;
+
+	std::mutex mutex;
+	bool finished; // under mutex, no continuations can be added afterwards
+	std::vector<TaskRef> continuations;
+};
+
+// Worker the current thread belongs to, -1 on threads outside the pool
+static thread_local JobSystem* current_system = nullptr;
+static thread_local int current_index = -1;
+
+JobSystem::JobSystem(int _workers)
+{
+	if (_workers < 0)
+		_workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	worker_count = _workers;
+	queued = 0;
+	stopping = false;
+	main_thread = std::this_thread::get_id();
+
+	for (int i = 0; i <= _workers; ++i)
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	for (int i = 0; i < _workers; ++i)
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+
+JobSystem::~JobSystem()
+{
+	// Workers drain the queues before they stop
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+JobSystem& JobSystem::global()
+{
+	static JobSystem system;
+	return system;
+}
+
+TaskRef JobSystem::create(std::function<void()> _work, const CancelToken& _cancel, bool _mainThread)
+{
+	TaskRef task = std::make_shared<Task>();
+	task->work = std::move(_work);
+	task->cancel = _cancel;
+	task->main_thread = _mainThread;
+	task->waiting = 1;
+	task->done = false;
+	task->finished = false;
+	return task;
+}
+
+TaskRef JobSystem::run(std::function<void()> _work, const CancelToken& _cancel)
+{
+	TaskRef task = create(std::move(_work), _cancel, false);
+	submit(task, std::vector<TaskRef>());
+	return task;
+}
+
+TaskRef JobSystem::runAfter(const std::vector<TaskRef>& _dependencies, std::function<void()> _work, const CancelToken& _cancel)
+{
+	TaskRef task = create(std::move(_work), _cancel, false);
+	submit(task, _dependencies);
+	return task;
+}
+
+TaskRef JobSystem::runOnMainThread(const std::vector<TaskRef>& _dependencies, std::function<void()> _work, const CancelToken& _cancel)
+{
+	TaskRef task = create(std::move(_work), _cancel, true);
+	submit(task, _dependencies);
+	return task;
+}
+
+//! Registers _task with every dependency that is still running, schedules it if there is none.
+void JobSystem::submit(const TaskRef& _task, const std::vector<TaskRef>& _dependencies)
+{
+	for (size_t i = 0; i < _dependencies.size(); ++i) {
+		Task& dependency = *_dependencies[i];
+		std::lock_guard<std::mutex> lock(dependency.mutex);
+		if (!dependency.finished) {
+			dependency.continuations.push_back(_task);
+			++_task->waiting;
+		}
+	}
+
+	// Drops the set up reference, the last dependency to finish may have been faster
+	if (--_task->waiting == 0)
+		schedule(_task);
+}
+
+void JobSystem::schedule(const TaskRef& _task)
+{
+	if (_task->main_thread) {
+		std::function<void()> wakeup;
+		{
+			std::lock_guard<std::mutex> lock(main_mutex);
+			main_tasks.push_back(_task);
+			wakeup = main_wakeup;
+		}
+		if (wakeup)
+			wakeup();
+		return;
+	}
+
+	int index = current_system == this ? current_index : worker_count;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(_task);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		++queued;
+	}
+	wake.notify_one();
+}
+
+void JobSystem::execute(const TaskRef& _task)
+{
+	if (!_task->cancel.isCancelled())
+		_task->work();
+	// Captures are released on the thread that ran the task
+	_task->work = nullptr;
+
+	std::vector<TaskRef> continuations;
+	{
+		std::lock_guard<std::mutex> lock(_task->mutex);
+		_task->finished = true;
+		continuations.swap(_task->continuations);
+	}
+	_task->done = true;
+
+	for (size_t i = 0; i < continuations.size(); ++i) {
+		if (--continuations[i]->waiting == 0)
+			schedule(continuations[i]);
+	}
+}
+
+//! Own deque from the back, then the shared queue, then steals from the front of the other workers.
+bool JobSystem::findTask(TaskRef& _task)
+{
+	int self = current_system == this ? current_index : -1;
+	int count = (int)queues.size();
+	int shared = worker_count;
+
+	for (int i = 0; i < count; ++i) {
+		int index = self < 0 ? (shared + i) % count : (self + i) % count;
+		WorkerQueue& queue = *queues[index];
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		if (index == self) {
+			_task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+		else {
+			_task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		--queued;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::workerLoop(int _index)
+{
+	current_system = this;
+	current_index = _index;
+
+	for (;;) {
+		TaskRef task;
+		if (findTask(task)) {
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake.wait(lock, [this] { return queued > 0 || stopping; });
+		if (stopping && queued == 0)
+			return;
+	}
+}
+
+//! Runs tasks, and main thread tasks on the main thread, until _busy turns false.
+void JobSystem::helpWhile(const std::function<bool()>& _busy)
+{
+	while (_busy()) {
+		TaskRef task;
+		if (findTask(task))
+			execute(task);
+		else if (!(isMainThread() && pumpMainThread(1) > 0))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::wait(const TaskRef& _task)
+{
+	helpWhile([&_task] { return !_task->done; });
+}
+
+bool JobSystem::isDone(const TaskRef& _task)
+{
+	return !_task || _task->done;
+}
+
+void JobSystem::parallelFor(int _count, int _grain, const std::function<void(int, int)>& _body, const CancelToken& _cancel)
+{
+	if (_count <= 0)
+		return;
+	_grain = std::max(1, _grain);
+
+	std::atomic<int> pending(0);
+	std::function<void(int, int)> range;
+
+	// Hands the upper half to the deque until the piece is small enough, thieves take the large halves first
+	range = [&](int _begin, int _end) {
+		while (_end - _begin > _grain) {
+			int middle = _begin + (_end - _begin) / 2;
+			++pending;
+			run([&range, &pending, middle, _end] {
+				range(middle, _end);
+				--pending;
+			});
+			_end = middle;
+		}
+
+		if (!_cancel.isCancelled())
+			_body(_begin, _end);
+	};
+
+	range(0, _count);
+	helpWhile([&pending] { return pending > 0; });
+}
+
+void JobSystem::setMainThreadWakeup(std::function<void()> _wakeup)
+{
+	std::lock_guard<std::mutex> lock(main_mutex);
+	main_wakeup = std::move(_wakeup);
+}
+
+int JobSystem::pumpMainThread(int _maxTasks)
+{
+	int executed = 0;
+	while (_maxTasks < 0 || executed < _maxTasks) {
+		TaskRef task;
+		{
+			std::lock_guard<std::mutex> lock(main_mutex);
+			if (main_tasks.empty())
+				break;
+			task = main_tasks.front();
+			main_tasks.pop_front();
+		}
+
+		execute(task);
+		++executed;
+	}
+	return executed;
+}
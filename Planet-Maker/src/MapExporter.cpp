@@ -0,0 +1,289 @@
+#include "MapExporter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "ClimateMap.h"
+#include "ImageWriter.h"
+#include "PresetFile.h"
+
+static const float PI = 3.14159265358979323846f;
+
+// Elevation range stored in the 16 bit heights, the fBm stays within it
+static const float HEIGHT_RANGE = 2.0f;
+
+MapExporter::MapExporter(const MapExportSettings& _settings) : settings(_settings), jobs(_settings.workers > 0 ? _settings.workers - 1 : -1)
+{
+	settings.workers = jobs.getThreadCount();
+}
+
+int MapExporter::run()
+{
+	PlanetParameters params;
+	if (!settings.preset.empty() && !load_preset(settings.preset, params)) {
+		std::cout << "Error reading preset " << settings.preset << std::endl;
+		return 1;
+	}
+
+	if (!exportMaps(params))
+		return 1;
+
+	std::cout << "Exported " << statistics.pixels / 1.0e6 << " Mpixel in " << statistics.seconds << " s, "
+		<< statistics.megapixelsPerSecond() << " Mpixel/s with " << settings.workers << " workers, "
+		<< statistics.peak_bytes / (1024 * 1024) << " MB strip memory" << std::endl;
+	return 0;
+}
+
+bool MapExporter::exportMaps(const PlanetParameters& _params)
+{
+	statistics = MapExportStatistics();
+	PlanetSurface surface(_params);
+
+	// Biome colours as terrain_frag.glsl draws them
+	CubeHeightmap heightmap;
+	heightmap.bake(_params, ClimateMap::DEFAULT_RESOLUTION, nullptr, &jobs);
+	ClimateMap climate;
+	climate.bake(heightmap, _params, &jobs);
+	surface.setClimateMap(&climate);
+
+	std::vector<Image> images;
+	if (settings.projection == MAP_EQUIRECTANGULAR) {
+		Image image = { settings.output_prefix, settings.width, std::max(1, settings.width / 2), -1 };
+		images.push_back(image);
+	}
+	else {
+		static const char* const FACE_NAMES[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+		for (int face = 0; face < 6; ++face) {
+			Image image = { settings.output_prefix + "_" + FACE_NAMES[face], settings.width, settings.width, face };
+			images.push_back(image);
+		}
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < images.size(); ++i) {
+		if (!exportImage(images[i], surface))
+			return false;
+	}
+
+	statistics.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+//! Direction of the pixel center, see MapProjection.
+static glm::vec3 pixel_direction(int _face, int _x, int _y, int _width, int _height)
+{
+	float u = (_x + 0.5f) / _width;
+	float v = (_y + 0.5f) / _height;
+
+	if (_face < 0) {
+		// Same parametrization as the texture coordinates of Sphere
+		float phi = u * 2.0f * PI;
+		float theta = v * PI;
+		return glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+	}
+
+	return PlanetSurface::cubeDirection(_face, 2.0f * u - 1.0f, 2.0f * v - 1.0f);
+}
+
+void MapExporter::fillStrip(const Image& _image, const PlanetSurface& _surface, Strip& _strip)
+{
+	for (int row = 0; row < _strip.rows; ++row) {
+		int y = _strip.first_row + row;
+		uint16_t* height = settings.export_height ? &_strip.height[(size_t)row * _image.width] : nullptr;
+		uint8_t* color = settings.export_color ? &_strip.color[(size_t)row * _image.width * 3] : nullptr;
+
+		for (int x = 0; x < _image.width; ++x) {
+			glm::vec3 direction = pixel_direction(_image.face, x, y, _image.width, _image.height);
+			float elevation = _surface.elevation(direction);
+
+			if (height) {
+				float normalized = (elevation + HEIGHT_RANGE) / (2.0f * HEIGHT_RANGE);
+				height[x] = (uint16_t)(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			}
+			if (color) {
+				glm::vec3 c = glm::clamp(_surface.color(direction, elevation), 0.0f, 1.0f);
+				color[3 * x] = (uint8_t)(c.r * 255.0f + 0.5f);
+				color[3 * x + 1] = (uint8_t)(c.g * 255.0f + 0.5f);
+				color[3 * x + 2] = (uint8_t)(c.b * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+bool MapExporter::exportImage(const Image& _image, const PlanetSurface& _surface)
+{
+	std::string extension = settings.format == MAP_PNG ? ".png" : ".raw";
+	std::string height_path = settings.export_height ? _image.name + "_height" + extension : "";
+	std::string color_path = settings.export_color ? _image.name + "_color" + extension : "";
+
+	// __________ OUTPUT FILES ______________
+	PngWriter height_png, color_png;
+	FILE* height_raw = nullptr;
+	FILE* color_raw = nullptr;
+	bool ok = true;
+
+	if (settings.format == MAP_PNG) {
+		if (settings.export_height)
+			ok = ok && height_png.open(height_path, _image.width, _image.height, 1, 16);
+		if (settings.export_color)
+			ok = ok && color_png.open(color_path, _image.width, _image.height, 3, 8);
+	}
+	else {
+		if (settings.export_height)
+			ok = ok && (height_raw = fopen(height_path.c_str(), "wb")) != nullptr;
+		if (settings.export_color)
+			ok = ok && (color_raw = fopen(color_path.c_str(), "wb")) != nullptr;
+	}
+
+	if (!ok) {
+		std::cout << "Error opening " << _image.name << " for writing" << std::endl;
+		if (height_raw) fclose(height_raw);
+		if (color_raw) fclose(color_raw);
+		return false;
+	}
+
+	// __________ STRIPS ______________
+	// Two strips per thread keep the workers busy while the writer catches up
+	int slot_count = 2 * settings.workers;
+	size_t row_bytes = (size_t)_image.width * ((settings.export_height ? 2 : 0) + (settings.export_color ? 3 : 0));
+	size_t budget = settings.memory_budget * 1024 * 1024;
+	int strip_rows = (int)std::max<size_t>(1, budget / (slot_count * row_bytes));
+	strip_rows = std::min(strip_rows, _image.height);
+	int strip_count = (_image.height + strip_rows - 1) / strip_rows;
+
+	std::vector<Strip> slots(slot_count);
+	for (int i = 0; i < slot_count; ++i) {
+		if (settings.export_height)
+			slots[i].height.resize((size_t)strip_rows * _image.width);
+		if (settings.export_color)
+			slots[i].color.resize((size_t)strip_rows * _image.width * 3);
+	}
+	statistics.peak_bytes = std::max(statistics.peak_bytes, slot_count * strip_rows * row_bytes);
+
+	// Strip i is computed in slot i % slot_count once strip i - slot_count is written
+	std::vector<TaskRef> slot_tasks(slot_count);
+	auto start_strip = [&](int _strip) {
+		Strip& slot = slots[_strip % slot_count];
+		slot.first_row = _strip * strip_rows;
+		slot.rows = std::min(strip_rows, _image.height - slot.first_row);
+		slot_tasks[_strip % slot_count] = jobs.run([this, &_image, &_surface, &slot] { fillStrip(_image, _surface, slot); });
+	};
+
+	for (int strip = 0; strip < std::min(slot_count, strip_count); ++strip)
+		start_strip(strip);
+
+	// __________ WRITE IN ORDER ______________
+	for (int strip = 0; strip < strip_count; ++strip) {
+		Strip& slot = slots[strip % slot_count];
+		// Computes strips itself while this one is not done
+		jobs.wait(slot_tasks[strip % slot_count]);
+
+		for (int row = 0; row < slot.rows; ++row) {
+			const uint16_t* height = settings.export_height ? &slot.height[(size_t)row * _image.width] : nullptr;
+			const uint8_t* color = settings.export_color ? &slot.color[(size_t)row * _image.width * 3] : nullptr;
+
+			if (settings.format == MAP_PNG) {
+				if (height) ok = height_png.writeRow(height) && ok;
+				if (color) ok = color_png.writeRow(color) && ok;
+			}
+			else {
+				if (height) ok = fwrite(height, 2, _image.width, height_raw) == (size_t)_image.width && ok;
+				if (color) ok = fwrite(color, 3, _image.width, color_raw) == (size_t)_image.width && ok;
+			}
+		}
+		statistics.pixels += (int64_t)slot.rows * _image.width;
+
+		if (strip + slot_count < strip_count)
+			start_strip(strip + slot_count);
+	}
+
+	if (settings.format == MAP_PNG) {
+		if (settings.export_height) ok = height_png.close() && ok;
+		if (settings.export_color) ok = color_png.close() && ok;
+	}
+	else {
+		if (height_raw) ok = fclose(height_raw) == 0 && ok;
+		if (color_raw) ok = fclose(color_raw) == 0 && ok;
+	}
+
+	ok = writeSidecar(_image, height_path, color_path, _surface) && ok;
+	if (!ok)
+		std::cout << "Error writing " << _image.name << std::endl;
+	return ok;
+}
+
+bool MapExporter::writeSidecar(const Image& _image, const std::string& _heightPath, const std::string& _colorPath, const PlanetSurface& _surface)
+{
+	const PlanetParameters& params = _surface.getParameters();
+	std::ofstream file(_image.name + ".txt");
+
+	file << "width " << _image.width << std::endl;
+	file << "height " << _image.height << std::endl;
+	file << "projection " << (_image.face < 0 ? "equirectangular" : "cube") << std::endl;
+	if (_image.face >= 0)
+		file << "face " << _image.face << std::endl;
+	if (!_heightPath.empty())
+		file << "height_map " << _heightPath << (settings.format == MAP_RAW ? " uint16_le" : " png16") << std::endl;
+	if (!_colorPath.empty())
+		file << "color_map " << _colorPath << (settings.format == MAP_RAW ? " rgb8" : " png8") << std::endl;
+
+	// radius = radius_base + (value / 65535 * 2 - 1) * radius_scale
+	file << "radius_base " << 1.0f + params.terrain_radius << std::endl;
+	file << "radius_scale " << HEIGHT_RANGE * params.terrain_elevation << std::endl;
+	file << "ocean_radius " << (params.ocean_enabled ? _surface.oceanRadius() : 0.0f) << std::endl;
+
+	return file.good();
+}
+
+void MapExporter::printUsage()
+{
+	std::cout <<
+		"Usage: Planet-Maker --export [options] [preset]\n"
+		"  --out PREFIX    output file prefix (default planet)\n"
+		"  --size N        map width, or face size with --cube (default 16384)\n"
+		"  --cube          six cube faces instead of one equirectangular map\n"
+		"  --raw           raw files instead of PNG\n"
+		"  --height-only   skip the colour map\n"
+		"  --color-only    skip the height map\n"
+		"  --workers N     evaluation threads (default: all cores)\n"
+		"  --memory MB     memory for strips in flight (default 64)\n";
+}
+
+bool MapExporter::parseArguments(int _argc, char* _argv[], MapExportSettings& _settings)
+{
+	for (int i = 1; i < _argc; ++i) {
+		std::string arg = _argv[i];
+		bool has_value = i + 1 < _argc;
+
+		if (arg == "--export")
+			continue;
+		else if (arg == "--out" && has_value)
+			_settings.output_prefix = _argv[++i];
+		else if (arg == "--size" && has_value)
+			_settings.width = atoi(_argv[++i]);
+		else if (arg == "--cube")
+			_settings.projection = MAP_CUBE;
+		else if (arg == "--raw")
+			_settings.format = MAP_RAW;
+		else if (arg == "--height-only")
+			_settings.export_color = false;
+		else if (arg == "--color-only")
+			_settings.export_height = false;
+		else if (arg == "--workers" && has_value)
+			_settings.workers = atoi(_argv[++i]);
+		else if (arg == "--memory" && has_value)
+			_settings.memory_budget = (size_t)atoi(_argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0)
+			return false;
+		else
+			_settings.preset = arg;
+	}
+
+	return _settings.width > 0 && _settings.workers >= 0 && _settings.memory_budget > 0 &&
+		(_settings.export_height || _settings.export_color);
+}
@@ -0,0 +1,174 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	bytes = nullptr;
+	length = 0;
+	writable = false;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#else
+	file_descriptor = -1;
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& _filePath)
+{
+	close();
+
+	file_handle = CreateFileA(_filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	// Empty files cannot be mapped
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_handle) {
+		close();
+		return false;
+	}
+
+	bytes = (uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!bytes) {
+		close();
+		return false;
+	}
+
+	length = (size_t)file_size.QuadPart;
+	return true;
+}
+
+bool MappedFile::create(const std::string& _filePath, size_t _size)
+{
+	close();
+
+	file_handle = CreateFileA(_filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE || _size == 0) {
+		close();
+		return false;
+	}
+
+	// The mapping grows the file to its size
+	uint64_t size = _size;
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (!mapping_handle) {
+		close();
+		return false;
+	}
+
+	bytes = (uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, 0);
+	if (!bytes) {
+		close();
+		return false;
+	}
+
+	length = _size;
+	writable = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+
+	bytes = nullptr;
+	length = 0;
+	writable = false;
+	mapping_handle = nullptr;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const std::string& _filePath)
+{
+	close();
+
+	file_descriptor = ::open(_filePath.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+
+	struct stat info;
+	// Empty files cannot be mapped
+	if (fstat(file_descriptor, &info) != 0 || info.st_size == 0) {
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (mapping == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	bytes = (uint8_t*)mapping;
+	length = (size_t)info.st_size;
+	return true;
+}
+
+bool MappedFile::create(const std::string& _filePath, size_t _size)
+{
+	close();
+
+	file_descriptor = ::open(_filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor < 0 || _size == 0 || ftruncate(file_descriptor, (off_t)_size) != 0) {
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	if (mapping == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	bytes = (uint8_t*)mapping;
+	length = _size;
+	writable = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes)
+		munmap(bytes, length);
+	if (file_descriptor >= 0)
+		::close(file_descriptor);
+
+	bytes = nullptr;
+	length = 0;
+	writable = false;
+	file_descriptor = -1;
+}
+
+#endif
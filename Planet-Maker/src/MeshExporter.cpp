@@ -0,0 +1,455 @@
+#include "MeshExporter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "ClimateMap.h"
+#include "MappedFile.h"
+#include "PresetFile.h"
+
+// glTF component types and buffer targets
+static const int GLTF_UNSIGNED_BYTE = 5121;
+static const int GLTF_UNSIGNED_INT = 5125;
+static const int GLTF_FLOAT = 5126;
+static const int GLTF_ARRAY_BUFFER = 34962;
+static const int GLTF_ELEMENT_ARRAY_BUFFER = 34963;
+
+static const size_t PLY_FACE_SIZE = 1 + 3 * 4; // uchar count + 3 int32
+
+MeshExporter::MeshExporter(const MeshExportSettings& _settings) : settings(_settings), jobs(_settings.workers > 0 ? _settings.workers - 1 : -1)
+{
+	settings.workers = jobs.getThreadCount();
+	gltf_binary_size = 0;
+}
+
+int MeshExporter::run()
+{
+	PlanetParameters params;
+	if (!settings.preset.empty() && !load_preset(settings.preset, params)) {
+		std::cout << "Error reading preset " << settings.preset << std::endl;
+		return 1;
+	}
+
+	if (!exportMesh(params))
+		return 1;
+
+	std::cout << "Exported " << statistics.chunks << " chunks, " << statistics.triangles / 1.0e6 << " M triangles in "
+		<< statistics.seconds << " s, " << statistics.megatrianglesPerSecond() << " M triangles/s with "
+		<< settings.workers << " workers" << std::endl;
+	return 0;
+}
+
+//! Lays out every chunk of every LOD in the output files.
+void MeshExporter::planChunks()
+{
+	chunks.clear();
+	gltf_binary_size = 0;
+
+	int per_edge = std::max(1, settings.resolution / settings.chunk_size);
+	int quads = std::max(1, settings.resolution / per_edge);
+
+	for (int lod = 0; lod < settings.lods; ++lod) {
+		int64_t first_vertex = 0;
+		int64_t first_triangle = 0;
+
+		for (int face = 0; face < 6; ++face) {
+			for (int y = 0; y < per_edge; ++y) {
+				for (int x = 0; x < per_edge; ++x) {
+					Chunk chunk;
+					chunk.face = face;
+					chunk.x = x;
+					chunk.y = y;
+					chunk.lod = lod;
+					chunk.quads = std::max(1, quads >> lod);
+					chunk.chunks = per_edge;
+					chunk.first_vertex = first_vertex;
+					chunk.first_triangle = first_triangle;
+					chunk.gltf_offset = gltf_binary_size;
+					chunk.min = chunk.max = glm::vec3(0.0f);
+
+					first_vertex += chunk.vertexCount();
+					first_triangle += chunk.triangleCount();
+					// Vertices then indices, both multiples of 4 bytes
+					gltf_binary_size += chunk.vertexCount() * vertexStride() + chunk.triangleCount() * 3 * sizeof(uint32_t);
+
+					chunks.push_back(chunk);
+				}
+			}
+		}
+	}
+}
+
+bool MeshExporter::exportMesh(const PlanetParameters& _params)
+{
+	statistics = MeshExportStatistics();
+	PlanetSurface surface(_params);
+
+	// Biome colours as terrain_frag.glsl draws them
+	CubeHeightmap heightmap;
+	heightmap.bake(_params, ClimateMap::DEFAULT_RESOLUTION, nullptr, &jobs);
+	ClimateMap climate;
+	climate.bake(heightmap, _params, &jobs);
+	surface.setClimateMap(&climate);
+	planChunks();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool ok = true;
+
+	// __________ glTF ______________
+	MappedFile gltf;
+	uint8_t* gltf_binary = nullptr;
+	std::string json;
+
+	if (settings.write_gltf) {
+		// Numbers are printed at a fixed width, so the JSON written after
+		// generation has exactly the length reserved here
+		json = gltfJson();
+		while (json.size() % 4 != 0)
+			json += ' ';
+
+		uint64_t total = 12 + 8 + json.size() + 8 + gltf_binary_size;
+		if (total > std::numeric_limits<uint32_t>::max()) {
+			std::cout << "The mesh is too large for glTF (" << total / (1024 * 1024) << " MB), use fewer LODs, a lower resolution or PLY" << std::endl;
+			return false;
+		}
+
+		std::string path = settings.output_prefix + ".glb";
+		if (!gltf.create(path, (size_t)total)) {
+			std::cout << "Error creating " << path << std::endl;
+			return false;
+		}
+
+		uint8_t* out = gltf.writableData();
+		uint32_t header[5] = { 0x46546C67, 2, (uint32_t)total, (uint32_t)json.size(), 0x4E4F534A }; // glTF, JSON
+		memcpy(out, header, sizeof(header));
+		uint32_t binary_header[2] = { (uint32_t)gltf_binary_size, 0x004E4942 }; // BIN
+		memcpy(out + 20 + json.size(), binary_header, sizeof(binary_header));
+		gltf_binary = out + 28 + json.size();
+	}
+
+	// __________ PLY ______________
+	std::vector<MappedFile> ply(settings.write_ply ? settings.lods : 0);
+	std::vector<uint8_t*> ply_vertices(ply.size(), nullptr);
+	std::vector<uint8_t*> ply_faces(ply.size(), nullptr);
+
+	for (int lod = 0; lod < (int)ply.size(); ++lod) {
+		int64_t vertices = 0, triangles = 0;
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			if (chunks[i].lod == lod) {
+				vertices += chunks[i].vertexCount();
+				triangles += chunks[i].triangleCount();
+			}
+		}
+
+		size_t vertex_size = settings.vertex_colors ? 27 : 24;
+		std::string header = plyHeader(vertices, triangles);
+		size_t total = header.size() + vertices * vertex_size + triangles * PLY_FACE_SIZE;
+
+		std::string path = settings.output_prefix + "_lod" + std::to_string(lod) + ".ply";
+		if (!ply[lod].create(path, total)) {
+			std::cout << "Error creating " << path << std::endl;
+			return false;
+		}
+
+		uint8_t* out = ply[lod].writableData();
+		memcpy(out, header.data(), header.size());
+		ply_vertices[lod] = out + header.size();
+		ply_faces[lod] = ply_vertices[lod] + vertices * vertex_size;
+	}
+
+	// __________ GENERATE ______________
+	jobs.parallelFor((int)chunks.size(), 1, [&](int _begin, int _end) {
+		std::vector<glm::vec3> scratch;
+		for (int index = _begin; index < _end; ++index) {
+			Chunk& chunk = chunks[index];
+			buildChunk(surface, chunk, scratch, gltf_binary,
+				ply.empty() ? nullptr : ply_vertices[chunk.lod],
+				ply.empty() ? nullptr : ply_faces[chunk.lod]);
+		}
+	});
+
+	if (settings.write_gltf) {
+		// Now with the bounds of every chunk
+		std::string final_json = gltfJson();
+		while (final_json.size() % 4 != 0)
+			final_json += ' ';
+		ok = final_json.size() == json.size() && ok;
+		if (ok)
+			memcpy(gltf.writableData() + 20, final_json.data(), final_json.size());
+		gltf.close();
+	}
+	for (size_t i = 0; i < ply.size(); ++i)
+		ply[i].close();
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		statistics.vertices += chunks[i].vertexCount();
+		statistics.triangles += chunks[i].triangleCount();
+	}
+	statistics.chunks = (int)chunks.size();
+	statistics.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!ok)
+		std::cout << "Error writing the glTF file" << std::endl;
+	return ok;
+}
+
+void MeshExporter::buildChunk(const PlanetSurface& _surface, Chunk& _chunk, std::vector<glm::vec3>& _scratch,
+	uint8_t* _gltf, uint8_t* _plyVertices, uint8_t* _plyFaces)
+{
+	int q = _chunk.quads;
+	int n = q + 3; // one sample of border on every side for the normals
+
+	// Displaced positions, the border continues onto the neighbouring chunks and faces
+	_scratch.resize((size_t)n * n);
+	for (int j = 0; j < n; ++j) {
+		for (int i = 0; i < n; ++i) {
+			float u = (_chunk.x + (i - 1) / (float)q) / _chunk.chunks;
+			float v = (_chunk.y + (j - 1) / (float)q) / _chunk.chunks;
+			glm::vec3 direction = PlanetSurface::cubeDirection(_chunk.face, 2.0f * u - 1.0f, 2.0f * v - 1.0f);
+			_scratch[j * n + i] = direction * _surface.terrainRadius(_surface.elevation(direction));
+		}
+	}
+
+	// __________ VERTICES ______________
+	size_t gltf_stride = vertexStride();
+	size_t ply_stride = settings.vertex_colors ? 27 : 24;
+	uint8_t* gltf_vertex = _gltf ? _gltf + _chunk.gltf_offset : nullptr;
+	uint8_t* ply_vertex = _plyVertices ? _plyVertices + _chunk.first_vertex * ply_stride : nullptr;
+
+	glm::vec3 low(std::numeric_limits<float>::max());
+	glm::vec3 high(-std::numeric_limits<float>::max());
+
+	for (int j = 0; j <= q; ++j) {
+		for (int i = 0; i <= q; ++i) {
+			const glm::vec3& p = _scratch[(j + 1) * n + i + 1];
+			glm::vec3 du = _scratch[(j + 1) * n + i + 2] - _scratch[(j + 1) * n + i];
+			glm::vec3 dv = _scratch[(j + 2) * n + i + 1] - _scratch[j * n + i + 1];
+
+			glm::vec3 normal = glm::normalize(glm::cross(du, dv));
+			if (glm::dot(normal, p) < 0.0f)
+				normal = -normal;
+
+			glm::vec3 position = p * settings.scale;
+			low = glm::min(low, position);
+			high = glm::max(high, position);
+
+			uint8_t rgba[4] = { 255, 255, 255, 255 };
+			if (settings.vertex_colors) {
+				glm::vec3 direction = glm::normalize(p);
+				float elevation = (glm::length(p) - 1.0f - _surface.getParameters().terrain_radius) /
+					std::max(_surface.getParameters().terrain_elevation, 1e-6f);
+				glm::vec3 c = glm::clamp(_surface.color(direction, elevation), 0.0f, 1.0f);
+				for (int k = 0; k < 3; ++k)
+					rgba[k] = (uint8_t)(c[k] * 255.0f + 0.5f);
+			}
+
+			if (gltf_vertex) {
+				memcpy(gltf_vertex, &position, 12);
+				memcpy(gltf_vertex + 12, &normal, 12);
+				if (settings.vertex_colors)
+					memcpy(gltf_vertex + 24, rgba, 4);
+				gltf_vertex += gltf_stride;
+			}
+			if (ply_vertex) {
+				memcpy(ply_vertex, &position, 12);
+				memcpy(ply_vertex + 12, &normal, 12);
+				if (settings.vertex_colors)
+					memcpy(ply_vertex + 24, rgba, 3);
+				ply_vertex += ply_stride;
+			}
+		}
+	}
+
+	_chunk.min = low;
+	_chunk.max = high;
+
+	// __________ TRIANGLES ______________
+	// Counter clockwise seen from outside, which way that is depends on the face
+	const glm::vec3& a = _scratch[n + 1];
+	glm::vec3 face_normal = glm::cross(_scratch[n + 2] - a, _scratch[2 * n + 1] - a);
+	bool flip = glm::dot(face_normal, a) < 0.0f;
+
+	uint32_t* gltf_index = _gltf ? (uint32_t*)(_gltf + _chunk.gltf_offset + _chunk.vertexCount() * gltf_stride) : nullptr;
+	uint8_t* ply_face = _plyFaces ? _plyFaces + _chunk.first_triangle * PLY_FACE_SIZE : nullptr;
+
+	for (int j = 0; j < q; ++j) {
+		for (int i = 0; i < q; ++i) {
+			uint32_t v00 = j * (q + 1) + i;
+			uint32_t v10 = v00 + 1;
+			uint32_t v01 = v00 + q + 1;
+			uint32_t v11 = v01 + 1;
+
+			uint32_t triangles[6] = { v00, v10, v11, v00, v11, v01 };
+			if (flip) {
+				std::swap(triangles[1], triangles[2]);
+				std::swap(triangles[4], triangles[5]);
+			}
+
+			if (gltf_index) {
+				memcpy(gltf_index, triangles, sizeof(triangles));
+				gltf_index += 6;
+			}
+			if (ply_face) {
+				for (int t = 0; t < 2; ++t) {
+					ply_face[0] = 3;
+					for (int k = 0; k < 3; ++k) {
+						int32_t index = (int32_t)(_chunk.first_vertex + triangles[3 * t + k]);
+						memcpy(ply_face + 1 + 4 * k, &index, 4);
+					}
+					ply_face += PLY_FACE_SIZE;
+				}
+			}
+		}
+	}
+}
+
+//! Fixed width so the length does not depend on the value, positive numbers get a leading space.
+static std::string json_float(float _value)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "% .8e", _value);
+	return buffer;
+}
+
+static std::string json_vec3(const glm::vec3& _v)
+{
+	return "[" + json_float(_v.x) + "," + json_float(_v.y) + "," + json_float(_v.z) + "]";
+}
+
+std::string MeshExporter::gltfJson() const
+{
+	static const char* const FACE_NAMES[6] = { "px", "nx", "py", "ny", "pz", "nz" };
+
+	std::ostringstream nodes, meshes, accessors, views;
+	int accessor = 0;
+	int view = 0;
+
+	// One parent node per LOD, chunk nodes follow them
+	for (int lod = 0; lod < settings.lods; ++lod) {
+		nodes << (lod > 0 ? "," : "") << "{\"name\":\"lod" << lod << "\",\"children\":[";
+		bool first = true;
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			if (chunks[i].lod == lod) {
+				nodes << (first ? "" : ",") << settings.lods + i;
+				first = false;
+			}
+		}
+		nodes << "]}";
+	}
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		const Chunk& chunk = chunks[i];
+		size_t vertex_bytes = chunk.vertexCount() * vertexStride();
+		size_t index_bytes = chunk.triangleCount() * 3 * sizeof(uint32_t);
+		std::string sep = i > 0 ? "," : "";
+
+		nodes << ",{\"name\":\"" << FACE_NAMES[chunk.face] << "_" << chunk.x << "_" << chunk.y << "_lod" << chunk.lod
+			<< "\",\"mesh\":" << i << "}";
+
+		views << sep << "{\"buffer\":0,\"byteOffset\":" << chunk.gltf_offset << ",\"byteLength\":" << vertex_bytes
+			<< ",\"byteStride\":" << vertexStride() << ",\"target\":" << GLTF_ARRAY_BUFFER << "},"
+			<< "{\"buffer\":0,\"byteOffset\":" << chunk.gltf_offset + vertex_bytes << ",\"byteLength\":" << index_bytes
+			<< ",\"target\":" << GLTF_ELEMENT_ARRAY_BUFFER << "}";
+
+		int position = accessor++;
+		int normal = accessor++;
+		int color = settings.vertex_colors ? accessor++ : -1;
+		int indices = accessor++;
+
+		accessors << sep << "{\"bufferView\":" << view << ",\"byteOffset\":0,\"componentType\":" << GLTF_FLOAT
+			<< ",\"count\":" << chunk.vertexCount() << ",\"type\":\"VEC3\",\"min\":" << json_vec3(chunk.min)
+			<< ",\"max\":" << json_vec3(chunk.max) << "}";
+		accessors << ",{\"bufferView\":" << view << ",\"byteOffset\":12,\"componentType\":" << GLTF_FLOAT
+			<< ",\"count\":" << chunk.vertexCount() << ",\"type\":\"VEC3\"}";
+		if (settings.vertex_colors)
+			accessors << ",{\"bufferView\":" << view << ",\"byteOffset\":24,\"componentType\":" << GLTF_UNSIGNED_BYTE
+			<< ",\"normalized\":true,\"count\":" << chunk.vertexCount() << ",\"type\":\"VEC4\"}";
+		accessors << ",{\"bufferView\":" << view + 1 << ",\"byteOffset\":0,\"componentType\":" << GLTF_UNSIGNED_INT
+			<< ",\"count\":" << chunk.triangleCount() * 3 << ",\"type\":\"SCALAR\"}";
+		view += 2;
+
+		meshes << sep << "{\"primitives\":[{\"attributes\":{\"POSITION\":" << position << ",\"NORMAL\":" << normal;
+		if (color >= 0)
+			meshes << ",\"COLOR_0\":" << color;
+		meshes << "},\"indices\":" << indices << "}]}";
+	}
+
+	std::ostringstream json;
+	json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Planet-Maker\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+	for (int lod = 0; lod < settings.lods; ++lod)
+		json << (lod > 0 ? "," : "") << lod;
+	json << "]}],\"nodes\":[" << nodes.str() << "],\"meshes\":[" << meshes.str() << "],\"accessors\":["
+		<< accessors.str() << "],\"bufferViews\":[" << views.str() << "],\"buffers\":[{\"byteLength\":"
+		<< gltf_binary_size << "}]}";
+	return json.str();
+}
+
+std::string MeshExporter::plyHeader(int64_t _vertices, int64_t _triangles) const
+{
+	std::ostringstream header;
+	header << "ply\nformat binary_little_endian 1.0\ncomment Planet-Maker\n";
+	header << "element vertex " << _vertices << "\n";
+	header << "property float x\nproperty float y\nproperty float z\n";
+	header << "property float nx\nproperty float ny\nproperty float nz\n";
+	if (settings.vertex_colors)
+		header << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+	header << "element face " << _triangles << "\n";
+	header << "property list uchar int vertex_indices\nend_header\n";
+	return header.str();
+}
+
+void MeshExporter::printUsage()
+{
+	std::cout <<
+		"Usage: Planet-Maker --mesh [options] [preset]\n"
+		"  --out PREFIX      output file prefix (default planet)\n"
+		"  --resolution N    quads along each cube face edge (default 512)\n"
+		"  --chunk N         quads along each chunk edge (default 128)\n"
+		"  --lods N          levels of detail, each with half the quads (default 1)\n"
+		"  --format F        glb, ply or both (default both)\n"
+		"  --colors          add vertex colours\n"
+		"  --scale S         radius of the planet in output units (default 1)\n"
+		"  --workers N       generation threads (default: all cores)\n";
+}
+
+bool MeshExporter::parseArguments(int _argc, char* _argv[], MeshExportSettings& _settings)
+{
+	for (int i = 1; i < _argc; ++i) {
+		std::string arg = _argv[i];
+		bool has_value = i + 1 < _argc;
+
+		if (arg == "--mesh")
+			continue;
+		else if (arg == "--out" && has_value)
+			_settings.output_prefix = _argv[++i];
+		else if (arg == "--resolution" && has_value)
+			_settings.resolution = atoi(_argv[++i]);
+		else if (arg == "--chunk" && has_value)
+			_settings.chunk_size = atoi(_argv[++i]);
+		else if (arg == "--lods" && has_value)
+			_settings.lods = atoi(_argv[++i]);
+		else if (arg == "--format" && has_value) {
+			std::string format = _argv[++i];
+			_settings.write_gltf = format == "glb" || format == "both";
+			_settings.write_ply = format == "ply" || format == "both";
+		}
+		else if (arg == "--colors")
+			_settings.vertex_colors = true;
+		else if (arg == "--scale" && has_value)
+			_settings.scale = (float)atof(_argv[++i]);
+		else if (arg == "--workers" && has_value)
+			_settings.workers = atoi(_argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0)
+			return false;
+		else
+			_settings.preset = arg;
+	}
+
+	return _settings.resolution > 0 && _settings.chunk_size > 0 && _settings.lods > 0 && _settings.workers >= 0 &&
+		_settings.scale > 0.0f && (_settings.write_gltf || _settings.write_ply);
+}
@@ -0,0 +1,194 @@
+#include "Noise.h"
+#include <algorithm>
+#include <cmath>
+
+// Ports of the GLSL helpers, see the shaders for the original comments. The
+// shaders evaluate four corners per vec4 operation; the lanes never mix, so
+// the code below computes one corner at a time with the same float
+// arithmetic, which is several times faster than emulating vec4 on the CPU.
+
+static inline float mod289(float _x)
+{
+	return _x - std::floor(_x * (1.0f / 289.0f)) * 289.0f;
+}
+
+static inline float permute(float _x)
+{
+	return mod289(((_x * 34.0f) + 1.0f) * _x);
+}
+
+static inline float fract(float _x)
+{
+	return _x - std::floor(_x);
+}
+
+static inline float taylor_inv_sqrt(float _r)
+{
+	return 1.79284291400159f - 0.85373472095314f * _r;
+}
+
+static inline float fade(float _t)
+{
+	return _t * _t * _t * (_t * (_t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline float mix(float _a, float _b, float _t)
+{
+	return _a + _t * (_b - _a);
+}
+
+//! Gradient of one cnoise() corner from its hash, dotted with the offset to the corner.
+static inline float perlin_corner(float _hash, float _x, float _y, float _z)
+{
+	float gx = _hash * (1.0f / 7.0f);
+	float gy = fract(std::floor(gx) * (1.0f / 7.0f)) - 0.5f;
+	gx = fract(gx);
+	float gz = 0.5f - std::fabs(gx) - std::fabs(gy);
+	if (gz <= 0.0f) {
+		gx -= (gx >= 0.0f ? 1.0f : 0.0f) - 0.5f;
+		gy -= (gy >= 0.0f ? 1.0f : 0.0f) - 0.5f;
+	}
+	glm::vec3 gradient = glm::vec3(gx, gy, gz);
+	gradient *= taylor_inv_sqrt(glm::dot(gradient, gradient));
+	return glm::dot(gradient, glm::vec3(_x, _y, _z));
+}
+
+float perlin_noise(const glm::vec3& _p)
+{
+	float x0 = std::floor(_p.x), y0 = std::floor(_p.y), z0 = std::floor(_p.z);
+	float x1 = mod289(x0 + 1.0f), y1 = mod289(y0 + 1.0f), z1 = mod289(z0 + 1.0f);
+	x0 = mod289(x0);
+	y0 = mod289(y0);
+	z0 = mod289(z0);
+
+	float fx0 = fract(_p.x), fy0 = fract(_p.y), fz0 = fract(_p.z);
+	float fx1 = fx0 - 1.0f, fy1 = fy0 - 1.0f, fz1 = fz0 - 1.0f;
+
+	float px0 = permute(x0), px1 = permute(x1);
+	float h00 = permute(px0 + y0), h10 = permute(px1 + y0);
+	float h01 = permute(px0 + y1), h11 = permute(px1 + y1);
+
+	float n000 = perlin_corner(permute(h00 + z0), fx0, fy0, fz0);
+	float n100 = perlin_corner(permute(h10 + z0), fx1, fy0, fz0);
+	float n010 = perlin_corner(permute(h01 + z0), fx0, fy1, fz0);
+	float n110 = perlin_corner(permute(h11 + z0), fx1, fy1, fz0);
+	float n001 = perlin_corner(permute(h00 + z1), fx0, fy0, fz1);
+	float n101 = perlin_corner(permute(h10 + z1), fx1, fy0, fz1);
+	float n011 = perlin_corner(permute(h01 + z1), fx0, fy1, fz1);
+	float n111 = perlin_corner(permute(h11 + z1), fx1, fy1, fz1);
+
+	float u = fade(fx0), v = fade(fy0), w = fade(fz0);
+	float n_z0 = mix(n000, n001, w);
+	float n_z1 = mix(n100, n101, w);
+	float n_z2 = mix(n010, n011, w);
+	float n_z3 = mix(n110, n111, w);
+	float n_y0 = mix(n_z0, n_z2, v);
+	float n_y1 = mix(n_z1, n_z3, v);
+	return 2.2f * mix(n_y0, n_y1, u);
+}
+
+//! Contribution of one snoise() corner: gradient from the hash, falloff from the offset.
+static inline float simplex_corner(float _hash, const glm::vec3& _offset)
+{
+	// Gradients: 7x7 points over a square, mapped onto an octahedron
+	const float n_ = 0.142857142857f; // 1/7
+	const float ns_x = n_ * 2.0f;
+	const float ns_y = n_ * 0.5f - 1.0f;
+
+	float j = _hash - 49.0f * std::floor(_hash * n_ * n_);
+	float x_ = std::floor(j * n_);
+	float y_ = std::floor(j - 7.0f * x_);
+
+	float x = x_ * ns_x + ns_y;
+	float y = y_ * ns_x + ns_y;
+	float h = 1.0f - std::fabs(x) - std::fabs(y);
+
+	if (h <= 0.0f) {
+		x += (std::floor(x) * 2.0f + 1.0f) * -1.0f;
+		y += (std::floor(y) * 2.0f + 1.0f) * -1.0f;
+	}
+
+	glm::vec3 gradient = glm::vec3(x, y, h);
+	gradient *= taylor_inv_sqrt(glm::dot(gradient, gradient));
+
+	float m = std::max(0.6f - glm::dot(_offset, _offset), 0.0f);
+	m = m * m;
+	return m * m * glm::dot(gradient, _offset);
+}
+
+float simplex_noise(const glm::vec3& _v)
+{
+	const float Cx = 1.0f / 6.0f;
+	const float Cy = 1.0f / 3.0f;
+
+	// First corner
+	glm::vec3 i = glm::floor(_v + glm::dot(_v, glm::vec3(Cy)));
+	glm::vec3 x0 = _v - i + glm::dot(i, glm::vec3(Cx));
+
+	// Other corners
+	glm::vec3 g(x0.x >= x0.y ? 1.0f : 0.0f, x0.y >= x0.z ? 1.0f : 0.0f, x0.z >= x0.x ? 1.0f : 0.0f);
+	glm::vec3 l = 1.0f - g;
+	glm::vec3 i1 = glm::min(g, glm::vec3(l.z, l.x, l.y));
+	glm::vec3 i2 = glm::max(g, glm::vec3(l.z, l.x, l.y));
+
+	glm::vec3 x1 = x0 - i1 + Cx;
+	glm::vec3 x2 = x0 - i2 + Cy;
+	glm::vec3 x3 = x0 - 0.5f;
+
+	// Permutations
+	i = glm::vec3(mod289(i.x), mod289(i.y), mod289(i.z));
+	float p0 = permute(permute(permute(i.z) + i.y) + i.x);
+	float p1 = permute(permute(permute(i.z + i1.z) + i.y + i1.y) + i.x + i1.x);
+	float p2 = permute(permute(permute(i.z + i2.z) + i.y + i2.y) + i.x + i2.x);
+	float p3 = permute(permute(permute(i.z + 1.0f) + i.y + 1.0f) + i.x + 1.0f);
+
+	return 42.0f * (simplex_corner(p0, x0) + simplex_corner(p1, x1) + simplex_corner(p2, x2) + simplex_corner(p3, x3));
+}
+
+glm::vec2 cellular_noise(const glm::vec3& _p)
+{
+	const float K = 0.142857142857f;   // 1/7
+	const float Ko = 0.428571428571f;  // 1/2-K/2
+	const float K2 = 0.020408163265306f; // 1/(7*7)
+	const float Kz = 0.166666666667f;  // 1/6
+	const float Kzo = 0.416666666667f; // 1/2-1/6*2
+	const float jitter = 1.0f;
+
+	glm::vec3 Pi = glm::floor(_p);
+	Pi = glm::vec3(mod289(Pi.x), mod289(Pi.y), mod289(Pi.z));
+	glm::vec3 Pf = glm::fract(_p) - 0.5f;
+
+	// The shader unrolls the 3x3x3 neighbourhood, the loops visit the same
+	// cells with the same hashes and keep the two smallest distances
+	float f1 = 1e30f;
+	float f2 = 1e30f;
+
+	for (int dx = -1; dx <= 1; ++dx) {
+		float px = permute(Pi.x + (float)dx);
+		for (int dy = -1; dy <= 1; ++dy) {
+			float pxy = permute(px + Pi.y + (float)dy);
+			for (int dz = -1; dz <= 1; ++dz) {
+				float p = permute(pxy + Pi.z + (float)dz);
+
+				float ox = glm::fract(p * K) - Ko;
+				float oy = (glm::floor(p * K) - glm::floor(glm::floor(p * K) * (1.0f / 7.0f)) * 7.0f) * K - Ko;
+				float oz = glm::floor(p * K2) * Kz - Kzo;
+
+				float ddx = Pf.x - (float)dx + jitter * ox;
+				float ddy = Pf.y - (float)dy + jitter * oy;
+				float ddz = Pf.z - (float)dz + jitter * oz;
+				float d = ddx * ddx + ddy * ddy + ddz * ddz;
+
+				if (d < f1) {
+					f2 = f1;
+					f1 = d;
+				}
+				else if (d < f2) {
+					f2 = d;
+				}
+			}
+		}
+	}
+
+	return glm::vec2(std::sqrt(f1), std::sqrt(f2));
+}
@@ -0,0 +1,143 @@
+#include "OctaveCache.h"
+#include "BakeCache.h"
+#include "CubeHeightmap.h"
+#include "FeatureLayer.h"
+#include "PlanetSurface.h"
+
+// Ten octaves of a 512 heightmap and a few coarser maps
+static const size_t GLOBAL_MAX_BYTES = 256 * 1024 * 1024;
+
+OctaveCache::OctaveCache(size_t _maxBytes)
+{
+	bytes = 0;
+	max_bytes = _maxBytes;
+	tick = 0;
+	hits = 0;
+	misses = 0;
+}
+
+
+OctaveCache& OctaveCache::global()
+{
+	static OctaveCache cache(GLOBAL_MAX_BYTES);
+	return cache;
+}
+
+CubeLayer OctaveCache::octave(const PlanetParameters& _params, int _octave, int _resolution,
+	JobSystem& _jobs, const CancelToken& _cancel)
+{
+	uint64_t key = BakeKey("terrain_octave", CubeHeightmap::GENERATOR_VERSION)
+		.add(_resolution)
+		.add(_params.noise_method)
+		.add(_params.terrain_seed)
+		.add(_params.terrain_vert_frequency)
+		.add(_octave)
+		.get();
+
+	PlanetSurface surface(_params);
+	return layer(key, _resolution, [&](const glm::vec3& _direction) {
+		return surface.octave(_direction, _octave);
+	}, _jobs, _cancel);
+}
+
+CubeLayer OctaveCache::features(const PlanetParameters& _params, int _resolution,
+	JobSystem& _jobs, const CancelToken& _cancel)
+{
+	std::shared_ptr<const FeatureLayer> features = FeatureLayer::get(_params);
+	if (!features)
+		return nullptr;
+
+	uint64_t key = BakeKey("terrain_features", CubeHeightmap::GENERATOR_VERSION)
+		.add(_resolution)
+		.add(FeatureLayer::cacheKey(_params))
+		.get();
+
+	return layer(key, _resolution, [&](const glm::vec3& _direction) {
+		return features->height(_direction);
+	}, _jobs, _cancel);
+}
+
+//! The cached layer of _key or a new one from _sample at every texel center.
+CubeLayer OctaveCache::layer(uint64_t _key, int _resolution, const std::function<float(const glm::vec3&)>& _sample,
+	JobSystem& _jobs, const CancelToken& _cancel)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Entry& entry : entries) {
+			if (entry.key == _key) {
+				entry.last_used = ++tick;
+				++hits;
+				return entry.layer;
+			}
+		}
+		++misses;
+	}
+
+	// Evaluated outside the lock, a layer asked for twice at once is made twice
+	const int res = _resolution;
+	std::shared_ptr<std::vector<float>> values = std::make_shared<std::vector<float>>(6 * (size_t)res * res);
+	_jobs.parallelFor(6 * res, 4, [&](int _begin, int _end) {
+		for (int row = _begin; row < _end; ++row) {
+			int face = row / res;
+			int y = row % res;
+			float* out = &(*values)[(size_t)row * res];
+			for (int x = 0; x < res; ++x) {
+				float s = 2.0f * (x + 0.5f) / res - 1.0f;
+				float t = 2.0f * (y + 0.5f) / res - 1.0f;
+				out[x] = _sample(PlanetSurface::cubeDirection(face, s, t));
+			}
+		}
+	}, _cancel);
+
+	if (_cancel.isCancelled())
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const Entry& entry : entries) {
+		if (entry.key == _key)
+			return entry.layer;
+	}
+
+	Entry entry;
+	entry.key = _key;
+	entry.layer = values;
+	entry.last_used = ++tick;
+	entries.push_back(entry);
+	bytes += values->size() * sizeof(float);
+	evict();
+	return values;
+}
+
+//! Drops least recently used layers until the cache fits its cap, the caller holds the lock.
+//! Layers still in use stay alive with their users.
+void OctaveCache::evict()
+{
+	while (bytes > max_bytes && entries.size() > 1) {
+		size_t oldest = 0;
+		for (size_t i = 1; i < entries.size(); ++i) {
+			if (entries[i].last_used < entries[oldest].last_used)
+				oldest = i;
+		}
+		bytes -= entries[oldest].layer->size() * sizeof(float);
+		entries.erase(entries.begin() + oldest);
+	}
+}
+
+void OctaveCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	bytes = 0;
+}
+
+size_t OctaveCache::getSize() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes;
+}
+
+int OctaveCache::getLayerCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)entries.size();
+}
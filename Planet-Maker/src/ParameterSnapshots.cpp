@@ -0,0 +1,83 @@
+#include "ParameterSnapshots.h"
+#include <utility>
+
+SnapshotRef::SnapshotRef(const SnapshotRef& _other) : snapshot(_other.snapshot), refs(_other.refs)
+{
+	// The slot is pinned by _other already, it cannot be rewritten in between
+	if (refs != nullptr)
+		++*refs;
+}
+
+SnapshotRef::SnapshotRef(SnapshotRef&& _other) : snapshot(_other.snapshot), refs(_other.refs)
+{
+	_other.snapshot = nullptr;
+	_other.refs = nullptr;
+}
+
+SnapshotRef& SnapshotRef::operator=(SnapshotRef _other)
+{
+	std::swap(snapshot, _other.snapshot);
+	std::swap(refs, _other.refs);
+	return *this;
+}
+
+SnapshotRef::~SnapshotRef()
+{
+	if (refs != nullptr)
+		--*refs;
+}
+
+ParameterSnapshots::ParameterSnapshots()
+{
+	for (int i = 0; i < SLOT_COUNT; ++i)
+		slots[i].refs = 0;
+
+	slots[0].snapshot.hash = hash_parameters(slots[0].snapshot.params);
+	current = 0;
+	version = 0;
+}
+
+bool ParameterSnapshots::publish(const PlanetParameters& _params)
+{
+	// Only this thread writes slots, reading the current one needs no reference
+	int latest = current;
+	const PlanetSnapshot& previous = slots[latest].snapshot;
+
+	uint64_t hash = hash_parameters(_params);
+	if (hash == previous.hash)
+		return true;
+
+	// A reader that pins a slot after this check sees it is not current and lets go
+	int free_slot = -1;
+	for (int i = 1; i < SLOT_COUNT && free_slot < 0; ++i) {
+		int slot = (latest + i) % SLOT_COUNT;
+		if (slots[slot].refs == 0)
+			free_slot = slot;
+	}
+	if (free_slot < 0)
+		return false;
+
+	PlanetSnapshot& snapshot = slots[free_slot].snapshot;
+	snapshot.params = _params;
+	snapshot.version = previous.version + 1;
+	snapshot.hash = hash;
+	snapshot.changes = compare_parameters(previous.params, _params);
+
+	current = free_slot;
+	version = snapshot.version;
+	return true;
+}
+
+SnapshotRef ParameterSnapshots::acquire() const
+{
+	for (;;) {
+		int slot = current;
+		++slots[slot].refs;
+
+		// Still current after pinning, so publish() will not pick it
+		if (current == slot)
+			return SnapshotRef(&slots[slot].snapshot, &slots[slot].refs);
+
+		--slots[slot].refs;
+	}
+}
@@ -0,0 +1,243 @@
+#include "Parameters.h"
+#include <cstring>
+#include <fstream>
+
+static void color_to_file(std::ofstream &file, const float color[3]) {
+	file << color[0] << std::endl;
+	file << color[1] << std::endl;
+	file << color[2] << std::endl;
+}
+
+
+static void file_to_color(std::ifstream &file, float color[3]) {
+	file >> color[0];
+	file >> color[1];
+	file >> color[2];
+}
+
+
+bool load_parameters(const std::string& _filePath, PlanetParameters& _params)
+{
+	std::ifstream in_file(_filePath, std::ifstream::binary);
+	if (!in_file.is_open())
+		return false;
+
+	PlanetParameters p;
+
+	// Noise
+	in_file >> p.noise_method;
+
+	// Sky
+	file_to_color(in_file, p.sky_color);
+	in_file >> p.sky_enabled;
+	in_file >> p.sky_frequency;
+	in_file >> p.sky_octaves;
+	in_file >> p.sky_opacity;
+	in_file >> p.sky_seed;
+
+	// Terrain
+	file_to_color(in_file, p.terrain_color_beach);
+	file_to_color(in_file, p.terrain_color_deep);
+	file_to_color(in_file, p.terrain_color_grass);
+	file_to_color(in_file, p.terrain_color_rock);
+	file_to_color(in_file, p.terrain_color_snow);
+	in_file >> p.terrain_elevation;
+	in_file >> p.terrain_frag_frequency;
+	in_file >> p.terrain_octaves;
+	in_file >> p.terrain_radius;
+	in_file >> p.terrain_seed;
+	in_file >> p.terrain_segments;
+	in_file >> p.terrain_vert_frequency;
+
+	// Ocean
+	file_to_color(in_file, p.ocean_color_1);
+	file_to_color(in_file, p.ocean_color_2);
+	in_file >> p.ocean_enabled;
+	in_file >> p.ocean_frequency;
+	in_file >> p.ocean_octaves;
+	in_file >> p.ocean_seed;
+
+	if (in_file.fail())
+		return false;
+
+	// Features, files saved before they existed end here
+	PlanetParameters features = p;
+	in_file >> features.features_enabled;
+	in_file >> features.feature_craters;
+	in_file >> features.feature_rifts;
+	in_file >> features.feature_seed;
+	in_file >> features.feature_size;
+	in_file >> features.feature_strength;
+	in_file >> features.feature_volcanoes;
+	if (!in_file.fail())
+		p = features;
+
+	_params = p;
+	return true;
+}
+
+
+bool save_parameters(const std::string& _filePath, const PlanetParameters& _params)
+{
+	std::ofstream out_file(_filePath, std::ofstream::binary);
+	if (!out_file.is_open())
+		return false;
+
+	const PlanetParameters& p = _params;
+
+	// Noise
+	out_file << p.noise_method << std::endl;
+
+	// Sky
+	color_to_file(out_file, p.sky_color);
+	out_file << p.sky_enabled << std::endl;
+	out_file << p.sky_frequency << std::endl;
+	out_file << p.sky_octaves << std::endl;
+	out_file << p.sky_opacity << std::endl;
+	out_file << p.sky_seed << std::endl;
+
+	// Terrain
+	color_to_file(out_file, p.terrain_color_beach);
+	color_to_file(out_file, p.terrain_color_deep);
+	color_to_file(out_file, p.terrain_color_grass);
+	color_to_file(out_file, p.terrain_color_rock);
+	color_to_file(out_file, p.terrain_color_snow);
+	out_file << p.terrain_elevation << std::endl;
+	out_file << p.terrain_frag_frequency << std::endl;
+	out_file << p.terrain_octaves << std::endl;
+	out_file << p.terrain_radius << std::endl;
+	out_file << p.terrain_seed << std::endl;
+	out_file << p.terrain_segments << std::endl;
+	out_file << p.terrain_vert_frequency << std::endl;
+
+	// Ocean
+	color_to_file(out_file, p.ocean_color_1);
+	color_to_file(out_file, p.ocean_color_2);
+	out_file << p.ocean_enabled << std::endl;
+	out_file << p.ocean_frequency << std::endl;
+	out_file << p.ocean_octaves << std::endl;
+	out_file << p.ocean_seed << std::endl;
+
+	// Features
+	out_file << p.features_enabled << std::endl;
+	out_file << p.feature_craters << std::endl;
+	out_file << p.feature_rifts << std::endl;
+	out_file << p.feature_seed << std::endl;
+	out_file << p.feature_size << std::endl;
+	out_file << p.feature_strength << std::endl;
+	out_file << p.feature_volcanoes << std::endl;
+
+	return out_file.good();
+}
+
+//! Mixes the bytes of one value into a FNV-1a hash.
+template <typename T>
+static void hash_value(uint64_t& _hash, const T& _value)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&_value);
+	for (size_t i = 0; i < sizeof(T); ++i) {
+		_hash ^= bytes[i];
+		_hash *= 1099511628211ULL;
+	}
+}
+
+uint64_t hash_parameters(const PlanetParameters& _params)
+{
+	// Field by field, the struct padding is not initialized
+	uint64_t hash = 14695981039346656037ULL;
+
+	hash_value(hash, _params.noise_method);
+
+	hash_value(hash, _params.sky_enabled);
+	hash_value(hash, _params.sky_frequency);
+	hash_value(hash, _params.sky_seed);
+	hash_value(hash, _params.sky_octaves);
+	hash_value(hash, _params.sky_color);
+	hash_value(hash, _params.sky_opacity);
+
+	hash_value(hash, _params.terrain_segments);
+	hash_value(hash, _params.terrain_elevation);
+	hash_value(hash, _params.terrain_radius);
+	hash_value(hash, _params.terrain_vert_frequency);
+	hash_value(hash, _params.terrain_frag_frequency);
+	hash_value(hash, _params.terrain_octaves);
+	hash_value(hash, _params.terrain_seed);
+	hash_value(hash, _params.terrain_color_deep);
+	hash_value(hash, _params.terrain_color_beach);
+	hash_value(hash, _params.terrain_color_grass);
+	hash_value(hash, _params.terrain_color_rock);
+	hash_value(hash, _params.terrain_color_snow);
+
+	hash_value(hash, _params.ocean_enabled);
+	hash_value(hash, _params.ocean_frequency);
+	hash_value(hash, _params.ocean_seed);
+	hash_value(hash, _params.ocean_octaves);
+	hash_value(hash, _params.ocean_color_1);
+	hash_value(hash, _params.ocean_color_2);
+
+	hash_value(hash, _params.features_enabled);
+	hash_value(hash, _params.feature_seed);
+	hash_value(hash, _params.feature_craters);
+	hash_value(hash, _params.feature_volcanoes);
+	hash_value(hash, _params.feature_rifts);
+	hash_value(hash, _params.feature_size);
+	hash_value(hash, _params.feature_strength);
+
+	return hash;
+}
+
+//! Adds _change to _changes if the field differs.
+template <typename T>
+static void compare_value(int& _changes, const T& _from, const T& _to, int _change)
+{
+	if (memcmp(&_from, &_to, sizeof(T)) != 0)
+		_changes |= _change;
+}
+
+int compare_parameters(const PlanetParameters& _from, const PlanetParameters& _to)
+{
+	int changes = PARAMETERS_UNCHANGED;
+
+	// Noise fields: shape of the terrain, ocean and cloud layers
+	compare_value(changes, _from.noise_method, _to.noise_method, PARAMETERS_REBAKE);
+	compare_value(changes, _from.sky_frequency, _to.sky_frequency, PARAMETERS_REBAKE);
+	compare_value(changes, _from.sky_seed, _to.sky_seed, PARAMETERS_REBAKE);
+	compare_value(changes, _from.sky_octaves, _to.sky_octaves, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_elevation, _to.terrain_elevation, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_radius, _to.terrain_radius, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_vert_frequency, _to.terrain_vert_frequency, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_frag_frequency, _to.terrain_frag_frequency, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_octaves, _to.terrain_octaves, PARAMETERS_REBAKE);
+	compare_value(changes, _from.terrain_seed, _to.terrain_seed, PARAMETERS_REBAKE);
+	compare_value(changes, _from.ocean_frequency, _to.ocean_frequency, PARAMETERS_REBAKE);
+	compare_value(changes, _from.ocean_seed, _to.ocean_seed, PARAMETERS_REBAKE);
+	compare_value(changes, _from.ocean_octaves, _to.ocean_octaves, PARAMETERS_REBAKE);
+	compare_value(changes, _from.features_enabled, _to.features_enabled, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_seed, _to.feature_seed, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_craters, _to.feature_craters, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_volcanoes, _to.feature_volcanoes, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_rifts, _to.feature_rifts, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_size, _to.feature_size, PARAMETERS_REBAKE);
+	compare_value(changes, _from.feature_strength, _to.feature_strength, PARAMETERS_REBAKE);
+
+	// Colours, opacity and layer switches only change uniforms
+	compare_value(changes, _from.sky_enabled, _to.sky_enabled, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.sky_color, _to.sky_color, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.sky_opacity, _to.sky_opacity, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.terrain_color_deep, _to.terrain_color_deep, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.terrain_color_beach, _to.terrain_color_beach, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.terrain_color_grass, _to.terrain_color_grass, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.terrain_color_rock, _to.terrain_color_rock, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.terrain_color_snow, _to.terrain_color_snow, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.ocean_enabled, _to.ocean_enabled, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.ocean_color_1, _to.ocean_color_1, PARAMETERS_UNIFORMS);
+	compare_value(changes, _from.ocean_color_2, _to.ocean_color_2, PARAMETERS_UNIFORMS);
+
+	compare_value(changes, _from.terrain_segments, _to.terrain_segments, PARAMETERS_TESSELLATE);
+
+	// A rebake is drawn with new uniforms as well
+	if (changes & PARAMETERS_REBAKE)
+		changes |= PARAMETERS_UNIFORMS;
+
+	return changes;
+}
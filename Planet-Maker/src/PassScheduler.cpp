@@ -0,0 +1,203 @@
+#include "PassScheduler.h"
+#include <algorithm>
+
+// Heat map colors for 1, 2, 3, ... shaded fragments per pixel, the last one repeats
+static const int OVERDRAW_LEVELS = 6;
+static const float OVERDRAW_COLORS[OVERDRAW_LEVELS][3] = {
+	{ 0.0f, 0.0f, 0.6f },
+	{ 0.0f, 0.7f, 0.0f },
+	{ 0.9f, 0.9f, 0.0f },
+	{ 1.0f, 0.5f, 0.0f },
+	{ 1.0f, 0.0f, 0.0f },
+	{ 1.0f, 1.0f, 1.0f },
+};
+
+PassScheduler::PassScheduler()
+{
+	measure = false;
+	show_overdraw = false;
+	frame = 0;
+	overdraw_vao = 0;
+	loc_overdraw_color = -1;
+}
+
+
+PassScheduler::~PassScheduler()
+{
+	for (int i = 0; i < 2; ++i) {
+		if (!queries[i].empty())
+			glDeleteQueries((GLsizei)queries[i].size(), queries[i].data());
+	}
+	if (overdraw_vao != 0)
+		glDeleteVertexArrays(1, &overdraw_vao);
+}
+
+void PassScheduler::init()
+{
+	overdraw_shader.createShader("shaders/fullscreen_vert.glsl", "shaders/overdraw_frag.glsl");
+	loc_overdraw_color = glGetUniformLocation(overdraw_shader.programID, "overdraw_color");
+
+	// Core profile needs a bound VAO even when the vertex shader makes up the positions
+	glGenVertexArrays(1, &overdraw_vao);
+}
+
+void PassScheduler::add(const RenderPass& _pass)
+{
+	passes.push_back(_pass);
+}
+
+void PassScheduler::applyQueueState(PassQueue _queue)
+{
+	switch (_queue)
+	{
+	case PASS_DEPTH_PREPASS:
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+		glDisable(GL_BLEND);
+		break;
+	case PASS_OPAQUE:
+		// Equal depths pass, so pre-pass fragments shade exactly once
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+		glDisable(GL_BLEND);
+		break;
+	case PASS_BACKGROUND:
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+		glDisable(GL_BLEND);
+		break;
+	case PASS_TRANSPARENT:
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+		glEnable(GL_BLEND);
+		// Alpha accumulates as coverage, so offscreen targets (impostors) keep opaque planets opaque
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		break;
+	default:
+		break;
+	}
+
+	// Count every shaded fragment in the stencil buffer, the pre-pass is nearly free
+	if (show_overdraw && _queue != PASS_DEPTH_PREPASS) {
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 0, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+	}
+	else {
+		glDisable(GL_STENCIL_TEST);
+	}
+}
+
+void PassScheduler::execute()
+{
+	std::stable_sort(passes.begin(), passes.end(), [](const RenderPass& a, const RenderPass& b) {
+		if (a.queue != b.queue)
+			return a.queue < b.queue;
+		if (a.queue == PASS_TRANSPARENT)
+			return a.sort_depth > b.sort_depth;
+		return a.sort_depth < b.sort_depth;
+	});
+
+	// Unmeasured executes, e.g. impostor bakes and explorer cells drawn
+	// between two measured frames, leave the query slots and parity alone
+	if (measure)
+		collectQueries();
+
+	std::vector<GLuint>& frame_queries = queries[frame & 1];
+	std::vector<std::string>& frame_names = query_names[frame & 1];
+	if (measure) {
+		if (frame_queries.size() < passes.size()) {
+			size_t old_size = frame_queries.size();
+			frame_queries.resize(passes.size());
+			glGenQueries((GLsizei)(passes.size() - old_size), &frame_queries[old_size]);
+		}
+		frame_names.clear();
+	}
+
+	int current_queue = -1;
+	for (size_t i = 0; i < passes.size(); ++i) {
+		if (passes[i].queue != current_queue) {
+			current_queue = passes[i].queue;
+			applyQueueState(passes[i].queue);
+		}
+
+		if (measure) {
+			glBeginQuery(GL_SAMPLES_PASSED, frame_queries[i]);
+			passes[i].draw();
+			glEndQuery(GL_SAMPLES_PASSED);
+			frame_names.push_back(passes[i].name);
+		}
+		else {
+			passes[i].draw();
+		}
+	}
+
+	// Back to the state the rest of the frame expects
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_STENCIL_TEST);
+
+	passes.clear();
+	if (measure)
+		++frame;
+}
+
+//! Reads the queries issued by the previous execute().
+void PassScheduler::collectQueries()
+{
+	std::vector<GLuint>& last_queries = queries[(frame + 1) & 1];
+	std::vector<std::string>& last_names = query_names[(frame + 1) & 1];
+
+	if (last_names.empty())
+		return;
+
+	statistics.resize(last_names.size());
+	for (size_t i = 0; i < last_names.size(); ++i) {
+		statistics[i].name = last_names[i];
+		glGetQueryObjectui64v(last_queries[i], GL_QUERY_RESULT, &statistics[i].samples);
+	}
+}
+
+GLuint64 PassScheduler::getTotalSamples() const
+{
+	GLuint64 total = 0;
+	for (size_t i = 0; i < statistics.size(); ++i)
+		total += statistics[i].samples;
+	return total;
+}
+
+void PassScheduler::drawOverdraw()
+{
+	glUseProgram(overdraw_shader.programID);
+	glBindVertexArray(overdraw_vao);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glEnable(GL_STENCIL_TEST);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+	// Untouched pixels go black
+	glStencilFunc(GL_EQUAL, 0, 0xff);
+	glUniform3f(loc_overdraw_color, 0.0f, 0.0f, 0.0f);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	for (int level = 1; level <= OVERDRAW_LEVELS; ++level) {
+		// GL_LEQUAL: ref <= stored, so the last level also takes everything above it
+		glStencilFunc(level == OVERDRAW_LEVELS ? GL_LEQUAL : GL_EQUAL, level, 0xff);
+		glUniform3fv(loc_overdraw_color, 1, OVERDRAW_COLORS[level - 1]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
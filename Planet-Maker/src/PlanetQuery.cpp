@@ -0,0 +1,422 @@
+#include "PlanetQuery.h"
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+
+static const uint32_t QUERY_VERSION = 1;
+static const float HALF_PI = 1.5707963f;
+// Exact batches at least this large are split over the job system
+static const size_t EXACT_BATCH_GRAIN = 1024;
+static const int MAX_RAY_STEPS = 4096;
+static const int BISECTION_STEPS = 12;
+
+PlanetQuery::PlanetQuery() : surface(PlanetParameters())
+{
+	normal_step = 0.001f;
+	outer_radius = 0.0f;
+	inner_radius = 0.0f;
+}
+
+void PlanetQuery::build(const PlanetParameters& _params, CubeHeightmap&& _heightmap)
+{
+	surface = PlanetSurface(_params);
+	heightmap = std::move(_heightmap);
+	levels.clear();
+	if (heightmap.empty())
+		return;
+
+	const int res = heightmap.getResolution();
+	normal_step = HALF_PI / res;
+
+	// Level 0: a bilinear sample inside a texel reads its 3x3 neighbourhood
+	Level finest;
+	finest.size = res;
+	finest.shift = 0;
+	finest.max_height.resize(6 * (size_t)res * res);
+	finest.min_height.resize(6 * (size_t)res * res);
+	for (int face = 0; face < 6; ++face) {
+		for (int y = 0; y < res; ++y) {
+			for (int x = 0; x < res; ++x) {
+				float high = -1.0e30f, low = 1.0e30f;
+				for (int j = std::max(y - 1, 0); j <= std::min(y + 1, res - 1); ++j) {
+					for (int i = std::max(x - 1, 0); i <= std::min(x + 1, res - 1); ++i) {
+						float h = heightmap.at(face, i, j);
+						high = std::max(high, h);
+						low = std::min(low, h);
+					}
+				}
+				size_t cell = ((size_t)face * res + y) * res + x;
+				finest.max_height[cell] = high;
+				finest.min_height[cell] = low;
+			}
+		}
+	}
+	levels.push_back(std::move(finest));
+
+	// Each coarser level halves the cells per edge, down to one cell per face
+	while (levels.back().size > 1) {
+		const Level& below = levels.back();
+		Level level;
+		level.size = (below.size + 1) / 2;
+		level.shift = below.shift + 1;
+		level.max_height.resize(6 * (size_t)level.size * level.size);
+		level.min_height.resize(6 * (size_t)level.size * level.size);
+
+		for (int face = 0; face < 6; ++face) {
+			for (int y = 0; y < level.size; ++y) {
+				for (int x = 0; x < level.size; ++x) {
+					float high = -1.0e30f, low = 1.0e30f;
+					for (int j = 2 * y; j <= std::min(2 * y + 1, below.size - 1); ++j) {
+						for (int i = 2 * x; i <= std::min(2 * x + 1, below.size - 1); ++i) {
+							size_t child = ((size_t)face * below.size + j) * below.size + i;
+							high = std::max(high, below.max_height[child]);
+							low = std::min(low, below.min_height[child]);
+						}
+					}
+					size_t cell = ((size_t)face * level.size + y) * level.size + x;
+					level.max_height[cell] = high;
+					level.min_height[cell] = low;
+				}
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+
+	const Level& top = levels.back();
+	outer_radius = surface.terrainRadius(*std::max_element(top.max_height.begin(), top.max_height.end()));
+	inner_radius = surface.terrainRadius(*std::min_element(top.min_height.begin(), top.min_height.end()));
+}
+
+float PlanetQuery::sampleHeightmap(const glm::vec3& _direction) const
+{
+	return heightmap.sample(_direction);
+}
+
+float PlanetQuery::sampleHeight(const glm::vec3& _direction, bool _exact) const
+{
+	if (_exact || heightmap.empty())
+		return surface.elevation(glm::normalize(_direction));
+	return heightmap.sample(_direction);
+}
+
+//! Normal from central differences of the surface radius along two tangents, like the preset thumbnails.
+glm::vec3 PlanetQuery::sampleNormal(const glm::vec3& _direction, bool _exact) const
+{
+	glm::vec3 direction = glm::normalize(_direction);
+	glm::vec3 axis = std::abs(direction.z) < 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = glm::normalize(glm::cross(axis, direction));
+	glm::vec3 bitangent = glm::cross(direction, tangent);
+
+	float e = normal_step;
+	float du = surface.terrainRadius(sampleHeight(direction + e * tangent, _exact)) -
+		surface.terrainRadius(sampleHeight(direction - e * tangent, _exact));
+	float dv = surface.terrainRadius(sampleHeight(direction + e * bitangent, _exact)) -
+		surface.terrainRadius(sampleHeight(direction - e * bitangent, _exact));
+	float radius = surface.terrainRadius(sampleHeight(direction, _exact));
+
+	return glm::normalize(direction - (du * tangent + dv * bitangent) / (2.0f * e * radius));
+}
+
+void PlanetQuery::elevations(const glm::vec3* _directions, float* _elevations, size_t _count, bool _exact) const
+{
+	if (_exact && _count >= 2 * EXACT_BATCH_GRAIN) {
+		JobSystem::global().parallelFor((int)((_count + EXACT_BATCH_GRAIN - 1) / EXACT_BATCH_GRAIN), 1, [&](int _begin, int _end) {
+			size_t end = std::min(_end * EXACT_BATCH_GRAIN, _count);
+			for (size_t i = _begin * EXACT_BATCH_GRAIN; i < end; ++i)
+				_elevations[i] = sampleHeight(_directions[i], true);
+		});
+		return;
+	}
+
+	for (size_t i = 0; i < _count; ++i)
+		_elevations[i] = sampleHeight(_directions[i], _exact);
+}
+
+void PlanetQuery::surfaceRadii(const glm::vec3* _directions, float* _radii, size_t _count, bool _exact) const
+{
+	elevations(_directions, _radii, _count, _exact);
+	for (size_t i = 0; i < _count; ++i)
+		_radii[i] = surface.terrainRadius(_radii[i]);
+}
+
+void PlanetQuery::normals(const glm::vec3* _directions, glm::vec3* _normals, size_t _count, bool _exact) const
+{
+	if (_exact && _count >= EXACT_BATCH_GRAIN) {
+		// Five noise evaluations each, worth splitting at a fifth of the elevations() batch
+		size_t grain = EXACT_BATCH_GRAIN / 4;
+		JobSystem::global().parallelFor((int)((_count + grain - 1) / grain), 1, [&](int _begin, int _end) {
+			size_t end = std::min(_end * grain, _count);
+			for (size_t i = _begin * grain; i < end; ++i)
+				_normals[i] = sampleNormal(_directions[i], true);
+		});
+		return;
+	}
+
+	for (size_t i = 0; i < _count; ++i)
+		_normals[i] = sampleNormal(_directions[i], _exact);
+}
+
+void PlanetQuery::raycast(const PlanetRay* _rays, PlanetRayHit* _hits, size_t _count) const
+{
+	// A ray costs a dozen pyramid steps, about as much as a few noise evaluations
+	if (_count >= EXACT_BATCH_GRAIN) {
+		size_t grain = EXACT_BATCH_GRAIN / 4;
+		JobSystem::global().parallelFor((int)((_count + grain - 1) / grain), 1, [&](int _begin, int _end) {
+			size_t end = std::min(_end * grain, _count);
+			for (size_t i = _begin * grain; i < end; ++i)
+				_hits[i] = castRay(_rays[i]);
+		});
+		return;
+	}
+
+	for (size_t i = 0; i < _count; ++i)
+		_hits[i] = castRay(_rays[i]);
+}
+
+float PlanetQuery::elevation(const glm::vec3& _direction, bool _exact) const
+{
+	return sampleHeight(_direction, _exact);
+}
+
+float PlanetQuery::surfaceRadius(const glm::vec3& _direction, bool _exact) const
+{
+	return surface.terrainRadius(sampleHeight(_direction, _exact));
+}
+
+glm::vec3 PlanetQuery::normal(const glm::vec3& _direction, bool _exact) const
+{
+	return sampleNormal(_direction, _exact);
+}
+
+PlanetRayHit PlanetQuery::raycast(const PlanetRay& _ray) const
+{
+	return castRay(_ray);
+}
+
+//! Distance along _ray to the sphere of _radius, entering (_sign -1) or leaving (+1). False if it misses.
+static bool intersect_sphere(const PlanetRay& _ray, float _radius, float _sign, float& _distance)
+{
+	float b = glm::dot(_ray.origin, _ray.direction);
+	float c = glm::dot(_ray.origin, _ray.origin) - _radius * _radius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0f)
+		return false;
+	_distance = -b + _sign * std::sqrt(discriminant);
+	return true;
+}
+
+//! Face center and the directions of growing s and t of every cube face,
+//! PlanetSurface::cubeDirection() before normalizing is center + s * along_s + t * along_t.
+//! cross(center + s0 * along_s, along_t) points towards growing s on every face, and
+//! cross(center + t0 * along_t, along_s) towards falling t.
+static const glm::vec3 FACE_AXES[6][3] = {
+	{ glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0) },
+	{ glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, -1, 0) },
+	{ glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) },
+	{ glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1) },
+	{ glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0) },
+	{ glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0) },
+};
+
+//! Distance along the ray to where it crosses the plane through the center
+//! with _normal, leaving the side the normal points to. Infinite if it never does.
+static float leave_plane(const glm::vec3& _normal, const glm::vec3& _origin, const glm::vec3& _direction)
+{
+	float speed = glm::dot(_normal, _direction);
+	if (speed >= 0.0f)
+		return 1.0e30f;
+	return -glm::dot(_normal, _origin) / speed;
+}
+
+//! Steps along the ray as far as the pyramid allows. Every cell of a cube
+//! face is a cone bounded by four planes through the planet center, the ray
+//! may advance until it leaves the cone or comes down to the cell's highest
+//! terrain, whichever is first. The level that allows the longest step wins.
+//! Near the terrain it walks quarter texels and bisects the step that went
+//! below the heightmap.
+PlanetRayHit PlanetQuery::castRay(const PlanetRay& _ray) const
+{
+	PlanetRayHit result;
+	if (levels.empty())
+		return result;
+
+	float begin, end;
+	if (!intersect_sphere(_ray, outer_radius, 1.0f, end) || end < 0.0f)
+		return result;
+	if (!intersect_sphere(_ray, outer_radius, -1.0f, begin))
+		return result;
+	begin = std::max(begin, 0.0f);
+
+	// Below the lowest terrain everything is solid
+	float solid;
+	if (intersect_sphere(_ray, inner_radius, -1.0f, solid) && solid >= begin)
+		end = std::min(end, solid);
+	end = std::min(end, _ray.max_distance);
+
+	const int res = heightmap.getResolution();
+	const float min_step = 0.25f * normal_step * inner_radius;
+	// Carries the ray over the border it stepped to, into the next cell
+	const float nudge = 0.01f * min_step;
+
+	float t = begin;
+	float previous = t;
+	bool found = false;
+
+	for (int i = 0; i < MAX_RAY_STEPS && t <= end; ++i) {
+		glm::vec3 p = _ray.origin + t * _ray.direction;
+		float r = glm::length(p);
+
+		int face;
+		float s, v;
+		PlanetSurface::cubeCoordinates(p, face, s, v);
+		int tx = glm::clamp((int)((s * 0.5f + 0.5f) * res), 0, res - 1);
+		int ty = glm::clamp((int)((v * 0.5f + 0.5f) * res), 0, res - 1);
+
+		const glm::vec3& center = FACE_AXES[face][0];
+		const glm::vec3& along_s = FACE_AXES[face][1];
+		const glm::vec3& along_t = FACE_AXES[face][2];
+
+		float step = 0.0f;
+		for (size_t l = levels.size(); l-- > 0;) {
+			const Level& level = levels[l];
+			int cx = tx >> level.shift;
+			int cy = ty >> level.shift;
+			float high = surface.terrainRadius(level.max_height[((size_t)face * level.size + cy) * level.size + cx]);
+			if (r <= high)
+				continue;
+
+			float s0 = 2.0f * (cx << level.shift) / res - 1.0f;
+			float s1 = 2.0f * std::min((cx + 1) << level.shift, res) / res - 1.0f;
+			float t0 = 2.0f * (cy << level.shift) / res - 1.0f;
+			float t1 = 2.0f * std::min((cy + 1) << level.shift, res) / res - 1.0f;
+
+			float leave = std::min(
+				std::min(leave_plane(glm::cross(center + s0 * along_s, along_t), _ray.origin, _ray.direction),
+					leave_plane(-glm::cross(center + s1 * along_s, along_t), _ray.origin, _ray.direction)),
+				std::min(leave_plane(-glm::cross(center + t0 * along_t, along_s), _ray.origin, _ray.direction),
+					leave_plane(glm::cross(center + t1 * along_t, along_s), _ray.origin, _ray.direction)));
+
+			// Cells of finer levels lie inside this one, they only allow a
+			// longer step if it is cut short by the terrain of this cell
+			float land;
+			if (intersect_sphere(_ray, high, -1.0f, land) && land >= t && land < leave) {
+				step = std::max(step, land - t);
+				continue;
+			}
+			step = std::max(step, leave + nudge - t);
+			break;
+		}
+
+		if (step < min_step) {
+			float ground = surface.terrainRadius(sampleHeightmap(p));
+			if (r <= ground) {
+				found = true;
+				break;
+			}
+			step = min_step;
+		}
+
+		previous = t;
+		t += step;
+	}
+
+	// The last step may have jumped past the end onto solid ground
+	if (!found && t > end && end < _ray.max_distance) {
+		glm::vec3 p = _ray.origin + end * _ray.direction;
+		if (glm::length(p) <= surface.terrainRadius(sampleHeightmap(p))) {
+			t = end;
+			found = true;
+		}
+	}
+	if (!found)
+		return result;
+
+	// Above the ground at previous, on or below it at t
+	float above = previous, below = t;
+	if (below > above) {
+		for (int i = 0; i < BISECTION_STEPS; ++i) {
+			float middle = 0.5f * (above + below);
+			glm::vec3 p = _ray.origin + middle * _ray.direction;
+			if (glm::length(p) <= surface.terrainRadius(sampleHeightmap(p)))
+				below = middle;
+			else
+				above = middle;
+		}
+	}
+
+	result.hit = true;
+	result.distance = below;
+	result.position = _ray.origin + below * _ray.direction;
+	result.elevation = sampleHeightmap(result.position);
+	result.normal = sampleNormal(result.position, false);
+	return result;
+}
+
+
+// __________ BACKGROUND QUERY ______________
+
+BackgroundQuery::BackgroundQuery()
+{
+	building_key = 0;
+}
+
+
+BackgroundQuery::~BackgroundQuery()
+{
+	stop();
+}
+
+uint64_t BackgroundQuery::cacheKey(const PlanetParameters& _params, int _resolution)
+{
+	return BakeKey("query", QUERY_VERSION)
+		.add(CubeHeightmap::cacheKey(_params, _resolution))
+		.add(_params.terrain_radius)
+		.add(_params.terrain_elevation)
+		.add(_params.ocean_enabled)
+		.get();
+}
+
+void BackgroundQuery::start(const PlanetParameters& _params, int _resolution, BakeCache* _cache)
+{
+	uint64_t key = cacheKey(_params, _resolution);
+	if (key == building_key)
+		return;
+
+	cancel.cancel();
+	cancel = CancelToken();
+	building_key = key;
+
+	std::shared_ptr<PlanetQuery> query = std::make_shared<PlanetQuery>();
+	building = query;
+	CancelToken token = cancel;
+	PlanetParameters params = _params;
+	task = JobSystem::global().run([query, params, _resolution, _cache, token]() {
+		CubeHeightmap heightmap;
+		heightmap.bake(params, _resolution, _cache, nullptr, token);
+		if (!heightmap.empty() && !token.isCancelled())
+			query->build(params, std::move(heightmap));
+	}, cancel);
+}
+
+void BackgroundQuery::stop()
+{
+	cancel.cancel();
+	cancel = CancelToken();
+	building.reset();
+	building_key = 0;
+	task = TaskRef();
+}
+
+bool BackgroundQuery::update()
+{
+	if (!building || !JobSystem::isDone(task))
+		return false;
+
+	// Cancelled or the bake failed, keep the old query
+	bool built = !building->empty();
+	if (built)
+		current = building;
+	building.reset();
+	return built;
+}
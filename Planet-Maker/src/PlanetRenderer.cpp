@@ -0,0 +1,1270 @@
+#include "PlanetRenderer.h"
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+
+static const float SKYBOX_SCALE = 100.0f;
+static const float PI = 3.141592653f;
+// Room for a few terrain meshes at the highest segment count in flight
+static const size_t MESH_STREAM_SIZE = 32 * 1024 * 1024;
+// Kept apart from the units the passes bind their own textures to
+static const int EROSION_TEXTURE_UNIT = 3;
+static const int CLIMATE_TEXTURE_UNIT = 4;
+static const int BIOME_TEXTURE_UNIT = 5;
+static const int BIOME_LUT_SIZE = 64;
+
+// Per planet values of the instanced shaders, std430 layout of PlanetData below.
+// Only vec4 sized members so the C++ and GLSL layouts cannot drift apart.
+struct PlanetInstanceData
+{
+	glm::mat4 model;
+	glm::vec4 terrain;     // radius, elevation, vert_frequency, frag_frequency
+	glm::ivec4 noise;      // method, terrain seed, terrain octaves, unused
+	glm::vec4 color_deep;
+	glm::vec4 color_beach;
+	glm::vec4 color_grass;
+	glm::vec4 color_rock;
+	glm::vec4 color_snow;
+	glm::vec4 ocean;       // frequency
+	glm::ivec4 ocean_noise; // unused, seed, octaves, unused
+	glm::vec4 ocean_color_1;
+	glm::vec4 ocean_color_2;
+	glm::vec4 sky;         // frequency, opacity
+	glm::ivec4 sky_noise;  // unused, seed, octaves, unused
+	glm::vec4 sky_color;
+};
+
+static const char* INSTANCED_DEFINES =
+	"#extension GL_ARB_shader_storage_buffer_object : require\n"
+	"#define INSTANCED\n"
+	"struct PlanetData {\n"
+	"  mat4 model;\n"
+	"  vec4 terrain;\n"
+	"  ivec4 noise;\n"
+	"  vec4 color_deep;\n"
+	"  vec4 color_beach;\n"
+	"  vec4 color_grass;\n"
+	"  vec4 color_rock;\n"
+	"  vec4 color_snow;\n"
+	"  vec4 ocean;\n"
+	"  ivec4 ocean_noise;\n"
+	"  vec4 ocean_color_1;\n"
+	"  vec4 ocean_color_2;\n"
+	"  vec4 sky;\n"
+	"  ivec4 sky_noise;\n"
+	"  vec4 sky_color;\n"
+	"};\n"
+	"layout(std430, binding = 0) readonly buffer PlanetBuffer { PlanetData planets[]; };\n"
+	"layout(std430, binding = 1) readonly buffer InstanceBuffer { uint instance_list[]; };\n"
+	"uniform mat4 scene_model;\n"
+	"uniform int instance_offset;\n";
+
+// Single planet terrain shaders read the feature layer from storage buffers 2 and 3
+static const char* FEATURE_DEFINES =
+	"#extension GL_ARB_shader_storage_buffer_object : require\n"
+	"#define FEATURES\n";
+
+static glm::vec4 to_vec4(const float _color[3])
+{
+	return glm::vec4(_color[0], _color[1], _color[2], 1.0f);
+}
+
+PlanetRenderer::PlanetRenderer()
+{
+	terrain_sphere = nullptr;
+	sky_sphere = nullptr;
+	ocean_sphere = nullptr;
+	terrain_segments = 0;
+
+	pending_segments = 0;
+	requested_segments = 0;
+
+	instancing_supported = false;
+	planet_buffer = 0;
+	instance_buffer = 0;
+	uploaded_scene = nullptr;
+	uploaded_version = 0;
+	hashed_scene = nullptr;
+	hashed_version = 0;
+	for (int i = 0; i < LAYER_COUNT; ++i)
+		layer_offset[i] = layer_count[i] = 0;
+
+	biome_lut = 0;
+	climate_texture = 0;
+	climate_key = pending_climate_key = 0;
+
+	feature_stamp_buffer = 0;
+	feature_cell_buffer = 0;
+	feature_grid = 0;
+	feature_key = pending_feature_key = 0;
+}
+
+
+PlanetRenderer::~PlanetRenderer()
+{
+	cancelMeshTask();
+	climate_cancel.cancel();
+	feature_cancel.cancel();
+	deleteMeshes();
+
+	// Tasks may still write into the stream mapping
+	for (size_t i = 0; i < abandoned_writes.size(); ++i)
+		JobSystem::global().wait(abandoned_writes[i].writer);
+	mesh_stream.clean();
+
+	// delete the skybox
+	for (std::vector<Plane*>::iterator it = skybox.begin(); it != skybox.end(); ++it)
+	{
+		delete (*it);
+	}
+	skybox.clear();
+
+	if (planet_buffer != 0)
+		glDeleteBuffers(1, &planet_buffer);
+	if (instance_buffer != 0)
+		glDeleteBuffers(1, &instance_buffer);
+	if (biome_lut != 0)
+		glDeleteTextures(1, &biome_lut);
+	if (climate_texture != 0)
+		glDeleteTextures(1, &climate_texture);
+	if (feature_stamp_buffer != 0)
+		glDeleteBuffers(1, &feature_stamp_buffer);
+	if (feature_cell_buffer != 0)
+		glDeleteBuffers(1, &feature_cell_buffer);
+}
+
+void PlanetRenderer::init(int _terrainSegments)
+{
+	instancing_supported = GLEW_ARB_shader_storage_buffer_object != 0;
+	if (instancing_supported) {
+		glGenBuffers(1, &planet_buffer);
+		glGenBuffers(1, &instance_buffer);
+		glGenBuffers(1, &feature_stamp_buffer);
+		glGenBuffers(1, &feature_cell_buffer);
+	}
+
+	// The erosion and climate maps are sampled across cube face edges
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	std::vector<uint8_t> lut;
+	build_biome_lut(BIOME_LUT_SIZE, lut);
+	glGenTextures(1, &biome_lut);
+	glBindTexture(GL_TEXTURE_2D, biome_lut);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, BIOME_LUT_SIZE, BIOME_LUT_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, lut.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Without ARB_buffer_storage meshes are built into arrays and uploaded
+	mesh_stream.init(MESH_STREAM_SIZE);
+
+	loadShaders();
+	scheduler.init();
+	temporal_clouds.init();
+	impostors.init();
+	props.init();
+
+	const float scale = SKYBOX_SCALE;
+	skybox.push_back(new Plane(scale, glm::vec3(0, 0, scale / 2.f), 0.0f, glm::vec3(0.0f, 0.0f, 1.0f))); // back
+	skybox.push_back(new Plane(scale, glm::vec3(0, 0, -scale / 2.f), PI, glm::vec3(1.0f, 0.0f, 0.0f))); // front
+	skybox.push_back(new Plane(scale, glm::vec3(0, scale / 2.f, 0.0f), -PI / 2.f, glm::vec3(1.0f, 0.0f, 0.0f))); // top
+	skybox.push_back(new Plane(scale, glm::vec3(0, -scale / 2.f, 0.0f), PI / 2.f, glm::vec3(1.0f, 0.0f, 0.0f))); // bottom
+	skybox.push_back(new Plane(scale, glm::vec3(scale / 2.f, 0.0f, 0.0f), PI / 2.f, glm::vec3(0.0f, 1.0f, 0.0f))); // right
+	skybox.push_back(new Plane(scale, glm::vec3(-scale / 2.f, 0.0f, 0.0f), -PI / 2.f, glm::vec3(0.0f, 1.0f, 0.0f))); // left
+
+	rebuildSpheres(_terrainSegments);
+}
+
+//! Compiles all planet shaders. A shader that fails to compile keeps its previous program.
+void PlanetRenderer::loadShaders()
+{
+	GLuint old_programs[9] = { terrain_shader.programID, terrain_depth_shader.programID,
+		sky_shader.programID, ocean_shader.programID, stars_shader.programID,
+		terrain_instanced_shader.programID, terrain_depth_instanced_shader.programID,
+		ocean_instanced_shader.programID, sky_instanced_shader.programID };
+
+	// Without storage buffers the terrain is drawn without its feature layer
+	if (instancing_supported) {
+		terrain_shader.defines = FEATURE_DEFINES;
+		terrain_depth_shader.defines = FEATURE_DEFINES;
+	}
+
+	terrain_shader.createShader("shaders/terrain_vert.glsl", "shaders/terrain_frag.glsl");
+	terrain_depth_shader.createShader("shaders/terrain_vert.glsl", "shaders/depth_frag.glsl");
+	sky_shader.createShader("shaders/sky_vert.glsl", "shaders/sky_frag.glsl");
+	ocean_shader.createShader("shaders/ocean_vert.glsl", "shaders/ocean_frag.glsl");
+	stars_shader.createShader("shaders/star_vert.glsl", "shaders/star_frag.glsl");
+
+	if (instancing_supported) {
+		terrain_instanced_shader.defines = INSTANCED_DEFINES;
+		terrain_depth_instanced_shader.defines = INSTANCED_DEFINES;
+		ocean_instanced_shader.defines = INSTANCED_DEFINES;
+		sky_instanced_shader.defines = INSTANCED_DEFINES;
+
+		terrain_instanced_shader.createShader("shaders/terrain_vert.glsl", "shaders/terrain_frag.glsl");
+		terrain_depth_instanced_shader.createShader("shaders/terrain_vert.glsl", "shaders/depth_frag.glsl");
+		ocean_instanced_shader.createShader("shaders/ocean_vert.glsl", "shaders/ocean_frag.glsl");
+		sky_instanced_shader.createShader("shaders/sky_vert.glsl", "shaders/sky_frag.glsl");
+	}
+
+	GLuint new_programs[9] = { terrain_shader.programID, terrain_depth_shader.programID,
+		sky_shader.programID, ocean_shader.programID, stars_shader.programID,
+		terrain_instanced_shader.programID, terrain_depth_instanced_shader.programID,
+		ocean_instanced_shader.programID, sky_instanced_shader.programID };
+
+	for (int i = 0; i < 9; ++i) {
+		if (old_programs[i] != 0 && old_programs[i] != new_programs[i])
+			glDeleteProgram(old_programs[i]);
+	}
+
+	lookupUniforms();
+}
+
+void PlanetRenderer::reloadShaders()
+{
+	loadShaders();
+	temporal_clouds.loadShaders();
+	props.loadShaders();
+}
+
+void PlanetRenderer::lookupUniforms()
+{
+	// __________ TERRAIN ______________
+	loc_P_terrain = glGetUniformLocation(terrain_shader.programID, "P"); // perspective matrix
+	loc_V_terrain = glGetUniformLocation(terrain_shader.programID, "V"); // view matrix
+	loc_M_terrain = glGetUniformLocation(terrain_shader.programID, "M"); // model matrix
+
+	loc_color_deep = glGetUniformLocation(terrain_shader.programID, "color_deep");
+	loc_color_beach = glGetUniformLocation(terrain_shader.programID, "color_beach");
+	loc_color_grass = glGetUniformLocation(terrain_shader.programID, "color_grass");
+	loc_color_rock = glGetUniformLocation(terrain_shader.programID, "color_rock");
+	loc_color_snow = glGetUniformLocation(terrain_shader.programID, "color_snow");
+
+	loc_terrain_method = glGetUniformLocation(terrain_shader.programID, "noise_method");
+
+	loc_radius = glGetUniformLocation(terrain_shader.programID, "radius");
+	loc_elevation = glGetUniformLocation(terrain_shader.programID, "elevationModifier");
+	loc_seed = glGetUniformLocation(terrain_shader.programID, "seed");
+	loc_octaves = glGetUniformLocation(terrain_shader.programID, "octaves");
+	loc_vert_frequency = glGetUniformLocation(terrain_shader.programID, "vert_frequency");
+	loc_frag_frequency = glGetUniformLocation(terrain_shader.programID, "frag_frequency");
+
+	loc_erosion_map = glGetUniformLocation(terrain_shader.programID, "erosion_map");
+	loc_erosion_strength = glGetUniformLocation(terrain_shader.programID, "erosion_strength");
+	loc_erosion_step = glGetUniformLocation(terrain_shader.programID, "erosion_step");
+
+	loc_climate_map = glGetUniformLocation(terrain_shader.programID, "climate_map");
+	loc_climate_enabled = glGetUniformLocation(terrain_shader.programID, "climate_enabled");
+	loc_slope_scale = glGetUniformLocation(terrain_shader.programID, "slope_scale");
+	loc_biome_lut = glGetUniformLocation(terrain_shader.programID, "biome_lut");
+	loc_feature_grid = glGetUniformLocation(terrain_shader.programID, "feature_grid");
+	loc_lod_pixel_angle = glGetUniformLocation(terrain_shader.programID, "lod_pixel_angle");
+	loc_lod_pixel_size = glGetUniformLocation(terrain_shader.programID, "lod_pixel_size");
+	loc_lod_vertex_angle = glGetUniformLocation(terrain_shader.programID, "lod_vertex_angle");
+
+	// __________ TERRAIN DEPTH PRE-PASS ______________
+	loc_P_depth = glGetUniformLocation(terrain_depth_shader.programID, "P");
+	loc_V_depth = glGetUniformLocation(terrain_depth_shader.programID, "V");
+	loc_M_depth = glGetUniformLocation(terrain_depth_shader.programID, "M");
+
+	loc_depth_method = glGetUniformLocation(terrain_depth_shader.programID, "noise_method");
+	loc_depth_radius = glGetUniformLocation(terrain_depth_shader.programID, "radius");
+	loc_depth_elevation = glGetUniformLocation(terrain_depth_shader.programID, "elevationModifier");
+	loc_depth_seed = glGetUniformLocation(terrain_depth_shader.programID, "seed");
+	loc_depth_octaves = glGetUniformLocation(terrain_depth_shader.programID, "octaves");
+	loc_depth_frequency = glGetUniformLocation(terrain_depth_shader.programID, "vert_frequency");
+
+	loc_depth_erosion_map = glGetUniformLocation(terrain_depth_shader.programID, "erosion_map");
+	loc_depth_erosion_strength = glGetUniformLocation(terrain_depth_shader.programID, "erosion_strength");
+	loc_depth_erosion_step = glGetUniformLocation(terrain_depth_shader.programID, "erosion_step");
+	loc_depth_feature_grid = glGetUniformLocation(terrain_depth_shader.programID, "feature_grid");
+	loc_depth_lod_pixel_angle = glGetUniformLocation(terrain_depth_shader.programID, "lod_pixel_angle");
+	loc_depth_lod_pixel_size = glGetUniformLocation(terrain_depth_shader.programID, "lod_pixel_size");
+	loc_depth_lod_vertex_angle = glGetUniformLocation(terrain_depth_shader.programID, "lod_vertex_angle");
+
+	// __________ SKY ______________
+	loc_P_sky = glGetUniformLocation(sky_shader.programID, "P");
+	loc_V_sky = glGetUniformLocation(sky_shader.programID, "V");
+	loc_M_sky = glGetUniformLocation(sky_shader.programID, "M");
+
+	loc_sky_radius = glGetUniformLocation(sky_shader.programID, "radius");
+	loc_sky_elevation = glGetUniformLocation(sky_shader.programID, "elevationModifier");
+
+	loc_sky_method = glGetUniformLocation(sky_shader.programID, "noise_method");
+
+	loc_sky_time = glGetUniformLocation(sky_shader.programID, "time");
+	loc_sky_speed = glGetUniformLocation(sky_shader.programID, "speed");
+	loc_sky_frequency = glGetUniformLocation(sky_shader.programID, "frequency");
+	loc_sky_octaves = glGetUniformLocation(sky_shader.programID, "octaves");
+	loc_sky_seed = glGetUniformLocation(sky_shader.programID, "seed");
+	loc_sky_color = glGetUniformLocation(sky_shader.programID, "sky_color");
+	loc_sky_opacity = glGetUniformLocation(sky_shader.programID, "opacity");
+	loc_sky_octave_lod = glGetUniformLocation(sky_shader.programID, "octave_lod");
+
+	// __________ OCEAN ______________
+	loc_P_ocean = glGetUniformLocation(ocean_shader.programID, "P");
+	loc_V_ocean = glGetUniformLocation(ocean_shader.programID, "V");
+	loc_M_ocean = glGetUniformLocation(ocean_shader.programID, "M");
+
+	loc_light_position = glGetUniformLocation(ocean_shader.programID, "light_pos");
+	loc_light_intensity = glGetUniformLocation(ocean_shader.programID, "light_intensity");
+	loc_shininess = glGetUniformLocation(ocean_shader.programID, "shininess");
+
+	loc_ocean_method = glGetUniformLocation(ocean_shader.programID, "noise_method");
+
+	loc_ocean_radius = glGetUniformLocation(ocean_shader.programID, "radius");
+	loc_ocean_elevation = glGetUniformLocation(ocean_shader.programID, "elevationModifier");
+	loc_ocean_frequency = glGetUniformLocation(ocean_shader.programID, "frequency");
+	loc_ocean_octaves = glGetUniformLocation(ocean_shader.programID, "octaves");
+	loc_ocean_seed = glGetUniformLocation(ocean_shader.programID, "seed");
+	loc_ocean_color_1 = glGetUniformLocation(ocean_shader.programID, "color_1");
+	loc_ocean_color_2 = glGetUniformLocation(ocean_shader.programID, "color_2");
+	loc_ocean_octave_lod = glGetUniformLocation(ocean_shader.programID, "octave_lod");
+
+	// __________ STAR BACKGROUND ______________
+	loc_P_stars = glGetUniformLocation(stars_shader.programID, "P");
+	loc_V_stars = glGetUniformLocation(stars_shader.programID, "V");
+	loc_M_stars = glGetUniformLocation(stars_shader.programID, "M");
+
+	// __________ INSTANCED ______________
+	Shader* instanced_shaders[4] = { &terrain_instanced_shader, &terrain_depth_instanced_shader, &ocean_instanced_shader, &sky_instanced_shader };
+	InstancedUniforms* instanced_locations[4] = { &loc_terrain_instanced, &loc_depth_instanced, &loc_ocean_instanced, &loc_sky_instanced };
+
+	for (int i = 0; i < 4; ++i) {
+		GLuint program = instanced_shaders[i]->programID;
+		instanced_locations[i]->P = glGetUniformLocation(program, "P");
+		instanced_locations[i]->V = glGetUniformLocation(program, "V");
+		instanced_locations[i]->scene_model = glGetUniformLocation(program, "scene_model");
+		instanced_locations[i]->instance_offset = glGetUniformLocation(program, "instance_offset");
+		instanced_locations[i]->lod_pixel_angle = glGetUniformLocation(program, "lod_pixel_angle");
+		instanced_locations[i]->lod_pixel_size = glGetUniformLocation(program, "lod_pixel_size");
+		instanced_locations[i]->lod_vertex_angle = glGetUniformLocation(program, "lod_vertex_angle");
+		instanced_locations[i]->octave_lod = glGetUniformLocation(program, "octave_lod");
+	}
+
+	loc_instanced_biome_lut = glGetUniformLocation(terrain_instanced_shader.programID, "biome_lut");
+
+	loc_instanced_light_position = glGetUniformLocation(ocean_instanced_shader.programID, "light_pos");
+	loc_instanced_light_intensity = glGetUniformLocation(ocean_instanced_shader.programID, "light_intensity");
+	loc_instanced_shininess = glGetUniformLocation(ocean_instanced_shader.programID, "shininess");
+
+	loc_instanced_sky_time = glGetUniformLocation(sky_instanced_shader.programID, "time");
+	loc_instanced_sky_speed = glGetUniformLocation(sky_instanced_shader.programID, "speed");
+}
+
+void PlanetRenderer::deleteMeshes()
+{
+	delete terrain_sphere;
+	delete sky_sphere;
+	delete ocean_sphere;
+	terrain_sphere = sky_sphere = ocean_sphere = nullptr;
+}
+
+void PlanetRenderer::setTerrainSegments(int _segments)
+{
+	// A pending request would replace this mesh later
+	cancelMeshTask();
+	requested_segments = _segments;
+
+	if (_segments == terrain_segments && terrain_sphere)
+		return;
+
+	delete terrain_sphere;
+	terrain_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, _segments);
+	terrain_segments = _segments;
+}
+
+void PlanetRenderer::requestTerrainSegments(int _segments)
+{
+	requested_segments = _segments;
+	if (_segments != pending_segments)
+		startMeshTask();
+}
+
+//! Tessellates the requested segment count in a task, a main thread task uploads and swaps it in.
+void PlanetRenderer::startMeshTask()
+{
+	// Whatever is still being built is stale now
+	cancelMeshTask();
+	if (requested_segments == terrain_segments)
+		return;
+
+	int segments = requested_segments;
+	pending_segments = segments;
+	mesh_cancel = CancelToken();
+
+	JobSystem& jobs = JobSystem::global();
+	if (startStreamedMeshTask(segments))
+		return;
+
+	// Shared by both tasks, whichever releases it last frees an unused mesh
+	std::shared_ptr<std::unique_ptr<Sphere>> built = std::make_shared<std::unique_ptr<Sphere>>();
+
+	TaskRef build = jobs.run([built, segments]() {
+		built->reset(new Sphere());
+		(*built)->setPosition(glm::vec3(0.0f));
+		(*built)->buildArrays(1.0f, segments);
+	}, mesh_cancel);
+
+	mesh_task = jobs.runOnMainThread({ build }, [this, built, segments]() {
+		(*built)->upload();
+		delete terrain_sphere;
+		terrain_sphere = built->release();
+		terrain_segments = segments;
+		pending_segments = 0;
+	}, mesh_cancel);
+}
+
+//! startMeshTask() without a copy: the task tessellates straight into the stream buffer,
+//! which the mesh is drawn from. False if the stream is unavailable or full.
+bool PlanetRenderer::startStreamedMeshTask(int _segments)
+{
+	int nverts, ntris;
+	Sphere::countElements(_segments, nverts, ntris);
+	size_t index_offset = (8 * nverts * sizeof(GLfloat) + 15) / 16 * 16;
+	size_t bytes = index_offset + 3 * ntris * sizeof(GLuint);
+
+	StreamAllocation allocation;
+	if (!mesh_stream.allocate(bytes, 256, allocation))
+		return false;
+
+	JobSystem& jobs = JobSystem::global();
+	GLfloat* vertices = (GLfloat*)allocation.pointer;
+	GLuint* indices = (GLuint*)(allocation.pointer + index_offset);
+	TaskRef build = jobs.run([vertices, indices, _segments]() {
+		Sphere::writeArrays(1.0f, _segments, vertices, indices);
+	}, mesh_cancel);
+
+	streamed_build = build;
+	streamed_allocation = allocation;
+
+	mesh_task = jobs.runOnMainThread({ build }, [this, allocation, index_offset, _segments]() {
+		Sphere* sphere = new Sphere();
+		sphere->setPosition(glm::vec3(0.0f));
+		sphere->useStream(&mesh_stream, allocation, index_offset, 1.0f, _segments);
+		streamed_build = nullptr;
+
+		delete terrain_sphere;
+		terrain_sphere = sphere;
+		terrain_segments = _segments;
+		pending_segments = 0;
+	}, mesh_cancel);
+	return true;
+}
+
+//! Skips the tasks of a mesh being built, a tessellation already running finishes unused.
+void PlanetRenderer::cancelMeshTask()
+{
+	mesh_cancel.cancel();
+	mesh_task = nullptr;
+	pending_segments = 0;
+
+	// The stream space is still written until the tessellation is done, see beginFrame()
+	if (streamed_build) {
+		AbandonedWrite abandoned;
+		abandoned.writer = streamed_build;
+		abandoned.allocation = streamed_allocation;
+		abandoned_writes.push_back(abandoned);
+		streamed_build = nullptr;
+	}
+}
+
+void PlanetRenderer::adoptTerrainMesh(Sphere* _sphere, int _segments)
+{
+	cancelMeshTask();
+	requested_segments = _segments;
+
+	delete terrain_sphere;
+	terrain_sphere = _sphere;
+	terrain_segments = _segments;
+}
+
+void PlanetRenderer::invalidateBakes()
+{
+	temporal_clouds.invalidate();
+}
+
+void PlanetRenderer::applySnapshot(const SnapshotRef& _snapshot)
+{
+	if (applied_snapshot && applied_snapshot->version == _snapshot->version)
+		return;
+
+	// Versions may have been skipped, compare with the one applied instead of taking its changes
+	int changes = applied_snapshot ? compare_parameters(applied_snapshot->params, _snapshot->params)
+		: PARAMETERS_REBAKE | PARAMETERS_TESSELLATE;
+	applied_snapshot = _snapshot;
+
+	if (changes & PARAMETERS_REBAKE) {
+		invalidateBakes();
+		startFeatureTask(_snapshot->params);
+	}
+	// The climate also depends on uniforms such as the ocean switch, this is free if its key is the same
+	startClimateTask(_snapshot->params);
+	if (changes & PARAMETERS_TESSELLATE)
+		requestTerrainSegments(_snapshot->params.terrain_segments);
+}
+
+//! Bakes the heightmap and climate map of _params in a task, a main thread task uploads
+//! the cube map. Nothing happens if the map or the one being baked is for the same key.
+void PlanetRenderer::startClimateTask(const PlanetParameters& _params)
+{
+	uint64_t key = ClimateMap::cacheKey(_params, ClimateMap::DEFAULT_RESOLUTION);
+	if (key == climate_key || key == pending_climate_key)
+		return;
+
+	climate_cancel.cancel();
+	climate_cancel = CancelToken();
+	pending_climate_key = key;
+
+	JobSystem& jobs = JobSystem::global();
+	std::shared_ptr<ClimateMap> built = std::make_shared<ClimateMap>();
+	PlanetParameters params = _params;
+	CancelToken cancel = climate_cancel;
+
+	TaskRef build = jobs.run([built, params, cancel]() {
+		CubeHeightmap heightmap;
+		heightmap.bake(params, ClimateMap::DEFAULT_RESOLUTION, nullptr, nullptr, cancel);
+		built->bake(heightmap, params, nullptr, cancel);
+	}, cancel);
+
+	climate_task = jobs.runOnMainThread({ build }, [this, built, key]() {
+		pending_climate_key = 0;
+		if (built->empty())
+			return;
+
+		int resolution = built->getResolution();
+		if (climate_texture == 0) {
+			glGenTextures(1, &climate_texture);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, climate_texture);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		}
+
+		// Faces are in GL cube map order already
+		glBindTexture(GL_TEXTURE_CUBE_MAP, climate_texture);
+		for (int face = 0; face < 6; ++face)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F, resolution, resolution, 0, GL_RGB, GL_FLOAT, built->getFace(face));
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		climate_key = key;
+	}, cancel);
+}
+
+//! Builds the feature layer of _params in a task, a main thread task uploads the stamps
+//! and the grid. Nothing happens without features or if the layer is already there.
+void PlanetRenderer::startFeatureTask(const PlanetParameters& _params)
+{
+	uint64_t key = FeatureLayer::cacheKey(_params);
+	if (!instancing_supported || key == 0 || key == feature_key || key == pending_feature_key)
+		return;
+
+	feature_cancel.cancel();
+	feature_cancel = CancelToken();
+	pending_feature_key = key;
+
+	JobSystem& jobs = JobSystem::global();
+	std::shared_ptr<std::shared_ptr<const FeatureLayer>> built = std::make_shared<std::shared_ptr<const FeatureLayer>>();
+	PlanetParameters params = _params;
+	CancelToken cancel = feature_cancel;
+
+	// Shared with the heightmap bakes of the same planet, see FeatureLayer::get()
+	TaskRef build = jobs.run([built, params]() {
+		*built = FeatureLayer::get(params);
+	}, cancel);
+
+	feature_task = jobs.runOnMainThread({ build }, [this, built, key]() {
+		pending_feature_key = 0;
+		const FeatureLayer* layer = built->get();
+		if (layer != nullptr)
+			uploadFeatures(*layer, key);
+	}, cancel);
+}
+
+void PlanetRenderer::buildFeatures(const PlanetParameters& _params)
+{
+	uint64_t key = FeatureLayer::cacheKey(_params);
+	if (!instancing_supported || key == 0 || key == feature_key)
+		return;
+
+	std::shared_ptr<const FeatureLayer> layer = FeatureLayer::get(_params);
+	if (layer)
+		uploadFeatures(*layer, key);
+}
+
+//! Copies the stamps and the grid of _layer into the storage buffers. Empty layers are skipped,
+//! bindFeatures() then keeps the features off.
+void PlanetRenderer::uploadFeatures(const FeatureLayer& _layer, uint64_t _key)
+{
+	if (_layer.empty())
+		return;
+
+	const std::vector<FeatureStamp>& stamps = _layer.getStamps();
+	const std::vector<uint32_t>& cells = _layer.getCells();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, feature_stamp_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, stamps.size() * sizeof(FeatureStamp), stamps.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, feature_cell_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, cells.size() * sizeof(uint32_t), cells.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	feature_grid = _layer.getGridSize();
+	feature_key = _key;
+}
+
+void PlanetRenderer::rebuildSpheres(int _terrainSegments)
+{
+	cancelMeshTask();
+	requested_segments = _terrainSegments;
+	deleteMeshes();
+
+	sky_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
+	terrain_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, _terrainSegments);
+	ocean_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
+	terrain_segments = _terrainSegments;
+}
+
+void PlanetRenderer::beginFrame()
+{
+	for (size_t i = 0; i < abandoned_writes.size(); ) {
+		if (JobSystem::isDone(abandoned_writes[i].writer)) {
+			mesh_stream.release(abandoned_writes[i].allocation);
+			abandoned_writes.erase(abandoned_writes.begin() + i);
+		}
+		else {
+			++i;
+		}
+	}
+	// Fences everything the last frame released
+	mesh_stream.endFrame();
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClearStencil(0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	//glEnable(GL_CULL_FACE);
+	//glCullFace(GL_BACK);
+	glDisable(GL_TEXTURE);
+	glEnable(GL_ALPHA_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void PlanetRenderer::render(const PlanetParameters& _params, const RenderState& _state)
+{
+	if (_state.draw_wireframe)
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	// Distance from the camera to the closest point of each layer
+	glm::vec3 camera_position = glm::vec3(glm::inverse(_state.view)[3]);
+	glm::vec3 planet_center = glm::vec3(_state.model[3]);
+	float center_distance = glm::length(camera_position - planet_center);
+
+	float terrain_top = 1.0f + _params.terrain_radius + _params.terrain_elevation;
+	float ocean_top = 1.0f + _params.terrain_radius + 0.01f;
+	float sky_top = 1.0f + _params.terrain_radius + 1.1f * _params.terrain_elevation;
+
+	RenderPass pass;
+
+	// The terrain fragment shader is the most expensive, shade each pixel once
+	if (_state.depth_prepass && !_state.draw_wireframe) {
+		pass.name = "Terrain depth";
+		pass.queue = PASS_DEPTH_PREPASS;
+		pass.sort_depth = center_distance - terrain_top;
+		pass.draw = [&]() { renderTerrainDepth(_params, _state); };
+		scheduler.add(pass);
+	}
+
+	pass.name = "Terrain";
+	pass.queue = PASS_OPAQUE;
+	pass.sort_depth = center_distance - terrain_top;
+	pass.draw = [&]() { renderTerrain(_params, _state); };
+	scheduler.add(pass);
+
+	if (_state.draw_props) {
+		pass.name = "Props";
+		pass.queue = PASS_OPAQUE;
+		pass.sort_depth = center_distance - terrain_top;
+		pass.draw = [&]() { props.render(_params, _state, _state.prop_distance); };
+		scheduler.add(pass);
+	}
+
+	if (_state.draw_stars) {
+		pass.name = "Stars";
+		pass.queue = PASS_BACKGROUND;
+		pass.sort_depth = 0.0f;
+		pass.draw = [&]() { renderStars(_state); };
+		scheduler.add(pass);
+	}
+
+	if (_params.ocean_enabled) {
+		pass.name = "Ocean";
+		pass.queue = PASS_TRANSPARENT;
+		pass.sort_depth = center_distance - ocean_top;
+		pass.draw = [&]() { renderOcean(_params, _state); };
+		scheduler.add(pass);
+	}
+
+	if (_params.sky_enabled) {
+		pass.name = "Clouds";
+		pass.queue = PASS_TRANSPARENT;
+		pass.sort_depth = center_distance - sky_top;
+		pass.draw = [&]() { renderSky(_params, _state); };
+		scheduler.add(pass);
+	}
+
+	scheduler.measure = _state.measure_passes;
+	scheduler.show_overdraw = _state.show_overdraw;
+	scheduler.execute();
+
+	glUseProgram(0);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	if (_state.show_overdraw)
+		scheduler.drawOverdraw();
+}
+
+void PlanetRenderer::renderScene(const Scene& _scene, const RenderState& _state)
+{
+	if (_scene.empty())
+		return;
+
+	// Culling and impostor bakes come first, bakes render through the scheduler too
+	std::vector<int> full;
+	selectPlanets(_scene, _state, full);
+
+	bool instanced = instancing_supported && terrain_instanced_shader.programID != 0 &&
+		ocean_instanced_shader.programID != 0 && sky_instanced_shader.programID != 0;
+
+	if (!instanced) {
+		// One set of draws per planet, the amortized clouds keep a single history
+		RenderState planet_state = _state;
+		planet_state.cloud_update_rate = 1;
+		planet_state.show_overdraw = false;
+		for (size_t i = 0; i < full.size(); ++i) {
+			planet_state.model = _state.model * _scene.get(full[i]).modelMatrix();
+			planet_state.draw_stars = _state.draw_stars && i == 0;
+			render(_scene.get(full[i]).params, planet_state);
+		}
+		impostors.render(_state.projection, _state.view);
+		return;
+	}
+
+	uploadScene(_scene);
+	sortInstances(_scene, full, _state);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, planet_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instance_buffer);
+
+	if (_state.draw_wireframe)
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	// Every layer is one draw for all planets. The instances are sorted inside
+	// the draw, the layers keep the order of render(): oceans, then clouds.
+	RenderPass pass;
+	pass.sort_depth = 0.0f;
+
+	if (_state.depth_prepass && !_state.draw_wireframe && terrain_depth_instanced_shader.programID != 0 && layer_count[LAYER_TERRAIN] > 0) {
+		pass.name = "Terrain depth";
+		pass.queue = PASS_DEPTH_PREPASS;
+		pass.draw = [&]() { renderSceneTerrain(_state, true); };
+		scheduler.add(pass);
+	}
+
+	if (layer_count[LAYER_TERRAIN] > 0) {
+		pass.name = "Terrain";
+		pass.queue = PASS_OPAQUE;
+		pass.draw = [&]() { renderSceneTerrain(_state, false); };
+		scheduler.add(pass);
+	}
+
+	if (_state.draw_stars) {
+		pass.name = "Stars";
+		pass.queue = PASS_BACKGROUND;
+		pass.draw = [&]() { renderStars(_state); };
+		scheduler.add(pass);
+	}
+
+	// Impostors are the furthest planets, blend them first
+	if (impostors.getBillboardCount() > 0) {
+		pass.name = "Impostors";
+		pass.queue = PASS_TRANSPARENT;
+		pass.sort_depth = 2.0f;
+		pass.draw = [&]() { impostors.render(_state.projection, _state.view); };
+		scheduler.add(pass);
+	}
+
+	if (layer_count[LAYER_OCEAN] > 0) {
+		pass.name = "Ocean";
+		pass.queue = PASS_TRANSPARENT;
+		pass.sort_depth = 1.0f;
+		pass.draw = [&]() { renderSceneOcean(_state); };
+		scheduler.add(pass);
+	}
+
+	if (layer_count[LAYER_SKY] > 0) {
+		pass.name = "Clouds";
+		pass.queue = PASS_TRANSPARENT;
+		pass.sort_depth = 0.0f;
+		pass.draw = [&]() { renderSceneSky(_state); };
+		scheduler.add(pass);
+	}
+
+	scheduler.measure = _state.measure_passes;
+	scheduler.show_overdraw = _state.show_overdraw;
+	scheduler.execute();
+
+	glUseProgram(0);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+
+	if (_state.show_overdraw)
+		scheduler.drawOverdraw();
+}
+
+//! Copies the planet parameters into the planet buffer when the scene changed.
+void PlanetRenderer::uploadScene(const Scene& _scene)
+{
+	if (uploaded_scene == &_scene && uploaded_version == _scene.getVersion())
+		return;
+
+	std::vector<PlanetInstanceData> data(_scene.size());
+	for (int i = 0; i < _scene.size(); ++i) {
+		const PlanetParameters& params = _scene.get(i).params;
+		PlanetInstanceData& d = data[i];
+
+		d.model = _scene.get(i).modelMatrix();
+		d.terrain = glm::vec4(params.terrain_radius, params.terrain_elevation, params.terrain_vert_frequency, params.terrain_frag_frequency);
+		d.noise = glm::ivec4(params.noise_method, params.terrain_seed, params.terrain_octaves, 0);
+		d.color_deep = to_vec4(params.terrain_color_deep);
+		d.color_beach = to_vec4(params.terrain_color_beach);
+		d.color_grass = to_vec4(params.terrain_color_grass);
+		d.color_rock = to_vec4(params.terrain_color_rock);
+		d.color_snow = to_vec4(params.terrain_color_snow);
+		d.ocean = glm::vec4(params.ocean_frequency, 0.0f, 0.0f, 0.0f);
+		d.ocean_noise = glm::ivec4(0, params.ocean_seed, params.ocean_octaves, 0);
+		d.ocean_color_1 = to_vec4(params.ocean_color_1);
+		d.ocean_color_2 = to_vec4(params.ocean_color_2);
+		d.sky = glm::vec4(params.sky_frequency, params.sky_opacity, 0.0f, 0.0f);
+		d.sky_noise = glm::ivec4(0, params.sky_seed, params.sky_octaves, 0);
+		d.sky_color = to_vec4(params.sky_color);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, planet_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(PlanetInstanceData), data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	uploaded_scene = &_scene;
+	uploaded_version = _scene.getVersion();
+}
+
+//! Frustum culls the scene and splits the visible planets into full draws
+//! (_full) and impostor billboards, baking impostors that are missing or stale.
+void PlanetRenderer::selectPlanets(const Scene& _scene, const RenderState& _state, std::vector<int>& _full)
+{
+	scene_index.update(_scene);
+
+	if (hashed_scene != &_scene || hashed_version != _scene.getVersion()) {
+		planet_hashes.resize(_scene.size());
+		for (int i = 0; i < _scene.size(); ++i)
+			planet_hashes[i] = hash_parameters(_scene.get(i).params);
+		hashed_scene = &_scene;
+		hashed_version = _scene.getVersion();
+	}
+
+	std::vector<int> visible;
+	if (_state.frustum_culling) {
+		// Planet positions are in scene space, so are the planes
+		Frustum frustum = Frustum::fromMatrix(_state.projection * _state.view * _state.model);
+		scene_index.query(frustum, visible);
+	}
+	else {
+		for (int i = 0; i < _scene.size(); ++i)
+			visible.push_back(i);
+	}
+
+	glm::mat4 camera = glm::inverse(_state.view);
+	glm::vec3 camera_position = glm::vec3(camera[3]);
+	glm::vec3 camera_up = glm::vec3(camera[1]);
+
+	// Screen radius in pixels = world radius / distance * pixel_scale
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float pixel_scale = _state.projection[1][1] * viewport[3] * 0.5f;
+
+	impostors.beginFrame();
+	_full.clear();
+
+	for (size_t i = 0; i < visible.size(); ++i) {
+		int index = visible[i];
+		const Planet& planet = _scene.get(index);
+
+		glm::vec3 center = glm::vec3(_state.model * glm::vec4(scene_index.getCenter(index), 1.0f));
+		float radius = scene_index.getRadius(index);
+		float distance = glm::length(camera_position - center);
+
+		if (_state.impostor_pixels > 0.0f && distance > 2.0f * radius &&
+			radius / distance * pixel_scale < _state.impostor_pixels) {
+			// View in the planet's own frame, spinning the scene turns the planet too
+			glm::mat3 to_local = glm::inverse(glm::mat3(_state.model * planet.modelMatrix()));
+			glm::vec3 direction = glm::normalize(to_local * (camera_position - center));
+			glm::vec3 up = glm::normalize(to_local * camera_up);
+
+			// Over the bake budget a stale image is still better than a full draw
+			int slot;
+			if (!impostors.lookup(index, planet_hashes[index], direction, up, slot)) {
+				int bake_slot = impostors.acquire(index);
+				if (bake_slot >= 0) {
+					bakeImpostor(planet, bake_slot, planet_hashes[index], _state, center, radius, direction, up);
+					slot = bake_slot;
+				}
+			}
+
+			if (slot >= 0) {
+				impostors.addBillboard(slot, center, radius);
+				continue;
+			}
+		}
+
+		_full.push_back(index);
+	}
+
+	scene_statistics.planets = _scene.size();
+	scene_statistics.visible = (int)visible.size();
+	scene_statistics.impostors = impostors.getBillboardCount();
+	scene_statistics.bakes = impostors.getBakeCount();
+}
+
+//! Renders one planet into its atlas slot with an orthographic camera that
+//! looks at it from the current view direction.
+void PlanetRenderer::bakeImpostor(const Planet& _planet, int _slot, uint64_t _hash, const RenderState& _state,
+	const glm::vec3& _center, float _radius, const glm::vec3& _localDirection, const glm::vec3& _localUp)
+{
+	glm::mat4 camera = glm::inverse(_state.view);
+	glm::vec3 direction = glm::normalize(glm::vec3(camera[3]) - _center);
+
+	RenderState bake = _state;
+	bake.model = _state.model * _planet.modelMatrix();
+	bake.view = glm::lookAt(_center + 3.0f * _radius * direction, _center, glm::vec3(camera[1]));
+	bake.projection = glm::ortho(-_radius, _radius, -_radius, _radius, _radius, 5.0f * _radius);
+	bake.cloud_update_rate = 1;
+	bake.draw_stars = false;
+	bake.draw_wireframe = false;
+	bake.measure_passes = false;
+	bake.show_overdraw = false;
+
+	impostors.beginBake(_slot);
+	render(_planet.params, bake);
+	impostors.endBake(_slot, _hash, _localDirection, _localUp);
+}
+
+//! Builds the instance lists of all layers: terrain front-to-back for early
+//! depth rejection, ocean and clouds back-to-front for blending.
+void PlanetRenderer::sortInstances(const Scene& _scene, const std::vector<int>& _planets, const RenderState& _state)
+{
+	glm::vec3 camera_position = glm::vec3(glm::inverse(_state.view)[3]);
+
+	std::vector<std::pair<float, GLuint>> by_distance(_planets.size());
+	for (size_t i = 0; i < _planets.size(); ++i) {
+		glm::vec3 center = glm::vec3((_state.model * _scene.get(_planets[i]).modelMatrix())[3]);
+		by_distance[i] = std::make_pair(glm::length(camera_position - center), (GLuint)_planets[i]);
+	}
+	std::sort(by_distance.begin(), by_distance.end());
+
+	instances.clear();
+
+	layer_offset[LAYER_TERRAIN] = 0;
+	for (size_t i = 0; i < by_distance.size(); ++i)
+		instances.push_back(by_distance[i].second);
+	layer_count[LAYER_TERRAIN] = (int)instances.size();
+
+	layer_offset[LAYER_OCEAN] = (int)instances.size();
+	for (size_t i = by_distance.size(); i-- > 0;) {
+		if (_scene.get(by_distance[i].second).params.ocean_enabled)
+			instances.push_back(by_distance[i].second);
+	}
+	layer_count[LAYER_OCEAN] = (int)instances.size() - layer_offset[LAYER_OCEAN];
+
+	layer_offset[LAYER_SKY] = (int)instances.size();
+	for (size_t i = by_distance.size(); i-- > 0;) {
+		if (_scene.get(by_distance[i].second).params.sky_enabled)
+			instances.push_back(by_distance[i].second);
+	}
+	layer_count[LAYER_SKY] = (int)instances.size() - layer_offset[LAYER_SKY];
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(GLuint), instances.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void PlanetRenderer::renderSceneTerrain(const RenderState& _state, bool _depthOnly)
+{
+	const Shader& shader = _depthOnly ? terrain_depth_instanced_shader : terrain_instanced_shader;
+	const InstancedUniforms& loc = _depthOnly ? loc_depth_instanced : loc_terrain_instanced;
+
+	glUseProgram(shader.programID);
+	glUniformMatrix4fv(loc.P, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc.V, 1, GL_FALSE, glm::value_ptr(_state.view));
+	glUniformMatrix4fv(loc.scene_model, 1, GL_FALSE, glm::value_ptr(_state.model));
+	glUniform1i(loc.instance_offset, layer_offset[LAYER_TERRAIN]);
+	bindOctaveLod(_state, loc.lod_pixel_angle, loc.lod_pixel_size, loc.lod_vertex_angle);
+
+	if (!_depthOnly) {
+		glActiveTexture(GL_TEXTURE0 + BIOME_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, biome_lut);
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(loc_instanced_biome_lut, BIOME_TEXTURE_UNIT);
+	}
+
+	terrain_sphere->renderInstanced(layer_count[LAYER_TERRAIN]);
+}
+
+void PlanetRenderer::renderSceneOcean(const RenderState& _state)
+{
+	glUseProgram(ocean_instanced_shader.programID);
+	glUniformMatrix4fv(loc_ocean_instanced.P, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_ocean_instanced.V, 1, GL_FALSE, glm::value_ptr(_state.view));
+	glUniformMatrix4fv(loc_ocean_instanced.scene_model, 1, GL_FALSE, glm::value_ptr(_state.model));
+	glUniform1i(loc_ocean_instanced.instance_offset, layer_offset[LAYER_OCEAN]);
+	glUniform1i(loc_ocean_instanced.octave_lod, _state.octave_lod ? 1 : 0);
+
+	glUniform3fv(loc_instanced_light_position, 1, &_state.light_position[0]);
+	glUniform1f(loc_instanced_light_intensity, _state.light_intensity);
+	glUniform1f(loc_instanced_shininess, _state.shininess);
+
+	ocean_sphere->renderInstanced(layer_count[LAYER_OCEAN]);
+}
+
+void PlanetRenderer::renderSceneSky(const RenderState& _state)
+{
+	glUseProgram(sky_instanced_shader.programID);
+	glUniformMatrix4fv(loc_sky_instanced.P, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_sky_instanced.V, 1, GL_FALSE, glm::value_ptr(_state.view));
+	glUniformMatrix4fv(loc_sky_instanced.scene_model, 1, GL_FALSE, glm::value_ptr(_state.model));
+	glUniform1i(loc_sky_instanced.instance_offset, layer_offset[LAYER_SKY]);
+	glUniform1i(loc_sky_instanced.octave_lod, _state.octave_lod ? 1 : 0);
+
+	glUniform1f(loc_instanced_sky_time, _state.time);
+	glUniform1f(loc_instanced_sky_speed, _state.sky_speed);
+
+	sky_sphere->renderInstanced(layer_count[LAYER_SKY]);
+}
+
+//! Binds the erosion map of _state for the terrain program in use, the depth and color passes must set the same values.
+void PlanetRenderer::bindErosion(const RenderState& _state, GLint _map, GLint _strength, GLint _step)
+{
+	bool enabled = _state.erosion_map != 0 && _state.erosion_resolution > 0;
+	glUniform1f(_strength, enabled ? _state.erosion_strength : 0.0f);
+	if (!enabled)
+		return;
+
+	glActiveTexture(GL_TEXTURE0 + EROSION_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, _state.erosion_map);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(_map, EROSION_TEXTURE_UNIT);
+	glUniform1f(_step, 2.0f / _state.erosion_resolution);
+}
+
+//! Sets the footprint terrain_vert.glsl limits its octaves to: the view angle of
+//! a pixel at the center of the viewport, or its size in view space for an
+//! orthographic projection such as the impostor bakes, and the angle between
+//! the vertices of the terrain mesh. Zero keeps every octave.
+void PlanetRenderer::bindOctaveLod(const RenderState& _state, GLint _pixelAngle, GLint _pixelSize, GLint _vertexAngle)
+{
+	float pixel_angle = 0.0f;
+	float pixel_size = 0.0f;
+	float vertex_angle = 0.0f;
+	if (_state.octave_lod) {
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		// The height of the view volume at distance 1, or in total without perspective
+		float pixel = 2.0f / (_state.projection[1][1] * std::max(viewport[3], 1));
+		if (_state.projection[3][3] == 1.0f)
+			pixel_size = pixel;
+		else
+			pixel_angle = pixel;
+		// Longitude steps of the sphere mesh, the widest spacing at the equator
+		vertex_angle = glm::pi<float>() / std::max(terrain_segments, 1);
+	}
+
+	glUniform1f(_pixelAngle, pixel_angle);
+	glUniform1f(_pixelSize, pixel_size);
+	glUniform1f(_vertexAngle, vertex_angle);
+}
+
+//! Binds the biome lookup, and the climate map if it was baked for _params, for terrain_shader.
+void PlanetRenderer::bindClimate(const PlanetParameters& _params)
+{
+	// Impostor bakes draw other planets through render(), they estimate their climate
+	bool enabled = climate_texture != 0 && climate_key == ClimateMap::cacheKey(_params, ClimateMap::DEFAULT_RESOLUTION);
+
+	glActiveTexture(GL_TEXTURE0 + BIOME_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, biome_lut);
+	if (enabled) {
+		glActiveTexture(GL_TEXTURE0 + CLIMATE_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, climate_texture);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(loc_biome_lut, BIOME_TEXTURE_UNIT);
+	glUniform1i(loc_climate_map, CLIMATE_TEXTURE_UNIT);
+	glUniform1i(loc_climate_enabled, enabled ? 1 : 0);
+	glUniform1f(loc_slope_scale, _params.terrain_elevation / (1.0f + _params.terrain_radius));
+}
+
+//! Binds the feature layer if it was built for _params, for the terrain program in use.
+//! The depth and color passes must set the same values.
+void PlanetRenderer::bindFeatures(const PlanetParameters& _params, GLint _grid)
+{
+	// Impostor bakes draw other planets through render(), they go without
+	bool enabled = feature_key != 0 && feature_key == FeatureLayer::cacheKey(_params);
+	glUniform1i(_grid, enabled ? feature_grid : 0);
+	if (!enabled)
+		return;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, feature_stamp_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, feature_cell_buffer);
+}
+
+void PlanetRenderer::renderTerrainDepth(const PlanetParameters& _params, const RenderState& _state)
+{
+	glUseProgram(terrain_depth_shader.programID);
+
+	glUniformMatrix4fv(loc_P_depth, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V_depth, 1, GL_FALSE, glm::value_ptr(_state.view));
+
+	glm::mat4 model = glm::translate(_state.model, *terrain_sphere->getPosition());
+	glUniformMatrix4fv(loc_M_depth, 1, GL_FALSE, glm::value_ptr(model));
+
+	glUniform1i(loc_depth_method, _params.noise_method);
+	glUniform1f(loc_depth_radius, _params.terrain_radius);
+	glUniform1f(loc_depth_elevation, _params.terrain_elevation);
+	glUniform1i(loc_depth_seed, _params.terrain_seed);
+	glUniform1i(loc_depth_octaves, _params.terrain_octaves);
+	glUniform1f(loc_depth_frequency, _params.terrain_vert_frequency);
+	bindErosion(_state, loc_depth_erosion_map, loc_depth_erosion_strength, loc_depth_erosion_step);
+	bindFeatures(_params, loc_depth_feature_grid);
+	bindOctaveLod(_state, loc_depth_lod_pixel_angle, loc_depth_lod_pixel_size, loc_depth_lod_vertex_angle);
+
+	terrain_sphere->render();
+}
+
+void PlanetRenderer::renderStars(const RenderState& _state)
+{
+	glUseProgram(stars_shader.programID);
+	glUniformMatrix4fv(loc_P_stars, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V_stars, 1, GL_FALSE, glm::value_ptr(_state.view));
+
+	for (int i = 0; i < skybox.size(); ++i) {
+		glm::mat4 model;
+		model = glm::translate(model, skybox[i]->m_position);
+		model = glm::rotate(model, skybox[i]->m_angle, skybox[i]->m_rotation);
+
+		glUniformMatrix4fv(loc_M_stars, 1, GL_FALSE, glm::value_ptr(model));
+		skybox[i]->render();
+	}
+}
+
+void PlanetRenderer::renderTerrain(const PlanetParameters& _params, const RenderState& _state)
+{
+	glUseProgram(terrain_shader.programID);
+
+	glUniformMatrix4fv(loc_P_terrain, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V_terrain, 1, GL_FALSE, glm::value_ptr(_state.view));
+
+	glm::mat4 model = glm::translate(_state.model, *terrain_sphere->getPosition());
+	glUniformMatrix4fv(loc_M_terrain, 1, GL_FALSE, glm::value_ptr(model));
+
+	glUniform1i(loc_terrain_method, _params.noise_method);
+
+	glUniform1f(loc_radius, _params.terrain_radius);
+	glUniform1f(loc_elevation, _params.terrain_elevation);
+	glUniform1i(loc_seed, _params.terrain_seed);
+	glUniform1i(loc_octaves, _params.terrain_octaves);
+	glUniform1f(loc_vert_frequency, _params.terrain_vert_frequency);
+	glUniform1f(loc_frag_frequency, _params.terrain_frag_frequency);
+	bindErosion(_state, loc_erosion_map, loc_erosion_strength, loc_erosion_step);
+	bindFeatures(_params, loc_feature_grid);
+	bindOctaveLod(_state, loc_lod_pixel_angle, loc_lod_pixel_size, loc_lod_vertex_angle);
+	bindClimate(_params);
+
+	glUniform3fv(loc_color_deep, 1, &_params.terrain_color_deep[0]);
+	glUniform3fv(loc_color_beach, 1, &_params.terrain_color_beach[0]);
+	glUniform3fv(loc_color_grass, 1, &_params.terrain_color_grass[0]);
+	glUniform3fv(loc_color_rock, 1, &_params.terrain_color_rock[0]);
+	glUniform3fv(loc_color_snow, 1, &_params.terrain_color_snow[0]);
+
+	terrain_sphere->render();
+}
+
+void PlanetRenderer::renderOcean(const PlanetParameters& _params, const RenderState& _state)
+{
+	glUseProgram(ocean_shader.programID);
+
+	glUniformMatrix4fv(loc_P_ocean, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V_ocean, 1, GL_FALSE, glm::value_ptr(_state.view));
+
+	glm::mat4 model = glm::translate(_state.model, *ocean_sphere->getPosition());
+	glUniformMatrix4fv(loc_M_ocean, 1, GL_FALSE, glm::value_ptr(model));
+
+	glUniform1i(loc_ocean_method, _params.noise_method);
+
+	glUniform3fv(loc_light_position, 1, &_state.light_position[0]);
+	glUniform1f(loc_light_intensity, _state.light_intensity);
+	glUniform1f(loc_shininess, _state.shininess);
+
+	glUniform1f(loc_ocean_radius, _params.terrain_radius);
+	glUniform1f(loc_ocean_elevation, _params.terrain_elevation);
+	glUniform1i(loc_ocean_seed, _params.ocean_seed);
+	glUniform1f(loc_ocean_frequency, _params.ocean_frequency);
+	glUniform1i(loc_ocean_octaves, _params.ocean_octaves);
+	glUniform3fv(loc_ocean_color_1, 1, &_params.ocean_color_1[0]);
+	glUniform3fv(loc_ocean_color_2, 1, &_params.ocean_color_2[0]);
+	glUniform1i(loc_ocean_octave_lod, _state.octave_lod ? 1 : 0);
+
+	ocean_sphere->render();
+}
+
+void PlanetRenderer::renderSky(const PlanetParameters& _params, const RenderState& _state)
+{
+	glm::mat4 model = glm::translate(_state.model, *sky_sphere->getPosition());
+
+	// The amortized path intersects the shell per pixel, wireframe needs the mesh
+	if (_state.cloud_update_rate > 1 && !_state.draw_wireframe) {
+		temporal_clouds.render(_params, _state, model);
+		return;
+	}
+
+	glUseProgram(sky_shader.programID);
+
+	glUniformMatrix4fv(loc_P_sky, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V_sky, 1, GL_FALSE, glm::value_ptr(_state.view));
+	glUniformMatrix4fv(loc_M_sky, 1, GL_FALSE, glm::value_ptr(model));
+
+	glUniform1i(loc_sky_method, _params.noise_method);
+
+	glUniform1f(loc_sky_time, _state.time);
+	glUniform1f(loc_sky_speed, _state.sky_speed);
+	glUniform1f(loc_sky_radius, _params.terrain_radius);
+	glUniform1f(loc_sky_elevation, _params.terrain_elevation);
+	glUniform1i(loc_sky_seed, _params.sky_seed);
+	glUniform1f(loc_sky_frequency, _params.sky_frequency);
+	glUniform1i(loc_sky_octaves, _params.sky_octaves);
+	glUniform3fv(loc_sky_color, 1, &_params.sky_color[0]);
+	glUniform1f(loc_sky_opacity, _params.sky_opacity);
+	glUniform1i(loc_sky_octave_lod, _state.octave_lod ? 1 : 0);
+
+	sky_sphere->render();
+}
+
+void PlanetRenderer::defaultView(float _aspect, glm::mat4& _projection, glm::mat4& _view)
+{
+	// Same lens and start position as the interactive Camera
+	_projection = glm::perspective(45.0f, _aspect, 0.01f, 100.f);
+	_view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
@@ -0,0 +1,166 @@
+#include "PlanetSurface.h"
+#include "ClimateMap.h"
+#include "Noise.h"
+#include <cmath>
+
+// Same values as ocean_vert.glsl and ocean_frag.glsl
+static const float OCEAN_HEIGHT = 0.01f;
+static const float OCEAN_OPACITY = 0.6f;
+
+PlanetSurface::PlanetSurface(const PlanetParameters& _params) : params(_params)
+{
+	features = FeatureLayer::get(_params);
+	climate_map = nullptr;
+}
+
+//! generate_noise() of terrain_vert.glsl, worley falls back to perlin there.
+float PlanetSurface::terrainNoise(const glm::vec3& _p) const
+{
+	if (params.noise_method == 1)
+		return simplex_noise(_p);
+	return perlin_noise(_p);
+}
+
+//! generate_noise() of the fragment shaders.
+float PlanetSurface::detailNoise(const glm::vec3& _p) const
+{
+	if (params.noise_method == 1)
+		return simplex_noise(_p);
+	if (params.noise_method == 2)
+		return cellular_noise(_p).x;
+	return perlin_noise(_p);
+}
+
+float PlanetSurface::elevation(const glm::vec3& _direction) const
+{
+	float result = octave(_direction, 0);
+	for (int o = 1; o < params.terrain_octaves; ++o)
+		result += octave(_direction, o);
+
+	if (features)
+		result += features->height(_direction);
+
+	return result;
+}
+
+float PlanetSurface::octave(const glm::vec3& _direction, int _octave) const
+{
+	glm::vec3 p = _direction + (float)params.terrain_seed;
+	float frequency = params.terrain_vert_frequency;
+
+	if (_octave == 0)
+		return terrainNoise(frequency * p);
+	return 1.0f / std::pow(2.0f, (float)_octave) * terrainNoise((_octave + 1.0f) * frequency * p);
+}
+
+float PlanetSurface::terrainRadius(float _elevation) const
+{
+	return 1.0f + params.terrain_radius + _elevation * params.terrain_elevation;
+}
+
+float PlanetSurface::oceanRadius() const
+{
+	return 1.0f + params.terrain_radius + OCEAN_HEIGHT;
+}
+
+bool PlanetSurface::isUnderwater(float _elevation) const
+{
+	return params.ocean_enabled && terrainRadius(_elevation) < oceanRadius();
+}
+
+glm::vec3 PlanetSurface::terrainColor(const glm::vec3& _direction, float _elevation) const
+{
+	Climate climate = climate_map ? climate_map->sample(_direction) : estimate_climate(_direction, _elevation);
+
+	glm::vec3 c_d = glm::vec3(params.terrain_color_deep[0], params.terrain_color_deep[1], params.terrain_color_deep[2]);
+	glm::vec3 c_b = glm::vec3(params.terrain_color_beach[0], params.terrain_color_beach[1], params.terrain_color_beach[2]);
+	glm::vec3 c_g = glm::vec3(params.terrain_color_grass[0], params.terrain_color_grass[1], params.terrain_color_grass[2]);
+	glm::vec3 c_r = glm::vec3(params.terrain_color_rock[0], params.terrain_color_rock[1], params.terrain_color_rock[2]);
+	glm::vec3 c_s = glm::vec3(params.terrain_color_snow[0], params.terrain_color_snow[1], params.terrain_color_snow[2]);
+
+	// Same as terrain_frag.glsl, the lookup texture holds biome_weights()
+	glm::vec4 biome = biome_weights(climate.temperature, climate.moisture);
+	glm::vec3 land = biome.x * c_b + biome.y * c_g + biome.z * c_r + biome.w * c_s;
+
+	float slope_scale = params.terrain_elevation / (1.0f + params.terrain_radius);
+	float steep = glm::smoothstep(0.6f, 1.2f, climate.slope * slope_scale);
+	land = glm::mix(land, c_r, steep * (1.0f - biome.w));
+
+	float sand = 1.0f - glm::smoothstep(0.05f, 0.2f, _elevation);
+	land = glm::mix(land, c_b, sand * (1.0f - biome.w));
+
+	float coast = glm::smoothstep(0.0f, 0.1f, _elevation);
+	return glm::mix(c_d, land, coast);
+}
+
+float PlanetSurface::seaLevel() const
+{
+	if (!params.ocean_enabled || params.terrain_elevation <= 0.0f)
+		return 0.0f;
+	return OCEAN_HEIGHT / params.terrain_elevation;
+}
+
+glm::vec3 PlanetSurface::oceanColor(const glm::vec3& _direction) const
+{
+	glm::vec3 pos = _direction * oceanRadius();
+	glm::vec3 p = pos + (float)params.ocean_seed;
+	float frequency = params.ocean_frequency;
+
+	float noise = detailNoise(frequency * p);
+	for (int o = 1; o < params.ocean_octaves; ++o)
+		noise += 1.0f / std::pow(2.0f, (float)o) * detailNoise((o + 1.0f) * frequency * p);
+
+	glm::vec3 color_1 = glm::vec3(params.ocean_color_1[0], params.ocean_color_1[1], params.ocean_color_1[2]);
+	glm::vec3 color_2 = glm::vec3(params.ocean_color_2[0], params.ocean_color_2[1], params.ocean_color_2[2]);
+
+	glm::vec3 color = glm::mix(color_1, color_2, noise);
+	color -= 0.1f * detailNoise(800.0f * pos + (float)params.ocean_seed);
+
+	// Ambient + diffuse albedo of ocean_frag.glsl without the view dependent parts
+	return color * 0.8f;
+}
+
+glm::vec3 PlanetSurface::color(const glm::vec3& _direction, float _elevation) const
+{
+	glm::vec3 terrain = terrainColor(_direction, _elevation);
+	if (!isUnderwater(_elevation))
+		return terrain;
+
+	return glm::mix(terrain, oceanColor(_direction), OCEAN_OPACITY);
+}
+
+glm::vec3 PlanetSurface::cubeDirection(int _face, float _s, float _t)
+{
+	glm::vec3 d;
+	switch (_face)
+	{
+	case 0: d = glm::vec3(1.0f, -_t, -_s); break;
+	case 1: d = glm::vec3(-1.0f, -_t, _s); break;
+	case 2: d = glm::vec3(_s, 1.0f, _t); break;
+	case 3: d = glm::vec3(_s, -1.0f, -_t); break;
+	case 4: d = glm::vec3(_s, -_t, 1.0f); break;
+	default: d = glm::vec3(-_s, -_t, -1.0f); break;
+	}
+	return glm::normalize(d);
+}
+
+void PlanetSurface::cubeCoordinates(const glm::vec3& _direction, int& _face, float& _s, float& _t)
+{
+	glm::vec3 a = glm::abs(_direction);
+
+	if (a.x >= a.y && a.x >= a.z) {
+		_face = _direction.x > 0.0f ? 0 : 1;
+		_s = (_direction.x > 0.0f ? -_direction.z : _direction.z) / a.x;
+		_t = -_direction.y / a.x;
+	}
+	else if (a.y >= a.z) {
+		_face = _direction.y > 0.0f ? 2 : 3;
+		_s = _direction.x / a.y;
+		_t = (_direction.y > 0.0f ? _direction.z : -_direction.z) / a.y;
+	}
+	else {
+		_face = _direction.z > 0.0f ? 4 : 5;
+		_s = (_direction.z > 0.0f ? _direction.x : -_direction.x) / a.z;
+		_t = -_direction.y / a.z;
+	}
+}
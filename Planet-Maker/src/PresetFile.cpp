@@ -0,0 +1,257 @@
+#include "PresetFile.h"
+#include "Checksum.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+
+enum PresetFieldType : uint8_t
+{
+	PRESET_INT32 = 1,
+	PRESET_FLOAT32 = 2,
+	PRESET_BOOL = 3, // stored as int32
+};
+
+#pragma pack(push, 1)
+struct PresetHeader
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t field_count;
+	uint32_t table_offset;
+	uint32_t data_offset;
+	uint32_t data_size;
+	uint32_t checksum; // crc32 of the bytes from table_offset to the end
+};
+
+struct PresetFieldEntry
+{
+	char name[24]; // zero padded, not necessarily terminated
+	uint8_t type;
+	uint8_t count;
+	uint16_t reserved;
+	uint32_t offset; // into the data block
+};
+#pragma pack(pop)
+
+static const char PRESET_MAGIC[4] = { 'P', 'L', 'N', 'T' };
+
+// Fields this build knows about. Names are part of the file format, do not rename.
+struct PresetFieldInfo
+{
+	const char* name;
+	PresetFieldType type;
+	int count;
+	size_t offset;
+};
+
+#define PRESET_FIELD(field, type, count) { #field, type, count, offsetof(PlanetParameters, field) }
+
+static const PresetFieldInfo PRESET_FIELDS[] = {
+	PRESET_FIELD(noise_method, PRESET_INT32, 1),
+
+	PRESET_FIELD(sky_enabled, PRESET_BOOL, 1),
+	PRESET_FIELD(sky_frequency, PRESET_FLOAT32, 1),
+	PRESET_FIELD(sky_seed, PRESET_INT32, 1),
+	PRESET_FIELD(sky_octaves, PRESET_INT32, 1),
+	PRESET_FIELD(sky_color, PRESET_FLOAT32, 3),
+	PRESET_FIELD(sky_opacity, PRESET_FLOAT32, 1),
+
+	PRESET_FIELD(terrain_segments, PRESET_INT32, 1),
+	PRESET_FIELD(terrain_elevation, PRESET_FLOAT32, 1),
+	PRESET_FIELD(terrain_radius, PRESET_FLOAT32, 1),
+	PRESET_FIELD(terrain_vert_frequency, PRESET_FLOAT32, 1),
+	PRESET_FIELD(terrain_frag_frequency, PRESET_FLOAT32, 1),
+	PRESET_FIELD(terrain_octaves, PRESET_INT32, 1),
+	PRESET_FIELD(terrain_seed, PRESET_INT32, 1),
+	PRESET_FIELD(terrain_color_deep, PRESET_FLOAT32, 3),
+	PRESET_FIELD(terrain_color_beach, PRESET_FLOAT32, 3),
+	PRESET_FIELD(terrain_color_grass, PRESET_FLOAT32, 3),
+	PRESET_FIELD(terrain_color_rock, PRESET_FLOAT32, 3),
+	PRESET_FIELD(terrain_color_snow, PRESET_FLOAT32, 3),
+
+	PRESET_FIELD(ocean_enabled, PRESET_BOOL, 1),
+	PRESET_FIELD(ocean_frequency, PRESET_FLOAT32, 1),
+	PRESET_FIELD(ocean_seed, PRESET_INT32, 1),
+	PRESET_FIELD(ocean_octaves, PRESET_INT32, 1),
+	PRESET_FIELD(ocean_color_1, PRESET_FLOAT32, 3),
+	PRESET_FIELD(ocean_color_2, PRESET_FLOAT32, 3),
+
+	PRESET_FIELD(features_enabled, PRESET_BOOL, 1),
+	PRESET_FIELD(feature_seed, PRESET_INT32, 1),
+	PRESET_FIELD(feature_craters, PRESET_INT32, 1),
+	PRESET_FIELD(feature_volcanoes, PRESET_INT32, 1),
+	PRESET_FIELD(feature_rifts, PRESET_INT32, 1),
+	PRESET_FIELD(feature_size, PRESET_FLOAT32, 1),
+	PRESET_FIELD(feature_strength, PRESET_FLOAT32, 1),
+};
+
+#undef PRESET_FIELD
+
+static const int PRESET_FIELD_COUNT = sizeof(PRESET_FIELDS) / sizeof(PRESET_FIELDS[0]);
+
+//! Finds a field of the file's table by name, nullptr if the file does not have it.
+static const PresetFieldEntry* find_field(const PresetFieldEntry* _table, int _count, const char* _name)
+{
+	size_t length = strlen(_name);
+	for (int i = 0; i < _count; ++i) {
+		if (strncmp(_table[i].name, _name, sizeof(_table[i].name)) == 0 && length <= sizeof(_table[i].name))
+			return &_table[i];
+	}
+	return nullptr;
+}
+
+//! Copies one stored value into the member, converting between int, float and bool.
+//! Floats are rounded toward zero and clamped to the int range, NaN reads as 0.
+static void read_value(const uint8_t* _source, uint8_t _sourceType, PresetFieldType _targetType, uint8_t* _target)
+{
+	int32_t as_int = 0;
+	float as_float = 0.0f;
+
+	if (_sourceType == PRESET_FLOAT32) {
+		memcpy(&as_float, _source, 4);
+		if (std::isfinite(as_float))
+			as_int = (int32_t)std::min(std::max((double)as_float, (double)INT32_MIN), (double)INT32_MAX);
+		else if (std::isinf(as_float))
+			as_int = as_float > 0.0f ? INT32_MAX : INT32_MIN;
+	}
+	else {
+		memcpy(&as_int, _source, 4);
+		as_float = (float)as_int;
+	}
+
+	switch (_targetType)
+	{
+	case PRESET_INT32:
+		memcpy(_target, &as_int, 4);
+		break;
+	case PRESET_FLOAT32:
+		memcpy(_target, &as_float, 4);
+		break;
+	case PRESET_BOOL:
+		*(bool*)_target = as_int != 0;
+		break;
+	}
+}
+
+bool read_binary_preset(const uint8_t* _data, size_t _size, PlanetParameters& _params)
+{
+	if (_size < sizeof(PresetHeader))
+		return false;
+
+	PresetHeader header;
+	memcpy(&header, _data, sizeof(header));
+
+	if (memcmp(header.magic, PRESET_MAGIC, 4) != 0 || header.version > PRESET_FORMAT_VERSION)
+		return false;
+
+	size_t table_size = (size_t)header.field_count * sizeof(PresetFieldEntry);
+	if (header.table_offset < sizeof(PresetHeader) || header.table_offset + table_size > _size ||
+		header.data_offset < header.table_offset + table_size ||
+		header.data_offset + (size_t)header.data_size > _size)
+		return false;
+
+	if (crc32(_data + header.table_offset, _size - header.table_offset) != header.checksum)
+		return false;
+
+	// The table is read in place, entries are byte aligned so this is safe
+	const PresetFieldEntry* table = (const PresetFieldEntry*)(_data + header.table_offset);
+	const uint8_t* values = _data + header.data_offset;
+
+	PlanetParameters p;
+	uint8_t* base = (uint8_t*)&p;
+
+	for (int i = 0; i < PRESET_FIELD_COUNT; ++i) {
+		const PresetFieldInfo& info = PRESET_FIELDS[i];
+		const PresetFieldEntry* entry = find_field(table, header.field_count, info.name);
+		if (!entry)
+			continue;
+		if (entry->type != PRESET_INT32 && entry->type != PRESET_FLOAT32 && entry->type != PRESET_BOOL)
+			return false;
+
+		int count = entry->count < info.count ? entry->count : info.count;
+		if ((size_t)entry->offset + 4 * (size_t)count > header.data_size)
+			return false;
+
+		size_t member_size = info.type == PRESET_BOOL ? sizeof(bool) : 4;
+		for (int c = 0; c < count; ++c)
+			read_value(values + entry->offset + 4 * c, entry->type, info.type, base + info.offset + member_size * c);
+	}
+
+	_params = p;
+	return true;
+}
+
+bool load_preset(const std::string& _filePath, PlanetParameters& _params)
+{
+	MappedFile file;
+	if (file.open(_filePath) && file.size() >= 4 && memcmp(file.data(), PRESET_MAGIC, 4) == 0)
+		return read_binary_preset(file.data(), file.size(), _params);
+
+	file.close();
+	return load_parameters(_filePath, _params);
+}
+
+bool save_binary_preset(const std::string& _filePath, const PlanetParameters& _params)
+{
+	size_t table_size = PRESET_FIELD_COUNT * sizeof(PresetFieldEntry);
+
+	std::vector<PresetFieldEntry> table(PRESET_FIELD_COUNT);
+	std::vector<uint8_t> values;
+	const uint8_t* base = (const uint8_t*)&_params;
+
+	for (int i = 0; i < PRESET_FIELD_COUNT; ++i) {
+		const PresetFieldInfo& info = PRESET_FIELDS[i];
+		PresetFieldEntry& entry = table[i];
+
+		memset(&entry, 0, sizeof(entry));
+		strncpy(entry.name, info.name, sizeof(entry.name));
+		entry.type = (uint8_t)info.type;
+		entry.count = (uint8_t)info.count;
+		entry.offset = (uint32_t)values.size();
+
+		for (int c = 0; c < info.count; ++c) {
+			uint8_t stored[4];
+			if (info.type == PRESET_BOOL) {
+				int32_t value = *(const bool*)(base + info.offset + c) ? 1 : 0;
+				memcpy(stored, &value, 4);
+			}
+			else {
+				memcpy(stored, base + info.offset + 4 * c, 4);
+			}
+			values.insert(values.end(), stored, stored + 4);
+		}
+	}
+
+	PresetHeader header;
+	memcpy(header.magic, PRESET_MAGIC, 4);
+	header.version = PRESET_FORMAT_VERSION;
+	header.field_count = (uint16_t)PRESET_FIELD_COUNT;
+	header.table_offset = sizeof(PresetHeader);
+	header.data_offset = (uint32_t)(sizeof(PresetHeader) + table_size);
+	header.data_size = (uint32_t)values.size();
+	header.checksum = crc32(table.data(), table_size);
+	header.checksum = crc32(values.data(), values.size(), header.checksum);
+
+	FILE* file = fopen(_filePath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(table.data(), table_size, 1, file) == 1 &&
+		fwrite(values.data(), values.size(), 1, file) == 1;
+
+	return fclose(file) == 0 && ok;
+}
+
+bool convert_preset(const std::string& _sourcePath, const std::string& _targetPath)
+{
+	PlanetParameters params;
+	if (!load_preset(_sourcePath, params))
+		return false;
+	return save_binary_preset(_targetPath, params);
+}
@@ -0,0 +1,529 @@
+#include "PresetLibrary.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "BakeCache.h"
+#include "PlanetSurface.h"
+#include "PresetFile.h"
+
+static const char* const INDEX_FILE = "presets.index";
+// Bump with THUMBNAIL_VERSION, the index keeps the thumbnail keys of unchanged files
+static const int INDEX_VERSION = 2;
+static const char* const ENDINGS[2] = { PRESET_FILE_ENDING, ".txt" };
+
+// Bump when render_thumbnail() draws something else. 2: climate and biome colours
+static const uint32_t THUMBNAIL_VERSION = 2;
+// Jobs handed to the workers at once, the rest waits in pending so it can be reordered
+static const int MAX_IN_FLIGHT = 16;
+static const int MAX_UPLOADS_PER_FRAME = 16;
+
+//! Preset file ending of _fileName, or nullptr if it is no preset.
+static const char* preset_ending(const std::string& _fileName)
+{
+	for (int i = 0; i < 2; ++i) {
+		size_t length = strlen(ENDINGS[i]);
+		if (_fileName.size() > length && _fileName.compare(_fileName.size() - length, length, ENDINGS[i]) == 0)
+			return ENDINGS[i];
+	}
+	return nullptr;
+}
+
+static uint64_t thumbnail_key(const PlanetParameters& _params)
+{
+	int size = PresetLibrary::THUMBNAIL_SIZE;
+	return BakeKey("thumbnail", THUMBNAIL_VERSION).add(hash_parameters(_params)).add(size).get();
+}
+
+//! The planet as the default camera sees it (from +z, y up), lit by the default light.
+//! Clouds are left out, they move anyway. RGBA with a transparent background.
+static void render_thumbnail(const PlanetParameters& _params, std::vector<uint8_t>& _pixels)
+{
+	const int size = PresetLibrary::THUMBNAIL_SIZE;
+	const float disc = 0.45f * size; // radius in pixels, leaves a small margin
+	const float epsilon = 0.5f / disc;
+	const glm::vec3 light = glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f));
+
+	PlanetSurface surface(_params);
+	_pixels.assign(size * size * 4, 0);
+
+	for (int row = 0; row < size; ++row) {
+		for (int column = 0; column < size; ++column) {
+			float x = (column + 0.5f - 0.5f * size) / disc;
+			float y = (0.5f * size - row - 0.5f) / disc;
+			float r = std::sqrt(x * x + y * y);
+
+			// One pixel wide antialiased edge
+			float coverage = std::min(std::max((1.0f - r) * disc + 0.5f, 0.0f), 1.0f);
+			if (coverage <= 0.0f)
+				continue;
+
+			glm::vec3 direction = glm::normalize(glm::vec3(x, y, std::sqrt(std::max(1.0f - r * r, 0.0f))));
+			float elevation = surface.elevation(direction);
+			glm::vec3 normal = direction;
+
+			// Terrain normal from the radius a little to either side, the ocean is smooth
+			if (!surface.isUnderwater(elevation)) {
+				glm::vec3 tangent = glm::normalize(glm::cross(std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), direction));
+				glm::vec3 bitangent = glm::cross(direction, tangent);
+
+				float radius = surface.terrainRadius(elevation);
+				float du = surface.terrainRadius(surface.elevation(glm::normalize(direction + epsilon * tangent))) - radius;
+				float dv = surface.terrainRadius(surface.elevation(glm::normalize(direction + epsilon * bitangent))) - radius;
+				normal = glm::normalize(direction - (du * tangent + dv * bitangent) / (epsilon * radius));
+			}
+
+			float diffuse = 0.25f + 0.75f * std::max(glm::dot(normal, light), 0.0f);
+			glm::vec3 color = glm::clamp(surface.color(direction, elevation) * diffuse, 0.0f, 1.0f);
+
+			uint8_t* pixel = &_pixels[(row * size + column) * 4];
+			pixel[0] = (uint8_t)(color.r * 255.0f + 0.5f);
+			pixel[1] = (uint8_t)(color.g * 255.0f + 0.5f);
+			pixel[2] = (uint8_t)(color.b * 255.0f + 0.5f);
+			pixel[3] = (uint8_t)(coverage * 255.0f + 0.5f);
+		}
+	}
+}
+
+PresetLibrary::PresetLibrary()
+{
+	cache = nullptr;
+	index_dirty = false;
+	in_flight = 0;
+	worker_count = 0;
+	jobs = nullptr;
+	results = nullptr;
+#ifdef _WIN32
+	change_handle = INVALID_HANDLE_VALUE;
+#else
+	notify_descriptor = -1;
+#endif
+}
+
+
+PresetLibrary::~PresetLibrary()
+{
+	close();
+}
+
+bool PresetLibrary::open(const std::string& _directory, BakeCache* _cache, int _workers)
+{
+	close();
+
+	std::error_code error;
+	if (!fs::is_directory(fs::path(_directory), error)) {
+		std::cout << "Preset directory " << _directory << " not found" << std::endl;
+		return false;
+	}
+
+	directory = _directory;
+	cache = _cache;
+
+	worker_count = std::max(1, _workers);
+	jobs = new WorkQueue<Job>(MAX_IN_FLIGHT);
+	results = new WorkQueue<Result>(MAX_IN_FLIGHT);
+	for (int i = 0; i < worker_count; ++i)
+		workers.push_back(std::thread(&PresetLibrary::workerLoop, this));
+
+	readIndex();
+	startWatching();
+	rescan();
+	return true;
+}
+
+void PresetLibrary::close()
+{
+	if (jobs != nullptr) {
+		// Closing both queues also releases workers blocked on a full result queue
+		jobs->close();
+		results->close();
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+		workers.clear();
+
+		delete jobs;
+		delete results;
+		jobs = nullptr;
+		results = nullptr;
+	}
+
+	stopWatching();
+
+	if (index_dirty)
+		writeIndex();
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].texture != 0)
+			glDeleteTextures(1, &entries[i].texture);
+	}
+	entries.clear();
+	lookup.clear();
+	pending.clear();
+	in_flight = 0;
+	directory.clear();
+}
+
+bool PresetLibrary::update()
+{
+	if (jobs == nullptr)
+		return false;
+
+	bool changed = false;
+	if (directoryChanged()) {
+		rescan();
+		changed = true;
+	}
+
+	Result result;
+	for (int i = 0; i < MAX_UPLOADS_PER_FRAME && results->tryPop(result); ++i) {
+		--in_flight;
+		applyResult(result);
+		changed = true;
+	}
+
+	submitJobs();
+
+	if (index_dirty && !isBusy())
+		writeIndex();
+
+	return changed;
+}
+
+//! Lists the directory. Unchanged files keep their entry and thumbnail, new and modified ones are queued.
+void PresetLibrary::rescan()
+{
+	std::vector<PresetEntry> found;
+
+	std::error_code error;
+	for (fs::directory_iterator it(fs::path(directory), error), end; !error && it != end; it.increment(error)) {
+		std::error_code file_error;
+		if (!fs::is_regular_file(it->status(file_error)))
+			continue;
+
+		std::string file_name = it->path().filename().string();
+		const char* ending = preset_ending(file_name);
+		if (ending == nullptr)
+			continue;
+
+		PresetEntry entry;
+		entry.file_name = file_name;
+		entry.name = file_name.substr(0, file_name.size() - strlen(ending));
+		entry.modified = (uint64_t)fs::last_write_time(it->path(), file_error).time_since_epoch().count();
+		entry.size = (uint64_t)fs::file_size(it->path(), file_error);
+		found.push_back(entry);
+	}
+
+	std::sort(found.begin(), found.end(), [](const PresetEntry& _a, const PresetEntry& _b) { return _a.file_name < _b.file_name; });
+
+	for (size_t i = 0; i < found.size(); ++i) {
+		int old = find(found[i].file_name);
+		if (old >= 0 && entries[old].modified == found[i].modified && entries[old].size == found[i].size) {
+			found[i] = entries[old];
+			entries[old].texture = 0;
+			continue;
+		}
+
+		found[i].requested = true;
+		pending.push_back(found[i].file_name);
+		index_dirty = true;
+	}
+
+	// Entries of deleted or changed files
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].texture != 0)
+			glDeleteTextures(1, &entries[i].texture);
+	}
+	if (found.size() != entries.size())
+		index_dirty = true;
+
+	entries.swap(found);
+	lookup.clear();
+	for (size_t i = 0; i < entries.size(); ++i)
+		lookup[entries[i].file_name] = (int)i;
+}
+
+void PresetLibrary::requestThumbnail(int _index)
+{
+	if (_index < 0 || _index >= (int)entries.size())
+		return;
+
+	PresetEntry& entry = entries[_index];
+	if (entry.texture != 0 || entry.requested || (entry.parsed && !entry.valid))
+		return;
+
+	entry.requested = true;
+	pending.push_front(entry.file_name);
+}
+
+std::string PresetLibrary::getPath(int _index) const
+{
+	return (fs::path(directory) / entries[_index].file_name).string();
+}
+
+int PresetLibrary::find(const std::string& _fileName) const
+{
+	std::map<std::string, int>::const_iterator it = lookup.find(_fileName);
+	return it == lookup.end() ? -1 : it->second;
+}
+
+void PresetLibrary::submitJobs()
+{
+	while (in_flight < MAX_IN_FLIGHT && !pending.empty()) {
+		std::string file_name = pending.front();
+		pending.pop_front();
+
+		// Deleted since it was queued, or queued twice
+		int index = find(file_name);
+		if (index < 0 || !entries[index].requested || entries[index].texture != 0)
+			continue;
+
+		Job job;
+		job.file_name = file_name;
+		job.modified = entries[index].modified;
+		job.thumbnail_key = entries[index].parsed ? entries[index].thumbnail_key : 0;
+
+		// Never blocks, there are never more jobs than the queue holds
+		jobs->push(job);
+		++in_flight;
+	}
+}
+
+void PresetLibrary::applyResult(Result& _result)
+{
+	int index = find(_result.job.file_name);
+	// The file changed again while this was rendered, a newer job is queued
+	if (index < 0 || entries[index].modified != _result.job.modified)
+		return;
+
+	PresetEntry& entry = entries[index];
+	entry.requested = false;
+
+	if (_result.info.parsed) {
+		entry.parsed = true;
+		entry.valid = _result.info.valid;
+		entry.noise_method = _result.info.noise_method;
+		entry.terrain_seed = _result.info.terrain_seed;
+		entry.terrain_octaves = _result.info.terrain_octaves;
+		entry.terrain_radius = _result.info.terrain_radius;
+		entry.terrain_elevation = _result.info.terrain_elevation;
+		entry.ocean_enabled = _result.info.ocean_enabled;
+		entry.sky_enabled = _result.info.sky_enabled;
+		entry.thumbnail_key = _result.info.thumbnail_key;
+		index_dirty = true;
+	}
+
+	if (_result.pixels.empty())
+		return;
+
+	glGenTextures(1, &entry.texture);
+	glBindTexture(GL_TEXTURE_2D, entry.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, THUMBNAIL_SIZE, THUMBNAIL_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, &_result.pixels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void PresetLibrary::workerLoop()
+{
+	Job job;
+	while (jobs->pop(job)) {
+		Result result;
+		result.job = job;
+		process(job, result);
+
+		if (!results->push(std::move(result)))
+			return;
+	}
+}
+
+//! Worker side: the thumbnail from the cache if the key is known, otherwise parses the preset first.
+void PresetLibrary::process(const Job& _job, Result& _result)
+{
+	const size_t thumbnail_bytes = THUMBNAIL_SIZE * THUMBNAIL_SIZE * 4;
+
+	if (_job.thumbnail_key != 0 && cache != nullptr &&
+		cache->load(_job.thumbnail_key, _result.pixels) && _result.pixels.size() == thumbnail_bytes)
+		return;
+	_result.pixels.clear();
+
+	PlanetParameters params;
+	PresetEntry& info = _result.info;
+	info.parsed = true;
+	info.valid = load_preset((fs::path(directory) / _job.file_name).string(), params);
+	if (!info.valid)
+		return;
+
+	info.noise_method = params.noise_method;
+	info.terrain_seed = params.terrain_seed;
+	info.terrain_octaves = params.terrain_octaves;
+	info.terrain_radius = params.terrain_radius;
+	info.terrain_elevation = params.terrain_elevation;
+	info.ocean_enabled = params.ocean_enabled;
+	info.sky_enabled = params.sky_enabled;
+	info.thumbnail_key = thumbnail_key(params);
+
+	if (cache != nullptr && cache->load(info.thumbnail_key, _result.pixels) && _result.pixels.size() == thumbnail_bytes)
+		return;
+
+	render_thumbnail(params, _result.pixels);
+	if (cache != nullptr)
+		cache->store(info.thumbnail_key, &_result.pixels[0], _result.pixels.size());
+}
+
+#ifdef _WIN32
+
+void PresetLibrary::startWatching()
+{
+	change_handle = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE);
+	if (change_handle == INVALID_HANDLE_VALUE)
+		std::cout << "Not watching " << directory << " for changes" << std::endl;
+}
+
+void PresetLibrary::stopWatching()
+{
+	if (change_handle != INVALID_HANDLE_VALUE)
+		FindCloseChangeNotification(change_handle);
+	change_handle = INVALID_HANDLE_VALUE;
+}
+
+//! Change notifications carry no names, writing the index causes one cheap rescan.
+bool PresetLibrary::directoryChanged()
+{
+	if (change_handle == INVALID_HANDLE_VALUE || WaitForSingleObject(change_handle, 0) != WAIT_OBJECT_0)
+		return false;
+
+	FindNextChangeNotification(change_handle);
+	return true;
+}
+
+#else
+
+void PresetLibrary::startWatching()
+{
+	notify_descriptor = inotify_init1(IN_NONBLOCK);
+	if (notify_descriptor >= 0 && inotify_add_watch(notify_descriptor, directory.c_str(),
+		IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO) >= 0)
+		return;
+
+	std::cout << "Not watching " << directory << " for changes" << std::endl;
+	stopWatching();
+}
+
+void PresetLibrary::stopWatching()
+{
+	if (notify_descriptor >= 0)
+		::close(notify_descriptor);
+	notify_descriptor = -1;
+}
+
+//! Drains the pending events, only preset files count.
+bool PresetLibrary::directoryChanged()
+{
+	if (notify_descriptor < 0)
+		return false;
+
+	bool changed = false;
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(notify_descriptor, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event* event = (const inotify_event*)(buffer + offset);
+			if (event->len > 0 && preset_ending(event->name) != nullptr)
+				changed = true;
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
+
+#endif
+
+//! One line per file: modified size thumbnail_key valid noise seed octaves radius elevation ocean sky file_name
+void PresetLibrary::readIndex()
+{
+	std::ifstream file((fs::path(directory) / INDEX_FILE).string());
+	int version = 0;
+	std::string header;
+	if (!(file >> header >> version) || header != "presets" || version != INDEX_VERSION)
+		return;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		PresetEntry entry;
+		unsigned long long modified, size, key;
+		int valid, ocean, sky, name_offset = 0;
+		if (sscanf(line.c_str(), "%llu %llu %llx %d %d %d %d %f %f %d %d %n", &modified, &size, &key, &valid,
+			&entry.noise_method, &entry.terrain_seed, &entry.terrain_octaves, &entry.terrain_radius,
+			&entry.terrain_elevation, &ocean, &sky, &name_offset) < 11 || name_offset == 0)
+			continue;
+
+		entry.file_name = line.substr(name_offset);
+		const char* ending = preset_ending(entry.file_name);
+		if (ending == nullptr)
+			continue;
+
+		entry.name = entry.file_name.substr(0, entry.file_name.size() - strlen(ending));
+		entry.modified = modified;
+		entry.size = size;
+		entry.thumbnail_key = key;
+		entry.parsed = true;
+		entry.valid = valid != 0;
+		entry.ocean_enabled = ocean != 0;
+		entry.sky_enabled = sky != 0;
+		entries.push_back(entry);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const PresetEntry& _a, const PresetEntry& _b) { return _a.file_name < _b.file_name; });
+	lookup.clear();
+	for (size_t i = 0; i < entries.size(); ++i)
+		lookup[entries[i].file_name] = (int)i;
+}
+
+void PresetLibrary::writeIndex()
+{
+	index_dirty = false;
+
+	std::ofstream file((fs::path(directory) / INDEX_FILE).string(), std::ios::trunc);
+	if (!file) {
+		std::cout << "Error writing the preset index" << std::endl;
+		return;
+	}
+
+	file << "presets " << INDEX_VERSION << "\n";
+	char line[256];
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const PresetEntry& entry = entries[i];
+		// Not parsed yet, the next session parses it again anyway
+		if (!entry.parsed)
+			continue;
+
+		snprintf(line, sizeof(line), "%llu %llu %016llx %d %d %d %d %.9g %.9g %d %d ",
+			(unsigned long long)entry.modified, (unsigned long long)entry.size, (unsigned long long)entry.thumbnail_key,
+			entry.valid ? 1 : 0, entry.noise_method, entry.terrain_seed, entry.terrain_octaves,
+			entry.terrain_radius, entry.terrain_elevation, entry.ocean_enabled ? 1 : 0, entry.sky_enabled ? 1 : 0);
+		file << line << entry.file_name << "\n";
+	}
+}
@@ -0,0 +1,120 @@
+#include "PresetLoader.h"
+#include <algorithm>
+
+#include "PresetFile.h"
+
+PresetLoader::PresetLoader()
+{
+	upload_budget = 4 * 1024 * 1024;
+}
+
+
+PresetLoader::~PresetLoader()
+{
+	if (current)
+		current->cancel.cancel();
+}
+
+void PresetLoader::init(size_t _stagingBytes)
+{
+	ring.init(_stagingBytes);
+}
+
+void PresetLoader::request(const std::string& _filePath, int _currentSegments)
+{
+	if (current)
+		current->cancel.cancel();
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->file_path = _filePath;
+	job->current_segments = _currentSegments;
+	job->ok = false;
+	job->allocated = false;
+	job->vertex_offset = job->index_offset = 0;
+
+	JobSystem& jobs = JobSystem::global();
+	job->parse = jobs.run([job]() {
+		job->ok = load_preset(job->file_path, job->params);
+	}, job->cancel);
+
+	job->tessellate = jobs.runAfter({ job->parse }, [job]() {
+		if (!job->ok || job->params.terrain_segments == job->current_segments)
+			return;
+
+		job->terrain.reset(new Sphere());
+		job->terrain->setPosition(glm::vec3(0.0f));
+		job->terrain->buildArrays(1.0f, job->params.terrain_segments);
+	}, job->cancel);
+
+	current = job;
+}
+
+//! Stage 3: copies the next part of the mesh, returns true once all of it is in the buffers.
+bool PresetLoader::uploadTerrain(Job& _job)
+{
+	Sphere* terrain = _job.terrain.get();
+	if (!_job.allocated) {
+		terrain->allocate();
+		_job.allocated = true;
+	}
+
+	size_t budget = upload_budget;
+	const uint8_t* vertices = (const uint8_t*)terrain->getVertexArray();
+	const uint8_t* indices = (const uint8_t*)terrain->getIndexArray();
+
+	while (budget > 0 && _job.vertex_offset < terrain->getVertexBytes()) {
+		size_t bytes = std::min(budget, terrain->getVertexBytes() - _job.vertex_offset);
+		size_t taken = ring.upload(terrain->getVertexBuffer(), _job.vertex_offset, vertices + _job.vertex_offset, bytes);
+		if (taken == 0)
+			return false;
+		_job.vertex_offset += taken;
+		budget -= taken;
+	}
+
+	while (budget > 0 && _job.index_offset < terrain->getIndexBytes()) {
+		size_t bytes = std::min(budget, terrain->getIndexBytes() - _job.index_offset);
+		size_t taken = ring.upload(terrain->getIndexBuffer(), _job.index_offset, indices + _job.index_offset, bytes);
+		if (taken == 0)
+			return false;
+		_job.index_offset += taken;
+		budget -= taken;
+	}
+
+	return _job.vertex_offset == terrain->getVertexBytes() && _job.index_offset == terrain->getIndexBytes();
+}
+
+bool PresetLoader::update(PlanetParameters& _params, Sphere*& _terrain, bool& _failed)
+{
+	_failed = false;
+
+	bool complete = false;
+	if (current && JobSystem::isDone(current->tessellate)) {
+		if (!current->ok) {
+			_failed = true;
+			current.reset();
+		}
+		else if (!current->terrain || uploadTerrain(*current)) {
+			_params = current->params;
+			_terrain = current->terrain.release();
+			if (_terrain != nullptr)
+				_terrain->releaseArrays();
+
+			current.reset();
+			complete = true;
+		}
+	}
+
+	ring.endFrame();
+	return complete;
+}
+
+float PresetLoader::getProgress() const
+{
+	if (!current || !JobSystem::isDone(current->tessellate))
+		return 0.0f;
+	if (!current->terrain)
+		return 1.0f;
+
+	size_t total = current->terrain->getVertexBytes() + current->terrain->getIndexBytes();
+	return total > 0 ? (float)(current->vertex_offset + current->index_offset) / total : 1.0f;
+}
@@ -0,0 +1,665 @@
+#include "PropScatter.h"
+#include "PlanetRenderer.h"
+#include "SceneIndex.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t SCATTER_VERSION = 1;
+// Heightmap the props stand on, a texel is about three prop spacings at the defaults
+static const int SCATTER_RESOLUTION = 512;
+// Candidates tried around a point before it stops spawning new ones, Bridson's k
+static const int POISSON_CANDIDATES = 12;
+static const float TWO_PI = 6.2831853f;
+static const float SQRT_2 = 1.4142136f;
+
+// Double cone around +y, flat shaded: from the tip at bottom through the
+// widest ring at middle to the tip at top. Unit size, scaled by size (planet radii).
+struct PropShape
+{
+	int sides;
+	float bottom, middle, top, radius;
+	float size;
+};
+
+static const PropShape PROP_SHAPES[PROP_KIND_COUNT] = {
+	{ 5, -0.3f, 0.05f, 0.45f, 0.5f, 0.0015f }, // rock, half buried
+	{ 6, -0.1f, 0.2f, 0.6f, 0.45f, 0.0012f },  // shrub
+	{ 7, -0.1f, 0.25f, 1.0f, 0.3f, 0.003f },   // tree, a conifer
+};
+static const float LARGEST_PROP = 0.003f * 1.4f;
+
+PropScatter::PropScatter()
+{
+	for (int kind = 0; kind < PROP_KIND_COUNT; ++kind) {
+		vao[kind] = 0;
+		mesh_buffer[kind] = 0;
+		index_buffer[kind] = 0;
+		index_count[kind] = 0;
+	}
+	instance_buffer = 0;
+	built_key = 0;
+	built_terrain = 0;
+	built_layers = 0;
+	core_radius = 0.0f;
+	building_key = 0;
+}
+
+
+PropScatter::~PropScatter()
+{
+	cancel.cancel();
+	for (int kind = 0; kind < PROP_KIND_COUNT; ++kind) {
+		if (vao[kind] != 0)
+			glDeleteVertexArrays(1, &vao[kind]);
+		if (mesh_buffer[kind] != 0)
+			glDeleteBuffers(1, &mesh_buffer[kind]);
+		if (index_buffer[kind] != 0)
+			glDeleteBuffers(1, &index_buffer[kind]);
+	}
+	if (instance_buffer != 0)
+		glDeleteBuffers(1, &instance_buffer);
+}
+
+void PropScatter::init()
+{
+	loadShaders();
+	glGenBuffers(1, &instance_buffer);
+	createMeshes();
+}
+
+//! A shader that fails to compile keeps its previous program.
+void PropScatter::loadShaders()
+{
+	GLuint old_program = prop_shader.programID;
+	prop_shader.createShader("shaders/prop_vert.glsl", "shaders/prop_frag.glsl");
+	if (old_program != 0 && old_program != prop_shader.programID)
+		glDeleteProgram(old_program);
+
+	loc_P = glGetUniformLocation(prop_shader.programID, "P");
+	loc_V = glGetUniformLocation(prop_shader.programID, "V");
+	loc_M = glGetUniformLocation(prop_shader.programID, "M");
+	loc_prop_size = glGetUniformLocation(prop_shader.programID, "prop_size");
+	loc_prop_color = glGetUniformLocation(prop_shader.programID, "prop_color");
+	loc_light_position = glGetUniformLocation(prop_shader.programID, "light_pos");
+	loc_light_intensity = glGetUniformLocation(prop_shader.programID, "light_intensity");
+}
+
+//! Positions and normals of a PropShape, one triangle per face so every face is flat.
+static void build_spindle(const PropShape& _shape, std::vector<GLfloat>& _vertices, std::vector<GLushort>& _indices)
+{
+	const glm::vec3 tips[2] = { glm::vec3(0.0f, _shape.top, 0.0f), glm::vec3(0.0f, _shape.bottom, 0.0f) };
+
+	for (int side = 0; side < _shape.sides; ++side) {
+		float a0 = TWO_PI * side / _shape.sides;
+		float a1 = TWO_PI * (side + 1) / _shape.sides;
+		glm::vec3 ring0(_shape.radius * std::cos(a0), _shape.middle, _shape.radius * std::sin(a0));
+		glm::vec3 ring1(_shape.radius * std::cos(a1), _shape.middle, _shape.radius * std::sin(a1));
+
+		for (int tip = 0; tip < 2; ++tip) {
+			glm::vec3 corners[3] = { ring0, ring1, tips[tip] };
+			glm::vec3 normal = glm::normalize(glm::cross(ring1 - ring0, tips[tip] - ring0));
+			glm::vec3 centroid = (ring0 + ring1 + tips[tip]) / 3.0f;
+			// Counter-clockwise seen from outside
+			if (glm::dot(normal, centroid - glm::vec3(0.0f, centroid.y, 0.0f)) < 0.0f) {
+				std::swap(corners[0], corners[1]);
+				normal = -normal;
+			}
+			for (int i = 0; i < 3; ++i) {
+				_indices.push_back((GLushort)(_vertices.size() / 6));
+				_vertices.insert(_vertices.end(), { corners[i].x, corners[i].y, corners[i].z, normal.x, normal.y, normal.z });
+			}
+		}
+	}
+}
+
+//! One VAO per kind: the mesh at locations 0 and 1, the instances at 2 and 3
+//! with a divisor of 1. The instance pointers are set per chunk in render().
+void PropScatter::createMeshes()
+{
+	for (int kind = 0; kind < PROP_KIND_COUNT; ++kind) {
+		std::vector<GLfloat> vertices;
+		std::vector<GLushort> indices;
+		build_spindle(PROP_SHAPES[kind], vertices, indices);
+		index_count[kind] = (GLsizei)indices.size();
+
+		glGenVertexArrays(1, &vao[kind]);
+		glBindVertexArray(vao[kind]);
+
+		glGenBuffers(1, &mesh_buffer[kind]);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer[kind]);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+		glGenBuffers(1, &index_buffer[kind]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer[kind]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(3);
+		glVertexAttribDivisor(3, 1);
+
+		glBindVertexArray(0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+uint64_t PropScatter::cacheKey(const PlanetParameters& _params, const ScatterSettings& _settings)
+{
+	return BakeKey("props", SCATTER_VERSION)
+		.add(ClimateMap::cacheKey(_params, ClimateMap::DEFAULT_RESOLUTION))
+		.add(CubeHeightmap::cacheKey(_params, SCATTER_RESOLUTION))
+		.add(_params.terrain_radius)
+		.add(_settings)
+		.get();
+}
+
+//! Everything the positions of the props depend on. Props of another terrain would float.
+static uint64_t terrain_key(const PlanetParameters& _params)
+{
+	return BakeKey("prop terrain", SCATTER_VERSION)
+		.add(CubeHeightmap::cacheKey(_params, SCATTER_RESOLUTION))
+		.add(_params.terrain_radius)
+		.add(_params.terrain_elevation)
+		.get();
+}
+
+// __________ BUILD ______________
+
+struct PropScatter::Build
+{
+	PlanetParameters params;
+	ScatterSettings settings;
+	BakeCache* cache;
+	CancelToken cancel;
+
+	bool placed = false;
+	float core_radius = 0.0f;
+	std::vector<PropChunk> chunks;
+	std::vector<PropInstance> instances;
+};
+
+void PropScatter::start(const PlanetParameters& _params, const ScatterSettings& _settings, BakeCache* _cache)
+{
+	uint64_t key = cacheKey(_params, _settings);
+	if (key == building_key || (key == built_key && building_key == 0))
+		return;
+
+	// Back to the props already there, e.g. a slider moved and returned
+	cancel.cancel();
+	cancel = CancelToken();
+	building_key = 0;
+	task = TaskRef();
+	if (key == built_key)
+		return;
+
+	std::shared_ptr<Build> build = std::make_shared<Build>();
+	build->params = _params;
+	build->settings = _settings;
+	build->cache = _cache;
+	build->cancel = cancel;
+	building_key = key;
+
+	JobSystem& jobs = JobSystem::global();
+	TaskRef placed = jobs.run([build]() {
+		const CancelToken& cancel = build->cancel;
+
+		CubeHeightmap coarse;
+		coarse.bake(build->params, ClimateMap::DEFAULT_RESOLUTION, build->cache, nullptr, cancel);
+		ClimateMap climate;
+		if (coarse.empty() || !climate.bake(coarse, build->params, nullptr, cancel))
+			return;
+
+		CubeHeightmap heightmap;
+		heightmap.bake(build->params, SCATTER_RESOLUTION, build->cache, nullptr, cancel);
+		if (heightmap.empty())
+			return;
+		PlanetQuery query;
+		query.build(build->params, std::move(heightmap));
+		build->core_radius = query.getInnerRadius();
+
+		build->placed = place(build->params, build->settings, query, climate, JobSystem::global(), cancel,
+			build->chunks, build->instances);
+	}, cancel);
+
+	task = jobs.runOnMainThread({ placed }, [this, build, key]() {
+		building_key = 0;
+		if (build->placed) {
+			upload(*build);
+			built_key = key;
+		}
+	}, cancel);
+}
+
+void PropScatter::stop()
+{
+	cancel.cancel();
+	cancel = CancelToken();
+	building_key = 0;
+	task = TaskRef();
+	clear();
+}
+
+void PropScatter::clear()
+{
+	chunks.clear();
+	built_key = 0;
+	built_terrain = 0;
+	built_layers = 0;
+	statistics = ScatterStatistics();
+
+	// Orphans the storage so the driver can free it
+	if (instance_buffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void PropScatter::upload(Build& _build)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, _build.instances.size() * sizeof(PropInstance), _build.instances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	chunks.swap(_build.chunks);
+	built_terrain = terrain_key(_build.params);
+	core_radius = _build.core_radius;
+	built_layers = std::min(std::max(_build.settings.layers, 1), (int)PropChunk::MAX_LAYERS);
+
+	statistics = ScatterStatistics();
+	statistics.instances = _build.instances.size();
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (chunks[i].radius > 0.0f)
+			++statistics.chunks;
+	}
+}
+
+// __________ PLACEMENT ______________
+
+//! PCG hash generator, every chunk seeds its own so the placement does not
+//! depend on the order the chunks run in.
+struct ScatterRandom
+{
+	uint32_t state;
+
+	explicit ScatterRandom(uint32_t _seed) : state(_seed) {}
+
+	uint32_t next()
+	{
+		state = state * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+static float smoothstep(float _edge0, float _edge1, float _x)
+{
+	float t = glm::clamp((_x - _edge0) / (_edge1 - _edge0), 0.0f, 1.0f);
+	return t * t * (3.0f - 2.0f * t);
+}
+
+// What every chunk reads
+struct Placement
+{
+	const PlanetQuery* query;
+	const ClimateMap* climate;
+	ScatterSettings settings;
+	int layers;
+	uint32_t seed;
+	float slope_scale; // like terrain_frag.glsl
+	float lowest;      // elevation, below it the coast colour shows
+
+	// Poisson disk tile the chunks cut their points from, in units of the finest spacing
+	std::vector<glm::vec2> tile_points;
+	int tile_layer_end[PropChunk::MAX_LAYERS];
+	float tile_size;
+};
+
+//! Shortest offset between two points of a tile that wraps around.
+static glm::vec2 wrapped(glm::vec2 _offset, float _size)
+{
+	return _offset - _size * glm::floor(_offset / _size + 0.5f);
+}
+
+//! Layers of Poisson disk points on a _size x _size tile that wraps around
+//! at its edges, the finest layer _layers - 1 at spacing 1. Bridson's
+//! algorithm, every layer seeded with the points of the layers before.
+//! _layerEnd gets the number of points up to and including each layer.
+static void poisson_tile(float _size, int _layers, ScatterRandom& _random,
+	std::vector<glm::vec2>& _points, int* _layerEnd)
+{
+	std::vector<int> grid;
+	std::vector<int> active;
+
+	for (int layer = 0; layer < _layers; ++layer) {
+		float radius = std::pow(SQRT_2, (float)(_layers - 1 - layer));
+		// At most one point per cell, the cell diagonal is at most the radius
+		int cells = std::max(1, (int)std::ceil(_size * SQRT_2 / radius));
+		float cell = _size / cells;
+		int reach = (int)std::ceil(radius / cell);
+		grid.assign((size_t)cells * cells, -1);
+		active.clear();
+
+		for (size_t i = 0; i < _points.size(); ++i) {
+			int cx = std::min((int)(_points[i].x / cell), cells - 1);
+			int cy = std::min((int)(_points[i].y / cell), cells - 1);
+			grid[cy * cells + cx] = (int)i;
+			active.push_back((int)i);
+		}
+		if (_points.empty()) {
+			grid[0] = 0;
+			_points.push_back(glm::vec2(0.0f));
+			active.push_back(0);
+		}
+
+		while (!active.empty()) {
+			int slot = std::min((int)(_random.uniform() * active.size()), (int)active.size() - 1);
+			glm::vec2 around = _points[active[slot]];
+			bool spawned = false;
+
+			for (int c = 0; c < POISSON_CANDIDATES && !spawned; ++c) {
+				float angle = TWO_PI * _random.uniform();
+				float distance = radius * (1.0f + _random.uniform());
+				glm::vec2 candidate = around + distance * glm::vec2(std::cos(angle), std::sin(angle));
+				candidate -= _size * glm::floor(candidate / _size);
+
+				int cx = std::min((int)(candidate.x / cell), cells - 1);
+				int cy = std::min((int)(candidate.y / cell), cells - 1);
+				bool free = true;
+				for (int y = cy - reach; y <= cy + reach && free; ++y) {
+					for (int x = cx - reach; x <= cx + reach; ++x) {
+						int other = grid[((y + cells) % cells) * cells + (x + cells) % cells];
+						if (other < 0)
+							continue;
+						glm::vec2 offset = wrapped(_points[other] - candidate, _size);
+						if (glm::dot(offset, offset) < radius * radius) {
+							free = false;
+							break;
+						}
+					}
+				}
+				if (!free)
+					continue;
+
+				grid[cy * cells + cx] = (int)_points.size();
+				active.push_back((int)_points.size());
+				_points.push_back(candidate);
+				spawned = true;
+			}
+
+			if (!spawned) {
+				active[slot] = active.back();
+				active.pop_back();
+			}
+		}
+		_layerEnd[layer] = (int)_points.size();
+	}
+}
+
+//! Kind of prop for a spot, or PROP_KIND_COUNT for none. The same climate,
+//! slope and sand terms as PlanetSurface::terrainColor().
+static int choose_kind(const Climate& _climate, float _height, float _slopeScale, float _random)
+{
+	glm::vec4 biome = biome_weights(_climate.temperature, _climate.moisture);
+	float steep = smoothstep(0.6f, 1.2f, _climate.slope * _slopeScale);
+	float sand = 1.0f - smoothstep(0.05f, 0.2f, _height);
+
+	float green = biome.y * (1.0f - steep) * (1.0f - sand);
+	float forest = smoothstep(0.45f, 0.75f, _climate.moisture);
+	float tree = 0.8f * green * forest;
+	float shrub = 0.5f * green * (1.0f - forest) + 0.1f * biome.x * (1.0f - steep);
+	float rock = 0.25f * (biome.z + steep) * (1.0f - biome.w) + 0.05f * biome.w;
+
+	if (_random < tree)
+		return PROP_TREE;
+	if (_random < tree + shrub)
+		return PROP_SHRUB;
+	if (_random < tree + shrub + rock)
+		return PROP_ROCK;
+	return PROP_KIND_COUNT;
+}
+
+//! Props of one chunk, kinds one after the other and each by layer, offsets relative to the chunk.
+static void place_chunk(const Placement& _placement, int _face, int _x, int _y,
+	PropChunk& _chunk, std::vector<PropInstance>& _instances)
+{
+	const PlanetSurface& surface = _placement.query->getSurface();
+	const int edge = _placement.settings.chunks_per_edge;
+	const int layers = _placement.layers;
+
+	float tile = 2.0f / edge;
+	float s0 = -1.0f + _x * tile;
+	float t0 = -1.0f + _y * tile;
+	float sc = s0 + 0.5f * tile;
+	float tc = t0 + 0.5f * tile;
+	// Face coordinates per radian at the tile center, about constant across a tile
+	float stretch = std::pow(1.0f + sc * sc + tc * tc, 0.75f);
+	float finest = _placement.settings.spacing / surface.terrainRadius(0.0f) * stretch;
+
+	uint32_t seed = (uint32_t)BakeKey("prop chunk", SCATTER_VERSION)
+		.add(_placement.seed).add(_face).add(_x).add(_y).get();
+	ScatterRandom random(seed);
+
+	// A window of the Poisson tile at a random offset, mirrored and turned
+	// one of eight ways, so neighbouring chunks do not repeat each other
+	float span = tile / finest;
+	float size = _placement.tile_size;
+	glm::vec2 origin(random.uniform() * size, random.uniform() * size);
+	uint32_t symmetry = random.next();
+
+	std::vector<glm::vec2> points;
+	int point_layer_end[PropChunk::MAX_LAYERS];
+	int layer = 0;
+	for (int i = 0; i < (int)_placement.tile_points.size(); ++i) {
+		while (i >= _placement.tile_layer_end[layer])
+			point_layer_end[layer++] = (int)points.size();
+
+		glm::vec2 p = _placement.tile_points[i];
+		if (symmetry & 1)
+			p.x = size - p.x;
+		if (symmetry & 2)
+			p.y = size - p.y;
+		if (symmetry & 4)
+			std::swap(p.x, p.y);
+		p -= origin;
+		p -= size * glm::floor(p / size);
+		if (p.x < span && p.y < span)
+			points.push_back(p * finest);
+	}
+	while (layer < layers)
+		point_layer_end[layer++] = (int)points.size();
+
+	std::vector<PropInstance> buckets[PROP_KIND_COUNT][PropChunk::MAX_LAYERS];
+	glm::vec3 low(1.0e30f), high(-1.0e30f);
+	layer = 0;
+	for (int i = 0; i < (int)points.size(); ++i) {
+		while (i >= point_layer_end[layer])
+			++layer;
+
+		glm::vec3 direction = PlanetSurface::cubeDirection(_face, s0 + points[i].x, t0 + points[i].y);
+		float height = _placement.query->elevation(direction);
+		float chance = random.uniform();
+		uint32_t bits = random.next();
+		if (height < _placement.lowest)
+			continue;
+
+		int kind = choose_kind(_placement.climate->sample(direction), height, _placement.slope_scale, chance);
+		if (kind == PROP_KIND_COUNT)
+			continue;
+
+		PropInstance instance;
+		instance.position = direction * surface.terrainRadius(height);
+		instance.packed = bits & 0xffffffu;
+		buckets[kind][layer].push_back(instance);
+		low = glm::min(low, instance.position);
+		high = glm::max(high, instance.position);
+	}
+
+	_chunk.center = 0.5f * (low + high);
+	_chunk.radius = 0.0f;
+	for (int kind = 0; kind < PROP_KIND_COUNT; ++kind) {
+		_chunk.first[kind] = (uint32_t)_instances.size();
+		for (int l = 0; l < PropChunk::MAX_LAYERS; ++l) {
+			if (l < layers)
+				_instances.insert(_instances.end(), buckets[kind][l].begin(), buckets[kind][l].end());
+			_chunk.layer_end[kind][l] = (uint32_t)_instances.size() - _chunk.first[kind];
+		}
+	}
+	for (size_t i = 0; i < _instances.size(); ++i)
+		_chunk.radius = std::max(_chunk.radius, glm::length(_instances[i].position - _chunk.center));
+	if (!_instances.empty())
+		_chunk.radius += LARGEST_PROP;
+}
+
+bool PropScatter::place(const PlanetParameters& _params, const ScatterSettings& _settings,
+	const PlanetQuery& _query, const ClimateMap& _climate, JobSystem& _jobs, const CancelToken& _cancel,
+	std::vector<PropChunk>& _chunks, std::vector<PropInstance>& _instances)
+{
+	Placement placement;
+	placement.query = &_query;
+	placement.climate = &_climate;
+	placement.settings = _settings;
+	placement.settings.chunks_per_edge = std::max(_settings.chunks_per_edge, 1);
+	placement.layers = std::min(std::max(_settings.layers, 1), (int)PropChunk::MAX_LAYERS);
+	placement.seed = (uint32_t)_params.terrain_seed;
+	placement.slope_scale = _params.terrain_elevation / (1.0f + _params.terrain_radius);
+	placement.lowest = std::max(0.1f, _query.getSurface().seaLevel() + 0.02f);
+
+	// Large enough that the widest chunk, at the face centers, takes a window of it
+	float widest = 2.0f / placement.settings.chunks_per_edge / (_settings.spacing / _query.getSurface().terrainRadius(0.0f));
+	placement.tile_size = std::max(64.0f, std::ceil(2.0f * widest));
+	ScatterRandom random((uint32_t)BakeKey("prop tile", SCATTER_VERSION).add(_params.terrain_seed).get());
+	poisson_tile(placement.tile_size, placement.layers, random, placement.tile_points, placement.tile_layer_end);
+
+	const int edge = placement.settings.chunks_per_edge;
+	const int count = 6 * edge * edge;
+	std::vector<std::vector<PropInstance>> placed(count);
+	_chunks.assign(count, PropChunk());
+
+	_jobs.parallelFor(count, 4, [&](int _begin, int _end) {
+		for (int i = _begin; i < _end; ++i)
+			place_chunk(placement, i / (edge * edge), i % edge, (i / edge) % edge, _chunks[i], placed[i]);
+	}, _cancel);
+	if (_cancel.isCancelled())
+		return false;
+
+	size_t total = 0;
+	for (int i = 0; i < count; ++i)
+		total += placed[i].size();
+	_instances.clear();
+	_instances.reserve(total);
+	for (int i = 0; i < count; ++i) {
+		uint32_t offset = (uint32_t)_instances.size();
+		for (int kind = 0; kind < PROP_KIND_COUNT; ++kind)
+			_chunks[i].first[kind] += offset;
+		_instances.insert(_instances.end(), placed[i].begin(), placed[i].end());
+		std::vector<PropInstance>().swap(placed[i]);
+	}
+	return true;
+}
+
+// __________ RENDER ______________
+
+//! True if the sphere hides behind the sphere of _core seen from _camera:
+//! farther than the horizon and inside the cone the core shadows.
+static bool behind_horizon(const glm::vec3& _camera, float _core, const glm::vec3& _center, float _radius)
+{
+	float distance = glm::length(_camera);
+	if (distance <= _core)
+		return false;
+
+	glm::vec3 axis = -_camera / distance;
+	glm::vec3 offset = _center - _camera;
+	float along = glm::dot(offset, axis);
+	float across = std::sqrt(std::max(glm::dot(offset, offset) - along * along, 0.0f));
+
+	float horizon = (distance * distance - _core * _core) / distance;
+	float sine = _core / distance;
+	float cosine = std::sqrt(1.0f - sine * sine);
+	return along - _radius > horizon && along * sine - across * cosine > _radius;
+}
+
+void PropScatter::render(const PlanetParameters& _params, const RenderState& _state, float _distance)
+{
+	statistics.visible_chunks = 0;
+	statistics.drawn = 0;
+	statistics.draws = 0;
+	if (chunks.empty() || prop_shader.programID == 0 || _distance <= 0.0f)
+		return;
+
+	// The settings may differ while a new build runs, the terrain may not
+	if (terrain_key(_params) != built_terrain)
+		return;
+
+	// Culling in planet space
+	glm::vec3 camera = glm::vec3(glm::inverse(_state.model) * glm::inverse(_state.view)[3]);
+	Frustum frustum = Frustum::fromMatrix(_state.projection * _state.view * _state.model);
+
+	// Full density up to near, one layer less every sqrt(2) farther, only layer 0 at _distance
+	float near = _distance / std::pow(SQRT_2, (float)(built_layers - 1));
+
+	visible.clear();
+	visible_layers.clear();
+	for (int i = 0; i < (int)chunks.size(); ++i) {
+		const PropChunk& chunk = chunks[i];
+		if (chunk.radius <= 0.0f || !frustum.intersectsSphere(chunk.center, chunk.radius) ||
+			behind_horizon(camera, core_radius, chunk.center, chunk.radius))
+			continue;
+
+		float distance = std::max(glm::length(chunk.center - camera) - chunk.radius, 0.0f);
+		if (distance > _distance)
+			continue;
+		int dropped = distance <= near ? 0 : (int)(2.0f * std::log2(distance / near));
+		visible.push_back(i);
+		visible_layers.push_back(std::max(built_layers - dropped, 1));
+	}
+	statistics.visible_chunks = (int)visible.size();
+	if (visible.empty())
+		return;
+
+	const glm::vec3 colors[PROP_KIND_COUNT] = {
+		0.8f * glm::make_vec3(_params.terrain_color_rock),
+		0.75f * glm::make_vec3(_params.terrain_color_grass),
+		0.5f * glm::make_vec3(_params.terrain_color_grass),
+	};
+
+	glUseProgram(prop_shader.programID);
+	glUniformMatrix4fv(loc_P, 1, GL_FALSE, glm::value_ptr(_state.projection));
+	glUniformMatrix4fv(loc_V, 1, GL_FALSE, glm::value_ptr(_state.view));
+	glUniformMatrix4fv(loc_M, 1, GL_FALSE, glm::value_ptr(_state.model));
+	glUniform3fv(loc_light_position, 1, &_state.light_position[0]);
+	glUniform1f(loc_light_intensity, _state.light_intensity);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	for (int kind = 0; kind < PROP_KIND_COUNT; ++kind) {
+		glBindVertexArray(vao[kind]);
+		glUniform1f(loc_prop_size, PROP_SHAPES[kind].size);
+		glUniform3fv(loc_prop_color, 1, glm::value_ptr(colors[kind]));
+
+		for (size_t v = 0; v < visible.size(); ++v) {
+			const PropChunk& chunk = chunks[visible[v]];
+			GLsizei count = (GLsizei)chunk.layer_end[kind][visible_layers[v] - 1];
+			if (count == 0)
+				continue;
+
+			// The chunk's instances start at the attribute offset, GL 3.3 has no base instance
+			const char* offset = (const char*)0 + chunk.first[kind] * sizeof(PropInstance);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(PropInstance), offset);
+			glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(PropInstance), offset + sizeof(glm::vec3));
+			glDrawElementsInstanced(GL_TRIANGLES, index_count[kind], GL_UNSIGNED_SHORT, (void*)0, count);
+
+			statistics.drawn += count;
+			++statistics.draws;
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
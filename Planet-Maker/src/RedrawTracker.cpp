@@ -0,0 +1,131 @@
+#include "RedrawTracker.h"
+
+// GLFW callbacks carry no user data we can use (ImGui does not set the window
+// user pointer either), so the tracker of the main window is kept here.
+static RedrawTracker* active_tracker = nullptr;
+
+static GLFWmousebuttonfun previous_mouse_button = nullptr;
+static GLFWscrollfun previous_scroll = nullptr;
+static GLFWkeyfun previous_key = nullptr;
+static GLFWcharfun previous_char = nullptr;
+static GLFWcursorposfun previous_cursor_pos = nullptr;
+static GLFWframebuffersizefun previous_framebuffer_size = nullptr;
+static GLFWwindowrefreshfun previous_refresh = nullptr;
+static GLFWwindowfocusfun previous_focus = nullptr;
+
+RedrawTracker::RedrawTracker()
+{
+	on_demand = true;
+	idle_timeout = 0.5;
+	settle_frames = 16;
+
+	pending_frames = 1;
+	frames_drawn = 0;
+	frames_skipped = 0;
+}
+
+void RedrawTracker::attach(GLFWwindow* _window)
+{
+	active_tracker = this;
+
+	previous_mouse_button = glfwSetMouseButtonCallback(_window, mouseButtonCallback);
+	previous_scroll = glfwSetScrollCallback(_window, scrollCallback);
+	previous_key = glfwSetKeyCallback(_window, keyCallback);
+	previous_char = glfwSetCharCallback(_window, charCallback);
+	previous_cursor_pos = glfwSetCursorPosCallback(_window, cursorPosCallback);
+	previous_framebuffer_size = glfwSetFramebufferSizeCallback(_window, framebufferSizeCallback);
+	previous_refresh = glfwSetWindowRefreshCallback(_window, refreshCallback);
+	previous_focus = glfwSetWindowFocusCallback(_window, focusCallback);
+}
+
+bool RedrawTracker::waitForFrame(bool _animating)
+{
+	if (!on_demand || _animating) {
+		glfwPollEvents();
+		// Keep settling once the animation stops
+		pending_frames = settle_frames;
+	}
+	else if (pending_frames > 0) {
+		glfwPollEvents();
+	}
+	else {
+		glfwWaitEventsTimeout(idle_timeout);
+	}
+
+	if (pending_frames > 0) {
+		--pending_frames;
+		++frames_drawn;
+		return true;
+	}
+
+	++frames_skipped;
+	return false;
+}
+
+void RedrawTracker::requestRedraw()
+{
+	pending_frames = settle_frames;
+}
+
+//! Every callback ends here: draw for a while after any input.
+void RedrawTracker::onEvent()
+{
+	if (active_tracker)
+		active_tracker->requestRedraw();
+}
+
+void RedrawTracker::mouseButtonCallback(GLFWwindow* _window, int _button, int _action, int _mods)
+{
+	if (previous_mouse_button)
+		previous_mouse_button(_window, _button, _action, _mods);
+	onEvent();
+}
+
+void RedrawTracker::scrollCallback(GLFWwindow* _window, double _x, double _y)
+{
+	if (previous_scroll)
+		previous_scroll(_window, _x, _y);
+	onEvent();
+}
+
+void RedrawTracker::keyCallback(GLFWwindow* _window, int _key, int _scancode, int _action, int _mods)
+{
+	if (previous_key)
+		previous_key(_window, _key, _scancode, _action, _mods);
+	onEvent();
+}
+
+void RedrawTracker::charCallback(GLFWwindow* _window, unsigned int _c)
+{
+	if (previous_char)
+		previous_char(_window, _c);
+	onEvent();
+}
+
+void RedrawTracker::cursorPosCallback(GLFWwindow* _window, double _x, double _y)
+{
+	if (previous_cursor_pos)
+		previous_cursor_pos(_window, _x, _y);
+	onEvent();
+}
+
+void RedrawTracker::framebufferSizeCallback(GLFWwindow* _window, int _w, int _h)
+{
+	if (previous_framebuffer_size)
+		previous_framebuffer_size(_window, _w, _h);
+	onEvent();
+}
+
+void RedrawTracker::refreshCallback(GLFWwindow* _window)
+{
+	if (previous_refresh)
+		previous_refresh(_window);
+	onEvent();
+}
+
+void RedrawTracker::focusCallback(GLFWwindow* _window, int _focused)
+{
+	if (previous_focus)
+		previous_focus(_window, _focused);
+	onEvent();
+}
@@ -0,0 +1,99 @@
+#include "Scene.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const float PI = 3.141592653f;
+
+glm::mat4 Planet::modelMatrix() const
+{
+	glm::mat4 model = glm::translate(glm::mat4(), position);
+	model = glm::rotate(model, spin, glm::vec3(0.0f, 1.0f, 0.0f));
+	return glm::scale(model, glm::vec3(scale));
+}
+
+float Planet::boundingRadius() const
+{
+	// The fBm sum stays below 2, the clouds sit at 1.1 * elevation
+	float top = std::max(2.0f * params.terrain_elevation, 0.01f);
+	return scale * (1.0f + params.terrain_radius + top);
+}
+
+Scene::Scene()
+{
+	version = 0;
+}
+
+int Scene::add(const Planet& _planet)
+{
+	planets.push_back(_planet);
+	++version;
+	return (int)planets.size() - 1;
+}
+
+void Scene::remove(int _index)
+{
+	if (_index < 0 || _index >= (int)planets.size())
+		return;
+
+	planets.erase(planets.begin() + _index);
+	++version;
+}
+
+void Scene::clear()
+{
+	planets.clear();
+	++version;
+}
+
+//! Offsets every seed of the planet, the same way the batch renderer sweeps seeds.
+static PlanetParameters vary_seed(const PlanetParameters& _base, int _offset)
+{
+	PlanetParameters params = _base;
+	params.terrain_seed = _base.terrain_seed + _offset;
+	params.ocean_seed = _base.ocean_seed + _offset;
+	params.sky_seed = _base.sky_seed + _offset;
+	return params;
+}
+
+void Scene::layoutGrid(const PlanetParameters& _base, int _count, float _spacing)
+{
+	planets.clear();
+
+	int columns = (int)std::ceil(std::sqrt((float)_count));
+	int rows = (_count + columns - 1) / std::max(columns, 1);
+
+	for (int i = 0; i < _count; ++i) {
+		int column = i % columns;
+		int row = i / columns;
+
+		Planet planet;
+		planet.name = "planet " + std::to_string(i);
+		planet.params = vary_seed(_base, i);
+		planet.position = glm::vec3((column - 0.5f * (columns - 1)) * _spacing, (0.5f * (rows - 1) - row) * _spacing, 0.0f);
+		planets.push_back(planet);
+	}
+	++version;
+}
+
+void Scene::layoutOrbits(const PlanetParameters& _base, int _count)
+{
+	planets.clear();
+
+	for (int i = 0; i < _count; ++i) {
+		Planet planet;
+		planet.name = i == 0 ? "primary" : "planet " + std::to_string(i);
+		planet.params = vary_seed(_base, i);
+
+		if (i > 0) {
+			// Rings grow outwards, planets get smaller and spread around the circle
+			float orbit = 2.0f + 1.2f * i;
+			float angle = 2.4f * i; // golden angle, keeps neighbours apart
+			planet.position = glm::vec3(orbit * std::cos(angle), 0.0f, orbit * std::sin(angle));
+			planet.scale = 0.25f + 0.35f / (1.0f + 0.3f * i);
+			planet.spin = std::fmod(1.7f * i, 2.0f * PI);
+		}
+		planets.push_back(planet);
+	}
+	++version;
+}
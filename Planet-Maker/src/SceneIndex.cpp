@@ -0,0 +1,125 @@
+#include "SceneIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+// Upper bound for cells per axis, the scene is small next to that
+static const int MAX_CELLS_PER_AXIS = 64;
+
+Frustum Frustum::fromMatrix(const glm::mat4& _viewProjection)
+{
+	// Rows of the matrix, glm stores columns
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; ++i)
+		row[i] = glm::vec4(_viewProjection[0][i], _viewProjection[1][i], _viewProjection[2][i], _viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = row[3] + row[0]; // left
+	frustum.planes[1] = row[3] - row[0]; // right
+	frustum.planes[2] = row[3] + row[1]; // bottom
+	frustum.planes[3] = row[3] - row[1]; // top
+	frustum.planes[4] = row[3] + row[2]; // near
+	frustum.planes[5] = row[3] - row[2]; // far
+
+	for (int i = 0; i < 6; ++i)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+	return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& _center, float _radius) const
+{
+	for (int i = 0; i < 6; ++i) {
+		if (glm::dot(glm::vec3(planes[i]), _center) + planes[i].w < -_radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3& _min, const glm::vec3& _max) const
+{
+	for (int i = 0; i < 6; ++i) {
+		glm::vec3 normal = glm::vec3(planes[i]);
+
+		// The corner furthest along the normal decides
+		glm::vec3 corner(normal.x >= 0.0f ? _max.x : _min.x,
+			normal.y >= 0.0f ? _max.y : _min.y,
+			normal.z >= 0.0f ? _max.z : _min.z);
+
+		if (glm::dot(normal, corner) + planes[i].w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+SceneIndex::SceneIndex()
+{
+	indexed_scene = nullptr;
+	indexed_version = 0;
+}
+
+void SceneIndex::update(const Scene& _scene)
+{
+	if (indexed_scene == &_scene && indexed_version == _scene.getVersion())
+		return;
+
+	indexed_scene = &_scene;
+	indexed_version = _scene.getVersion();
+
+	int count = _scene.size();
+	centers.resize(count);
+	radii.resize(count);
+	cells.clear();
+
+	if (count == 0)
+		return;
+
+	glm::vec3 low, high;
+	float max_radius = 0.0f;
+	for (int i = 0; i < count; ++i) {
+		centers[i] = _scene.get(i).position;
+		radii[i] = _scene.get(i).boundingRadius();
+		low = i == 0 ? centers[i] : glm::min(low, centers[i]);
+		high = i == 0 ? centers[i] : glm::max(high, centers[i]);
+		max_radius = std::max(max_radius, radii[i]);
+	}
+
+	// About one planet per cell, but never cells smaller than a planet
+	glm::vec3 extent = high - low;
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	float cell_size = std::max(longest / std::cbrt((float)count), 2.0f * max_radius);
+	cell_size = std::max(cell_size, longest / MAX_CELLS_PER_AXIS);
+
+	std::map<long long, int> cell_of_key;
+	for (int i = 0; i < count; ++i) {
+		glm::ivec3 c = glm::ivec3(glm::floor((centers[i] - low) / cell_size));
+		long long key = ((long long)c.x * (MAX_CELLS_PER_AXIS + 1) + c.y) * (MAX_CELLS_PER_AXIS + 1) + c.z;
+
+		std::map<long long, int>::iterator it = cell_of_key.find(key);
+		if (it == cell_of_key.end()) {
+			Cell cell;
+			cell.min = low + glm::vec3(c) * cell_size - max_radius;
+			cell.max = low + glm::vec3(c + 1) * cell_size + max_radius;
+			cells.push_back(cell);
+			it = cell_of_key.insert(std::make_pair(key, (int)cells.size() - 1)).first;
+		}
+		cells[it->second].planets.push_back(i);
+	}
+}
+
+void SceneIndex::query(const Frustum& _frustum, std::vector<int>& _visible) const
+{
+	_visible.clear();
+
+	for (size_t c = 0; c < cells.size(); ++c) {
+		const Cell& cell = cells[c];
+		if (!_frustum.intersectsBox(cell.min, cell.max))
+			continue;
+
+		for (size_t i = 0; i < cell.planets.size(); ++i) {
+			int planet = cell.planets[i];
+			if (_frustum.intersectsSphere(centers[planet], radii[planet]))
+				_visible.push_back(planet);
+		}
+	}
+}
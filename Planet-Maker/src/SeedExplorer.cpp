@@ -0,0 +1,252 @@
+#include "SeedExplorer.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PlanetRenderer.h"
+#include "Scene.h"
+
+// Vertical field of view of the cells, radians
+static const float FIELD_OF_VIEW = 0.6f;
+
+SeedExplorer::SeedExplorer()
+{
+	budget_ms = 4.0f;
+
+	cell_size = 0;
+	cells_per_row = 0;
+	first_seed = 0;
+	jitter = 0.0f;
+	next_cell = 0;
+	next_level = LEVEL_COUNT;
+
+	timer_queries[0] = timer_queries[1] = 0;
+	timer_pending[0] = timer_pending[1] = false;
+	timer_level[0] = timer_level[1] = -1;
+	timer_renders[0] = timer_renders[1] = 0;
+	frame = 0;
+
+	for (int i = 0; i < LEVEL_COUNT; ++i) {
+		level_ms[i] = 0.0;
+		level_renders[i] = 0;
+	}
+}
+
+
+SeedExplorer::~SeedExplorer()
+{
+	if (timer_queries[0] != 0)
+		glDeleteQueries(2, timer_queries);
+}
+
+void SeedExplorer::init(int _atlasSize, int _cellSize)
+{
+	atlas.create(_atlasSize, _atlasSize);
+	cell_size = _cellSize;
+	cells_per_row = _atlasSize / _cellSize;
+
+	glGenQueries(2, timer_queries);
+}
+
+//! _base with every seed moved by _offset, as Scene::layoutGrid() does, and
+//! the continuous values scaled by random factors within 2^-_jitter..2^_jitter.
+static PlanetParameters vary_parameters(const PlanetParameters& _base, int _offset, float _jitter)
+{
+	PlanetParameters params = _base;
+	params.terrain_seed = _base.terrain_seed + _offset;
+	params.ocean_seed = _base.ocean_seed + _offset;
+	params.sky_seed = _base.sky_seed + _offset;
+	if (_jitter <= 0.0f)
+		return params;
+
+	// Seeded by the offset, so paging back shows the same candidates
+	std::mt19937 random((uint32_t)_offset);
+	std::uniform_real_distribution<float> spread(-_jitter, _jitter);
+
+	params.terrain_vert_frequency *= std::exp2(spread(random));
+	params.terrain_frag_frequency *= std::exp2(spread(random));
+	params.terrain_elevation *= std::exp2(spread(random));
+	params.ocean_frequency *= std::exp2(spread(random));
+	params.sky_frequency *= std::exp2(spread(random));
+	params.sky_opacity = std::min(params.sky_opacity * std::exp2(spread(random)), 1.0f);
+	return params;
+}
+
+void SeedExplorer::generate(const PlanetParameters& _base, int _count, int _firstSeed, float _jitter)
+{
+	int count = std::max(0, std::min(_count, getCapacity()));
+
+	cells.assign(count, Cell());
+	for (int i = 0; i < count; ++i)
+		cells[i].params = vary_parameters(_base, _firstSeed + i, _jitter);
+
+	first_seed = _firstSeed;
+	jitter = _jitter;
+	next_cell = 0;
+	next_level = count > 0 ? 0 : LEVEL_COUNT;
+	started = finished = std::chrono::steady_clock::now();
+
+	// Timers still in flight measured the last grid
+	timer_level[0] = timer_level[1] = -1;
+	for (int i = 0; i < LEVEL_COUNT; ++i) {
+		level_ms[i] = 0.0;
+		level_renders[i] = 0;
+	}
+}
+
+void SeedExplorer::adopt(int _index, PlanetParameters& _params) const
+{
+	const PlanetParameters& candidate = cells[_index].params;
+	_params.terrain_seed = candidate.terrain_seed;
+	_params.ocean_seed = candidate.ocean_seed;
+	_params.sky_seed = candidate.sky_seed;
+	if (jitter <= 0.0f)
+		return;
+
+	// Same values as vary_parameters()
+	_params.terrain_vert_frequency = candidate.terrain_vert_frequency;
+	_params.terrain_frag_frequency = candidate.terrain_frag_frequency;
+	_params.terrain_elevation = candidate.terrain_elevation;
+	_params.ocean_frequency = candidate.ocean_frequency;
+	_params.sky_frequency = candidate.sky_frequency;
+	_params.sky_opacity = candidate.sky_opacity;
+}
+
+void SeedExplorer::update(PlanetRenderer& _renderer, const RenderState& _state)
+{
+	readTimers();
+	if (isDone() || atlas.fbo == 0)
+		return;
+
+	// A level is timed by its first frame before it gets more than one cell
+	int renders = 1;
+	if (level_renders[next_level] > 0) {
+		double per_render = level_ms[next_level] / level_renders[next_level];
+		renders = (int)std::max(1.0, budget_ms / std::max(per_render, 0.001));
+	}
+	renders = std::min(renders, (int)cells.size() - next_cell);
+
+	GLint previous_framebuffer = 0;
+	GLint previous_viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+	glGetIntegerv(GL_VIEWPORT, previous_viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, atlas.fbo);
+	glEnable(GL_SCISSOR_TEST);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	int slot = frame & 1;
+	glBeginQuery(GL_TIME_ELAPSED, timer_queries[slot]);
+	for (int i = 0; i < renders; ++i)
+		renderCell(_renderer, _state, next_cell + i, next_level);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	timer_pending[slot] = true;
+	timer_level[slot] = next_level;
+	timer_renders[slot] = renders;
+	++frame;
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+	glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+
+	next_cell += renders;
+	if (next_cell >= (int)cells.size()) {
+		next_cell = 0;
+		++next_level;
+		if (isDone())
+			finished = std::chrono::steady_clock::now();
+	}
+}
+
+//! Renders candidate _index into the _level corner of its cell, framed so its bounding sphere fills the cell.
+void SeedExplorer::renderCell(PlanetRenderer& _renderer, const RenderState& _state, int _index, int _level)
+{
+	int size = getLevelSize(_level);
+	int x = (_index % cells_per_row) * cell_size;
+	int y = (_index / cells_per_row) * cell_size;
+
+	glViewport(x, y, size, size);
+	glScissor(x, y, size, size);
+
+	// Opaque cells, ImGui draws the atlas with its alpha
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClearStencil(0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+
+	Planet planet;
+	planet.params = cells[_index].params;
+	float bound = planet.boundingRadius();
+	float distance = bound / std::sin(0.5f * FIELD_OF_VIEW);
+
+	// Same side of the planet as the main view, without the main view's effects.
+	// Every level of a cell sees the clouds at the same time.
+	RenderState cell = _state;
+	cell.projection = glm::perspective(FIELD_OF_VIEW, 1.0f, std::max(distance - bound, 0.01f), distance + bound);
+	cell.view = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	cell.time = 0.0f;
+	cell.cloud_update_rate = 1;
+	cell.erosion_map = 0;
+	cell.draw_props = false;
+	cell.draw_stars = false;
+	cell.draw_wireframe = false;
+	// Cells are a few pixels, the vertex work of a pre-pass would cost more than it saves
+	cell.depth_prepass = false;
+	cell.measure_passes = false;
+	cell.show_overdraw = false;
+
+	_renderer.render(planet.params, cell);
+	cells[_index].level = _level;
+}
+
+//! Adds the timers the GPU is done with to the statistics of their level.
+void SeedExplorer::readTimers()
+{
+	for (int slot = 0; slot < 2; ++slot) {
+		if (!timer_pending[slot])
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(timer_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(timer_queries[slot], GL_QUERY_RESULT, &nanoseconds);
+		timer_pending[slot] = false;
+
+		if (timer_level[slot] < 0)
+			continue;
+		level_ms[timer_level[slot]] += nanoseconds / 1.0e6;
+		level_renders[timer_level[slot]] += timer_renders[slot];
+	}
+}
+
+void SeedExplorer::getRect(int _index, glm::vec2& _min, glm::vec2& _max) const
+{
+	int level = std::max(cells[_index].level, 0);
+	glm::vec2 corner((_index % cells_per_row) * cell_size, (_index / cells_per_row) * cell_size);
+
+	// Half a texel inside, linear filtering would pick up the rest of the cell
+	_min = (corner + 0.5f) / (float)atlas.width;
+	_max = (corner + glm::vec2(getLevelSize(level) - 0.5f)) / (float)atlas.width;
+}
+
+float SeedExplorer::getThroughput(int _level) const
+{
+	if (level_ms[_level] <= 0.0)
+		return 0.0f;
+	return (float)(level_renders[_level] * 1000.0 / level_ms[_level]);
+}
+
+double SeedExplorer::getElapsed() const
+{
+	std::chrono::steady_clock::time_point end = isDone() ? finished : std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - started).count();
+}
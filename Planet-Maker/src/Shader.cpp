@@ -403,6 +403,10 @@ std::string Shader::readFile(const char *filePath) {
 
 			std::getline(fileStream, line);
 			sourceCode.append(line + "\n");
+
+			// #version has to stay the first line, the defines go right after it
+			if (!defines.empty() && line.compare(0, 8, "#version") == 0)
+				sourceCode.append(defines);
 		}
 	} else {
 		std::cerr << "Could not open file: " << filePath << std::endl;
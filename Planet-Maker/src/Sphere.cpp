@@ -6,11 +6,28 @@ Sphere::Sphere(float x, float y, float z, float _rad, int segments)
 {
 	m_position = glm::vec3(x, y, z);
 	m_radius = _rad;
+	m_vao = 0;
+	m_vertexbuffer = 0;
+	m_indexbuffer = 0;
+	p_vertexarray = nullptr;
+	p_indexarray = nullptr;
+	p_stream = nullptr;
+	m_index_offset = 0;
 	createSphere(_rad, segments);
 }
 
 void Sphere::clean() {
 
+	// Meshes that were only tessellated, possibly on another thread, own no GL objects
+	if (m_vao == 0 && m_vertexbuffer == 0 && m_indexbuffer == 0)
+		return;
+
+	// The GPU may still draw it this frame, the stream reuses the space after its fence
+	if (p_stream != nullptr)
+		p_stream->release(m_stream_allocation);
+	p_stream = nullptr;
+	m_index_offset = 0;
+
 	if (glIsVertexArray(m_vao)) {
 		glDeleteVertexArrays(1, &m_vao);
 	}
@@ -31,54 +48,85 @@ void Sphere::clean() {
 void Sphere::render()
 {
 	glBindVertexArray(m_vao);
-	glDrawElements(GL_TRIANGLES, 3 * m_ntris, GL_UNSIGNED_INT, (void*)0);
+	glDrawElements(GL_TRIANGLES, 3 * m_ntris, GL_UNSIGNED_INT, (void*)m_index_offset);
 	// (mode, vertex count, type, element array buffer offset)
 	glBindVertexArray(0);
 }
 
+void Sphere::renderInstanced(int _count)
+{
+	glBindVertexArray(m_vao);
+	glDrawElementsInstanced(GL_TRIANGLES, 3 * m_ntris, GL_UNSIGNED_INT, (void*)m_index_offset, _count);
+	glBindVertexArray(0);
+}
+
 Sphere::~Sphere(void)
 {
 	clean();
+	delete[] p_vertexarray;
+	delete[] p_indexarray;
 }
 
 void Sphere::createSphere(float radius, int segments) {
+	// Delete any previous content in the TriangleSoup object
+	clean();
+
+	buildArrays(radius, segments);
+	upload();
+}
+
+void Sphere::countElements(int segments, int& nverts, int& ntris) {
+	int vsegs = segments;
+	if (vsegs < 2) vsegs = 2;
+	int hsegs = vsegs * 2;
+	nverts = 1 + (vsegs - 1) * (hsegs + 1) + 1; // top + middle + bottom
+	ntris = hsegs + (vsegs - 2) * hsegs * 2 + hsegs; // top + middle + bottom
+}
+
+void Sphere::buildArrays(float radius, int segments) {
+	m_radius = radius;
+	delete[] p_vertexarray;
+	delete[] p_indexarray;
+
+	countElements(segments, m_nverts, m_ntris);
+	p_vertexarray = new float[m_nverts * 8];
+	p_indexarray = new GLuint[m_ntris * 3];
+	writeArrays(radius, segments, p_vertexarray, p_indexarray);
+}
+
+void Sphere::writeArrays(float radius, int segments, GLfloat* vertices, GLuint* indices) {
 	int i, j, base, i0;
 	float x, y, z, R;
 	double theta, phi;
 	int vsegs, hsegs;
 	int stride = 8;
-
-	// Delete any previous content in the TriangleSoup object
-	clean();
+	int nverts, ntris;
 
 	vsegs = segments;
 	if (vsegs < 2) vsegs = 2;
 	hsegs = vsegs * 2;
-	m_nverts = 1 + (vsegs - 1) * (hsegs + 1) + 1; // top + middle + bottom
-	m_ntris = hsegs + (vsegs - 2) * hsegs * 2 + hsegs; // top + middle + bottom
-	p_vertexarray = new float[m_nverts * 8];
-	p_indexarray = new GLuint[m_ntris * 3];
+	countElements(segments, nverts, ntris);
 
 	// The vertex array: 3D xyz, 3D normal, 2D st (8 floats per vertex)
 	// First vertex: top pole (+z is "up" in object local coords)
-	p_vertexarray[0] = 0.0f;
-	p_vertexarray[1] = 0.0f;
-	p_vertexarray[2] = radius;
-	p_vertexarray[3] = 0.0f;
-	p_vertexarray[4] = 0.0f;
-	p_vertexarray[5] = 1.0f;
-	p_vertexarray[6] = 0.5f;
-	p_vertexarray[7] = 1.0f;
+	vertices[0] = 0.0f;
+	vertices[1] = 0.0f;
+	vertices[2] = radius;
+	vertices[3] = 0.0f;
+	vertices[4] = 0.0f;
+	vertices[5] = 1.0f;
+	vertices[6] = 0.5f;
+	vertices[7] = 1.0f;
 	// Last vertex: bottom pole
-	base = (m_nverts - 1)*stride;
-	p_vertexarray[base] = 0.0f;
-	p_vertexarray[base + 1] = 0.0f;
-	p_vertexarray[base + 2] = -radius;
-	p_vertexarray[base + 3] = 0.0f;
-	p_vertexarray[base + 4] = 0.0f;
-	p_vertexarray[base + 5] = -1.0f;
-	p_vertexarray[base + 6] = 0.5f;
-	p_vertexarray[base + 7] = 0.0f;
+	base = (nverts - 1)*stride;
+	vertices[base] = 0.0f;
+	vertices[base + 1] = 0.0f;
+	vertices[base + 2] = -radius;
+	vertices[base + 3] = 0.0f;
+	vertices[base + 4] = 0.0f;
+	vertices[base + 5] = -1.0f;
+	vertices[base + 6] = 0.5f;
+	vertices[base + 7] = 0.0f;
 	// All other vertices:
 	// vsegs-1 latitude rings of hsegs+1 vertices each
 	// (duplicates at texture seam s=0 / s=1)
@@ -91,45 +139,94 @@ void Sphere::createSphere(float radius, int segments) {
 			x = R*cos(phi);
 			y = R*sin(phi);
 			base = (1 + j*(hsegs + 1) + i)*stride;
-			p_vertexarray[base] = radius*x;
-			p_vertexarray[base + 1] = radius*y;
-			p_vertexarray[base + 2] = radius*z;
-			p_vertexarray[base + 3] = x;
-			p_vertexarray[base + 4] = y;
-			p_vertexarray[base + 5] = z;
-			p_vertexarray[base + 6] = (float)i / hsegs;
-			p_vertexarray[base + 7] = 1.0f - (float)(j + 1) / vsegs;
+			vertices[base] = radius*x;
+			vertices[base + 1] = radius*y;
+			vertices[base + 2] = radius*z;
+			vertices[base + 3] = x;
+			vertices[base + 4] = y;
+			vertices[base + 5] = z;
+			vertices[base + 6] = (float)i / hsegs;
+			vertices[base + 7] = 1.0f - (float)(j + 1) / vsegs;
 		}
 	}
 
 	// The index array: triplets of integers, one for each triangle
 	// Top cap
 	for (i = 0; i < hsegs; i++) {
-		p_indexarray[3 * i] = 0;
-		p_indexarray[3 * i + 1] = 1 + i;
-		p_indexarray[3 * i + 2] = 2 + i;
+		indices[3 * i] = 0;
+		indices[3 * i + 1] = 1 + i;
+		indices[3 * i + 2] = 2 + i;
 	}
 	// Middle part (possibly empty if vsegs=2)
 	for (j = 0; j < vsegs - 2; j++) {
 		for (i = 0; i < hsegs; i++) {
 			base = 3 * (hsegs + 2 * (j*hsegs + i));
 			i0 = 1 + j*(hsegs + 1) + i;
-			p_indexarray[base] = i0;
-			p_indexarray[base + 1] = i0 + hsegs + 1;
-			p_indexarray[base + 2] = i0 + 1;
-			p_indexarray[base + 3] = i0 + 1;
-			p_indexarray[base + 4] = i0 + hsegs + 1;
-			p_indexarray[base + 5] = i0 + hsegs + 2;
+			indices[base] = i0;
+			indices[base + 1] = i0 + hsegs + 1;
+			indices[base + 2] = i0 + 1;
+			indices[base + 3] = i0 + 1;
+			indices[base + 4] = i0 + hsegs + 1;
+			indices[base + 5] = i0 + hsegs + 2;
 		}
 	}
 	// Bottom cap
 	base = 3 * (hsegs + 2 * (vsegs - 2)*hsegs);
 	for (i = 0; i < hsegs; i++) {
-		p_indexarray[base + 3 * i] = m_nverts - 1;
-		p_indexarray[base + 3 * i + 1] = m_nverts - 2 - i;
-		p_indexarray[base + 3 * i + 2] = m_nverts - 3 - i;
+		indices[base + 3 * i] = nverts - 1;
+		indices[base + 3 * i + 1] = nverts - 2 - i;
+		indices[base + 3 * i + 2] = nverts - 3 - i;
 	}
+}
+
+void Sphere::useStream(StreamBuffer* stream, const StreamAllocation& allocation, size_t indexOffset, float radius, int segments) {
+	clean();
+	releaseArrays();
+
+	m_radius = radius;
+	countElements(segments, m_nverts, m_ntris);
+	p_stream = stream;
+	m_stream_allocation = allocation;
+	m_index_offset = allocation.offset + indexOffset;
+
+	// Same layout as createBuffers(), only the offsets point into the stream buffer
+	size_t vertex_offset = allocation.offset;
+	glGenVertexArrays(1, &(m_vao));
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream->getBuffer());
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+		8 * sizeof(GLfloat), (void*)(vertex_offset)); // xyz coordinates
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+		8 * sizeof(GLfloat), (void*)(vertex_offset + 3 * sizeof(GLfloat))); // normals
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
+		8 * sizeof(GLfloat), (void*)(vertex_offset + 6 * sizeof(GLfloat))); // texcoords
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream->getBuffer());
 
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Sphere::upload() {
+	createBuffers(p_vertexarray, p_indexarray);
+	releaseArrays();
+}
+
+void Sphere::allocate() {
+	createBuffers(nullptr, nullptr);
+}
+
+void Sphere::releaseArrays() {
+	delete[] p_vertexarray;
+	delete[] p_indexarray;
+	p_vertexarray = nullptr;
+	p_indexarray = nullptr;
+}
+
+void Sphere::createBuffers(const GLfloat* vertices, const GLuint* indices) {
 	// Generate one vertex array object (VAO) and bind it
 	glGenVertexArrays(1, &(m_vao));
 	glBindVertexArray(m_vao);
@@ -142,7 +239,7 @@ void Sphere::createSphere(float radius, int segments) {
 	glBindBuffer(GL_ARRAY_BUFFER, m_vertexbuffer);
 	// Present our vertex coordinates to OpenGL
 	glBufferData(GL_ARRAY_BUFFER,
-		8 * m_nverts * sizeof(GLfloat), p_vertexarray, GL_STATIC_DRAW);
+		getVertexBytes(), vertices, GL_STATIC_DRAW);
 	// Specify how many attribute arrays we have in our VAO
 	glEnableVertexAttribArray(0); // Vertex coordinates
 	glEnableVertexAttribArray(1); // Normals
@@ -165,7 +262,7 @@ void Sphere::createSphere(float radius, int segments) {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexbuffer);
 	// Present our vertex indices to OpenGL
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		3 * m_ntris * sizeof(GLuint), p_indexarray, GL_STATIC_DRAW);
+		getIndexBytes(), indices, GL_STATIC_DRAW);
 
 	// Deactivate (unbind) the VAO and the buffers again.
 	// Do NOT unbind the buffers while the VAO is still bound.
@@ -173,5 +270,4 @@ void Sphere::createSphere(float radius, int segments) {
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer()
+{
+	buffer = 0;
+	mapped = nullptr;
+	capacity = 0;
+	head = used = 0;
+	frame = 1;
+	completed = 0;
+	frame_released = false;
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+	clean();
+}
+
+bool StreamBuffer::init(size_t _capacity)
+{
+	clean();
+	if (!GLEW_ARB_buffer_storage)
+		return false;
+
+	capacity = _capacity;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+	mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (mapped == nullptr) {
+		clean();
+		return false;
+	}
+	return true;
+}
+
+void StreamBuffer::clean()
+{
+	for (size_t i = 0; i < frames.size(); ++i)
+		glDeleteSync(frames[i].fence);
+	frames.clear();
+	blocks.clear();
+
+	if (buffer != 0) {
+		if (mapped != nullptr) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+
+	buffer = 0;
+	mapped = nullptr;
+	capacity = 0;
+	head = used = 0;
+	frame_released = false;
+}
+
+//! Frees the blocks at the front of the ring that were released in a frame the GPU finished.
+void StreamBuffer::reclaim()
+{
+	while (!frames.empty()) {
+		GLenum status = glClientWaitSync(frames.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		completed = frames.front().frame;
+		glDeleteSync(frames.front().fence);
+		frames.pop_front();
+	}
+
+	// Blocks further back wait for the front one, however long it stays in use
+	while (!blocks.empty() && blocks.front().released <= completed) {
+		used -= blocks.front().bytes;
+		blocks.pop_front();
+	}
+
+	if (blocks.empty())
+		head = used = 0;
+}
+
+bool StreamBuffer::allocate(size_t _size, size_t _alignment, StreamAllocation& _allocation)
+{
+	if (mapped == nullptr || _size == 0 || _size > capacity)
+		return false;
+
+	reclaim();
+
+	if (_alignment == 0)
+		_alignment = 1;
+	size_t begin = (head + _alignment - 1) / _alignment * _alignment;
+
+	if (!blocks.empty()) {
+		size_t tail = blocks.front().begin;
+
+		if (head > tail) {
+			// Free space runs to the end of the buffer, then from the start up to tail
+			if (begin + _size > capacity) {
+				if (_size > tail)
+					return false;
+				begin = 0;
+			}
+		}
+		else if (begin + _size > tail) {
+			return false;
+		}
+	}
+
+	// Alignment and a skipped end of the buffer become free with the block before them
+	size_t gap = begin >= head ? begin - head : capacity - head;
+	if (!blocks.empty())
+		blocks.back().bytes += gap;
+
+	Block block;
+	block.begin = begin;
+	block.end = begin + _size;
+	block.bytes = _size;
+	block.released = NOT_RELEASED;
+	blocks.push_back(block);
+
+	head = block.end;
+	used += gap + _size;
+
+	_allocation.offset = begin;
+	_allocation.size = _size;
+	_allocation.pointer = mapped + begin;
+	return true;
+}
+
+void StreamBuffer::release(const StreamAllocation& _allocation)
+{
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		if (blocks[i].begin == _allocation.offset && blocks[i].released == NOT_RELEASED) {
+			blocks[i].released = frame;
+			frame_released = true;
+			return;
+		}
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	if (mapped == nullptr)
+		return;
+
+	if (frame_released) {
+		Frame fenced;
+		fenced.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fenced.frame = frame;
+		frames.push_back(fenced);
+		frame_released = false;
+	}
+	++frame;
+
+	reclaim();
+}
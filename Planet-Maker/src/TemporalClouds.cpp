@@ -0,0 +1,187 @@
+#include "TemporalClouds.h"
+#include "PlanetRenderer.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+
+TemporalClouds::TemporalClouds()
+{
+	vao = 0;
+	history_valid = false;
+	frame = 0;
+	previous_camera = glm::vec3(0.0f);
+	for (int i = 0; i < 11; ++i)
+		cloud_key[i] = 0.0f;
+}
+
+
+TemporalClouds::~TemporalClouds()
+{
+	if (vao != 0)
+		glDeleteVertexArrays(1, &vao);
+}
+
+void TemporalClouds::init()
+{
+	loadShaders();
+	glGenVertexArrays(1, &vao);
+}
+
+//! Compiles both programs. A shader that fails to compile keeps its previous program.
+void TemporalClouds::loadShaders()
+{
+	GLuint old_programs[2] = { cloud_shader.programID, composite_shader.programID };
+
+	cloud_shader.createShader("shaders/fullscreen_vert.glsl", "shaders/cloud_temporal_frag.glsl");
+	composite_shader.createShader("shaders/fullscreen_vert.glsl", "shaders/cloud_composite_frag.glsl");
+
+	GLuint new_programs[2] = { cloud_shader.programID, composite_shader.programID };
+
+	for (int i = 0; i < 2; ++i) {
+		if (old_programs[i] != 0 && old_programs[i] != new_programs[i])
+			glDeleteProgram(old_programs[i]);
+	}
+
+	lookupUniforms();
+	history_valid = false;
+}
+
+void TemporalClouds::lookupUniforms()
+{
+	// __________ CLOUDS ______________
+	loc_method = glGetUniformLocation(cloud_shader.programID, "noise_method");
+	loc_time = glGetUniformLocation(cloud_shader.programID, "time");
+	loc_speed = glGetUniformLocation(cloud_shader.programID, "speed");
+	loc_seed = glGetUniformLocation(cloud_shader.programID, "seed");
+	loc_octaves = glGetUniformLocation(cloud_shader.programID, "octaves");
+	loc_frequency = glGetUniformLocation(cloud_shader.programID, "frequency");
+	loc_opacity = glGetUniformLocation(cloud_shader.programID, "opacity");
+	loc_color = glGetUniformLocation(cloud_shader.programID, "sky_color");
+
+	loc_inverse_view_projection = glGetUniformLocation(cloud_shader.programID, "inverse_view_projection");
+	loc_inverse_model = glGetUniformLocation(cloud_shader.programID, "inverse_model");
+	loc_camera_position = glGetUniformLocation(cloud_shader.programID, "camera_position");
+	loc_shell_radius = glGetUniformLocation(cloud_shader.programID, "shell_radius");
+	loc_core_radius = glGetUniformLocation(cloud_shader.programID, "core_radius");
+	loc_lod_pixel_angle = glGetUniformLocation(cloud_shader.programID, "lod_pixel_angle");
+
+	loc_history = glGetUniformLocation(cloud_shader.programID, "history");
+	loc_history_valid = glGetUniformLocation(cloud_shader.programID, "history_valid");
+	loc_previous_view_projection = glGetUniformLocation(cloud_shader.programID, "previous_view_projection");
+	loc_previous_model = glGetUniformLocation(cloud_shader.programID, "previous_model");
+	loc_previous_camera = glGetUniformLocation(cloud_shader.programID, "previous_camera");
+
+	loc_pattern_size = glGetUniformLocation(cloud_shader.programID, "pattern_size");
+	loc_phase = glGetUniformLocation(cloud_shader.programID, "phase");
+
+	// __________ COMPOSITE ______________
+	loc_composite_clouds = glGetUniformLocation(composite_shader.programID, "clouds");
+}
+
+//! True if anything but time and view changed the clouds since the last frame.
+bool TemporalClouds::parametersChanged(const PlanetParameters& _params, const RenderState& _state)
+{
+	float key[11] = {
+		(float)_params.noise_method, (float)_params.sky_seed, (float)_params.sky_octaves,
+		_params.sky_frequency, _params.sky_opacity,
+		_params.sky_color[0], _params.sky_color[1], _params.sky_color[2],
+		_params.terrain_radius + 1.1f * _params.terrain_elevation, _state.sky_speed,
+		_state.octave_lod ? 1.0f : 0.0f
+	};
+
+	bool changed = false;
+	for (int i = 0; i < 11; ++i) {
+		if (key[i] != cloud_key[i]) {
+			cloud_key[i] = key[i];
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void TemporalClouds::render(const PlanetParameters& _params, const RenderState& _state, const glm::mat4& _model)
+{
+	GLint target_framebuffer = 0;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	Framebuffer& write = history[frame & 1];
+	Framebuffer& read = history[(frame + 1) & 1];
+
+	// The history is sampled with normalized coordinates, so a resize only
+	// reallocates the target that is written this frame.
+	if (write.width != viewport[2] || write.height != viewport[3])
+		write.create(viewport[2], viewport[3]);
+	if (read.fbo == 0 || parametersChanged(_params, _state))
+		history_valid = false;
+
+	int pattern_size = _state.cloud_update_rate >= 16 ? 4 : 2;
+	int pattern_count = pattern_size * pattern_size;
+
+	glm::mat4 view_projection = _state.projection * _state.view;
+	glm::vec3 camera_position = glm::vec3(glm::inverse(_state.view)[3]);
+
+	// __________ CLOUDS INTO HISTORY ______________
+	glBindFramebuffer(GL_FRAMEBUFFER, write.fbo);
+	glViewport(0, 0, write.width, write.height);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	glUseProgram(cloud_shader.programID);
+
+	glUniform1i(loc_method, _params.noise_method);
+	glUniform1f(loc_time, _state.time);
+	glUniform1f(loc_speed, _state.sky_speed);
+	glUniform1i(loc_seed, _params.sky_seed);
+	glUniform1i(loc_octaves, _params.sky_octaves);
+	glUniform1f(loc_frequency, _params.sky_frequency);
+	glUniform1f(loc_opacity, _params.sky_opacity);
+	glUniform3fv(loc_color, 1, &_params.sky_color[0]);
+
+	glUniformMatrix4fv(loc_inverse_view_projection, 1, GL_FALSE, glm::value_ptr(glm::inverse(view_projection)));
+	glUniformMatrix4fv(loc_inverse_model, 1, GL_FALSE, glm::value_ptr(glm::inverse(_model)));
+	glUniform3fv(loc_camera_position, 1, glm::value_ptr(camera_position));
+
+	// Same heights as sky_vert.glsl and ocean_vert.glsl
+	glUniform1f(loc_shell_radius, 1.0f + _params.terrain_radius + 1.1f * _params.terrain_elevation);
+	glUniform1f(loc_core_radius, 1.0f + _params.terrain_radius + 0.01f);
+
+	// Pixels of the history target are the size of the viewport's
+	glUniform1f(loc_lod_pixel_angle, _state.octave_lod ? 2.0f / (_state.projection[1][1] * std::max(viewport[3], 1)) : 0.0f);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, read.colorTexture);
+	glUniform1i(loc_history, 0);
+	glUniform1i(loc_history_valid, history_valid ? 1 : 0);
+	glUniformMatrix4fv(loc_previous_view_projection, 1, GL_FALSE, glm::value_ptr(previous_view_projection));
+	glUniformMatrix4fv(loc_previous_model, 1, GL_FALSE, glm::value_ptr(previous_model));
+	glUniform3fv(loc_previous_camera, 1, glm::value_ptr(previous_camera));
+
+	glUniform1i(loc_pattern_size, pattern_size);
+	glUniform1i(loc_phase, frame % pattern_count);
+
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// __________ COMPOSITE ______________
+	glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(composite_shader.programID);
+	glBindTexture(GL_TEXTURE_2D, write.colorTexture);
+	glUniform1i(loc_composite_clouds, 0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_DEPTH_TEST);
+
+	previous_view_projection = view_projection;
+	previous_model = _model;
+	previous_camera = glm::vec3(glm::inverse(_model) * glm::vec4(camera_position, 1.0f));
+	history_valid = true;
+	++frame;
+}
@@ -0,0 +1,459 @@
+#include "TerrainErosion.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "BakeCache.h"
+#include "PlanetSurface.h"
+
+// Part of the background job key, bump when the simulation changes
+static const uint32_t EROSION_VERSION = 1;
+
+//! Small fast generator for droplet positions, one stream per tile and iteration.
+static uint32_t next_random(uint32_t& _state)
+{
+	_state ^= _state << 13;
+	_state ^= _state >> 17;
+	_state ^= _state << 5;
+	return _state;
+}
+
+static float random_unit(uint32_t& _state)
+{
+	return (next_random(_state) >> 8) * (1.0f / 16777216.0f);
+}
+
+//! Bilinear sample of a six face grid at a direction, like CubeHeightmap::sample().
+static float sample_faces(const std::vector<float>& _grid, int _resolution, const glm::vec3& _direction)
+{
+	int face;
+	float s, t;
+	PlanetSurface::cubeCoordinates(_direction, face, s, t);
+
+	float x = glm::clamp((s * 0.5f + 0.5f) * _resolution - 0.5f, 0.0f, _resolution - 1.0f);
+	float y = glm::clamp((t * 0.5f + 0.5f) * _resolution - 0.5f, 0.0f, _resolution - 1.0f);
+	int x0 = std::min((int)x, _resolution - 2);
+	int y0 = std::min((int)y, _resolution - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const float* row = &_grid[((size_t)face * _resolution + y0) * _resolution];
+	float top = glm::mix(row[x0], row[x0 + 1], fx);
+	float bottom = glm::mix(row[x0 + _resolution], row[x0 + _resolution + 1], fx);
+	return glm::mix(top, bottom, fy);
+}
+
+TerrainErosion::TerrainErosion()
+{
+	resolution = 0;
+	iterations = 0;
+	height_scale = 1.0f;
+}
+
+void TerrainErosion::init(const CubeHeightmap& _heightmap, int _resolution, const ErosionSettings& _settings)
+{
+	resolution = std::max(2, _resolution);
+	iterations = 0;
+	settings = _settings;
+	settings.droplet_lifetime = std::min(settings.droplet_lifetime, TILE_HALO - 2);
+
+	// A face spans two units, a texel 2 / resolution of them
+	height_scale = settings.relief * resolution * 0.5f;
+
+	size_t face_size = (size_t)resolution * resolution;
+	baked.resize(6 * face_size);
+
+	if (_heightmap.getResolution() == resolution) {
+		for (int face = 0; face < 6; ++face)
+			memcpy(&baked[face * face_size], _heightmap.getFace(face), face_size * sizeof(float));
+	}
+	else {
+		for (int face = 0; face < 6; ++face) {
+			for (int y = 0; y < resolution; ++y) {
+				float* row = &baked[face * face_size + (size_t)y * resolution];
+				float t = 2.0f * (y + 0.5f) / resolution - 1.0f;
+				for (int x = 0; x < resolution; ++x) {
+					float s = 2.0f * (x + 0.5f) / resolution - 1.0f;
+					row[x] = _heightmap.sample(PlanetSurface::cubeDirection(face, s, t));
+				}
+			}
+		}
+	}
+
+	front.resize(baked.size());
+	back.resize(baked.size());
+	for (size_t i = 0; i < baked.size(); ++i)
+		front[i] = baked[i] * height_scale;
+}
+
+float TerrainErosion::sampleFront(const glm::vec3& _direction) const
+{
+	return sample_faces(front, resolution, _direction);
+}
+
+//! Copies _size x _size texels from (_originX, _originY) of the front grid, texels past the face come from its neighbours.
+void TerrainErosion::fillTile(int _face, int _originX, int _originY, int _size, float* _tile) const
+{
+	size_t face_offset = (size_t)_face * resolution * resolution;
+	int inside_begin = std::max(0, -_originX);
+	int inside_end = std::min(_size, resolution - _originX);
+
+	for (int y = 0; y < _size; ++y) {
+		int face_y = _originY + y;
+		float* out = _tile + (size_t)y * _size;
+
+		// Texels [copy_begin, copy_end) lie on the face, the rest is halo on other faces
+		int copy_begin = _size, copy_end = _size;
+		if (face_y >= 0 && face_y < resolution && inside_end > inside_begin) {
+			copy_begin = inside_begin;
+			copy_end = inside_end;
+			memcpy(out + copy_begin, &front[face_offset + (size_t)face_y * resolution + _originX + copy_begin],
+				(copy_end - copy_begin) * sizeof(float));
+		}
+
+		float t = 2.0f * (face_y + 0.5f) / resolution - 1.0f;
+		for (int x = 0; x < _size; ++x) {
+			if (x == copy_begin)
+				x = copy_end;
+			if (x >= _size)
+				break;
+			float s = 2.0f * (_originX + x + 0.5f) / resolution - 1.0f;
+			out[x] = sampleFront(PlanetSurface::cubeDirection(_face, s, t));
+		}
+	}
+}
+
+void TerrainErosion::erodeTile(int _face, int _originX, int _originY, uint32_t _seed, std::vector<float>& _tile, std::vector<float>& _scratch)
+{
+	const int size = TILE_SIZE + 2 * TILE_HALO;
+	_tile.resize((size_t)size * size);
+	_scratch.resize((size_t)size * size);
+	float* h = _tile.data();
+
+	// Part of the face this tile writes, the tile grid may start before the face
+	int begin_x = std::max(_originX, 0);
+	int begin_y = std::max(_originY, 0);
+	int end_x = std::min(_originX + TILE_SIZE, resolution);
+	int end_y = std::min(_originY + TILE_SIZE, resolution);
+	if (end_x <= begin_x || end_y <= begin_y)
+		return;
+
+	int local_x = _originX - TILE_HALO;
+	int local_y = _originY - TILE_HALO;
+	fillTile(_face, local_x, local_y, size, h);
+
+	// __________ HYDRAULIC ______________
+	uint32_t random = _seed | 1;
+	float expected = settings.droplets_per_texel * (end_x - begin_x) * (end_y - begin_y);
+	int droplets = (int)expected + (random_unit(random) < expected - (int)expected ? 1 : 0);
+	const float limit = (float)(size - 2);
+
+	for (int d = 0; d < droplets; ++d) {
+		float px = begin_x - local_x + random_unit(random) * (end_x - begin_x);
+		float py = begin_y - local_y + random_unit(random) * (end_y - begin_y);
+		float dx = 0.0f, dy = 0.0f;
+		float speed = 1.0f, water = 1.0f, sediment = 0.0f;
+
+		for (int step = 0; step < settings.droplet_lifetime; ++step) {
+			int cx = (int)px, cy = (int)py;
+			float u = px - cx, v = py - cy;
+			size_t i = (size_t)cy * size + cx;
+
+			float nw = h[i], ne = h[i + 1], sw = h[i + size], se = h[i + size + 1];
+			float gx = (ne - nw) * (1.0f - v) + (se - sw) * v;
+			float gy = (sw - nw) * (1.0f - u) + (se - ne) * u;
+			float height = nw * (1.0f - u) * (1.0f - v) + ne * u * (1.0f - v) + sw * (1.0f - u) * v + se * u * v;
+
+			// Downhill, keeping some of the old direction
+			dx = dx * settings.inertia - gx * (1.0f - settings.inertia);
+			dy = dy * settings.inertia - gy * (1.0f - settings.inertia);
+			float length = std::sqrt(dx * dx + dy * dy);
+			if (length < 1e-6f)
+				break;
+			dx /= length;
+			dy /= length;
+
+			px += dx;
+			py += dy;
+			if (px < 0.0f || py < 0.0f || px >= limit || py >= limit)
+				break;
+
+			int nx = (int)px, ny = (int)py;
+			float nu = px - nx, nv = py - ny;
+			size_t j = (size_t)ny * size + nx;
+			float new_height = h[j] * (1.0f - nu) * (1.0f - nv) + h[j + 1] * nu * (1.0f - nv) +
+				h[j + size] * (1.0f - nu) * nv + h[j + size + 1] * nu * nv;
+			float delta = new_height - height;
+
+			float capacity = std::max(-delta * speed * water * settings.capacity, settings.min_capacity);
+			float amount;
+			if (delta > 0.0f || sediment > capacity) {
+				// Uphill it fills the pit behind it, otherwise drops what it cannot carry
+				amount = delta > 0.0f ? std::min(delta, sediment) : (sediment - capacity) * settings.deposit_speed;
+				sediment -= amount;
+			}
+			else {
+				amount = -std::min((capacity - sediment) * settings.erode_speed, -delta);
+				sediment -= amount;
+			}
+
+			h[i] += amount * (1.0f - u) * (1.0f - v);
+			h[i + 1] += amount * u * (1.0f - v);
+			h[i + size] += amount * (1.0f - u) * v;
+			h[i + size + 1] += amount * u * v;
+
+			speed = std::sqrt(std::max(0.0f, speed * speed - delta * settings.gravity));
+			water *= 1.0f - settings.evaporate_speed;
+		}
+
+		// Whatever it still carries settles where it stopped
+		if (px >= 0.0f && py >= 0.0f && px < limit && py < limit) {
+			int cx = (int)px, cy = (int)py;
+			float u = px - cx, v = py - cy;
+			size_t i = (size_t)cy * size + cx;
+			h[i] += sediment * (1.0f - u) * (1.0f - v);
+			h[i + 1] += sediment * u * (1.0f - v);
+			h[i + size] += sediment * (1.0f - u) * v;
+			h[i + size + 1] += sediment * u * v;
+		}
+	}
+
+	// __________ THERMAL ______________
+	// Every pair of neighbours above the talus slope evens out a part of the
+	// excess. Pairs are antisymmetric, so material is only moved.
+	const float talus = settings.talus;
+	const float rate = settings.thermal_rate;
+	for (int pass = 0; pass < settings.thermal_passes; ++pass) {
+		float* out = _scratch.data();
+		memcpy(out, h, (size_t)size * size * sizeof(float));
+
+		for (int y = 1; y < size - 1; ++y) {
+			const float* up = h + (size_t)(y - 1) * size;
+			const float* row = up + size;
+			const float* down = row + size;
+			float* result = out + (size_t)y * size;
+
+			// The excess of a difference d is d - clamp(d, -talus, talus)
+			for (int x = 1; x < size - 1; ++x) {
+				float c = row[x];
+				float l = row[x - 1] - c, r = row[x + 1] - c, t = up[x] - c, b = down[x] - c;
+				float stable = std::min(std::max(l, -talus), talus) + std::min(std::max(r, -talus), talus)
+					+ std::min(std::max(t, -talus), talus) + std::min(std::max(b, -talus), talus);
+				result[x] = c + rate * 0.5f * (l + r + t + b - stable);
+			}
+		}
+
+		_tile.swap(_scratch);
+		h = _tile.data();
+	}
+
+	// Only the tile itself, its halo belongs to the neighbours
+	size_t face_offset = (size_t)_face * resolution * resolution;
+	for (int y = begin_y; y < end_y; ++y)
+		memcpy(&back[face_offset + (size_t)y * resolution + begin_x],
+			h + (size_t)(y - local_y) * size + (begin_x - local_x), (end_x - begin_x) * sizeof(float));
+}
+
+bool TerrainErosion::iterate(JobSystem& _jobs, const CancelToken& _cancel)
+{
+	if (resolution == 0)
+		return false;
+
+	// Every other iteration the tile grid starts half a tile before the face
+	int shift = (iterations & 1) ? TILE_SIZE / 2 : 0;
+	int tiles = (resolution + shift + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles_per_face = tiles * tiles;
+	int iteration = iterations;
+
+	_jobs.parallelFor(6 * tiles_per_face, 1, [&](int _begin, int _end) {
+		std::vector<float> tile, scratch;
+		for (int i = _begin; i < _end; ++i) {
+			int face = i / tiles_per_face;
+			int x = (i % tiles_per_face) % tiles;
+			int y = (i % tiles_per_face) / tiles;
+			uint32_t seed = (uint32_t)(iteration + 1) * 2654435761u ^ (uint32_t)(i + 1) * 2246822519u;
+			erodeTile(face, x * TILE_SIZE - shift, y * TILE_SIZE - shift, seed, tile, scratch);
+		}
+	}, _cancel);
+
+	if (_cancel.isCancelled())
+		return false;
+
+	front.swap(back);
+	++iterations;
+	return true;
+}
+
+void TerrainErosion::getDelta(int _face, float* _delta) const
+{
+	size_t face_size = (size_t)resolution * resolution;
+	const float* eroded = &front[_face * face_size];
+	const float* original = &baked[_face * face_size];
+	float scale = 1.0f / height_scale;
+
+	for (size_t i = 0; i < face_size; ++i)
+		_delta[i] = eroded[i] * scale - original[i];
+}
+
+// __________ BACKGROUND ______________
+
+// Shared with the tasks, a cancelled simulation is freed by whoever finishes last
+struct BackgroundErosion::Job
+{
+	CancelToken cancel;
+	PlanetParameters params;
+	int resolution;
+	int target;
+	ErosionSettings settings;
+	BakeCache* cache;
+
+	TerrainErosion erosion;
+	TaskRef task; // bake, then one iteration at a time
+	double seconds; // of the last iteration
+};
+
+BackgroundErosion::BackgroundErosion()
+{
+	upload_interval = 0.5;
+	job_key = 0;
+	iterations_per_second = 0.0;
+	last_upload = -1.0e9;
+	uploaded_iterations = 0;
+	texture = 0;
+	texture_resolution = 0;
+}
+
+
+BackgroundErosion::~BackgroundErosion()
+{
+	stop();
+}
+
+void BackgroundErosion::start(const PlanetParameters& _params, int _resolution, int _iterations,
+	const ErosionSettings& _settings, BakeCache* _cache)
+{
+	uint64_t key = BakeKey("erosion", EROSION_VERSION)
+		.add(CubeHeightmap::cacheKey(_params, _resolution))
+		.add(_settings)
+		.get();
+
+	// More or fewer iterations continue the same simulation
+	if (job && key == job_key) {
+		job->target = _iterations;
+		return;
+	}
+
+	stop();
+	job = std::make_shared<Job>();
+	job->params = _params;
+	job->resolution = _resolution;
+	job->target = _iterations;
+	job->settings = _settings;
+	job->cache = _cache;
+	job->seconds = 0.0;
+	job_key = key;
+
+	std::shared_ptr<Job> started = job;
+	job->task = JobSystem::global().run([started]() {
+		CubeHeightmap heightmap;
+		heightmap.bake(started->params, started->resolution, started->cache, nullptr, started->cancel);
+		if (!heightmap.empty())
+			started->erosion.init(heightmap, started->resolution, started->settings);
+	}, job->cancel);
+}
+
+void BackgroundErosion::stop()
+{
+	if (job)
+		job->cancel.cancel();
+	job.reset();
+	job_key = 0;
+	uploaded_iterations = 0;
+	iterations_per_second = 0.0;
+
+	// The delta belongs to the old heightmap
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	texture_resolution = 0;
+}
+
+bool BackgroundErosion::isRunning() const
+{
+	return job && (!JobSystem::isDone(job->task) || job->erosion.getIterations() < job->target);
+}
+
+int BackgroundErosion::getTargetIterations() const
+{
+	return job ? job->target : 0;
+}
+
+//! Next iteration in a task, the grids are only touched by one task at a time.
+void BackgroundErosion::startIteration()
+{
+	std::shared_ptr<Job> started = job;
+	job->task = JobSystem::global().run([started]() {
+		auto begin = std::chrono::high_resolution_clock::now();
+		if (started->erosion.iterate(JobSystem::global(), started->cancel))
+			started->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	}, job->cancel);
+}
+
+//! Delta of every face into the cube map, faces in the GL cube map order like cubeDirection().
+void BackgroundErosion::upload()
+{
+	const TerrainErosion& erosion = job->erosion;
+	int resolution = erosion.getResolution();
+	delta.resize((size_t)resolution * resolution);
+
+	if (texture == 0 || texture_resolution != resolution) {
+		if (texture != 0)
+			glDeleteTextures(1, &texture);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (int face = 0; face < 6; ++face)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_R32F, resolution, resolution, 0, GL_RED, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		texture_resolution = resolution;
+	}
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	for (int face = 0; face < 6; ++face) {
+		erosion.getDelta(face, delta.data());
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, resolution, resolution, GL_RED, GL_FLOAT, delta.data());
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	uploaded_iterations = erosion.getIterations();
+}
+
+bool BackgroundErosion::update(double _time)
+{
+	if (!job || !JobSystem::isDone(job->task))
+		return false;
+
+	// The bake was cancelled or failed
+	if (job->erosion.getResolution() == 0)
+		return false;
+
+	if (job->seconds > 0.0)
+		iterations_per_second = 1.0 / job->seconds;
+
+	int done = job->erosion.getIterations();
+	bool finished = done >= job->target;
+	bool changed = false;
+	if (done > uploaded_iterations && (finished || _time - last_upload >= upload_interval)) {
+		upload();
+		last_upload = _time;
+		changed = true;
+	}
+
+	if (!finished)
+		startIteration();
+	return changed;
+}
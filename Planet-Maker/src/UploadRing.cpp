@@ -0,0 +1,139 @@
+#include "UploadRing.h"
+#include <algorithm>
+#include <cstring>
+
+UploadRing::UploadRing()
+{
+	buffer = 0;
+	mapped = nullptr;
+	capacity = 0;
+	head = tail = used = 0;
+	frame_bytes = 0;
+}
+
+
+UploadRing::~UploadRing()
+{
+	clean();
+}
+
+void UploadRing::init(size_t _capacity)
+{
+	clean();
+	capacity = _capacity;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, capacity, nullptr, flags);
+		mapped = (uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags);
+	}
+	else {
+		glBufferData(GL_COPY_READ_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void UploadRing::clean()
+{
+	for (size_t i = 0; i < regions.size(); ++i)
+		glDeleteSync(regions[i].fence);
+	regions.clear();
+
+	if (buffer != 0) {
+		if (mapped != nullptr) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+
+	buffer = 0;
+	mapped = nullptr;
+	head = tail = used = 0;
+	frame_bytes = 0;
+}
+
+//! Frees the regions of every frame the GPU is done with, without waiting for the others.
+void UploadRing::retire()
+{
+	while (!regions.empty()) {
+		GLenum status = glClientWaitSync(regions.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(regions.front().fence);
+		used -= regions.front().bytes;
+		tail = regions.front().end;
+		regions.pop_front();
+	}
+
+	if (used == 0)
+		head = tail = 0;
+}
+
+size_t UploadRing::upload(GLuint _target, size_t _offset, const void* _data, size_t _size)
+{
+	if (buffer == 0 || _size == 0)
+		return 0;
+
+	retire();
+
+	if (head == capacity && used < capacity)
+		head = 0;
+
+	// Contiguous free bytes after head, writes never wrap so no byte is skipped
+	size_t free_bytes;
+	if (used == capacity)
+		free_bytes = 0;
+	else if (head >= tail)
+		free_bytes = capacity - head;
+	else
+		free_bytes = tail - head;
+
+	size_t bytes = std::min(_size, free_bytes);
+	if (bytes == 0)
+		return 0;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	if (mapped != nullptr) {
+		memcpy(mapped + head, _data, bytes);
+	}
+	else {
+		void* range = glMapBufferRange(GL_COPY_READ_BUFFER, head, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (range == nullptr) {
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			return 0;
+		}
+		memcpy(range, _data, bytes);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _target);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, head, _offset, bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	head += bytes;
+	used += bytes;
+	frame_bytes += bytes;
+	return bytes;
+}
+
+void UploadRing::endFrame()
+{
+	if (frame_bytes == 0)
+		return;
+
+	Region region;
+	region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region.end = head;
+	region.bytes = frame_bytes;
+	regions.push_back(region);
+	frame_bytes = 0;
+}
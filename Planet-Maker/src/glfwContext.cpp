@@ -46,11 +46,46 @@ void glfwContext::init(int _w, int _h, const char* _wName)
 	std::cout << "glfw initialization complete" << std::endl;
 }
 
+bool glfwContext::initHeadless(int _count, int _w, int _h)
+{
+	if (!glfwInit()) {
+		std::cout << "ERROR: could not start GLFW3" << std::endl;
+		return false;
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	window.resize(_count);
+	for (int i = 0; i < _count; i++)
+	{
+		window[i].width = _w; window[i].height = _h;
+		window[i].object = glfwCreateWindow(_w, _h, "offscreen", NULL, NULL);
+
+		if (!window[i].object) {
+			std::cout << "failed to create offscreen context " << i << std::endl;
+			window.resize(i);
+			break;
+		}
+	}
+
+	glfwDefaultWindowHints();
+
+	currentWindow = window.empty() ? NULL : window[0].object;
+	glfwMakeContextCurrent(NULL);
+
+	return !window.empty();
+}
+
 void glfwContext::getCurrentWindow(GLFWwindow* &_window)
 {
 	_window = currentWindow;
 }
 
+GLFWwindow* glfwContext::getWindow(int _index)
+{
+	return window[_index].object;
+}
+
 
 void glfwContext::printGLInfo()
 {
@@ -8,15 +8,32 @@
 #include <Windows.h>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
 
-#include "Shader.h"
 #include "Camera.h"
-#include "Sphere.h"
-#include "Plane.h"
+#include "Parameters.h"
+#include "ParameterSnapshots.h"
+#include "PresetFile.h"
+#include "PlanetRenderer.h"
+#include "BatchRenderer.h"
+#include "MapExporter.h"
+#include "MeshExporter.h"
+#include "BakeCache.h"
+#include "CubeHeightmap.h"
+#include "OctaveCache.h"
+#include "PresetLibrary.h"
+#include "PresetLoader.h"
+#include "JobSystem.h"
+#include "TerrainErosion.h"
+#include "PlanetQuery.h"
+#include "DynamicResolution.h"
+#include "RedrawTracker.h"
+#include "SeedExplorer.h"
 
 void input_handler(GLFWwindow* _window, double _dT);
 // void camera_handler(GLFWwindow* _window, double _dT, Camera* _cam);
-void GL_calls();
 
 static const float M_PI = 3.141592653f;
 static const float DEGREE_TO_RADIAN = M_PI / 180.0f;
@@ -25,223 +42,411 @@ static const char file_name_buffer[30] = {};
 
 static char load_buffer[256] = "";
 static char save_buffer[256] = "";
-static char files_buffer[1024] = "";
 
-static const std::string FILE_ENDING = ".txt";
+// Presets are saved in the binary format, text presets are still listed and loaded
+static const std::string FILE_ENDING = PRESET_FILE_ENDING;
+static const std::string TEXT_FILE_ENDING = ".txt";
 
 static glm::vec3* background_pos = new glm::vec3(0.0f, 0.0f, 3.0f);
 
-int noise_method = 0;
 bool use_perlin = true;
 bool use_simplex = false;
 bool use_worley = false;
 
-// ________ Ocean _________
-
-bool ocean_enabled = true;
-float ocean_frequency = 4.0f;
-int ocean_seed = 0;
-int ocean_octaves = 6;
-float ocean_color_1[3] = { 0.0f,0.352941f,1.0f };
-float ocean_color_2[3] = { 0.0f,0.231142f,0.654902f };
-
-// ________ TERRAIN _________
-// Procedural related variables
-int terrain_segments = 100;
-float terrain_elevation = 0.1f;
-float terrain_radius = 0.01f;
-float terrain_vert_frequency = 4.0f;
-float terrain_frag_frequency = 4.0f;
-int terrain_octaves = 6;
-int terrain_seed = 0;
-
-float terrain_color_deep[3] = { 0.3f,0.3f,0.3f };
-float terrain_color_beach[3] = { 1.0f,0.96f,0.57f };
-float terrain_color_grass[3] = { 0.0535179f,0.454902f,0.0912952f };
-float terrain_color_rock[3] = { 0.286275f,0.286275f,0.286275f };
-float terrain_color_snow[3] = { 0.980392f,0.980392f,0.980392f };
-
-// ________ SKY _________
-// Procedural related variables
-bool sky_enabled = true;
-
-float sky_frequency = 4.0f;
-int sky_seed = 0;
-int sky_octaves = 6;
-float sky_color[3] = { 1.0f,1.0f,1.0f };
-float sky_opacity = 1.0f;
-
-Sphere* ocean_sphere;
-Sphere* terrain_sphere;
-Sphere* sky_sphere;
-
-std::vector<Plane*> skybox;
-float scale = 100.0f;
-
-void list_files()
+// Edited by the UI only, the renderer and tasks read what is published to planet_snapshots
+PlanetParameters planet;
+ParameterSnapshots planet_snapshots;
+PlanetRenderer* planet_renderer;
+PresetLoader* preset_loader;
+
+// Called at the start of a frame once preset_loader has everything, terrain
+// is the uploaded mesh or nullptr if the current one has the right segments.
+void apply_preset(const PlanetParameters& loaded, Sphere* terrain)
+{
+	// Published with the rest of the frame's edits, the new version invalidates what it changes
+	planet = loaded;
+
+	switch (planet.noise_method)
+	{
+	case 0:
+		use_perlin = true;
+		use_simplex = use_worley = false;
+		break;
+	case 1:
+		use_simplex = true;
+		use_perlin = use_worley = false;
+		break;
+	case 2:
+		use_worley = true;
+		use_perlin = use_simplex = false;
+		break;
+
+	default:
+		std::cout << "Error reading file." << std::endl;
+		break;
+	}
+
+	if (terrain != nullptr)
+		planet_renderer->adoptTerrainMesh(terrain, planet.terrain_segments);
+}
+
+
+// Parsed and tessellated in the background, the current planet stays until apply_preset().
+void load_path(const std::string& path)
+{
+	preset_loader->request(path, planet_renderer->getTerrainSegments());
+}
+
+
+void load_file(std::string file_name)
+{
+	// Prefer the binary preset, fall back to a text preset of the same name
+	std::string path = file_name + FILE_ENDING;
+	if (GetFileAttributes(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+		path = file_name + TEXT_FILE_ENDING;
+
+	load_path(path);
+}
+
+
+void save_file(std::string file_name) {
+	if (!save_binary_preset(file_name + FILE_ENDING, planet))
+		std::cout << "Error saving" << std::endl;
+}
+
+
+// Baked data shared by sessions and batch runs, least recently used blobs go first
+static const std::string CACHE_DIRECTORY = "cache";
+static const uint64_t CACHE_SIZE = 1024ull * 1024 * 1024;
+
+// Heightmap the ground collision queries, a texel is about 3 km on an Earth sized planet
+static const int QUERY_RESOLUTION = 512;
+// Closest the camera gets to the terrain or the sea, planet radii
+static const float GROUND_CLEARANCE = 0.005f;
+
+// Planet-Maker --bake [--resolution N] preset ... fills the bake cache ahead of batch runs.
+int bake_presets(int argc, char* argv[])
 {
-	std::vector<std::string> return_file_name;
-	WIN32_FIND_DATA file_info;
-	HANDLE h_find;
+	BakeCache cache;
+	cache.open(CACHE_DIRECTORY, CACHE_SIZE);
 
-	std::string full_path = "*" + FILE_ENDING;
-	h_find = FindFirstFile(full_path.c_str(), &file_info);
+	int resolution = 512;
+	int failures = 0;
 
-	file_info;
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--resolution" && i + 1 < argc) {
+			resolution = atoi(argv[++i]);
+			continue;
+		}
 
-	if (h_find != INVALID_HANDLE_VALUE) {
-		return_file_name.push_back(file_info.cFileName);
-		while (FindNextFile(h_find, &file_info) != 0) {
-			return_file_name.push_back(file_info.cFileName);
+		PlanetParameters params;
+		if (!load_preset(arg, params)) {
+			std::cout << "Error reading preset " << arg << std::endl;
+			++failures;
+			continue;
 		}
-	}
 
-	std::stringstream ss;
-	for (int i = 0; i < return_file_name.size(); ++i)
-		ss << return_file_name[i] << std::endl;
+		auto start = std::chrono::high_resolution_clock::now();
+		CubeHeightmap heightmap;
+		bool hit = heightmap.bake(params, resolution, &cache);
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << arg << ": heightmap " << resolution << " " << (hit ? "from cache" : "baked") << " in " << seconds << " s" << std::endl;
+	}
 
-	memset(files_buffer, 0, strlen(files_buffer));
-	strcpy(files_buffer, ss.str().c_str());
+	std::cout << cache.getEntryCount() << " blobs, " << cache.getSize() / (1024 * 1024) << " MB in " << CACHE_DIRECTORY << std::endl;
+	return failures == 0 ? 0 : 1;
 }
 
 
-void color_to_file(std::ofstream &file, float color[3]) {
-	file << color[0] << std::endl;
-	file << color[1] << std::endl;
-	file << color[2] << std::endl;
+// Planet-Maker --jobs-benchmark [--resolution N] [--threads N] [preset] bakes the
+// same heightmap with 1..N threads, nothing cached, and prints the speedup.
+int benchmark_jobs(int argc, char* argv[])
+{
+	int resolution = 512;
+	int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+	PlanetParameters params;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--resolution" && i + 1 < argc)
+			resolution = atoi(argv[++i]);
+		else if (arg == "--threads" && i + 1 < argc)
+			max_threads = std::max(1, atoi(argv[++i]));
+		else if (!load_preset(arg, params)) {
+			std::cout << "Error reading preset " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	double single = 0.0;
+	for (int threads = 1; threads <= max_threads; ++threads) {
+		// The calling thread is one of them
+		JobSystem jobs(threads - 1);
+		OctaveCache::global().clear();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		CubeHeightmap heightmap;
+		heightmap.bake(params, resolution, nullptr, &jobs);
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (threads == 1)
+			single = seconds;
+		double speedup = single / seconds;
+		double samples = 6.0 * resolution * resolution / seconds / 1.0e6;
+
+		printf("%3d threads: %8.3f s  %7.2f Msamples/s  speedup %5.2fx  efficiency %3.0f%%\n",
+			threads, seconds, samples, speedup, 100.0 * speedup / threads);
+	}
+	return 0;
 }
 
 
-void file_to_color(std::ifstream &file, float color[3]) {
-	file >> color[0];
-	file >> color[1];
-	file >> color[2];
+// Planet-Maker --erosion-benchmark [--resolution N] [--iterations N] [preset] times
+// erosion iterations on all threads, at 2048 and 4096 unless a resolution is given.
+int benchmark_erosion(int argc, char* argv[])
+{
+	std::vector<int> resolutions;
+	int iterations = 10;
+	PlanetParameters params;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--resolution" && i + 1 < argc)
+			resolutions.push_back(atoi(argv[++i]));
+		else if (arg == "--iterations" && i + 1 < argc)
+			iterations = std::max(1, atoi(argv[++i]));
+		else if (!load_preset(arg, params)) {
+			std::cout << "Error reading preset " << arg << std::endl;
+			return 1;
+		}
+	}
+	if (resolutions.empty()) {
+		resolutions.push_back(2048);
+		resolutions.push_back(4096);
+	}
+
+	// The erosion resamples it, the bake is not what is measured
+	CubeHeightmap heightmap;
+	heightmap.bake(params, 512, nullptr, &JobSystem::global());
+	ErosionSettings settings;
+
+	for (size_t r = 0; r < resolutions.size(); ++r) {
+		int resolution = resolutions[r];
+		TerrainErosion erosion;
+		erosion.init(heightmap, resolution, settings);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; ++i)
+			erosion.iterate(JobSystem::global());
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		double texels = 6.0 * resolution * resolution * iterations / seconds / 1.0e6;
+		printf("%5d: %d iterations in %.2f s  %6.2f it/s  %7.1f Mtexels/s  (%d threads)\n",
+			resolution, iterations, seconds, iterations / seconds, texels, JobSystem::global().getThreadCount());
+	}
+	return 0;
 }
 
 
-void load_file(std::string file_name)
+// Planet-Maker --query-benchmark [--resolution N] [--count N] [preset] times batches
+// of heights, normals and raycasts against random directions, on all threads.
+int benchmark_query(int argc, char* argv[])
 {
-	try
-	{
-		std::ifstream in_file(file_name + FILE_ENDING, std::ifstream::binary);
-
-		// Noise
-		in_file >> noise_method;
-
-		// Sky
-		file_to_color(in_file, sky_color);
-		in_file >> sky_enabled;
-		in_file >> sky_frequency;
-		in_file >> sky_octaves;
-		in_file >> sky_opacity;
-		in_file >> sky_seed;
-
-		// Terrain
-
-		file_to_color(in_file, terrain_color_beach);
-		file_to_color(in_file, terrain_color_deep);
-		file_to_color(in_file, terrain_color_grass);
-		file_to_color(in_file, terrain_color_rock);
-		file_to_color(in_file, terrain_color_snow);
-		in_file >> terrain_elevation;
-		in_file >> terrain_frag_frequency;
-		in_file >> terrain_octaves;
-		in_file >> terrain_radius;
-		in_file >> terrain_seed;
-		in_file >> terrain_segments;
-		in_file >> terrain_vert_frequency;
-
-		// Ocean
-
-		file_to_color(in_file, ocean_color_1);
-		file_to_color(in_file, ocean_color_2);
-		in_file >> ocean_enabled;
-		in_file >> ocean_frequency;
-		in_file >> ocean_octaves;
-		in_file >> ocean_seed;
-
-		switch (noise_method)
-		{
-		case 0:
-			use_perlin = true;
-			use_simplex = use_worley = false;
-			break;
-		case 1:
-			use_simplex = true;
-			use_perlin = use_worley = false;
-			break;
-		case 2:
-			use_worley = true;
-			use_perlin = use_simplex = false;
-			break;
-
-		default:
-			std::cout << "Error reading file." << std::endl;
-			break;
+	int resolution = QUERY_RESOLUTION;
+	int count = 1 << 20;
+	PlanetParameters params;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--resolution" && i + 1 < argc)
+			resolution = atoi(argv[++i]);
+		else if (arg == "--count" && i + 1 < argc)
+			count = std::max(1, atoi(argv[++i]));
+		else if (!load_preset(arg, params)) {
+			std::cout << "Error reading preset " << arg << std::endl;
+			return 1;
 		}
+	}
 
-		in_file.close();
-		delete sky_sphere;
-		delete terrain_sphere;
-		delete ocean_sphere;
+	CubeHeightmap heightmap;
+	heightmap.bake(params, resolution, nullptr, &JobSystem::global());
+
+	auto start = std::chrono::high_resolution_clock::now();
+	PlanetQuery query;
+	query.build(params, std::move(heightmap));
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("pyramid %d: %.3f s\n", resolution, seconds);
+
+	// Rays start outside the planet and aim at random points near the surface
+	std::mt19937 random(1);
+	std::normal_distribution<float> normal;
+	std::vector<glm::vec3> directions(count);
+	std::vector<PlanetRay> rays(count);
+	for (int i = 0; i < count; ++i) {
+		directions[i] = glm::normalize(glm::vec3(normal(random), normal(random), normal(random)));
+		glm::vec3 target = 0.9f * glm::normalize(glm::vec3(normal(random), normal(random), normal(random)));
+		rays[i].origin = 3.0f * directions[i];
+		rays[i].direction = glm::normalize(target - rays[i].origin);
+	}
 
-		sky_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
-		terrain_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, terrain_segments);
-		ocean_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
+	std::vector<float> heights(count);
+	std::vector<glm::vec3> normals(count);
+	std::vector<PlanetRayHit> hits(count);
+	const char* const names[4] = { "heights", "normals", "exact heights", "raycasts" };
+	for (int test = 0; test < 4; ++test) {
+		// The noise is slow, a slice of the batch is enough
+		int measured = test == 2 ? std::max(1, count / 16) : count;
+
+		start = std::chrono::high_resolution_clock::now();
+		if (test == 0)
+			query.elevations(directions.data(), heights.data(), measured);
+		else if (test == 1)
+			query.normals(directions.data(), normals.data(), measured);
+		else if (test == 2)
+			query.elevations(directions.data(), heights.data(), measured, true);
+		else
+			query.raycast(rays.data(), hits.data(), measured);
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 
+		printf("%-14s %8d in %.3f s  %8.2f M/s  (%d threads)\n", names[test], measured, seconds,
+			measured / seconds / 1.0e6, JobSystem::global().getThreadCount());
 	}
-	catch (const std::exception&)
-	{
-		std::cout << "Error loading file." << std::endl;
+	return 0;
+}
+
+
+// Planet-Maker --octave-benchmark [--resolution N] [preset] times the heightmap bakes
+// of a slider drag: octaves up and down, elevation and radius, then a new frequency.
+int benchmark_octaves(int argc, char* argv[])
+{
+	int resolution = QUERY_RESOLUTION;
+	PlanetParameters params;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--resolution" && i + 1 < argc)
+			resolution = atoi(argv[++i]);
+		else if (!load_preset(arg, params)) {
+			std::cout << "Error reading preset " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	OctaveCache& octaves = OctaveCache::global();
+	octaves.clear();
+
+	const char* const names[6] = { "first bake", "one octave more", "one octave less", "elevation", "radius", "frequency" };
+	for (int step = 0; step < 6; ++step) {
+		if (step == 1)
+			params.terrain_octaves += 1;
+		else if (step == 2)
+			params.terrain_octaves -= 1;
+		else if (step == 3)
+			params.terrain_elevation *= 1.5f;
+		else if (step == 4)
+			params.terrain_radius += 0.1f;
+		else if (step == 5)
+			params.terrain_vert_frequency *= 1.1f;
+
+		int misses = octaves.getMisses();
+		auto start = std::chrono::high_resolution_clock::now();
+		CubeHeightmap heightmap;
+		heightmap.bake(params, resolution, nullptr, &JobSystem::global());
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		printf("%-16s %8.3f s  %2d layers evaluated  (%d threads)\n", names[step], seconds,
+			octaves.getMisses() - misses, JobSystem::global().getThreadCount());
 	}
+	printf("%d layers, %d MB cached\n", octaves.getLayerCount(), (int)(octaves.getSize() / (1024 * 1024)));
+	return 0;
 }
 
 
-void save_file(std::string file_name) {
+// Grid of every preset in the working directory, only the visible rows are submitted.
+void preset_browser(PresetLibrary& library, bool* open)
+{
+	static ImGuiTextFilter filter;
+	const float thumbnail_size = (float)PresetLibrary::THUMBNAIL_SIZE;
+	static const char* const METHOD_NAMES[3] = { "Perlin", "Simplex", "Cell" };
 
-	try
-	{
-		std::ofstream out_file(file_name + FILE_ENDING, std::ofstream::binary);
-
-		// Noise
-		out_file << noise_method << std::endl;
-
-		// Sky
-		color_to_file(out_file, sky_color);
-		out_file << sky_enabled << std::endl;
-		out_file << sky_frequency << std::endl;
-		out_file << sky_octaves << std::endl;
-		out_file << sky_opacity << std::endl;
-		out_file << sky_seed << std::endl;
-
-		// Terrain
-		color_to_file(out_file, terrain_color_beach);
-		color_to_file(out_file, terrain_color_deep);
-		color_to_file(out_file, terrain_color_grass);
-		color_to_file(out_file, terrain_color_rock);
-		color_to_file(out_file, terrain_color_snow);
-		out_file << terrain_elevation << std::endl;
-		out_file << terrain_frag_frequency << std::endl;
-		out_file << terrain_octaves << std::endl;
-		out_file << terrain_radius << std::endl;
-		out_file << terrain_seed << std::endl;
-		out_file << terrain_segments << std::endl;
-		out_file << terrain_vert_frequency << std::endl;
-
-		// Ocean
-		color_to_file(out_file, ocean_color_1);
-		color_to_file(out_file, ocean_color_2);
-		out_file << ocean_enabled << std::endl;
-		out_file << ocean_frequency << std::endl;
-		out_file << ocean_octaves << std::endl;
-		out_file << ocean_seed << std::endl;
-
-		out_file.close();
+	ImGui::SetNextWindowSize(ImVec2(560, 480), ImGuiSetCond_FirstUseEver);
+	if (!ImGui::Begin("Preset library", open)) {
+		ImGui::End();
+		return;
 	}
-	catch (const std::exception&)
-	{
-		std::cout << "Error saving" << std::endl;
+
+	const std::vector<PresetEntry>& entries = library.getEntries();
+	std::vector<int> shown;
+	int unreadable = 0;
+	for (int i = 0; i < (int)entries.size(); ++i) {
+		if (entries[i].parsed && !entries[i].valid)
+			++unreadable;
+		else if (filter.PassFilter(entries[i].name.c_str()))
+			shown.push_back(i);
+	}
+
+	filter.Draw("Filter", 200.0f);
+	ImGui::SameLine();
+	if (ImGui::Button("Rescan"))
+		library.rescan();
+	ImGui::Text("%d presets, %d thumbnails pending, %d unreadable", (int)entries.size() - unreadable, library.getPendingCount(), unreadable);
+	ImGui::Separator();
+
+	ImGui::BeginChild("grid");
+	ImGuiStyle& style = ImGui::GetStyle();
+	float cell_width = thumbnail_size + 2.0f * style.FramePadding.x + style.ItemSpacing.x;
+	int columns = std::max(1, (int)((ImGui::GetContentRegionAvailWidth() + style.ItemSpacing.x) / cell_width));
+	int rows = ((int)shown.size() + columns - 1) / columns;
+
+	ImGuiListClipper clipper(rows);
+	while (clipper.Step()) {
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+			for (int column = 0; column < columns; ++column) {
+				int slot = row * columns + column;
+				if (slot >= (int)shown.size())
+					break;
+
+				int index = shown[slot];
+				const PresetEntry& entry = entries[index];
+				library.requestThumbnail(index);
+
+				if (column > 0)
+					ImGui::SameLine();
+				ImGui::BeginGroup();
+				ImGui::PushID(index);
+
+				bool clicked = entry.texture != 0
+					? ImGui::ImageButton((ImTextureID)(intptr_t)entry.texture, ImVec2(thumbnail_size, thumbnail_size))
+					: ImGui::Button("...", ImVec2(thumbnail_size + 2.0f * style.FramePadding.x, thumbnail_size + 2.0f * style.FramePadding.y));
+				if (clicked)
+					load_path(library.getPath(index));
+
+				if (ImGui::IsItemHovered()) {
+					if (entry.parsed)
+						ImGui::SetTooltip("%s\n%s, seed %d, %d octaves\nradius %.2f, elevation %.3f\nocean %s, clouds %s",
+							entry.file_name.c_str(), METHOD_NAMES[std::min(std::max(entry.noise_method, 0), 2)],
+							entry.terrain_seed, entry.terrain_octaves, entry.terrain_radius, entry.terrain_elevation,
+							entry.ocean_enabled ? "on" : "off", entry.sky_enabled ? "on" : "off");
+					else
+						ImGui::SetTooltip("%s", entry.file_name.c_str());
+				}
+
+				// Names longer than the cell are cut, the tooltip has the full one
+				std::string label = entry.name;
+				while (label.size() > 1 && ImGui::CalcTextSize(label.c_str()).x > cell_width - style.ItemSpacing.x)
+					label.erase(label.size() - 1);
+				ImGui::TextUnformatted(label.c_str());
+
+				ImGui::PopID();
+				ImGui::EndGroup();
+			}
+		}
 	}
+
+	ImGui::EndChild();
+	ImGui::End();
 }
 
 
@@ -250,18 +455,189 @@ inline float degree_to_radians(float degree) {
 }
 
 
-int main() {
+// Grid of candidate planets around the current one, clicking a candidate takes over its seeds and jittered values.
+void seed_explorer(SeedExplorer& explorer, PlanetParameters& planet, bool* open)
+{
+	static int count = 64;
+	static int first_seed = 0;
+	static float jitter = 0.0f;
+	const float thumbnail_size = 96.0f;
+
+	ImGui::SetNextWindowSize(ImVec2(560, 520), ImGuiSetCond_FirstUseEver);
+	if (!ImGui::Begin("Seed explorer", open)) {
+		ImGui::End();
+		return;
+	}
+
+	bool regenerate = explorer.getCount() == 0;
+	// Either changes the candidates, the grid has to match the label below
+	if (ImGui::SliderInt("Candidates", &count, 64, explorer.getCapacity()))
+		regenerate = true;
+	if (ImGui::SliderFloat("Jitter", &jitter, 0.0f, 1.0f))
+		regenerate = true;
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Also vary the frequencies, elevation and cloud opacity, by up to 2^jitter either way.");
+	ImGui::SliderFloat("Budget (ms)", &explorer.budget_ms, 1.0f, 16.0f);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("GPU time per frame spent on the candidates.");
+
+	if (ImGui::Button("Previous")) {
+		first_seed = std::max(first_seed - count, 0);
+		regenerate = true;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Next")) {
+		first_seed += count;
+		regenerate = true;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Around current planet"))
+		regenerate = true;
+	ImGui::SameLine();
+	ImGui::Text("Seed offsets %d to %d", first_seed, first_seed + count - 1);
+
+	if (regenerate)
+		explorer.generate(planet, count, first_seed, jitter);
+
+	// GPU throughput of each level, the coarse ones give a first look at the whole grid
+	for (int level = 0; level < SeedExplorer::LEVEL_COUNT; ++level) {
+		float throughput = explorer.getThroughput(level);
+		if (throughput > 0.0f)
+			ImGui::Text("%3d px: %8.0f planets/s", explorer.getLevelSize(level), throughput);
+	}
+	ImGui::Text("%d planets %s %.2f s, %.0f planets/s", explorer.getCount(), explorer.isDone() ? "in" : "so far",
+		explorer.getElapsed(), explorer.isDone() ? explorer.getCount() / std::max(explorer.getElapsed(), 1e-6) : 0.0);
+	ImGui::Separator();
+
+	ImGui::BeginChild("grid");
+	ImGuiStyle& style = ImGui::GetStyle();
+	float cell_width = thumbnail_size + 2.0f * style.FramePadding.x + style.ItemSpacing.x;
+	int columns = std::max(1, (int)((ImGui::GetContentRegionAvailWidth() + style.ItemSpacing.x) / cell_width));
+	int rows = (explorer.getCount() + columns - 1) / columns;
+
+	ImGuiListClipper clipper(rows);
+	while (clipper.Step()) {
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+			for (int column = 0; column < columns; ++column) {
+				int index = row * columns + column;
+				if (index >= explorer.getCount())
+					break;
+
+				if (column > 0)
+					ImGui::SameLine();
+				ImGui::PushID(index);
+
+				// The atlas is bottom-up
+				bool clicked;
+				if (explorer.getLevel(index) >= 0) {
+					glm::vec2 min, max;
+					explorer.getRect(index, min, max);
+					clicked = ImGui::ImageButton((ImTextureID)(intptr_t)explorer.getTexture(), ImVec2(thumbnail_size, thumbnail_size),
+						ImVec2(min.x, max.y), ImVec2(max.x, min.y));
+				}
+				else {
+					clicked = ImGui::Button("...", ImVec2(thumbnail_size + 2.0f * style.FramePadding.x, thumbnail_size + 2.0f * style.FramePadding.y));
+				}
+
+				const PlanetParameters& candidate = explorer.getCandidate(index);
+				if (clicked)
+					explorer.adopt(index, planet);
+
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Seed offset %d\nterrain seed %d, ocean %d, clouds %d\nfrequency %.2f, elevation %.3f",
+						explorer.getSeedOffset(index), candidate.terrain_seed, candidate.ocean_seed, candidate.sky_seed,
+						candidate.terrain_vert_frequency, candidate.terrain_elevation);
+
+				ImGui::PopID();
+			}
+		}
+	}
+
+	ImGui::EndChild();
+	ImGui::End();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "--batch") {
+		BatchSettings settings;
+		if (!BatchRenderer::parseArguments(argc, argv, settings)) {
+			BatchRenderer::printUsage();
+			return 1;
+		}
+		BatchRenderer batch(settings);
+		return batch.run();
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--export") {
+		MapExportSettings settings;
+		if (!MapExporter::parseArguments(argc, argv, settings)) {
+			MapExporter::printUsage();
+			return 1;
+		}
+		MapExporter exporter(settings);
+		return exporter.run();
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--mesh") {
+		MeshExportSettings settings;
+		if (!MeshExporter::parseArguments(argc, argv, settings)) {
+			MeshExporter::printUsage();
+			return 1;
+		}
+		MeshExporter exporter(settings);
+		return exporter.run();
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--bake")
+		return bake_presets(argc, argv);
+
+	if (argc > 1 && std::string(argv[1]) == "--jobs-benchmark")
+		return benchmark_jobs(argc, argv);
+
+	if (argc > 1 && std::string(argv[1]) == "--erosion-benchmark")
+		return benchmark_erosion(argc, argv);
+
+	if (argc > 1 && std::string(argv[1]) == "--query-benchmark")
+		return benchmark_query(argc, argv);
+
+	if (argc > 1 && std::string(argv[1]) == "--octave-benchmark")
+		return benchmark_octaves(argc, argv);
+
+	// Planet-Maker --convert a.txt b.txt ... writes a.planet, b.planet, ...
+	if (argc > 1 && std::string(argv[1]) == "--convert") {
+		int failures = 0;
+		for (int i = 2; i < argc; ++i) {
+			std::string source = argv[i];
+			size_t dot = source.find_last_of('.');
+			std::string target = (dot == std::string::npos ? source : source.substr(0, dot)) + FILE_ENDING;
+
+			if (convert_preset(source, target))
+				std::cout << source << " -> " << target << std::endl;
+			else {
+				std::cout << "Error converting " << source << std::endl;
+				++failures;
+			}
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
 	glfwContext glfw;
 	GLFWwindow* current_window = nullptr;
 
 	glfw.init(1920, 1080, "Procedural Planet Maker");
 	glfw.getCurrentWindow(current_window);
+	// The thread creating the job system is the one pumping its GL tasks,
+	// tasks that become ready wake it from an idle wait
+	JobSystem::global().setMainThreadWakeup([]() { glfwPostEmptyEvent(); });
 	glfwSetInputMode(current_window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 	glfwSetCursorPos(current_window, 1920 / 2, 1080 / 2);
 
 	// Setup ImGui binding
 	ImGui_ImplGlfw_Init(current_window, true);
 
+	RedrawTracker redraw;
+	redraw.attach(current_window);
+
 	//start GLEW extension handler
 	glewExperimental = GL_TRUE;
 	GLenum l_GlewResult = glewInit();
@@ -279,10 +655,22 @@ int main() {
 	// GUI related variables
 	bool show_tooltips = true;
 	bool draw_wireframe = false;
+	bool depth_prepass = true;
+	bool octave_lod = true;
+	bool measure_passes = false;
+	bool show_overdraw = false;
+
+	// Scene related variables
+	Scene scene;
+	bool show_scene = false;
+	int scene_count = 16;
+	bool frustum_culling = true;
+	float impostor_pixels = 24.0f;
 
 	// Time related variables
-	float time;
 	float sky_speed = 1.0f;
+	int cloud_update_mode = 1; // index into cloud_update_rates
+	const int cloud_update_rates[3] = { 1, 4, 16 };
 	bool is_paused = false;
 	bool FPS_reset = false;
 
@@ -293,105 +681,78 @@ int main() {
 	float rotation_degrees[2] = { 0.0f,0.0f };
 	float rotation_radians[2] = { 0.0f,0.0f };
 
-	// __________ TERRAIN ______________
-	Shader terrain_shader;
-	terrain_shader.createShader("shaders/terrain_vert.glsl", "shaders/terrain_frag.glsl");
+	planet_renderer = new PlanetRenderer();
+	planet_renderer->init(planet.terrain_segments);
 
-	GLint loc_P_terrain = glGetUniformLocation(terrain_shader.programID, "P"); // perspective matrix
-	GLint loc_V_terrain = glGetUniformLocation(terrain_shader.programID, "V"); // modelview matrix
-	GLint loc_M_terrain = glGetUniformLocation(terrain_shader.programID, "M"); // modelview matrix
+	preset_loader = new PresetLoader();
+	preset_loader->init();
 
-	GLint loc_color_deep = glGetUniformLocation(terrain_shader.programID, "color_deep"); // water color of the planet
-	GLint loc_color_beach = glGetUniformLocation(terrain_shader.programID, "color_beach"); // ground color of the planet
-	GLint loc_color_grass = glGetUniformLocation(terrain_shader.programID, "color_grass"); // ground color of the planet
-	GLint loc_color_rock = glGetUniformLocation(terrain_shader.programID, "color_rock"); // mountain color of the planet
-	GLint loc_color_snow = glGetUniformLocation(terrain_shader.programID, "color_snow"); // mountain color of the planet
+	DynamicResolution* dynamic_resolution = new DynamicResolution();
+	dynamic_resolution->init();
 
-	GLint loc_terrain_method = glGetUniformLocation(terrain_shader.programID, "noise_method");
+	BakeCache bake_cache;
+	bake_cache.open(CACHE_DIRECTORY, CACHE_SIZE);
 
-	GLfloat loc_radius = glGetUniformLocation(terrain_shader.programID, "radius");
-	GLfloat loc_elevation = glGetUniformLocation(terrain_shader.programID, "elevationModifier");
-	GLint loc_seed = glGetUniformLocation(terrain_shader.programID, "seed");
-	GLint loc_octaves = glGetUniformLocation(terrain_shader.programID, "octaves");
-	GLfloat loc_vert_frequency = glGetUniformLocation(terrain_shader.programID, "vert_frequency");
-	GLfloat loc_frag_frequency = glGetUniformLocation(terrain_shader.programID, "frag_frequency");
+	// Presets live in the working directory, next to the executable's shaders
+	PresetLibrary* preset_library = new PresetLibrary();
+	preset_library->open(".", &bake_cache);
+	bool show_library = false;
 
-	// __________ SKY ______________
+	SeedExplorer* explorer = new SeedExplorer();
+	explorer->init();
+	bool show_explorer = false;
 
-	Shader sky_shader;
-	sky_shader.createShader("shaders/sky_vert.glsl", "shaders/sky_frag.glsl");
+	// Erosion related variables
+	BackgroundErosion erosion;
+	ErosionSettings erosion_settings;
+	bool erosion_enabled = false;
+	int erosion_resolution_mode = 1; // index into erosion_resolutions
+	const int erosion_resolutions[4] = { 256, 512, 1024, 2048 };
+	int erosion_iterations = 50;
+	float erosion_strength = 1.0f;
 
-	GLint loc_P_sky = glGetUniformLocation(sky_shader.programID, "P"); // perspective matrix
-	GLint loc_V_sky = glGetUniformLocation(sky_shader.programID, "V"); // view matrix
-	GLint loc_M_sky = glGetUniformLocation(sky_shader.programID, "M"); // model matrix
-
-	GLint loc_sky_radius = glGetUniformLocation(sky_shader.programID, "radius");
-	GLfloat loc_sky_elevation = glGetUniformLocation(sky_shader.programID, "elevationModifier");
-
-	GLint loc_sky_method = glGetUniformLocation(sky_shader.programID, "noise_method");
-
-	GLint loc_sky_time = glGetUniformLocation(sky_shader.programID, "time");
-	GLint loc_sky_speed = glGetUniformLocation(sky_shader.programID, "speed");
-	GLint loc_sky_frequency = glGetUniformLocation(sky_shader.programID, "frequency");
-	GLint loc_sky_octaves = glGetUniformLocation(sky_shader.programID, "octaves");
-	GLint loc_sky_seed = glGetUniformLocation(sky_shader.programID, "seed");
-	GLint loc_sky_color = glGetUniformLocation(sky_shader.programID, "sky_color");
-	GLint loc_sky_opacity = glGetUniformLocation(sky_shader.programID, "opacity");
-
-	// __________ OCEAN ______________
-
-	Shader ocean_shader;
-	ocean_shader.createShader("shaders/ocean_vert.glsl", "shaders/ocean_frag.glsl");
-
-	GLint loc_P_ocean = glGetUniformLocation(ocean_shader.programID, "P"); // perspective matrix
-	GLint loc_V_ocean = glGetUniformLocation(ocean_shader.programID, "V"); // modelview matrix
-	GLint loc_M_ocean = glGetUniformLocation(ocean_shader.programID, "M"); // modelview matrix
-
-	GLint loc_light_position = glGetUniformLocation(ocean_shader.programID, "light_pos");
-	GLint loc_light_intensity = glGetUniformLocation(ocean_shader.programID, "light_intensity");
-	GLint loc_shininess = glGetUniformLocation(ocean_shader.programID, "shininess");
-
-	GLint loc_ocean_method = glGetUniformLocation(ocean_shader.programID, "noise_method");
-
-	GLint loc_ocean_radius = glGetUniformLocation(ocean_shader.programID, "radius");
-	GLfloat loc_ocean_elevation = glGetUniformLocation(ocean_shader.programID, "elevationModifier");
-	GLint loc_ocean_frequency = glGetUniformLocation(ocean_shader.programID, "frequency");
-	GLint loc_ocean_octaves = glGetUniformLocation(ocean_shader.programID, "octaves");
-	GLint loc_ocean_seed = glGetUniformLocation(ocean_shader.programID, "seed");
-	GLint loc_ocean_color_1 = glGetUniformLocation(ocean_shader.programID, "color_1");
-	GLint loc_ocean_color_2 = glGetUniformLocation(ocean_shader.programID, "color_2");
-
-	// __________ STAR BACKGROUND ______________
-
-	Shader stars_shader;
-	stars_shader.createShader("shaders/star_vert.glsl", "shaders/star_frag.glsl");
-
-	skybox.push_back(new Plane(scale, glm::vec3(0, 0, scale / 2.f), 0.0f, glm::vec3(0.0f, 0.0f, 1.0f))); // back
-	skybox.push_back(new Plane(scale, glm::vec3(0, 0, -scale / 2.f), M_PI, glm::vec3(1.0f, 0.0f, 0.0f))); // front
-	skybox.push_back(new Plane(scale, glm::vec3(0, scale / 2.f, 0.0f), -M_PI / 2.f, glm::vec3(1.0f, 0.0f, 0.0f))); // top
-	skybox.push_back(new Plane(scale, glm::vec3(0, -scale / 2.f, 0.0f), M_PI / 2.f, glm::vec3(1.0f, 0.0f, 0.0f))); // bottom
-	skybox.push_back(new Plane(scale, glm::vec3(scale / 2.f, 0.0f, 0.0f), M_PI / 2.f, glm::vec3(0.0f, 1.0f, 0.0f))); // right
-	skybox.push_back(new Plane(scale, glm::vec3(-scale / 2.f, 0.0f, 0.0f), -M_PI / 2.f, glm::vec3(0.0f, 1.0f, 0.0f))); // left
-
-	GLint loc_P_stars = glGetUniformLocation(stars_shader.programID, "P"); // perspective matrix
-	GLint loc_V_stars = glGetUniformLocation(stars_shader.programID, "V"); // view matrix
-	GLint loc_M_stars = glGetUniformLocation(stars_shader.programID, "M"); // model matrix
-
-	// _____________________________________________________
-
-	terrain_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, terrain_segments);
-	sky_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
-	ocean_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, 32);
+	// Prop related variables
+	ScatterSettings scatter_settings;
+	bool props_enabled = false;
+	float prop_distance = 0.3f;
 
 	Camera camera;
 	camera.setPosition(&glm::vec3(0.f, 0.f, 3.0f));
 	camera.update();
 
+	// Keeps the free camera out of the terrain
+	BackgroundQuery ground_query;
+	bool ground_collision = true;
+	float camera_altitude = 0.0f;
+
 	// RENDER LOOP \__________________________________________/
 
 	while (!glfwWindowShouldClose(current_window))
 	{
-		glfwPollEvents();
+		// GL work queued by tasks, e.g. terrain meshes to upload. Also while
+		// idle, a finished task wakes the wait below and asks for a frame.
+		if (JobSystem::global().pumpMainThread() > 0)
+			redraw.requestRedraw();
+
+		// Moving clouds and the free camera need every frame, the rest only redraws on input
+		// Thumbnails and preset loads arrive without input, keep drawing until they are done
+		bool animating = (planet.sky_enabled && sky_speed > 0.0f) || glfwGetKey(current_window, GLFW_KEY_LEFT_CONTROL) ||
+			(show_library && preset_library->isBusy()) || (show_explorer && !explorer->isDone()) ||
+			preset_loader->isLoading() || erosion.isRunning() ||
+			planet_renderer->getProps().isBuilding();
+		if (!redraw.waitForFrame(animating))
+			continue;
+
+		if (preset_library->update())
+			redraw.requestRedraw();
+
+		PlanetParameters loaded;
+		Sphere* loaded_terrain = nullptr;
+		bool load_failed = false;
+		if (preset_loader->update(loaded, loaded_terrain, load_failed))
+			apply_preset(loaded, loaded_terrain);
+		else if (load_failed)
+			std::cout << "Error loading file." << std::endl;
 
 		ImGui_ImplGlfw_NewFrame();
 		{
@@ -399,52 +760,77 @@ int main() {
 
 			ImGui::Separator();
 			ImGui::Text("Use CTRL + W,A,S,D to move camera \nfreely.");
+			ImGui::Checkbox("Ground collision", &ground_collision);
+			if (show_tooltips && ImGui::IsItemHovered())
+				ImGui::SetTooltip("Stop the camera at the terrain and the sea.");
+			if (ground_collision && ground_query.get())
+				ImGui::Text("Altitude %.4f", camera_altitude);
 			ImGui::Separator();
 
 			ImGui::Text("Geometry");
 
-			if (ImGui::SliderInt("Segments", &terrain_segments, 1, 200)) {
-				delete terrain_sphere;
-				terrain_sphere = new Sphere(0.0f, 0.0f, 0.0f, 1.0f, terrain_segments);
-			}
+			ImGui::SliderInt("Segments", &planet.terrain_segments, 1, 200);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("The numbers of segment the mesh has.");
 
-			ImGui::SliderInt("Octaves", &terrain_octaves, 1, 10);
+			ImGui::SliderInt("Octaves", &planet.terrain_octaves, 1, 10);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("The numbers of sub-step iterations the procedural method has.");
 
-			ImGui::SliderInt("Seed", &terrain_seed, 0, 100);
+			ImGui::SliderInt("Seed", &planet.terrain_seed, 0, 100);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Change seed to vary the noise.");
+			ImGui::Checkbox("Seed explorer", &show_explorer);
+			if (show_tooltips && ImGui::IsItemHovered())
+				ImGui::SetTooltip("Show a grid of planets with other seeds to pick from.");
 
-			ImGui::SliderFloat("Vertex Frequency", &terrain_vert_frequency, 0.1f, 10.0f);
+			ImGui::SliderFloat("Vertex Frequency", &planet.terrain_vert_frequency, 0.1f, 10.0f);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Frequency of the noise.");
 
-			ImGui::SliderFloat("Radius", &terrain_radius, 0.0f, 1.0f);
+			ImGui::SliderFloat("Radius", &planet.terrain_radius, 0.0f, 1.0f);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Radius of the planet.");
 
-			ImGui::SliderFloat("Elevation", &terrain_elevation, 0.0f, 0.2f);
+			ImGui::SliderFloat("Elevation", &planet.terrain_elevation, 0.0f, 0.2f);
 			if (show_tooltips && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Maximum height of the mountains.");
 
+			if (ImGui::BeginMenu("Features")) {
+				ImGui::Checkbox("Enable features", &planet.features_enabled);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Stamp impact craters, volcanoes and rifts onto the terrain.");
+				ImGui::SliderInt("Craters", &planet.feature_craters, 0, 500000);
+				ImGui::SliderInt("Volcanoes", &planet.feature_volcanoes, 0, 1000);
+				ImGui::SliderInt("Rifts", &planet.feature_rifts, 0, 500);
+				ImGui::SliderInt("Feature seed", &planet.feature_seed, 0, 100);
+				ImGui::SliderFloat("Size", &planet.feature_size, 0.005f, 0.2f);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Radius of the largest stamps, in radians.");
+				ImGui::SliderFloat("Strength", &planet.feature_strength, 0.0f, 1.0f);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Height of the largest stamps, smaller ones scale with their size.");
+				if (!planet_renderer->supportsInstancing())
+					ImGui::Text("No storage buffers, only exports show them.");
+
+				ImGui::EndMenu();
+			}
+
 			ImGui::Separator();
 
 			if (ImGui::BeginMenu("Colors")) {
 
 				ImGui::Text("Colors");
-				ImGui::SliderFloat("Color Frequency", &terrain_frag_frequency, 0.1f, 10.0f);
+				ImGui::SliderFloat("Color Frequency", &planet.terrain_frag_frequency, 0.1f, 10.0f);
 				if (show_tooltips && ImGui::IsItemHovered())
 					ImGui::SetTooltip("Frequency of the noise.");
 
 				ImGui::Spacing();
-				ImGui::ColorEdit3("Deep color", terrain_color_deep);
-				ImGui::ColorEdit3("Beach color", terrain_color_beach);
-				ImGui::ColorEdit3("Grass color", terrain_color_grass);
-				ImGui::ColorEdit3("Mountain color", terrain_color_rock);
-				ImGui::ColorEdit3("Snow color", terrain_color_snow);
+				ImGui::ColorEdit3("Deep color", planet.terrain_color_deep);
+				ImGui::ColorEdit3("Beach color", planet.terrain_color_beach);
+				ImGui::ColorEdit3("Grass color", planet.terrain_color_grass);
+				ImGui::ColorEdit3("Mountain color", planet.terrain_color_rock);
+				ImGui::ColorEdit3("Snow color", planet.terrain_color_snow);
 
 				ImGui::EndMenu();
 			}
@@ -454,15 +840,18 @@ int main() {
 			if (ImGui::BeginMenu("Clouds")) {
 
 				ImGui::Text("Clouds");
-				ImGui::Checkbox("Enable clouds", &sky_enabled);
-				ImGui::ColorEdit3("Color", sky_color);
-				ImGui::SliderFloat("Opacity", &sky_opacity, 0.0f, 1.0f);
+				ImGui::Checkbox("Enable clouds", &planet.sky_enabled);
+				ImGui::ColorEdit3("Color", planet.sky_color);
+				ImGui::SliderFloat("Opacity", &planet.sky_opacity, 0.0f, 1.0f);
 				ImGui::Spacing();
 
-				ImGui::SliderInt("Octaves", &sky_octaves, 1, 6);
-				ImGui::SliderFloat("Frequency", &sky_frequency, 0.01f, 10.0f);
-				ImGui::SliderInt("Seed", &sky_seed, 0, 10000);
+				ImGui::SliderInt("Octaves", &planet.sky_octaves, 1, 6);
+				ImGui::SliderFloat("Frequency", &planet.sky_frequency, 0.01f, 10.0f);
+				ImGui::SliderInt("Seed", &planet.sky_seed, 0, 10000);
 				ImGui::SliderFloat("Speed", &sky_speed, 0.0f, 10.0f);
+				ImGui::Combo("Update", &cloud_update_mode, "Every pixel\0One in 4 pixels\0One in 16 pixels\0");
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Shade only part of the clouds each frame and reproject the rest.");
 
 				ImGui::EndMenu();
 			}
@@ -472,12 +861,55 @@ int main() {
 			if (ImGui::BeginMenu("Ocean")) {
 
 				ImGui::Text("Ocean");
-				ImGui::Checkbox("Enable ocean", &ocean_enabled);
-				ImGui::ColorEdit3("Color 1", ocean_color_1);
-				ImGui::ColorEdit3("Color 2", ocean_color_2);
-				ImGui::SliderInt("Octaves", &ocean_octaves, 1, 6);
-				ImGui::SliderFloat("Frequency", &ocean_frequency, 0.01f, 10.0f);
-				ImGui::SliderInt("Seed", &ocean_seed, 0, 10000);
+				ImGui::Checkbox("Enable ocean", &planet.ocean_enabled);
+				ImGui::ColorEdit3("Color 1", planet.ocean_color_1);
+				ImGui::ColorEdit3("Color 2", planet.ocean_color_2);
+				ImGui::SliderInt("Octaves", &planet.ocean_octaves, 1, 6);
+				ImGui::SliderFloat("Frequency", &planet.ocean_frequency, 0.01f, 10.0f);
+				ImGui::SliderInt("Seed", &planet.ocean_seed, 0, 10000);
+
+				ImGui::EndMenu();
+			}
+
+			ImGui::Separator();
+
+			if (ImGui::BeginMenu("Erosion")) {
+				ImGui::Checkbox("Enable erosion", &erosion_enabled);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Erode the terrain with rain and landslides in the background.");
+				ImGui::Combo("Resolution", &erosion_resolution_mode, "256\0" "512\0" "1024\0" "2048\0");
+				ImGui::SliderInt("Iterations", &erosion_iterations, 1, 500);
+				ImGui::SliderFloat("Strength", &erosion_strength, 0.0f, 4.0f);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Scale of the eroded height added to the terrain.");
+
+				if (erosion_enabled) {
+					ImGui::Text("%d / %d iterations, %.1f it/s", erosion.getIterations(),
+						erosion.getTargetIterations(), erosion.getIterationsPerSecond());
+				}
+
+				ImGui::EndMenu();
+			}
+
+			ImGui::Separator();
+
+			if (ImGui::BeginMenu("Props")) {
+				ImGui::Checkbox("Enable props", &props_enabled);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Scatter rocks, shrubs and trees over the land.");
+				ImGui::SliderFloat("Spacing", &scatter_settings.spacing, 0.0005f, 0.005f, "%.4f");
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Closest distance between two props, in planet radii.");
+				ImGui::SliderFloat("Draw distance", &prop_distance, 0.05f, 1.0f);
+
+				if (props_enabled) {
+					const ScatterStatistics& statistics = planet_renderer->getProps().getStatistics();
+					if (planet_renderer->getProps().isBuilding())
+						ImGui::Text("Placing...");
+					ImGui::Text("%d instances in %d chunks", (int)statistics.instances, statistics.chunks);
+					ImGui::Text("Drawn: %d instances, %d chunks, %d draws", (int)statistics.drawn,
+						statistics.visible_chunks, statistics.draws);
+				}
 
 				ImGui::EndMenu();
 			}
@@ -498,15 +930,15 @@ int main() {
 			if (ImGui::BeginMenu("Procedural method")) {
 				if (ImGui::Checkbox("Perlin Noise", &use_perlin)) {
 					use_simplex = use_worley = false;
-					noise_method = 0;
+					planet.noise_method = 0;
 				}
 				if (ImGui::Checkbox("Simplex Noise", &use_simplex)) {
 					use_perlin = use_worley = false;
-					noise_method = 1;
+					planet.noise_method = 1;
 				}
 				if (ImGui::Checkbox("Cell Noise", &use_worley)) {
 					use_simplex = use_perlin = false;
-					noise_method = 2;
+					planet.noise_method = 2;
 				}
 				ImGui::EndMenu();
 			}
@@ -523,15 +955,15 @@ int main() {
 			ImGui::Checkbox("Show tooltips", &show_tooltips);
 
 			if (ImGui::Button("Reset")) {
-				terrain_radius = 1.0f;
-				terrain_octaves = 6;
-				terrain_seed = 0;
+				planet.terrain_radius = 1.0f;
+				planet.terrain_octaves = 6;
+				planet.terrain_seed = 0;
 
-				terrain_color_deep[0] = terrain_color_deep[1] = terrain_color_deep[2] = 1.0f;
-				terrain_color_beach[0] = terrain_color_beach[1] = terrain_color_beach[2] = 1.0f;
-				terrain_color_grass[0] = terrain_color_grass[1] = terrain_color_grass[2] = 1.0f;
-				terrain_color_rock[0] = terrain_color_rock[1] = terrain_color_rock[2] = 1.0f;
-				terrain_color_snow[0] = terrain_color_snow[1] = terrain_color_snow[2] = 1.0f;
+				planet.terrain_color_deep[0] = planet.terrain_color_deep[1] = planet.terrain_color_deep[2] = 1.0f;
+				planet.terrain_color_beach[0] = planet.terrain_color_beach[1] = planet.terrain_color_beach[2] = 1.0f;
+				planet.terrain_color_grass[0] = planet.terrain_color_grass[1] = planet.terrain_color_grass[2] = 1.0f;
+				planet.terrain_color_rock[0] = planet.terrain_color_rock[1] = planet.terrain_color_rock[2] = 1.0f;
+				planet.terrain_color_snow[0] = planet.terrain_color_snow[1] = planet.terrain_color_snow[2] = 1.0f;
 
 				use_perlin = true;
 				rotation_degrees[0] = rotation_degrees[1] = 0.0f;
@@ -539,13 +971,84 @@ int main() {
 
 			ImGui::Checkbox("Draw wireframe", &draw_wireframe);
 
-			if (ImGui::Button("Reload shaders")) {
-				sky_shader.createShader("shaders/ocean_vert.glsl", "shaders/ocean_frag.glsl");
-				terrain_shader.createShader("shaders/vert.glsl", "shaders/frag.glsl");
-				sky_shader.createShader("shaders/sky_vert.glsl", "shaders/sky_frag.glsl");
-				stars_shader.createShader("shaders/star_vert.glsl", "shaders/star_frag.glsl");
+			ImGui::Checkbox("Render on demand", &redraw.on_demand);
+			if (show_tooltips && ImGui::IsItemHovered())
+				ImGui::SetTooltip("Only redraw on input or while clouds move, idle windows cost nothing.");
+			if (redraw.on_demand)
+				ImGui::Text("Frames drawn: %d, skipped: %d", redraw.getFramesDrawn(), redraw.getFramesSkipped());
+
+			if (ImGui::BeginMenu("Render passes")) {
+				ImGui::Checkbox("Depth pre-pass", &depth_prepass);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Lay down terrain depth first so every pixel is shaded once.");
+				ImGui::Checkbox("Octave LOD", &octave_lod);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Skip noise octaves finer than a pixel or the terrain's vertex spacing, far planets get cheaper and shimmer less.");
+				ImGui::Checkbox("Show overdraw", &show_overdraw);
+				ImGui::Checkbox("Pass counters", &measure_passes);
+
+				if (measure_passes) {
+					const PassScheduler& scheduler = planet_renderer->getScheduler();
+					const std::vector<PassStatistics>& stats = scheduler.getStatistics();
+
+					for (size_t i = 0; i < stats.size(); ++i)
+						ImGui::Text("%-14s %8.1f K fragments", stats[i].name.c_str(), stats[i].samples / 1000.0);
+
+					double pixels = (double)dynamic_resolution->getRenderWidth() * dynamic_resolution->getRenderHeight();
+					ImGui::Text("Fragments per pixel: %.2f", pixels > 0.0 ? scheduler.getTotalSamples() / pixels : 0.0);
+				}
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Scene")) {
+				ImGui::Checkbox("Show scene", &show_scene);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Draw many planets built from the current one instead of a single planet.");
+				ImGui::SliderInt("Planets", &scene_count, 1, 256);
+
+				if (ImGui::Button("Catalogue wall")) {
+					scene.layoutGrid(planet, scene_count, 2.5f);
+					show_scene = true;
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Solar system")) {
+					scene.layoutOrbits(planet, scene_count);
+					show_scene = true;
+				}
+
+				ImGui::Text("%d planets, %s", scene.size(),
+					planet_renderer->supportsInstancing() ? "one draw per layer" : "one draw per planet (no SSBO support)");
+
+				ImGui::Checkbox("Frustum culling", &frustum_culling);
+				ImGui::SliderFloat("Impostor size (px)", &impostor_pixels, 0.0f, 128.0f);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Planets with a smaller radius on screen are drawn from a cached image. 0 disables.");
+
+				const SceneStatistics& scene_stats = planet_renderer->getSceneStatistics();
+				ImGui::Text("Visible: %d, impostors: %d, baked: %d", scene_stats.visible, scene_stats.impostors, scene_stats.bakes);
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Dynamic resolution")) {
+				ImGui::Checkbox("Enabled", &dynamic_resolution->enabled);
+				if (show_tooltips && ImGui::IsItemHovered())
+					ImGui::SetTooltip("Render the planet at a lower resolution when the GPU is over budget.");
+				ImGui::SliderFloat("Budget (ms)", &dynamic_resolution->budget_ms, 2.0f, 50.0f);
+				ImGui::SliderFloat("Min scale", &dynamic_resolution->min_scale, 0.25f, 1.0f);
+				ImGui::SliderFloat("Sharpness", &dynamic_resolution->sharpness, 0.0f, 1.0f);
+
+				ImGui::Text("GPU time: %.2f ms", dynamic_resolution->getGpuTime());
+				ImGui::Text("Scale: %.0f%% (%d x %d)", dynamic_resolution->getScale() * 100.0f,
+					dynamic_resolution->getRenderWidth(), dynamic_resolution->getRenderHeight());
+
+				ImGui::EndMenu();
 			}
 
+			if (ImGui::Button("Reload shaders"))
+				planet_renderer->reloadShaders();
+
 			if (ImGui::BeginMenu("Load/Save")) {
 
 				ImGui::InputText("<-", load_buffer, sizeof(load_buffer));
@@ -563,10 +1066,9 @@ int main() {
 					std::cout << "save ";
 					save_file(std::string(save_buffer));
 				}
-				ImGui::InputTextMultiline("  ", files_buffer, sizeof(files_buffer));
-				if (ImGui::Button("List all files")) {
-					list_files();
-				}
+				ImGui::Checkbox("Preset library", &show_library);
+				if (preset_loader->isLoading())
+					ImGui::ProgressBar(preset_loader->getProgress(), ImVec2(-1.0f, 0.0f), "Loading");
 
 				ImGui::EndMenu();
 			}
@@ -574,12 +1076,50 @@ int main() {
 
 		ImGui::End();
 
+		if (show_library)
+			preset_browser(*preset_library, &show_library);
+		if (show_explorer)
+			seed_explorer(*explorer, planet, &show_explorer);
+
+		// Everything below reads this frame's snapshot, tasks started from here capture it
+		planet_snapshots.publish(planet);
+		SnapshotRef snapshot = planet_snapshots.acquire();
+
+		// Restarts by itself when the heightmap of the snapshot changes
+		if (erosion_enabled)
+			erosion.start(snapshot->params, erosion_resolutions[erosion_resolution_mode], erosion_iterations, erosion_settings, &bake_cache);
+		else
+			erosion.stop();
+		if (erosion.update(glfwGetTime()))
+			redraw.requestRedraw();
+
+		// Placed again by itself when the terrain of the snapshot changes
+		if (props_enabled)
+			planet_renderer->getProps().start(snapshot->params, scatter_settings, &bake_cache);
+		else
+			planet_renderer->getProps().stop();
+
+		// Rebuilt by itself when the terrain of the snapshot changes
+		if (ground_collision)
+			ground_query.start(snapshot->params, QUERY_RESOLUTION, &bake_cache);
+		if (ground_query.update())
+			redraw.requestRedraw();
+
 		delta_time = glfwGetTime() - last_time;
 		last_time = glfwGetTime();
+		// Frames are skipped while idle, do not let the camera jump afterwards
+		delta_time = std::min(delta_time, 0.1);
 
 		//glfw input handler
 		input_handler(current_window, delta_time);
 
+		glm::mat4 planet_model;
+		planet_model = glm::rotate(planet_model, rotation_radians[0], glm::vec3(0.0f, 1.0f, 0.0f));
+		planet_model = glm::rotate(planet_model, rotation_radians[1], glm::vec3(1.0f, 0.0f, 0.0f));
+
+		glm::vec3 previous_position;
+		camera.getPosition(previous_position);
+
 		if (glfwGetKey(current_window, GLFW_KEY_LEFT_CONTROL))
 		{
 			if (!FPS_reset)
@@ -595,122 +1135,55 @@ int main() {
 			FPS_reset = false;
 		}
 
-		// __________ RENDERING SETTINGS _______
-
-		GL_calls();
-
-		if (draw_wireframe)
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-		// STARS SHADER
-		glUseProgram(stars_shader.programID);
-		glUniformMatrix4fv(loc_P_stars, 1, GL_FALSE, camera.getPerspective());
-		glUniformMatrix4fv(loc_V_stars, 1, GL_FALSE, camera.getTransformF());
-
-		for (int i = 0; i < skybox.size(); ++i) {
-			glm::mat4 model;
-			model = glm::translate(model, skybox[i]->m_position);
-			model = glm::rotate(model, skybox[i]->m_angle, skybox[i]->m_rotation);
-
-			glUniformMatrix4fv(loc_M_stars, 1, GL_FALSE, glm::value_ptr(model));
-			skybox[i]->render();
+		// Also every frame the camera stands still, the planet may have turned or grown under it
+		std::shared_ptr<const PlanetQuery> query = ground_query.get();
+		if (ground_collision && query && !show_scene)
+			camera_altitude = camera.collideWithGround(*query, planet_model, previous_position, GROUND_CLEARANCE);
+
+		// __________ RENDERING _______
+
+		RenderState render_state;
+		render_state.projection = glm::make_mat4(camera.getPerspective());
+		render_state.view = *camera.getTransformM();
+		render_state.model = planet_model;
+		std::copy(light_position, light_position + 3, render_state.light_position);
+		render_state.light_intensity = light_intensity;
+		render_state.shininess = shininess;
+		render_state.time = (float)glfwGetTime();
+		render_state.sky_speed = sky_speed;
+		render_state.cloud_update_rate = cloud_update_rates[cloud_update_mode];
+		render_state.frustum_culling = frustum_culling;
+		render_state.impostor_pixels = impostor_pixels;
+		render_state.draw_wireframe = draw_wireframe;
+		render_state.depth_prepass = depth_prepass;
+		render_state.octave_lod = octave_lod;
+		render_state.measure_passes = measure_passes;
+		render_state.show_overdraw = show_overdraw;
+		if (!show_scene) {
+			render_state.erosion_map = erosion.getTexture();
+			render_state.erosion_resolution = erosion_resolutions[erosion_resolution_mode];
+			render_state.erosion_strength = erosion_strength;
+			render_state.draw_props = props_enabled;
+			render_state.prop_distance = prop_distance;
 		}
 
-		// _________ PLANET __________
-		glUseProgram(terrain_shader.programID);
-
-		glUniformMatrix4fv(loc_P_terrain, 1, GL_FALSE, camera.getPerspective());
-		glUniformMatrix4fv(loc_V_terrain, 1, GL_FALSE, camera.getTransformF());
-
-		glm::mat4 model;
-		model = glm::rotate(model, rotation_radians[0], glm::vec3(0.0f, 1.0f, 0.0f));
-		model = glm::rotate(model, rotation_radians[1], glm::vec3(1.0f, 0.0f, 0.0f));
-		model = glm::translate(model, *sky_sphere->getPosition());
-		glUniformMatrix4fv(loc_M_terrain, 1, GL_FALSE, glm::value_ptr(model));
-
-		glUniform1i(loc_terrain_method, noise_method);
-
-		glUniform1f(loc_radius, terrain_radius);
-		glUniform1f(loc_elevation, terrain_elevation);
-		glUniform1i(loc_seed, terrain_seed);
-		glUniform1i(loc_octaves, terrain_octaves);
-		glUniform1f(loc_vert_frequency, terrain_vert_frequency);
-		glUniform1f(loc_frag_frequency, terrain_frag_frequency);
-
-		glUniform3fv(loc_color_deep, 1, &terrain_color_deep[0]);
-		glUniform3fv(loc_color_beach, 1, &terrain_color_beach[0]);
-		glUniform3fv(loc_color_grass, 1, &terrain_color_grass[0]);
-		glUniform3fv(loc_color_rock, 1, &terrain_color_rock[0]);
-		glUniform3fv(loc_color_snow, 1, &terrain_color_snow[0]);
-
-		terrain_sphere->render();
-
-		// OCEAN SHADER
-		if (ocean_enabled) {
-			glUseProgram(ocean_shader.programID);
-
-			glUniformMatrix4fv(loc_P_ocean, 1, GL_FALSE, camera.getPerspective());
-			glUniformMatrix4fv(loc_V_ocean, 1, GL_FALSE, camera.getTransformF());
-
-			glm::mat4 model;
-			model = glm::rotate(model, rotation_radians[0], glm::vec3(0.0f, 1.0f, 0.0f));
-			model = glm::rotate(model, rotation_radians[1], glm::vec3(1.0f, 0.0f, 0.0f));
-			model = glm::translate(model, *ocean_sphere->getPosition());
-			glUniformMatrix4fv(loc_M_ocean, 1, GL_FALSE, glm::value_ptr(model));
-
-			glUniform1i(loc_ocean_method, noise_method);
-
-			glUniform3fv(loc_light_position, 1, &light_position[0]);
-			glUniform1f(loc_light_intensity, light_intensity);
-			glUniform1f(loc_shininess, shininess);
-
-			glUniform1f(loc_ocean_radius, terrain_radius);
-			glUniform1f(loc_ocean_elevation, terrain_elevation);
-			glUniform1i(loc_ocean_seed, ocean_seed);
-			glUniform1f(loc_ocean_frequency, ocean_frequency);
-			glUniform1i(loc_ocean_octaves, ocean_octaves);
-			glUniform3fv(loc_ocean_color_1, 1, &ocean_color_1[0]);
-			glUniform3fv(loc_ocean_color_2, 1, &ocean_color_2[0]);
-
-			ocean_sphere->render();
-		}
+		int display_w, display_h;
+		glfwGetFramebufferSize(current_window, &display_w, &display_h);
 
-		// SKY SHADER
-		if (sky_enabled) {
-			glUseProgram(sky_shader.programID);
-
-			glUniformMatrix4fv(loc_P_sky, 1, GL_FALSE, camera.getPerspective());
-			glUniformMatrix4fv(loc_V_sky, 1, GL_FALSE, camera.getTransformF());
-
-			glm::mat4 model;
-			model = glm::rotate(model, rotation_radians[0], glm::vec3(0.0f, 1.0f, 0.0f));
-			model = glm::rotate(model, rotation_radians[1], glm::vec3(1.0f, 0.0f, 0.0f));
-			model = glm::translate(model, *sky_sphere->getPosition());
-			glUniformMatrix4fv(loc_M_sky, 1, GL_FALSE, glm::value_ptr(model));
-
-			glUniform1i(loc_sky_method, noise_method);
-
-			// update time
-			time = (float)glfwGetTime();
-			glUniform1f(loc_sky_time, time);
-			glUniform1f(loc_sky_speed, sky_speed);
-			glUniform1f(loc_sky_radius, terrain_radius);
-			glUniform1f(loc_sky_elevation, terrain_elevation);
-			glUniform1i(loc_sky_seed, sky_seed);
-			glUniform1f(loc_sky_frequency, sky_frequency);
-			glUniform1i(loc_sky_octaves, sky_octaves);
-			glUniform3fv(loc_sky_color, 1, &sky_color[0]);
-			glUniform1f(loc_sky_opacity, sky_opacity);
-
-			sky_sphere->render();
-		}
+		dynamic_resolution->begin(display_w, display_h);
+		planet_renderer->applySnapshot(snapshot);
+		planet_renderer->beginFrame();
+		if (show_scene && !scene.empty())
+			planet_renderer->renderScene(scene, render_state);
+		else
+			planet_renderer->render(snapshot->params, render_state);
+		dynamic_resolution->end();
 
-		glUseProgram(0);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		// Outside the dynamic resolution timer, the explorer has its own
+		if (show_explorer)
+			explorer->update(*planet_renderer, render_state);
 
-		// Rendering imgui
-		int display_w, display_h;
-		glfwGetFramebufferSize(current_window, &display_w, &display_h);
+		// Rendering imgui, always at window resolution
 		glViewport(0, 0, display_w, display_h);
 		ImGui::Render();
 
@@ -718,18 +1191,13 @@ int main() {
 	}
 
 	ImGui_ImplGlfw_Shutdown();
-	delete ocean_sphere;
-	delete terrain_sphere;
-	delete sky_sphere;
+	delete explorer;
+	delete preset_library;
+	delete preset_loader;
+	delete dynamic_resolution;
+	delete planet_renderer;
 
 	delete background_pos;
-	// delete the skybox
-	for (std::vector<Plane*>::iterator it = skybox.begin(); it != skybox.end(); ++it)
-	{
-		delete (*it);
-	}
-
-	skybox.clear();
 
 	return 0;
 }
@@ -742,19 +1210,3 @@ void input_handler(GLFWwindow* _window, double _dT)
 	}
 }
 
-
-void GL_calls()
-{
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
-	//glEnable(GL_CULL_FACE);
-	//glCullFace(GL_BACK);
-	glDisable(GL_TEXTURE);
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glEnable(GL_ALPHA_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
-